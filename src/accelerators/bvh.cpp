@@ -38,6 +38,16 @@
 #include "stats.h"
 #include "parallel.h"
 #include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#ifdef PBRT_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
 
 namespace pbrt {
 
@@ -45,6 +55,20 @@ STAT_MEMORY_COUNTER("Memory/BVH tree", treeBytes);
 STAT_RATIO("BVH/Primitives per leaf node", totalPrimitives, totalLeafNodes);
 STAT_COUNTER("BVH/Interior nodes", interiorNodes);
 STAT_COUNTER("BVH/Leaf nodes", leafNodes);
+STAT_COUNTER("BVH/Subtrees built in parallel", parallelSubtrees);
+STAT_PERCENT("BVH/Trees read from cache", bvhCacheHits, bvhCacheLookups);
+STAT_COUNTER("BVH/Spatial splits", spatialSplits);
+STAT_RATIO("BVH/SBVH references per primitive", sbvhReferences,
+           sbvhPrimitives);
+STAT_RATIO("BVH/Nodes visited per closest-hit ray", nodesVisited,
+           closestHitRays);
+
+// BVH construction uses the thread pool for at least this many primitives,
+// binning ranges of _ParallelBinningThreshold_ or more in chunks of
+// _BinningChunkSize_
+static PBRT_CONSTEXPR int ParallelBuildThreshold = 16 * 1024;
+static PBRT_CONSTEXPR int ParallelBinningThreshold = 64 * 1024;
+static PBRT_CONSTEXPR int BinningChunkSize = 16 * 1024;
 
 // BVHAccel Local Declarations
 struct BVHPrimitiveInfo {
@@ -82,6 +106,13 @@ struct BVHBuildNode {
     int splitAxis, firstPrimOffset, nPrimitives;
 };
 
+// A subtree that _recursiveBuild()_ left to be built independently into
+// _node_
+struct BVHBuildTask {
+    BVHBuildNode *node;
+    int start, end;
+};
+
 struct MortonPrimitive {
     int primitiveIndex;
     uint32_t mortonCode;
@@ -92,17 +123,6 @@ struct LBVHTreelet {
     BVHBuildNode *buildNodes;
 };
 
-struct LinearBVHNode {
-    Bounds3f bounds;
-    union {
-        int primitivesOffset;   // leaf
-        int secondChildOffset;  // interior
-    };
-    uint16_t nPrimitives;  // 0 -> interior node
-    uint8_t axis;          // interior node: xyz
-    uint8_t pad[1];        // ensure 32 byte total size
-};
-
 // BVHAccel Utility Functions
 inline uint32_t LeftShift3(uint32_t x) {
     CHECK_LE(x, (1 << 10));
@@ -179,11 +199,191 @@ static void RadixSort(std::vector<MortonPrimitive> *v) {
     if (nPasses & 1) std::swap(*v, tempVector);
 }
 
+// BVH Cache Definitions
+// A cached BVH is a _BVHCacheHeader_, the index of the primitive stored at
+// each position of the reordered primitive array, and, starting at the next
+// multiple of _BVHCacheAlignment_ bytes, the flattened nodes. SBVHs
+// reference some primitives more than once, so _nPrimitives_ is the size of
+// the reordered array.
+struct BVHCacheHeader {
+    char magic[8];
+    int32_t version;
+    int32_t nodeSize;
+    uint64_t hash;
+    int32_t nPrimitives;
+    int32_t nNodes;
+};
+
+static const char BVHCacheMagic[8] = {'p', 'b', 'r', 't', 'b', 'v', 'h', 0};
+static constexpr int BVHCacheVersion = 1;
+static constexpr size_t BVHCacheAlignment = 64;
+
+static size_t BVHCacheNodesOffset(int nPrimitives) {
+    size_t offset = sizeof(BVHCacheHeader) + nPrimitives * sizeof(int32_t);
+    return (offset + BVHCacheAlignment - 1) & ~(BVHCacheAlignment - 1);
+}
+
+// MurmurHash64A, by Austin Appleby; _len_ must be a multiple of 8
+static uint64_t MurmurHash64A(const unsigned char *key, size_t len,
+                              uint64_t seed) {
+    const uint64_t m = 0xc6a4a7935bd1e995ull;
+    const int r = 47;
+    uint64_t h = seed ^ (len * m);
+    for (size_t i = 0; i < len; i += 8) {
+        uint64_t k;
+        memcpy(&k, key + i, sizeof(uint64_t));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+// The tree built for a set of primitives only depends on their bounds, in
+// order, and on the build parameters, so those are all that is hashed.
+static uint64_t HashBVHInputs(const std::vector<BVHPrimitiveInfo> &primitiveInfo,
+                              int maxPrimsInNode, int splitMethod,
+                              Float maxDuplication) {
+    std::vector<Float> bounds(6 * primitiveInfo.size());
+    for (size_t i = 0; i < primitiveInfo.size(); ++i) {
+        const Bounds3f &b = primitiveInfo[i].bounds;
+        for (int c = 0; c < 3; ++c) {
+            bounds[6 * i + c] = b.pMin[c];
+            bounds[6 * i + 3 + c] = b.pMax[c];
+        }
+    }
+    uint64_t params[5] = {(uint64_t)BVHCacheVersion, sizeof(Float),
+                          (uint64_t)splitMethod, (uint64_t)maxPrimsInNode,
+                          (uint64_t)FloatToBits(maxDuplication)};
+    uint64_t seed = MurmurHash64A((const unsigned char *)params,
+                                  sizeof(params), 0);
+    return MurmurHash64A((const unsigned char *)bounds.data(),
+                         bounds.size() * sizeof(Float), seed);
+}
+
+bool BVHAccel::readCache(const std::string &filename, uint64_t hash) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    BVHCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+              memcmp(header.magic, BVHCacheMagic, sizeof(BVHCacheMagic)) ==
+                  0 &&
+              header.version == BVHCacheVersion &&
+              header.nodeSize == sizeof(LinearBVHNode) &&
+              header.hash == hash &&
+              header.nPrimitives >= (int32_t)primitives.size() &&
+              header.nNodes > 0;
+    std::vector<int32_t> order;
+    if (ok) {
+        order.resize(header.nPrimitives);
+        ok = fread(order.data(), sizeof(int32_t), order.size(), f) ==
+             order.size();
+    }
+    size_t nodesOffset = BVHCacheNodesOffset(header.nPrimitives);
+    size_t length = nodesOffset + header.nNodes * sizeof(LinearBVHNode);
+    if (ok) {
+        // Make sure the file is complete and its order is in range
+        ok = fseek(f, 0, SEEK_END) == 0 && ftell(f) == (long)length;
+        for (size_t i = 0; ok && i < order.size(); ++i)
+            ok = order[i] >= 0 && order[i] < (int32_t)primitives.size();
+    }
+    if (!ok) {
+        fclose(f);
+        Warning("%s: ignoring invalid or stale BVH cache file",
+                filename.c_str());
+        return false;
+    }
+
+    // Reorder _primitives_ as they were when the BVH was built
+    std::vector<std::shared_ptr<Primitive>> orderedPrims(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        orderedPrims[i] = primitives[order[i]];
+
+    // Map the nodes from the file, or read them if that isn't possible
+#ifdef PBRT_HAVE_MMAP
+    void *ptr = mmap(0, length, PROT_READ, MAP_FILE | MAP_SHARED,
+                     fileno(f), 0);
+    if (ptr != MAP_FAILED) {
+        mappedFile = ptr;
+        mappedLength = length;
+        nodes = (LinearBVHNode *)((char *)ptr + nodesOffset);
+    } else
+        Warning("%s: mmap: %s", filename.c_str(), strerror(errno));
+#endif
+    if (!nodes) {
+        nodes = AllocAligned<LinearBVHNode>(header.nNodes);
+        if (fseek(f, nodesOffset, SEEK_SET) != 0 ||
+            fread(nodes, sizeof(LinearBVHNode), header.nNodes, f) !=
+                (size_t)header.nNodes) {
+            FreeAligned(nodes);
+            nodes = nullptr;
+        }
+    }
+    fclose(f);
+    if (!nodes) {
+        Warning("%s: unable to read BVH cache file", filename.c_str());
+        return false;
+    }
+    primitives.swap(orderedPrims);
+    treeBytes += header.nNodes * sizeof(LinearBVHNode) + sizeof(*this) +
+                 primitives.size() * sizeof(primitives[0]);
+    LOG(INFO) << StringPrintf("BVH with %d nodes for %d primitives read from "
+                              "%s", header.nNodes, (int)primitives.size(),
+                              filename.c_str());
+    return true;
+}
+
+void BVHAccel::writeCache(const std::string &filename, uint64_t hash,
+                          const std::vector<BVHPrimitiveInfo> &primitiveInfo,
+                          int totalNodes) const {
+    BVHCacheHeader header;
+    memcpy(header.magic, BVHCacheMagic, sizeof(BVHCacheMagic));
+    header.version = BVHCacheVersion;
+    header.nodeSize = sizeof(LinearBVHNode);
+    header.hash = hash;
+    header.nPrimitives = primitiveInfo.size();
+    header.nNodes = totalNodes;
+    std::vector<int32_t> order(primitiveInfo.size());
+    for (size_t i = 0; i < primitiveInfo.size(); ++i)
+        order[i] = primitiveInfo[i].primitiveNumber;
+    size_t padding = BVHCacheNodesOffset(header.nPrimitives) -
+                     sizeof(header) - order.size() * sizeof(int32_t);
+    char zeros[BVHCacheAlignment] = {0};
+
+    // Write to a temporary file and rename it so that other processes
+    // never see a partially-written cache file
+    std::string tmpFilename = filename + ".tmp";
+    FILE *f = fopen(tmpFilename.c_str(), "wb");
+    if (!f) {
+        Warning("%s: %s", tmpFilename.c_str(), strerror(errno));
+        return;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(order.data(), sizeof(int32_t), order.size(), f) ==
+                  order.size() &&
+              fwrite(zeros, 1, padding, f) == padding &&
+              fwrite(nodes, sizeof(LinearBVHNode), totalNodes, f) ==
+                  (size_t)totalNodes;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+        Warning("%s: unable to write BVH cache file: %s", filename.c_str(),
+                strerror(errno));
+        remove(tmpFilename.c_str());
+    }
+}
+
 // BVHAccel Method Definitions
 BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
-                   int maxPrimsInNode, SplitMethod splitMethod)
+                   int maxPrimsInNode, SplitMethod splitMethod,
+                   Float maxDuplication)
     : maxPrimsInNode(std::min(255, maxPrimsInNode)),
       splitMethod(splitMethod),
+      maxDuplication(std::max((Float)1, maxDuplication)),
       primitives(std::move(p)) {
     ProfilePhase _(Prof::AccelConstruction);
     if (primitives.empty()) return;
@@ -194,26 +394,76 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
     for (size_t i = 0; i < primitives.size(); ++i)
         primitiveInfo[i] = {i, primitives[i]->WorldBound()};
 
+    // Look for a cached BVH for these primitives. HLBVH doesn't leave the
+    // primitive order in _primitiveInfo_, and is fast to build anyway.
+    std::string cacheFilename;
+    uint64_t hash = 0;
+    if (!PbrtOptions.bvhCacheDir.empty() &&
+        splitMethod != SplitMethod::HLBVH) {
+        hash = HashBVHInputs(
+            primitiveInfo, this->maxPrimsInNode, (int)splitMethod,
+            splitMethod == SplitMethod::SBVH ? this->maxDuplication : 1);
+        cacheFilename = StringPrintf("%s/%016llx.bvh",
+                                     PbrtOptions.bvhCacheDir.c_str(),
+                                     (unsigned long long)hash);
+        ++bvhCacheLookups;
+        if (readCache(cacheFilename, hash)) {
+            ++bvhCacheHits;
+            return;
+        }
+    }
+
     // Build BVH tree for primitives using _primitiveInfo_
     MemoryArena arena(1024 * 1024);
     int totalNodes = 0;
-    std::vector<std::shared_ptr<Primitive>> orderedPrims;
-    orderedPrims.reserve(primitives.size());
+    std::vector<std::shared_ptr<Primitive>> orderedPrims(primitives.size());
     BVHBuildNode *root;
+    std::vector<std::unique_ptr<MemoryArena>> threadArenas;
     if (splitMethod == SplitMethod::HLBVH)
         root = HLBVHBuild(arena, primitiveInfo, &totalNodes, orderedPrims);
-    else
+    else if (splitMethod == SplitMethod::SBVH)
+        root = SBVHBuild(arena, primitiveInfo, &totalNodes, orderedPrims);
+    else if (MaxThreadIndex() > 1 &&
+             primitives.size() >= ParallelBuildThreshold) {
+        // Build the top of the tree, binning large nodes in parallel, and
+        // collect the subtrees below it
+        std::vector<BVHBuildTask> subtrees;
+        int maxSubtreePrims = std::max<int>(
+            1024, primitives.size() / (8 * MaxThreadIndex()));
+        root = recursiveBuild(arena, primitiveInfo, 0, primitives.size(),
+                              &totalNodes, orderedPrims, &subtrees,
+                              maxSubtreePrims);
+
+        // Build the subtrees in parallel, largest first, allocating their
+        // nodes from per-thread arenas
+        std::sort(subtrees.begin(), subtrees.end(),
+                  [](const BVHBuildTask &a, const BVHBuildTask &b) {
+                      return a.end - a.start > b.end - b.start;
+                  });
+        for (int i = 0; i < MaxThreadIndex(); ++i)
+            threadArenas.push_back(
+                std::unique_ptr<MemoryArena>(new MemoryArena(1024 * 1024)));
+        std::vector<int> subtreeNodes(subtrees.size(), 0);
+        ParallelFor([&](int i) {
+            const BVHBuildTask &task = subtrees[i];
+            *task.node = *recursiveBuild(*threadArenas[ThreadIndex],
+                                         primitiveInfo, task.start, task.end,
+                                         &subtreeNodes[i], orderedPrims);
+        }, subtrees.size());
+        for (int n : subtreeNodes) totalNodes += n;
+        parallelSubtrees += subtrees.size();
+    } else
         root = recursiveBuild(arena, primitiveInfo, 0, primitives.size(),
                               &totalNodes, orderedPrims);
     primitives.swap(orderedPrims);
-    primitiveInfo.resize(0);
+    size_t arenaBytes = arena.TotalAllocated();
+    for (const auto &a : threadArenas) arenaBytes += a->TotalAllocated();
     LOG(INFO) << StringPrintf("BVH created with %d nodes for %d "
                               "primitives (%.2f MB), arena allocated %.2f MB",
                               totalNodes, (int)primitives.size(),
                               float(totalNodes * sizeof(LinearBVHNode)) /
                               (1024.f * 1024.f),
-                              float(arena.TotalAllocated()) /
-                              (1024.f * 1024.f));
+                              float(arenaBytes) / (1024.f * 1024.f));
 
     // Compute representation of depth-first traversal of BVH tree
     treeBytes += totalNodes * sizeof(LinearBVHNode) + sizeof(*this) +
@@ -222,6 +472,8 @@ BVHAccel::BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
     int offset = 0;
     flattenBVHTree(root, &offset);
     CHECK_EQ(totalNodes, offset);
+    if (!cacheFilename.empty())
+        writeCache(cacheFilename, hash, primitiveInfo, totalNodes);
 }
 
 Bounds3f BVHAccel::WorldBound() const {
@@ -236,39 +488,71 @@ struct BucketInfo {
 BVHBuildNode *BVHAccel::recursiveBuild(
     MemoryArena &arena, std::vector<BVHPrimitiveInfo> &primitiveInfo, int start,
     int end, int *totalNodes,
-    std::vector<std::shared_ptr<Primitive>> &orderedPrims) {
+    std::vector<std::shared_ptr<Primitive>> &orderedPrims,
+    std::vector<BVHBuildTask> *subtrees, int maxSubtreePrims) {
     CHECK_NE(start, end);
+    if (subtrees && end - start <= maxSubtreePrims) {
+        // Leave this subtree to be built later as an independent task; its
+        // parent needs its bounds now
+        BVHBuildNode *node = arena.Alloc<BVHBuildNode>();
+        for (int i = start; i < end; ++i)
+            node->bounds = Union(node->bounds, primitiveInfo[i].bounds);
+        subtrees->push_back({node, start, end});
+        return node;
+    }
     BVHBuildNode *node = arena.Alloc<BVHBuildNode>();
     (*totalNodes)++;
     // Compute bounds of all primitives in BVH node
-    Bounds3f bounds;
-    for (int i = start; i < end; ++i)
-        bounds = Union(bounds, primitiveInfo[i].bounds);
+    Bounds3f bounds, centroidBounds;
     int nPrimitives = end - start;
+    int nChunks = (nPrimitives + BinningChunkSize - 1) / BinningChunkSize;
+    bool parallelBinning = subtrees && nPrimitives >= ParallelBinningThreshold;
+    if (parallelBinning) {
+        // Compute bounds of chunks of primitives and of their centroids in
+        // parallel and merge them; unions are exact, so this matches the
+        // serial loops
+        std::vector<Bounds3f> chunkBounds(nChunks), chunkCentroidBounds(nChunks);
+        ParallelFor([&](int c) {
+            int chunkEnd = std::min(end, start + (c + 1) * BinningChunkSize);
+            for (int i = start + c * BinningChunkSize; i < chunkEnd; ++i) {
+                chunkBounds[c] = Union(chunkBounds[c], primitiveInfo[i].bounds);
+                chunkCentroidBounds[c] =
+                    Union(chunkCentroidBounds[c], primitiveInfo[i].centroid);
+            }
+        }, nChunks);
+        for (int c = 0; c < nChunks; ++c) {
+            bounds = Union(bounds, chunkBounds[c]);
+            centroidBounds = Union(centroidBounds, chunkCentroidBounds[c]);
+        }
+    } else
+        for (int i = start; i < end; ++i)
+            bounds = Union(bounds, primitiveInfo[i].bounds);
     if (nPrimitives == 1) {
-        // Create leaf _BVHBuildNode_
-        int firstPrimOffset = orderedPrims.size();
+        // Create leaf _BVHBuildNode_; leaves are created in order, so a
+        // leaf's primitives go where its range of _primitiveInfo_ is
+        int firstPrimOffset = start;
         for (int i = start; i < end; ++i) {
             int primNum = primitiveInfo[i].primitiveNumber;
-            orderedPrims.push_back(primitives[primNum]);
+            orderedPrims[i] = primitives[primNum];
         }
         node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
         return node;
     } else {
         // Compute bound of primitive centroids, choose split dimension _dim_
-        Bounds3f centroidBounds;
-        for (int i = start; i < end; ++i)
-            centroidBounds = Union(centroidBounds, primitiveInfo[i].centroid);
+        if (!parallelBinning)
+            for (int i = start; i < end; ++i)
+                centroidBounds =
+                    Union(centroidBounds, primitiveInfo[i].centroid);
         int dim = centroidBounds.MaximumExtent();
 
         // Partition primitives into two sets and build children
         int mid = (start + end) / 2;
         if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) {
             // Create leaf _BVHBuildNode_
-            int firstPrimOffset = orderedPrims.size();
+            int firstPrimOffset = start;
             for (int i = start; i < end; ++i) {
                 int primNum = primitiveInfo[i].primitiveNumber;
-                orderedPrims.push_back(primitives[primNum]);
+                orderedPrims[i] = primitives[primNum];
             }
             node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
             return node;
@@ -321,17 +605,41 @@ BVHBuildNode *BVHAccel::recursiveBuild(
                     BucketInfo buckets[nBuckets];
 
                     // Initialize _BucketInfo_ for SAH partition buckets
-                    for (int i = start; i < end; ++i) {
-                        int b = nBuckets *
-                                centroidBounds.Offset(
-                                    primitiveInfo[i].centroid)[dim];
-                        if (b == nBuckets) b = nBuckets - 1;
-                        CHECK_GE(b, 0);
-                        CHECK_LT(b, nBuckets);
-                        buckets[b].count++;
-                        buckets[b].bounds =
-                            Union(buckets[b].bounds, primitiveInfo[i].bounds);
-                    }
+                    auto binPrimitives = [&](int first, int last,
+                                             BucketInfo *bins) {
+                        for (int i = first; i < last; ++i) {
+                            int b = nBuckets *
+                                    centroidBounds.Offset(
+                                        primitiveInfo[i].centroid)[dim];
+                            if (b == nBuckets) b = nBuckets - 1;
+                            CHECK_GE(b, 0);
+                            CHECK_LT(b, nBuckets);
+                            bins[b].count++;
+                            bins[b].bounds =
+                                Union(bins[b].bounds, primitiveInfo[i].bounds);
+                        }
+                    };
+                    if (parallelBinning) {
+                        // Bin chunks of primitives in parallel and merge
+                        // their buckets
+                        std::vector<BucketInfo> chunkBuckets(nChunks *
+                                                             nBuckets);
+                        ParallelFor([&](int c) {
+                            binPrimitives(
+                                start + c * BinningChunkSize,
+                                std::min(end, start + (c + 1) * BinningChunkSize),
+                                &chunkBuckets[c * nBuckets]);
+                        }, nChunks);
+                        for (int c = 0; c < nChunks; ++c)
+                            for (int b = 0; b < nBuckets; ++b) {
+                                const BucketInfo &cb =
+                                    chunkBuckets[c * nBuckets + b];
+                                buckets[b].count += cb.count;
+                                buckets[b].bounds =
+                                    Union(buckets[b].bounds, cb.bounds);
+                            }
+                    } else
+                        binPrimitives(start, end, buckets);
 
                     // Compute costs for splitting after each bucket
                     Float cost[nBuckets - 1];
@@ -379,10 +687,10 @@ BVHBuildNode *BVHAccel::recursiveBuild(
                         mid = pmid - &primitiveInfo[0];
                     } else {
                         // Create leaf _BVHBuildNode_
-                        int firstPrimOffset = orderedPrims.size();
+                        int firstPrimOffset = start;
                         for (int i = start; i < end; ++i) {
                             int primNum = primitiveInfo[i].primitiveNumber;
-                            orderedPrims.push_back(primitives[primNum]);
+                            orderedPrims[i] = primitives[primNum];
                         }
                         node->InitLeaf(firstPrimOffset, nPrimitives, bounds);
                         return node;
@@ -393,9 +701,11 @@ BVHBuildNode *BVHAccel::recursiveBuild(
             }
             node->InitInterior(dim,
                                recursiveBuild(arena, primitiveInfo, start, mid,
-                                              totalNodes, orderedPrims),
+                                              totalNodes, orderedPrims,
+                                              subtrees, maxSubtreePrims),
                                recursiveBuild(arena, primitiveInfo, mid, end,
-                                              totalNodes, orderedPrims));
+                                              totalNodes, orderedPrims,
+                                              subtrees, maxSubtreePrims));
         }
     }
     return node;
@@ -535,6 +845,252 @@ BVHBuildNode *BVHAccel::emitLBVH(
     }
 }
 
+// Spatial splits are only considered where the children of the best object
+// split overlap by at least this fraction of the root's surface area
+static PBRT_CONSTEXPR Float SpatialSplitAlpha = 1e-5f;
+
+// The part of _b_ between _lo_ and _hi_ along _dim_. Only the primitives'
+// bounds are clipped, which is exact for axis-aligned quads and boxes and
+// conservative for everything else.
+static Bounds3f ClipBounds(Bounds3f b, int dim, Float lo, Float hi) {
+    b.pMin[dim] = std::max(b.pMin[dim], lo);
+    b.pMax[dim] = std::min(b.pMax[dim], hi);
+    return b;
+}
+
+BVHBuildNode *BVHAccel::SBVHBuild(
+    MemoryArena &arena, std::vector<BVHPrimitiveInfo> &primitiveInfo,
+    int *totalNodes,
+    std::vector<std::shared_ptr<Primitive>> &orderedPrims) const {
+    Bounds3f bounds;
+    for (const BVHPrimitiveInfo &pi : primitiveInfo)
+        bounds = Union(bounds, pi.bounds);
+    int nPrimitives = primitiveInfo.size();
+    int referenceBudget = std::min<Float>(
+        (maxDuplication - 1) * nPrimitives,
+        std::numeric_limits<int>::max() - nPrimitives);
+    std::vector<BVHPrimitiveInfo> refs(std::move(primitiveInfo)), orderedRefs;
+    orderedRefs.reserve(nPrimitives + referenceBudget);
+    BVHBuildNode *root =
+        recursiveSBVHBuild(arena, refs, bounds.SurfaceArea(),
+                           &referenceBudget, totalNodes, orderedRefs);
+
+    // Leave the leaves' references in _primitiveInfo_, like the other
+    // builders leave the primitive order there
+    orderedPrims.resize(orderedRefs.size());
+    for (size_t i = 0; i < orderedRefs.size(); ++i)
+        orderedPrims[i] = primitives[orderedRefs[i].primitiveNumber];
+    sbvhReferences += orderedRefs.size();
+    sbvhPrimitives += nPrimitives;
+    primitiveInfo = std::move(orderedRefs);
+    return root;
+}
+
+BVHBuildNode *BVHAccel::recursiveSBVHBuild(
+    MemoryArena &arena, std::vector<BVHPrimitiveInfo> &refs, Float rootArea,
+    int *referenceBudget, int *totalNodes,
+    std::vector<BVHPrimitiveInfo> &orderedRefs) const {
+    BVHBuildNode *node = arena.Alloc<BVHBuildNode>();
+    (*totalNodes)++;
+    int nRefs = refs.size();
+    Bounds3f bounds, centroidBounds;
+    for (const BVHPrimitiveInfo &ref : refs) {
+        bounds = Union(bounds, ref.bounds);
+        centroidBounds = Union(centroidBounds, ref.centroid);
+    }
+    // Costs below are scaled by the node's surface area, which may be zero
+    // for flat nodes, rather than divided by it
+    Float area = bounds.SurfaceArea();
+
+    // Find the best object split, binning reference centroids along each axis
+    PBRT_CONSTEXPR int nBuckets = 12;
+    auto objectBucket = [&](const BVHPrimitiveInfo &ref, int dim) {
+        int b = nBuckets * centroidBounds.Offset(ref.centroid)[dim];
+        return std::min(b, nBuckets - 1);
+    };
+    Float objectCost = Infinity;
+    int objectDim = -1, objectSplitBucket = 0;
+    Bounds3f objectBounds[2];
+    for (int dim = 0; nRefs > 1 && dim < 3; ++dim) {
+        if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) continue;
+        BucketInfo buckets[nBuckets];
+        for (const BVHPrimitiveInfo &ref : refs) {
+            int b = objectBucket(ref, dim);
+            buckets[b].count++;
+            buckets[b].bounds = Union(buckets[b].bounds, ref.bounds);
+        }
+        BucketInfo above[nBuckets];
+        for (int i = nBuckets - 1; i > 0; --i) {
+            above[i - 1].count = above[i].count + buckets[i].count;
+            above[i - 1].bounds = Union(above[i].bounds, buckets[i].bounds);
+        }
+        BucketInfo below;
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            below.count += buckets[i].count;
+            below.bounds = Union(below.bounds, buckets[i].bounds);
+            if (below.count == 0 || above[i].count == 0) continue;
+            Float cost = area + below.count * below.bounds.SurfaceArea() +
+                         above[i].count * above[i].bounds.SurfaceArea();
+            if (cost < objectCost) {
+                objectCost = cost;
+                objectDim = dim;
+                objectSplitBucket = i;
+                objectBounds[0] = below.bounds;
+                objectBounds[1] = above[i].bounds;
+            }
+        }
+    }
+
+    // Find the best spatial split if the object split's children overlap
+    // enough and references can still be duplicated
+    PBRT_CONSTEXPR int nBins = 32;
+    auto binPlane = [&](int b, int dim) {
+        return b == nBins ? bounds.pMax[dim]
+                          : bounds.pMin[dim] +
+                                b * (bounds.pMax[dim] - bounds.pMin[dim]) /
+                                    nBins;
+    };
+    auto spatialBin = [&](Float x, int dim) {
+        int b = nBins * (x - bounds.pMin[dim]) /
+                (bounds.pMax[dim] - bounds.pMin[dim]);
+        return Clamp(b, 0, nBins - 1);
+    };
+    Float spatialCost = Infinity;
+    int spatialDim = -1, spatialSplitBin = 0;
+    Bounds3f spatialBounds[2];
+    int spatialCounts[2];
+    Float overlap = (objectDim != -1 && Overlaps(objectBounds[0],
+                                                 objectBounds[1]))
+                        ? pbrt::Intersect(objectBounds[0], objectBounds[1])
+                              .SurfaceArea()
+                        : 0;
+    if (nRefs > 1 && *referenceBudget > 0 &&
+        (objectDim == -1 || overlap > SpatialSplitAlpha * rootArea)) {
+        for (int dim = 0; dim < 3; ++dim) {
+            if (bounds.pMax[dim] == bounds.pMin[dim]) continue;
+            // Count the references entering and leaving each bin and clip
+            // them to the bins they span
+            struct SpatialBin {
+                Bounds3f bounds;
+                int enter = 0, exit = 0;
+            };
+            SpatialBin bins[nBins];
+            for (const BVHPrimitiveInfo &ref : refs) {
+                int b0 = spatialBin(ref.bounds.pMin[dim], dim);
+                int b1 = spatialBin(ref.bounds.pMax[dim], dim);
+                bins[b0].enter++;
+                bins[b1].exit++;
+                for (int b = b0; b <= b1; ++b) {
+                    Bounds3f clipped = ClipBounds(ref.bounds, dim,
+                                                  binPlane(b, dim),
+                                                  binPlane(b + 1, dim));
+                    if (clipped.pMin[dim] <= clipped.pMax[dim])
+                        bins[b].bounds = Union(bins[b].bounds, clipped);
+                }
+            }
+            SpatialBin above[nBins];
+            for (int i = nBins - 1; i > 0; --i) {
+                above[i - 1].exit = above[i].exit + bins[i].exit;
+                above[i - 1].bounds = Union(above[i].bounds, bins[i].bounds);
+            }
+            SpatialBin below;
+            for (int i = 0; i < nBins - 1; ++i) {
+                below.enter += bins[i].enter;
+                below.bounds = Union(below.bounds, bins[i].bounds);
+                // Both children must make progress, and the references
+                // split in two must fit in the budget
+                int nBelow = below.enter, nAbove = above[i].exit;
+                if (nBelow == 0 || nAbove == 0 || nBelow == nRefs ||
+                    nAbove == nRefs ||
+                    nBelow + nAbove - nRefs > *referenceBudget)
+                    continue;
+                Float cost = area + nBelow * below.bounds.SurfaceArea() +
+                             nAbove * above[i].bounds.SurfaceArea();
+                if (cost < spatialCost) {
+                    spatialCost = cost;
+                    spatialDim = dim;
+                    spatialSplitBin = i;
+                    spatialBounds[0] = below.bounds;
+                    spatialBounds[1] = above[i].bounds;
+                    spatialCounts[0] = nBelow;
+                    spatialCounts[1] = nAbove;
+                }
+            }
+        }
+    }
+
+    // Create a leaf if no split is possible or no split is cheaper
+    Float splitCost = std::min(objectCost, spatialCost);
+    if ((objectDim == -1 && spatialDim == -1) ||
+        (nRefs <= maxPrimsInNode && nRefs * area <= splitCost)) {
+        node->InitLeaf(orderedRefs.size(), nRefs, bounds);
+        orderedRefs.insert(orderedRefs.end(), refs.begin(), refs.end());
+        return node;
+    }
+
+    std::vector<BVHPrimitiveInfo> left, right;
+    int dim;
+    if (spatialCost < objectCost) {
+        // Split references at the spatial split's plane, moving references
+        // that straddle it to one side instead when that is cheaper
+        dim = spatialDim;
+        Float plane = binPlane(spatialSplitBin + 1, dim);
+        Bounds3f bLeft = spatialBounds[0], bRight = spatialBounds[1];
+        int nLeft = spatialCounts[0], nRight = spatialCounts[1];
+        for (const BVHPrimitiveInfo &ref : refs) {
+            int b0 = spatialBin(ref.bounds.pMin[dim], dim);
+            int b1 = spatialBin(ref.bounds.pMax[dim], dim);
+            if (b1 <= spatialSplitBin)
+                left.push_back(ref);
+            else if (b0 > spatialSplitBin)
+                right.push_back(ref);
+            else {
+                Float aLeft = bLeft.SurfaceArea(),
+                      aRight = bRight.SurfaceArea();
+                Float costSplit = nLeft * aLeft + nRight * aRight;
+                Float costLeft = nLeft * Union(bLeft, ref.bounds).SurfaceArea() +
+                                 (nRight - 1) * aRight;
+                Float costRight = (nLeft - 1) * aLeft +
+                                  nRight * Union(bRight, ref.bounds).SurfaceArea();
+                if (nRight > 1 && costLeft < costSplit &&
+                    costLeft <= costRight) {
+                    left.push_back(ref);
+                    bLeft = Union(bLeft, ref.bounds);
+                    --nRight;
+                } else if (nLeft > 1 && costRight < costSplit) {
+                    right.push_back(ref);
+                    bRight = Union(bRight, ref.bounds);
+                    --nLeft;
+                } else {
+                    left.push_back(BVHPrimitiveInfo(
+                        ref.primitiveNumber,
+                        ClipBounds(ref.bounds, dim, -Infinity, plane)));
+                    right.push_back(BVHPrimitiveInfo(
+                        ref.primitiveNumber,
+                        ClipBounds(ref.bounds, dim, plane, Infinity)));
+                }
+            }
+        }
+        *referenceBudget -= left.size() + right.size() - nRefs;
+        ++spatialSplits;
+    } else {
+        dim = objectDim;
+        for (const BVHPrimitiveInfo &ref : refs)
+            (objectBucket(ref, dim) <= objectSplitBucket ? left : right)
+                .push_back(ref);
+    }
+    // Free this node's references before building its children
+    std::vector<BVHPrimitiveInfo>().swap(refs);
+    BVHBuildNode *c0 = recursiveSBVHBuild(arena, left, rootArea,
+                                          referenceBudget, totalNodes,
+                                          orderedRefs);
+    BVHBuildNode *c1 = recursiveSBVHBuild(arena, right, rootArea,
+                                          referenceBudget, totalNodes,
+                                          orderedRefs);
+    node->InitInterior(dim, c0, c1);
+    return node;
+}
+
 BVHBuildNode *BVHAccel::buildUpperSAH(MemoryArena &arena,
                                       std::vector<BVHBuildNode *> &treeletRoots,
                                       int start, int end,
@@ -657,9 +1213,17 @@ int BVHAccel::flattenBVHTree(BVHBuildNode *node, int *offset) {
     return myOffset;
 }
 
-BVHAccel::~BVHAccel() { FreeAligned(nodes); }
+BVHAccel::~BVHAccel() {
+#ifdef PBRT_HAVE_MMAP
+    if (mappedFile) {
+        munmap(mappedFile, mappedLength);
+        return;
+    }
+#endif
+    FreeAligned(nodes);
+}
 
-bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
+bool BVHAccel::IntersectHit(const Ray &ray, PrimitiveHit *closest) const {
     if (!nodes) return false;
     ProfilePhase p(Prof::AccelIntersect);
     bool hit = false;
@@ -668,15 +1232,17 @@ bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
     // Follow ray through BVH nodes to find primitive intersections
     int toVisitOffset = 0, currentNodeIndex = 0;
     int nodesToVisit[64];
+    int nVisited = 0;
     while (true) {
         const LinearBVHNode *node = &nodes[currentNodeIndex];
+        ++nVisited;
         // Check ray against BVH node
         if (node->bounds.IntersectP(ray, invDir, dirIsNeg)) {
             if (node->nPrimitives > 0) {
                 // Intersect ray with primitives in leaf BVH node
                 for (int i = 0; i < node->nPrimitives; ++i)
-                    if (primitives[node->primitivesOffset + i]->Intersect(
-                            ray, isect))
+                    if (primitives[node->primitivesOffset + i]->IntersectHit(
+                            ray, closest))
                         hit = true;
                 if (toVisitOffset == 0) break;
                 currentNodeIndex = nodesToVisit[--toVisitOffset];
@@ -696,6 +1262,8 @@ bool BVHAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
             currentNodeIndex = nodesToVisit[--toVisitOffset];
         }
     }
+    nodesVisited += nVisited;
+    ++closestHitRays;
     return hit;
 }
 
@@ -749,6 +1317,8 @@ std::shared_ptr<BVHAccel> CreateBVHAccelerator(
         splitMethod = BVHAccel::SplitMethod::Middle;
     else if (splitMethodName == "equal")
         splitMethod = BVHAccel::SplitMethod::EqualCounts;
+    else if (splitMethodName == "sbvh")
+        splitMethod = BVHAccel::SplitMethod::SBVH;
     else {
         Warning("BVH split method \"%s\" unknown.  Using \"sah\".",
                 splitMethodName.c_str());
@@ -756,7 +1326,9 @@ std::shared_ptr<BVHAccel> CreateBVHAccelerator(
     }
 
     int maxPrimsInNode = ps.FindOneInt("maxnodeprims", 4);
-    return std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode, splitMethod);
+    Float maxDuplication = ps.FindOneFloat("maxduplication", 1.5f);
+    return std::make_shared<BVHAccel>(std::move(prims), maxPrimsInNode,
+                                      splitMethod, maxDuplication);
 }
 
 }  // namespace pbrt
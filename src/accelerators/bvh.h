@@ -48,30 +48,55 @@ struct BVHBuildNode;
 
 // BVHAccel Forward Declarations
 struct BVHPrimitiveInfo;
+struct BVHBuildTask;
 struct MortonPrimitive;
-struct LinearBVHNode;
+template <typename Node>
+class WideBVHAccel;
+
+struct LinearBVHNode {
+    Bounds3f bounds;
+    union {
+        int primitivesOffset;   // leaf
+        int secondChildOffset;  // interior
+    };
+    uint16_t nPrimitives;  // 0 -> interior node
+    uint8_t axis;          // interior node: xyz
+    uint8_t pad[1];        // ensure 32 byte total size
+};
 
 // BVHAccel Declarations
 class BVHAccel : public Aggregate {
   public:
     // BVHAccel Public Types
-    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts };
+    enum class SplitMethod { SAH, HLBVH, Middle, EqualCounts, SBVH };
 
     // BVHAccel Public Methods
+    // _maxDuplication_ bounds the number of primitive references an SBVH
+    // may create, relative to the number of primitives
     BVHAccel(std::vector<std::shared_ptr<Primitive>> p,
              int maxPrimsInNode = 1,
-             SplitMethod splitMethod = SplitMethod::SAH);
+             SplitMethod splitMethod = SplitMethod::SAH,
+             Float maxDuplication = 1.5f);
     Bounds3f WorldBound() const;
     ~BVHAccel();
-    bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
+    bool IntersectHit(const Ray &ray, PrimitiveHit *closest) const;
     bool IntersectP(const Ray &ray) const;
+    // The number of primitive references in the leaves, which exceeds the
+    // number of primitives when spatial splits duplicate them
+    int PrimitiveReferences() const { return primitives.size(); }
 
   private:
+    // _WideBVHAccel_ collapses the flattened nodes of a built _BVHAccel_
+    template <typename Node>
+    friend class WideBVHAccel;
+
     // BVHAccel Private Methods
     BVHBuildNode *recursiveBuild(
         MemoryArena &arena, std::vector<BVHPrimitiveInfo> &primitiveInfo,
         int start, int end, int *totalNodes,
-        std::vector<std::shared_ptr<Primitive>> &orderedPrims);
+        std::vector<std::shared_ptr<Primitive>> &orderedPrims,
+        std::vector<BVHBuildTask> *subtrees = nullptr,
+        int maxSubtreePrims = 0);
     BVHBuildNode *HLBVHBuild(
         MemoryArena &arena, const std::vector<BVHPrimitiveInfo> &primitiveInfo,
         int *totalNodes,
@@ -82,16 +107,32 @@ class BVHAccel : public Aggregate {
         MortonPrimitive *mortonPrims, int nPrimitives, int *totalNodes,
         std::vector<std::shared_ptr<Primitive>> &orderedPrims,
         std::atomic<int> *orderedPrimsOffset, int bitIndex) const;
+    BVHBuildNode *SBVHBuild(
+        MemoryArena &arena, std::vector<BVHPrimitiveInfo> &primitiveInfo,
+        int *totalNodes,
+        std::vector<std::shared_ptr<Primitive>> &orderedPrims) const;
+    BVHBuildNode *recursiveSBVHBuild(
+        MemoryArena &arena, std::vector<BVHPrimitiveInfo> &refs,
+        Float rootArea, int *referenceBudget, int *totalNodes,
+        std::vector<BVHPrimitiveInfo> &orderedRefs) const;
     BVHBuildNode *buildUpperSAH(MemoryArena &arena,
                                 std::vector<BVHBuildNode *> &treeletRoots,
                                 int start, int end, int *totalNodes) const;
     int flattenBVHTree(BVHBuildNode *node, int *offset);
+    bool readCache(const std::string &filename, uint64_t hash);
+    void writeCache(const std::string &filename, uint64_t hash,
+                    const std::vector<BVHPrimitiveInfo> &primitiveInfo,
+                    int totalNodes) const;
 
     // BVHAccel Private Data
     const int maxPrimsInNode;
     const SplitMethod splitMethod;
+    const Float maxDuplication;
     std::vector<std::shared_ptr<Primitive>> primitives;
     LinearBVHNode *nodes = nullptr;
+    // Set when _nodes_ points into a memory-mapped cache file
+    void *mappedFile = nullptr;
+    size_t mappedLength = 0;
 };
 
 std::shared_ptr<BVHAccel> CreateBVHAccelerator(
@@ -262,7 +262,7 @@ retrySplit:
               prims0, prims1 + nPrimitives, badRefines);
 }
 
-bool KdTreeAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
+bool KdTreeAccel::IntersectHit(const Ray &ray, PrimitiveHit *closest) const {
     ProfilePhase p(Prof::AccelIntersect);
     // Compute initial parametric range of ray inside kd-tree extent
     Float tMin, tMax;
@@ -323,14 +323,14 @@ bool KdTreeAccel::Intersect(const Ray &ray, SurfaceInteraction *isect) const {
                 const std::shared_ptr<Primitive> &p =
                     primitives[node->onePrimitive];
                 // Check one primitive inside leaf node
-                if (p->Intersect(ray, isect)) hit = true;
+                if (p->IntersectHit(ray, closest)) hit = true;
             } else {
                 for (int i = 0; i < nPrimitives; ++i) {
                     int index =
                         primitiveIndices[node->primitiveIndicesOffset + i];
                     const std::shared_ptr<Primitive> &p = primitives[index];
                     // Check one primitive inside leaf node
-                    if (p->Intersect(ray, isect)) hit = true;
+                    if (p->IntersectHit(ray, closest)) hit = true;
                 }
             }
 
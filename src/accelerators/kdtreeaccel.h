@@ -55,7 +55,7 @@ class KdTreeAccel : public Aggregate {
                 Float emptyBonus = 0.5, int maxPrims = 1, int maxDepth = -1);
     Bounds3f WorldBound() const { return bounds; }
     ~KdTreeAccel();
-    bool Intersect(const Ray &ray, SurfaceInteraction *isect) const;
+    bool IntersectHit(const Ray &ray, PrimitiveHit *closest) const;
     bool IntersectP(const Ray &ray) const;
 
   private:
@@ -0,0 +1,596 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// accelerators/widebvh.cpp*
+#include "accelerators/widebvh.h"
+#include "interaction.h"
+#include "memory.h"
+#include "paramset.h"
+#include "stats.h"
+#include <algorithm>
+#include <string.h>
+#if !defined(PBRT_FLOAT_AS_DOUBLE) && (defined(__SSE2__) || defined(_M_X64))
+#include <immintrin.h>
+#define PBRT_WIDEBVH_SSE
+#endif
+
+namespace pbrt {
+
+STAT_MEMORY_COUNTER("Memory/Wide BVH tree", wideTreeBytes);
+STAT_RATIO("Wide BVH/Children per node", totalChildren, totalWideNodes);
+STAT_RATIO("Wide BVH/Bytes per primitive", wideBVHBytes, wideBVHPrimitives);
+
+// WideBVHAccel Local Declarations
+// What testing a ray against the children of a node needs from it
+struct ChildRay {
+    ChildRay(const Ray &ray)
+        : o{ray.o.x, ray.o.y, ray.o.z},
+          invDir{1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z},
+          dirIsNeg{invDir[0] < 0, invDir[1] < 0, invDir[2] < 0} {}
+    Float o[3], invDir[3];
+    int dirIsNeg[3];
+};
+
+// Stack entry for a child that remains to be visited
+struct WideBVHToVisit {
+    int offset, nPrimitives;
+    Float tMin;
+};
+
+// Sets the bounds of the first _nChildren_ children of _node_ and gives the
+// rest bounds that no ray overlaps
+template <int N>
+static void InitChildBounds(WideBVHNode<N> *node, const Bounds3f *b,
+                            int nChildren) {
+    for (int i = 0; i < N; ++i)
+        for (int a = 0; a < 3; ++a) {
+            node->bounds[0][a][i] = i < nChildren ? b[i].pMin[a] : Infinity;
+            node->bounds[1][a][i] = i < nChildren ? b[i].pMax[a] : -Infinity;
+        }
+}
+
+template <int N>
+static void InitChildBounds(QuantizedWideBVHNode<N> *node, const Bounds3f *b,
+                            int nChildren) {
+    node->nChildren = nChildren;
+    Bounds3f all;
+    for (int i = 0; i < nChildren; ++i) all = Union(all, b[i]);
+    for (int a = 0; a < 3; ++a) {
+        // Choose the smallest power-of-two step that spans the children in
+        // 255 steps; multiplying by it is exact, so the traversal decodes
+        // exactly the values checked here
+        Float origin = all.pMin[a];
+        int exponent;
+        std::frexp((all.pMax[a] - origin) / 255, &exponent);
+        exponent = Clamp(exponent, -126, 127);
+        while (exponent < 127 &&
+               origin + 255 * std::ldexp(Float(1), exponent) < all.pMax[a])
+            ++exponent;
+        Float scale = std::ldexp(Float(1), exponent);
+        node->origin[a] = origin;
+        node->exponent[a] = exponent;
+
+        // Round the children's bounds outward to multiples of the step
+        for (int i = 0; i < N; ++i) {
+            if (i >= nChildren) {
+                node->bounds[0][a][i] = node->bounds[1][a][i] = 0;
+                continue;
+            }
+            int qMin = Clamp(int(std::floor((b[i].pMin[a] - origin) / scale)),
+                             0, 255);
+            while (qMin > 0 && origin + qMin * scale > b[i].pMin[a]) --qMin;
+            int qMax = Clamp(int(std::ceil((b[i].pMax[a] - origin) / scale)),
+                             0, 255);
+            while (qMax < 255 && origin + qMax * scale < b[i].pMax[a]) ++qMax;
+            node->bounds[0][a][i] = qMin;
+            node->bounds[1][a][i] = qMax;
+        }
+    }
+}
+
+// Returns bound _j_ (0: min, 1: max) along axis _a_ of child _i_ of _node_
+template <int N>
+inline Float ChildBound(const WideBVHNode<N> &node, int j, int a, int i) {
+    return node.bounds[j][a][i];
+}
+
+template <int N>
+inline Float ChildBound(const QuantizedWideBVHNode<N> &node, int j, int a,
+                        int i) {
+    return node.origin[a] +
+           node.bounds[j][a][i] * std::ldexp(Float(1), node.exponent[a]);
+}
+
+// Children of _node_ that hold primitives or other nodes
+template <int N>
+inline int ValidChildren(const WideBVHNode<N> &node) {
+    // Unused children have empty bounds
+    return (1 << N) - 1;
+}
+
+template <int N>
+inline int ValidChildren(const QuantizedWideBVHNode<N> &node) {
+    return (1 << node.nChildren) - 1;
+}
+
+// Stores the node index of each interior child of _node_ and the first
+// primitive index of each leaf child in _offset_
+template <int N>
+inline void ChildOffsets(const WideBVHNode<N> &node, int32_t offset[N]) {
+    for (int i = 0; i < N; ++i) offset[i] = node.offset[i];
+}
+
+template <int N>
+inline void ChildOffsets(const QuantizedWideBVHNode<N> &node,
+                        int32_t offset[N]) {
+    int32_t child = node.childrenOffset, primitive = node.primitivesOffset;
+    for (int i = 0; i < N; ++i) {
+        if (node.nPrimitives[i] == 0)
+            offset[i] = child++;
+        else {
+            offset[i] = primitive;
+            primitive += node.nPrimitives[i];
+        }
+    }
+}
+
+// Sets the offsets of the first _nChildren_ children of _node_, whose
+// _nPrimitives_ have been set; interior children must be consecutive nodes
+// and leaf children must have consecutive primitives
+template <int N>
+static void InitChildOffsets(WideBVHNode<N> *node, const int32_t offset[N],
+                             int nChildren) {
+    for (int i = 0; i < N; ++i)
+        node->offset[i] = i < nChildren ? offset[i] : -1;
+}
+
+template <int N>
+static void InitChildOffsets(QuantizedWideBVHNode<N> *node,
+                             const int32_t offset[N], int nChildren) {
+    node->childrenOffset = node->primitivesOffset = 0;
+    for (int i = nChildren - 1; i >= 0; --i) {
+        if (node->nPrimitives[i] == 0)
+            node->childrenOffset = offset[i];
+        else
+            node->primitivesOffset = offset[i];
+    }
+    int32_t check[N];
+    ChildOffsets(*node, check);
+    for (int i = 0; i < nChildren; ++i) DCHECK_EQ(offset[i], check[i]);
+}
+
+// Tests the children of _node_ one at a time, as _IntersectChildren()_
+// does without SSE
+template <typename Node>
+inline int IntersectChildrenScalar(const Node &node, const ChildRay &r,
+                                   Float tMax, Float tNear[]) {
+    int hits = 0;
+    for (int i = 0; i < Node::Width; ++i) {
+        Float t0 = 0, t1 = tMax;
+        for (int a = 0; a < 3; ++a) {
+            Float tNearSlab =
+                (ChildBound(node, r.dirIsNeg[a], a, i) - r.o[a]) * r.invDir[a];
+            Float tFarSlab =
+                (ChildBound(node, 1 - r.dirIsNeg[a], a, i) - r.o[a]) *
+                r.invDir[a];
+            tFarSlab *= 1 + 2 * gamma(3);
+            if (tNearSlab > t0) t0 = tNearSlab;
+            if (tFarSlab < t1) t1 = tFarSlab;
+        }
+        tNear[i] = t0;
+        if (t0 <= t1) hits |= 1 << i;
+    }
+    return hits & ValidChildren(node);
+}
+
+#ifdef PBRT_WIDEBVH_SSE
+// Slab test of four children, given their bounds along each axis; NaN slab
+// distances leave the interval unchanged since _mm_max_ps()_ and
+// _mm_min_ps()_ then return their second operand
+inline int IntersectChildren4(const __m128 pMin[3], const __m128 pMax[3],
+                              const ChildRay &r, Float tMax, Float tNear[4]) {
+    const __m128 scale = _mm_set1_ps(1 + 2 * gamma(3));
+    __m128 t0 = _mm_setzero_ps(), t1 = _mm_set1_ps(tMax);
+    for (int a = 0; a < 3; ++a) {
+        __m128 o = _mm_set1_ps(r.o[a]), invDir = _mm_set1_ps(r.invDir[a]);
+        __m128 tNearSlab = _mm_mul_ps(
+            _mm_sub_ps(r.dirIsNeg[a] ? pMax[a] : pMin[a], o), invDir);
+        __m128 tFarSlab = _mm_mul_ps(
+            _mm_mul_ps(_mm_sub_ps(r.dirIsNeg[a] ? pMin[a] : pMax[a], o),
+                       invDir),
+            scale);
+        t0 = _mm_max_ps(tNearSlab, t0);
+        t1 = _mm_min_ps(tFarSlab, t1);
+    }
+    _mm_storeu_ps(tNear, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+
+// Converts four 8-bit quantized bounds to _float_s
+inline __m128 LoadQuantized4(const uint8_t *q) {
+    int32_t v;
+    memcpy(&v, q, sizeof(v));
+    __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), _mm_setzero_si128());
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, _mm_setzero_si128()));
+}
+#endif  // PBRT_WIDEBVH_SSE
+
+// Returns a bitmask of the children of _node_ whose bounds the ray overlaps
+// within $[0, \roman{tMax}]$ and stores where it enters them in _tNear_;
+// this matches _Bounds3::IntersectP()_, including its conservative exit
+// distances.
+template <int N>
+inline int IntersectChildren(const WideBVHNode<N> &node, const ChildRay &r,
+                             Float tMax, Float tNear[N]) {
+#ifdef PBRT_WIDEBVH_SSE
+    int hits = 0;
+    for (int k = 0; k < N; k += 4) {
+        __m128 pMin[3], pMax[3];
+        for (int a = 0; a < 3; ++a) {
+            pMin[a] = _mm_load_ps(&node.bounds[0][a][k]);
+            pMax[a] = _mm_load_ps(&node.bounds[1][a][k]);
+        }
+        hits |= IntersectChildren4(pMin, pMax, r, tMax, &tNear[k]) << k;
+    }
+    return hits;
+#else
+    return IntersectChildrenScalar(node, r, tMax, tNear);
+#endif  // PBRT_WIDEBVH_SSE
+}
+
+template <int N>
+inline int IntersectChildren(const QuantizedWideBVHNode<N> &node,
+                             const ChildRay &r, Float tMax, Float tNear[N]) {
+#ifdef PBRT_WIDEBVH_SSE
+    // Decode the bounds as _ChildBound()_ does
+    __m128 origin[3], scale[3];
+    for (int a = 0; a < 3; ++a) {
+        origin[a] = _mm_set1_ps(node.origin[a]);
+        scale[a] = _mm_set1_ps(std::ldexp(1.f, node.exponent[a]));
+    }
+    int hits = 0;
+    for (int k = 0; k < N; k += 4) {
+        __m128 pMin[3], pMax[3];
+        for (int a = 0; a < 3; ++a) {
+            pMin[a] = _mm_add_ps(
+                origin[a],
+                _mm_mul_ps(LoadQuantized4(&node.bounds[0][a][k]), scale[a]));
+            pMax[a] = _mm_add_ps(
+                origin[a],
+                _mm_mul_ps(LoadQuantized4(&node.bounds[1][a][k]), scale[a]));
+        }
+        hits |= IntersectChildren4(pMin, pMax, r, tMax, &tNear[k]) << k;
+    }
+    return hits & ValidChildren(node);
+#else
+    return IntersectChildrenScalar(node, r, tMax, tNear);
+#endif  // PBRT_WIDEBVH_SSE
+}
+
+#if defined(PBRT_WIDEBVH_SSE) && defined(__AVX__)
+template <>
+inline int IntersectChildren<8>(const WideBVHNode<8> &node, const ChildRay &r,
+                                Float tMax, Float tNear[8]) {
+    // Test all eight children at once
+    const __m256 scale = _mm256_set1_ps(1 + 2 * gamma(3));
+    __m256 t0 = _mm256_setzero_ps(), t1 = _mm256_set1_ps(tMax);
+    for (int a = 0; a < 3; ++a) {
+        __m256 o = _mm256_set1_ps(r.o[a]), invDir = _mm256_set1_ps(r.invDir[a]);
+        __m256 tNearSlab = _mm256_mul_ps(
+            _mm256_sub_ps(_mm256_load_ps(node.bounds[r.dirIsNeg[a]][a]), o),
+            invDir);
+        __m256 tFarSlab = _mm256_mul_ps(
+            _mm256_mul_ps(
+                _mm256_sub_ps(
+                    _mm256_load_ps(node.bounds[1 - r.dirIsNeg[a]][a]), o),
+                invDir),
+            scale);
+        t0 = _mm256_max_ps(tNearSlab, t0);
+        t1 = _mm256_min_ps(tFarSlab, t1);
+    }
+    _mm256_storeu_ps(tNear, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif  // PBRT_WIDEBVH_SSE && __AVX__
+
+// WideBVHAccel Method Definitions
+template <typename Node>
+WideBVHAccel<Node>::WideBVHAccel(BVHAccel &bvh,
+                                 std::shared_ptr<const PrimitiveStore> store)
+    : store(std::move(store)) {
+    ProfilePhase _(Prof::AccelConstruction);
+    if (!bvh.nodes) return;
+    bounds = bvh.nodes[0].bounds;
+
+    // Find the index in _store_ of each primitive the binary BVH refers to
+    std::vector<uint32_t> binaryOrder(bvh.primitives.size());
+    {
+        std::vector<std::pair<const Primitive *, uint32_t>> byAddress(
+            this->store->size());
+        for (size_t i = 0; i < byAddress.size(); ++i)
+            byAddress[i] = {(*this->store)[i].get(), uint32_t(i)};
+        std::sort(byAddress.begin(), byAddress.end());
+        for (size_t i = 0; i < binaryOrder.size(); ++i) {
+            auto iter = std::lower_bound(
+                byAddress.begin(), byAddress.end(),
+                std::make_pair((const Primitive *)bvh.primitives[i].get(),
+                               uint32_t(0)));
+            CHECK(iter != byAddress.end() &&
+                  iter->first == bvh.primitives[i].get());
+            binaryOrder[i] = iter->second;
+        }
+    }
+    std::vector<std::shared_ptr<Primitive>>().swap(bvh.primitives);
+
+    std::vector<Node> wideNodes(1);
+    primitiveIndices.reserve(binaryOrder.size());
+    collapse(bvh.nodes, 0, 0, binaryOrder, wideNodes);
+    size_t bytes = wideNodes.size() * sizeof(Node) +
+                   primitiveIndices.size() * sizeof(primitiveIndices[0]);
+    LOG(INFO) << StringPrintf("%d-wide BVH created with %d nodes for %d "
+                              "primitives (%.2f MB, %.1f bytes/primitive)",
+                              int(Node::Width), (int)wideNodes.size(),
+                              (int)this->store->size(),
+                              float(bytes) / (1024.f * 1024.f),
+                              float(bytes) / this->store->size());
+    wideTreeBytes += bytes + sizeof(*this);
+    wideBVHBytes += bytes;
+    wideBVHPrimitives += this->store->size();
+    nodes = AllocAligned<Node>(wideNodes.size());
+    std::copy(wideNodes.begin(), wideNodes.end(), nodes);
+}
+
+template <typename Node>
+void WideBVHAccel<Node>::collapse(const LinearBVHNode *binaryNodes, int index,
+                                  int nodeIndex,
+                                  const std::vector<uint32_t> &binaryOrder,
+                                  std::vector<Node> &wideNodes) {
+    // Gather up to _Node::Width_ children, repeatedly replacing the interior
+    // child with the largest surface area by its two children
+    int children[Node::Width], nChildren;
+    const LinearBVHNode &binaryNode = binaryNodes[index];
+    if (binaryNode.nPrimitives > 0) {
+        // Only a root that is a leaf is collapsed by itself
+        children[0] = index;
+        nChildren = 1;
+    } else {
+        children[0] = index + 1;
+        children[1] = binaryNode.secondChildOffset;
+        nChildren = 2;
+    }
+    while (nChildren < Node::Width) {
+        int open = -1;
+        Float maxArea = -1;
+        for (int i = 0; i < nChildren; ++i) {
+            const LinearBVHNode &child = binaryNodes[children[i]];
+            if (child.nPrimitives == 0 &&
+                child.bounds.SurfaceArea() > maxArea) {
+                open = i;
+                maxArea = child.bounds.SurfaceArea();
+            }
+        }
+        if (open == -1) break;
+        int c = children[open];
+        children[open] = c + 1;
+        children[nChildren++] = binaryNodes[c].secondChildOffset;
+    }
+
+    // Initialize the wide node; its interior children are allocated
+    // together and its leaf children's primitive indices are stored together
+    Node node = Node();
+    Bounds3f childBounds[Node::Width];
+    for (int i = 0; i < nChildren; ++i)
+        childBounds[i] = binaryNodes[children[i]].bounds;
+    InitChildBounds(&node, childBounds, nChildren);
+    int32_t offset[Node::Width];
+    for (int i = 0; i < nChildren; ++i) {
+        const LinearBVHNode &child = binaryNodes[children[i]];
+        if (child.nPrimitives == 0 ||
+            child.nPrimitives > Node::MaxLeafPrimitives) {
+            offset[i] = wideNodes.size();
+            wideNodes.push_back(Node());
+            node.nPrimitives[i] = 0;
+        } else {
+            offset[i] = primitiveIndices.size();
+            for (int j = 0; j < child.nPrimitives; ++j)
+                primitiveIndices.push_back(
+                    binaryOrder[child.primitivesOffset + j]);
+            node.nPrimitives[i] = child.nPrimitives;
+        }
+    }
+    InitChildOffsets(&node, offset, nChildren);
+    wideNodes[nodeIndex] = node;
+    ++totalWideNodes;
+    totalChildren += nChildren;
+
+    for (int i = 0; i < nChildren; ++i) {
+        const LinearBVHNode &child = binaryNodes[children[i]];
+        if (child.nPrimitives == 0)
+            collapse(binaryNodes, children[i], offset[i], binaryOrder,
+                     wideNodes);
+        else if (child.nPrimitives > Node::MaxLeafPrimitives)
+            splitLeaf(child.primitivesOffset, child.nPrimitives, child.bounds,
+                      offset[i], binaryOrder, wideNodes);
+    }
+}
+
+template <typename Node>
+void WideBVHAccel<Node>::splitLeaf(int primitivesOffset, int nPrimitives,
+                                   const Bounds3f &leafBounds, int nodeIndex,
+                                   const std::vector<uint32_t> &binaryOrder,
+                                   std::vector<Node> &wideNodes) {
+    // Spread a leaf with more primitives than _Node_ can count over the
+    // children of a new node that all have the leaf's bounds
+    Node node = Node();
+    int nChildren = std::min<int>(
+        Node::Width, (nPrimitives + Node::MaxLeafPrimitives - 1) /
+                         Node::MaxLeafPrimitives);
+    Bounds3f childBounds[Node::Width];
+    for (int i = 0; i < nChildren; ++i) childBounds[i] = leafBounds;
+    InitChildBounds(&node, childBounds, nChildren);
+    int32_t offset[Node::Width];
+    int split = -1;
+    for (int i = 0; i < nChildren; ++i) {
+        if (i == nChildren - 1 && nPrimitives > Node::MaxLeafPrimitives) {
+            split = offset[i] = wideNodes.size();
+            wideNodes.push_back(Node());
+            node.nPrimitives[i] = 0;
+        } else {
+            int n = std::min<int>(nPrimitives, Node::MaxLeafPrimitives);
+            offset[i] = primitiveIndices.size();
+            for (int j = 0; j < n; ++j)
+                primitiveIndices.push_back(binaryOrder[primitivesOffset + j]);
+            node.nPrimitives[i] = n;
+            primitivesOffset += n;
+            nPrimitives -= n;
+        }
+    }
+    InitChildOffsets(&node, offset, nChildren);
+    wideNodes[nodeIndex] = node;
+    ++totalWideNodes;
+    totalChildren += nChildren;
+    if (split != -1)
+        splitLeaf(primitivesOffset, nPrimitives, leafBounds, split,
+                  binaryOrder, wideNodes);
+}
+
+template <typename Node>
+WideBVHAccel<Node>::~WideBVHAccel() {
+    FreeAligned(nodes);
+}
+
+template <typename Node>
+bool WideBVHAccel<Node>::IntersectHit(const Ray &ray,
+                                      PrimitiveHit *closest) const {
+    if (!nodes) return false;
+    ProfilePhase p(Prof::AccelIntersect);
+    bool hit = false;
+    ChildRay r(ray);
+    // Follow ray through the nodes, visiting the nearest children first and
+    // skipping those that start beyond the closest hit found so far
+    WideBVHToVisit toVisit[(Node::Width - 1) * 64 + 1];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = {0, 0, 0};
+    while (toVisitOffset > 0) {
+        WideBVHToVisit v = toVisit[--toVisitOffset];
+        if (v.tMin > ray.tMax * (1 + 2 * gamma(3))) continue;
+        if (v.nPrimitives > 0) {
+            // Intersect ray with primitives in leaf
+            for (int i = 0; i < v.nPrimitives; ++i)
+                if ((*store)[primitiveIndices[v.offset + i]]->IntersectHit(
+                        ray, closest))
+                    hit = true;
+            continue;
+        }
+        const Node &node = nodes[v.offset];
+        Float tNear[Node::Width];
+        int hits = IntersectChildren(node, r, ray.tMax, tNear);
+        // Push the children that were hit farthest first
+        int order[Node::Width], nHits = 0;
+        for (int i = 0; i < Node::Width; ++i) {
+            if (!(hits & (1 << i))) continue;
+            int j = nHits++;
+            while (j > 0 && tNear[order[j - 1]] < tNear[i]) {
+                order[j] = order[j - 1];
+                --j;
+            }
+            order[j] = i;
+        }
+        int32_t offset[Node::Width];
+        ChildOffsets(node, offset);
+        for (int j = 0; j < nHits; ++j) {
+            int c = order[j];
+            toVisit[toVisitOffset++] = {offset[c], node.nPrimitives[c],
+                                        tNear[c]};
+        }
+    }
+    return hit;
+}
+
+template <typename Node>
+bool WideBVHAccel<Node>::IntersectP(const Ray &ray) const {
+    if (!nodes) return false;
+    ProfilePhase p(Prof::AccelIntersectP);
+    ChildRay r(ray);
+    // Any hit will do, so children are visited in whatever order they're in
+    WideBVHToVisit toVisit[(Node::Width - 1) * 64 + 1];
+    int toVisitOffset = 0;
+    toVisit[toVisitOffset++] = {0, 0, 0};
+    while (toVisitOffset > 0) {
+        WideBVHToVisit v = toVisit[--toVisitOffset];
+        if (v.nPrimitives > 0) {
+            for (int i = 0; i < v.nPrimitives; ++i)
+                if ((*store)[primitiveIndices[v.offset + i]]->IntersectP(ray))
+                    return true;
+            continue;
+        }
+        const Node &node = nodes[v.offset];
+        Float tNear[Node::Width];
+        int hits = IntersectChildren(node, r, ray.tMax, tNear);
+        int32_t offset[Node::Width];
+        ChildOffsets(node, offset);
+        for (int i = 0; i < Node::Width; ++i)
+            if (hits & (1 << i))
+                toVisit[toVisitOffset++] = {offset[i], node.nPrimitives[i],
+                                            tNear[i]};
+    }
+    return false;
+}
+
+template class WideBVHAccel<WideBVHNode<4>>;
+template class WideBVHAccel<WideBVHNode<8>>;
+template class WideBVHAccel<QuantizedWideBVHNode<4>>;
+template class WideBVHAccel<QuantizedWideBVHNode<8>>;
+
+std::shared_ptr<Primitive> CreateWideBVHAccelerator(
+    int width, std::shared_ptr<const PrimitiveStore> store,
+    const ParamSet &ps) {
+    // Build a binary BVH with the "bvh" parameters and collapse it
+    bool compressed = ps.FindOneBool("compressed", false);
+    std::shared_ptr<BVHAccel> bvh = CreateBVHAccelerator(*store, ps);
+    CHECK(width == 4 || width == 8);
+    if (compressed) {
+        if (width == 8)
+            return std::make_shared<WideBVHAccel<QuantizedWideBVHNode<8>>>(
+                *bvh, std::move(store));
+        return std::make_shared<WideBVHAccel<QuantizedWideBVHNode<4>>>(
+            *bvh, std::move(store));
+    }
+    if (width == 8)
+        return std::make_shared<WideBVHAccel<WideBVHNode<8>>>(
+            *bvh, std::move(store));
+    return std::make_shared<WideBVHAccel<WideBVHNode<4>>>(*bvh,
+                                                          std::move(store));
+}
+
+}  // namespace pbrt
@@ -0,0 +1,118 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_ACCELERATORS_WIDEBVH_H
+#define PBRT_ACCELERATORS_WIDEBVH_H
+
+// accelerators/widebvh.h*
+#include "pbrt.h"
+#include "primitive.h"
+#include "accelerators/bvh.h"
+
+namespace pbrt {
+
+// WideBVHAccel Declarations
+// Each node stores the bounds of its _N_ children as arrays over the
+// children, so that all of them can be tested against a ray at once.
+template <int N>
+struct WideBVHNode {
+    enum { Width = N, MaxLeafPrimitives = 65535 };
+    Float bounds[2][3][N];  // [pMin/pMax][axis][child]
+    // Interior child: node index; leaf child: first primitive index
+    int32_t offset[N];
+    uint16_t nPrimitives[N];  // 0 -> interior child
+    uint16_t pad[N];          // 128 or 256 bytes in total with _float_ bounds
+};
+
+// A _WideBVHNode_ with its children's bounds quantized to 8 bits along
+// each axis, relative to the bounds of all of them, and rounded outward.
+// Its interior children are consecutive nodes and its leaf children's
+// primitives are consecutive, so two offsets locate all of them: 52 or 80
+// bytes with _float_ bounds.
+template <int N>
+struct QuantizedWideBVHNode {
+    enum { Width = N, MaxLeafPrimitives = 255 };
+    // Child bounds are $\roman{origin} + q \, 2^\roman{exponent}$
+    Float origin[3];
+    int8_t exponent[3];
+    uint8_t nChildren;
+    uint8_t bounds[2][3][N];  // [pMin/pMax][axis][child]
+    // First interior child node and first primitive of the leaf children
+    int32_t childrenOffset, primitivesOffset;
+    uint8_t nPrimitives[N];  // 0 -> interior child
+};
+
+// A BVH with 4 ("qbvh") or 8 ("obvh") children per node, made by
+// collapsing the binary tree of a built _BVHAccel_ and traversed nearest
+// child first. _Node_ is one of the node types above. Leaves hold 32-bit
+// indices into a _PrimitiveStore_ rather than the primitives themselves.
+template <typename Node>
+class WideBVHAccel : public Aggregate {
+  public:
+    // WideBVHAccel Public Methods
+    // _bvh_ must have been built over the primitives in _store_; its
+    // primitives are released
+    WideBVHAccel(BVHAccel &bvh, std::shared_ptr<const PrimitiveStore> store);
+    Bounds3f WorldBound() const { return bounds; }
+    ~WideBVHAccel();
+    bool IntersectHit(const Ray &ray, PrimitiveHit *closest) const;
+    bool IntersectP(const Ray &ray) const;
+
+  private:
+    // WideBVHAccel Private Methods
+    void collapse(const LinearBVHNode *binaryNodes, int index,
+                  int nodeIndex, const std::vector<uint32_t> &binaryOrder,
+                  std::vector<Node> &wideNodes);
+    void splitLeaf(int primitivesOffset, int nPrimitives,
+                   const Bounds3f &leafBounds, int nodeIndex,
+                   const std::vector<uint32_t> &binaryOrder,
+                   std::vector<Node> &wideNodes);
+
+    // WideBVHAccel Private Data
+    std::shared_ptr<const PrimitiveStore> store;
+    std::vector<uint32_t> primitiveIndices;
+    Node *nodes = nullptr;
+    Bounds3f bounds;
+};
+
+std::shared_ptr<Primitive> CreateWideBVHAccelerator(
+    int width, std::shared_ptr<const PrimitiveStore> store,
+    const ParamSet &ps);
+
+}  // namespace pbrt
+
+#endif  // PBRT_ACCELERATORS_WIDEBVH_H
@@ -37,12 +37,16 @@
 #include "spectrum.h"
 #include "scene.h"
 #include "film.h"
+#include "imageio.h"
+#include "texcache.h"
 #include "medium.h"
+#include "parser.h"
 #include "stats.h"
 
 // API Additional Headers
 #include "accelerators/bvh.h"
 #include "accelerators/kdtreeaccel.h"
+#include "accelerators/widebvh.h"
 #include "cameras/environment.h"
 #include "cameras/orthographic.h"
 #include "cameras/perspective.h"
@@ -101,6 +105,9 @@
 #include "shapes/triangle.h"
 #include "shapes/plymesh.h"
 #include "shapes/quad.h"
+#include "shapes/quadmesh.h"
+#include "shapes/voxelchunk.h"
+#include "textures/atlas.h"
 #include "textures/bilerp.h"
 #include "textures/checkerboard.h"
 #include "textures/constant.h"
@@ -119,6 +126,8 @@
 #include "media/rayleigh.h"
 
 #include <map>
+#include <tuple>
+#include <unordered_map>
 #include <stdio.h>
 
 namespace pbrt {
@@ -376,6 +385,58 @@ static std::vector<GraphicsState> pushedGraphicsStates;
 static std::vector<TransformSet> pushedTransforms;
 static std::vector<uint32_t> pushedActiveTransformBits;
 static TransformCache transformCache;
+
+// Image and atlas textures are created on the thread pool while parsing
+// continues. Each pending texture is stored into the texture map that was
+// current when it was declared once a material, shape, or WorldEnd needs
+// the maps; textures are resolved in declaration order so that
+// redefinitions still replace earlier definitions.
+struct PendingTexture {
+    std::string name;
+    std::shared_future<std::shared_ptr<Texture<Float>>> floatTexture;
+    std::shared_ptr<GraphicsState::FloatTextureMap> floatTextures;
+    std::shared_future<std::shared_ptr<Texture<Spectrum>>> spectrumTexture;
+    std::shared_ptr<GraphicsState::SpectrumTextureMap> spectrumTextures;
+};
+static std::vector<PendingTexture> pendingTextures;
+
+STAT_COUNTER("Scene/Textures created asynchronously", nAsyncTextures);
+
+static void ResolvePendingTextures() {
+    for (PendingTexture &pending : pendingTextures) {
+        if (pending.floatTextures) {
+            std::shared_ptr<Texture<Float>> ft = pending.floatTexture.get();
+            if (ft) (*pending.floatTextures)[pending.name] = ft;
+        } else {
+            std::shared_ptr<Texture<Spectrum>> st =
+                pending.spectrumTexture.get();
+            if (st) (*pending.spectrumTextures)[pending.name] = st;
+        }
+    }
+    pendingTextures.clear();
+}
+
+// Runs _func_ on the thread pool, reporting its warnings and errors at the
+// parser's current location rather than wherever the parser is when it runs
+template <typename F>
+static auto RunAsyncAtParserLoc(F func) -> decltype(RunAsync(func)) {
+    std::shared_ptr<const Loc> loc;
+    if (parserLoc) loc = std::make_shared<const Loc>(*parserLoc);
+    return RunAsync([func, loc]() {
+        const Loc *prevLoc = threadParserLoc;
+        threadParserLoc = loc.get();
+        auto result = func();
+        threadParserLoc = prevLoc;
+        return result;
+    });
+}
+
+// Returns true for the texture types that read images, which are worth
+// creating asynchronously and don't refer to other textures.
+static bool IsImageTexture(const std::string &texname) {
+    return texname == "imagemap" || texname == "atlas";
+}
+
 int catIndentCount = 0;
 
 // API Forward Declarations
@@ -465,12 +526,20 @@ std::vector<std::shared_ptr<Shape>> MakeShapes(const std::string &name,
     else if (name == "quadz")
         s = CreateQuadZShape(object2world, world2object, reverseOrientation,
                              paramSet, &*graphicsState.floatTextures);
+    else if (name == "voxelchunk")
+        s = CreateVoxelChunkShape(object2world, world2object,
+                                  reverseOrientation, paramSet,
+                                  &*graphicsState.floatTextures);
     if (s != nullptr) shapes.push_back(s);
 
     // Create multiple-_Shape_ types
     else if (name == "curve")
         shapes = CreateCurveShape(object2world, world2object,
                                   reverseOrientation, paramSet);
+    else if (name == "quadmesh")
+        shapes = CreateQuadMeshShape(object2world, world2object,
+                                     reverseOrientation, paramSet,
+                                     &*graphicsState.floatTextures);
     else if (name == "trianglemesh") {
         if (PbrtOptions.toPly) {
             int nvi;
@@ -553,6 +622,7 @@ STAT_COUNTER("Scene/Materials created", nMaterialsCreated);
 std::shared_ptr<Material> MakeMaterial(const std::string &name,
                                        const TextureParams &mp) {
     Material *material = nullptr;
+    bool mixNeedsDifferentials = false, mixTexturesPeriodic = true;
     if (name == "" || name == "none")
         return nullptr;
     else if (name == "matte")
@@ -590,6 +660,10 @@ std::shared_ptr<Material> MakeMaterial(const std::string &name,
             mat2 = (*graphicsState.namedMaterials)[m2]->material;
 
         material = CreateMixMaterial(mp, mat1, mat2);
+        mixNeedsDifferentials = (mat1 && mat1->needsDifferentials) ||
+                                (mat2 && mat2->needsDifferentials);
+        mixTexturesPeriodic = (!mat1 || mat1->texturesPeriodic) &&
+                              (!mat2 || mat2->texturesPeriodic);
     } else if (name == "metal")
         material = CreateMetalMaterial(mp);
     else if (name == "substrate")
@@ -618,7 +692,13 @@ std::shared_ptr<Material> MakeMaterial(const std::string &name,
 
     mp.ReportUnused();
     if (!material) Error("Unable to create material \"%s\"", name.c_str());
-    else ++nMaterialsCreated;
+    else {
+        ++nMaterialsCreated;
+        material->needsDifferentials =
+            mp.TexturesNeedDifferentials() || mixNeedsDifferentials;
+        material->texturesPeriodic =
+            mp.TexturesPeriodic() && mixTexturesPeriodic;
+    }
     return std::shared_ptr<Material>(material);
 }
 
@@ -636,6 +716,8 @@ std::shared_ptr<Texture<Float>> MakeFloatTexture(const std::string &name,
         tex = CreateBilerpFloatTexture(tex2world, tp);
     else if (name == "imagemap")
         tex = CreateImageFloatTexture(tex2world, tp);
+    else if (name == "atlas")
+        tex = CreateAtlasFloatTexture(tex2world, tp);
     else if (name == "uv")
         tex = CreateUVFloatTexture(tex2world, tp);
     else if (name == "checkerboard")
@@ -672,6 +754,8 @@ std::shared_ptr<Texture<Spectrum>> MakeSpectrumTexture(
         tex = CreateBilerpSpectrumTexture(tex2world, tp);
     else if (name == "imagemap")
         tex = CreateImageSpectrumTexture(tex2world, tp);
+    else if (name == "atlas")
+        tex = CreateAtlasSpectrumTexture(tex2world, tp);
     else if (name == "uv")
         tex = CreateUVSpectrumTexture(tex2world, tp);
     else if (name == "checkerboard")
@@ -798,6 +882,14 @@ std::shared_ptr<Primitive> MakeAccelerator(
         accel = CreateBVHAccelerator(std::move(prims), paramSet);
     else if (name == "kdtree")
         accel = CreateKdTreeAccelerator(std::move(prims), paramSet);
+    else if (name == "qbvh")
+        accel = CreateWideBVHAccelerator(
+            4, std::make_shared<const PrimitiveStore>(std::move(prims)),
+            paramSet);
+    else if (name == "obvh")
+        accel = CreateWideBVHAccelerator(
+            8, std::make_shared<const PrimitiveStore>(std::move(prims)),
+            paramSet);
     else
         Warning("Accelerator \"%s\" unknown.", name.c_str());
     paramSet.ReportUnused();
@@ -909,6 +1001,7 @@ void pbrtInit(const Options &opt) {
 
 void pbrtCleanup() {
     // API Cleanup
+    ResolvePendingTextures();
     if (currentApiState == APIState::Uninitialized)
         Error("pbrtCleanup() called without pbrtInit().");
     else if (currentApiState == APIState::WorldBlock)
@@ -1219,41 +1312,85 @@ void pbrtTexture(const std::string &name, const std::string &type,
         return;
     }
 
+    // Textures that may refer to other textures are created right away,
+    // after any pending ones they might use
+    bool async = IsImageTexture(texname);
+    if (!async) ResolvePendingTextures();
+    auto isPending = [&](const std::string &name, bool isFloat) {
+        for (const PendingTexture &pending : pendingTextures)
+            if (pending.name == name && bool(pending.floatTextures) == isFloat)
+                return true;
+        return false;
+    };
     TextureParams tp(params, params, *graphicsState.floatTextures,
                      *graphicsState.spectrumTextures);
+    Transform tex2world = curTransform[0];
     if (type == "float") {
         // Create _Float_ texture and store in _floatTextures_
         if (graphicsState.floatTextures->find(name) !=
-            graphicsState.floatTextures->end())
+                graphicsState.floatTextures->end() ||
+            isPending(name, true))
             Warning("Texture \"%s\" being redefined", name.c_str());
         WARN_IF_ANIMATED_TRANSFORM("Texture");
-        std::shared_ptr<Texture<Float>> ft =
-            MakeFloatTexture(texname, curTransform[0], tp);
-        if (ft) {
-            // TODO: move this to be a GraphicsState method, also don't
-            // provide direct floatTextures access?
-            if (graphicsState.floatTexturesShared) {
-                graphicsState.floatTextures =
-                    std::make_shared<GraphicsState::FloatTextureMap>(*graphicsState.floatTextures);
-                graphicsState.floatTexturesShared = false;
-            }
-            (*graphicsState.floatTextures)[name] = ft;
+        // TODO: move this to be a GraphicsState method, also don't
+        // provide direct floatTextures access?
+        if (graphicsState.floatTexturesShared) {
+            // The copy must include the pending textures
+            ResolvePendingTextures();
+            graphicsState.floatTextures =
+                std::make_shared<GraphicsState::FloatTextureMap>(*graphicsState.floatTextures);
+            graphicsState.floatTexturesShared = false;
+        }
+        if (async) {
+            ++nAsyncTextures;
+            pendingTextures.push_back(PendingTexture());
+            PendingTexture &pending = pendingTextures.back();
+            pending.name = name;
+            pending.floatTextures = graphicsState.floatTextures;
+            pending.floatTexture = RunAsyncAtParserLoc(
+                [texname, tex2world, params]() {
+                    GraphicsState::FloatTextureMap noFloatTextures;
+                    GraphicsState::SpectrumTextureMap noSpectrumTextures;
+                    TextureParams tp(params, params, noFloatTextures,
+                                     noSpectrumTextures);
+                    return MakeFloatTexture(texname, tex2world, tp);
+                });
+        } else {
+            std::shared_ptr<Texture<Float>> ft =
+                MakeFloatTexture(texname, tex2world, tp);
+            if (ft) (*graphicsState.floatTextures)[name] = ft;
         }
     } else if (type == "color" || type == "spectrum") {
         // Create _color_ texture and store in _spectrumTextures_
         if (graphicsState.spectrumTextures->find(name) !=
-            graphicsState.spectrumTextures->end())
+                graphicsState.spectrumTextures->end() ||
+            isPending(name, false))
             Warning("Texture \"%s\" being redefined", name.c_str());
         WARN_IF_ANIMATED_TRANSFORM("Texture");
-        std::shared_ptr<Texture<Spectrum>> st =
-            MakeSpectrumTexture(texname, curTransform[0], tp);
-        if (st) {
-            if (graphicsState.spectrumTexturesShared) {
-                graphicsState.spectrumTextures =
-                    std::make_shared<GraphicsState::SpectrumTextureMap>(*graphicsState.spectrumTextures);
-                graphicsState.spectrumTexturesShared = false;
-            }
-            (*graphicsState.spectrumTextures)[name] = st;
+        if (graphicsState.spectrumTexturesShared) {
+            ResolvePendingTextures();
+            graphicsState.spectrumTextures =
+                std::make_shared<GraphicsState::SpectrumTextureMap>(*graphicsState.spectrumTextures);
+            graphicsState.spectrumTexturesShared = false;
+        }
+        if (async) {
+            ++nAsyncTextures;
+            pendingTextures.push_back(PendingTexture());
+            PendingTexture &pending = pendingTextures.back();
+            pending.name = name;
+            pending.spectrumTextures = graphicsState.spectrumTextures;
+            pending.spectrumTexture = RunAsyncAtParserLoc(
+                [texname, tex2world, params]() {
+                    GraphicsState::FloatTextureMap noFloatTextures;
+                    GraphicsState::SpectrumTextureMap noSpectrumTextures;
+                    TextureParams tp(params, params, noFloatTextures,
+                                     noSpectrumTextures);
+                    return MakeSpectrumTexture(texname, tex2world, tp);
+                });
+        } else {
+            std::shared_ptr<Texture<Spectrum>> st =
+                MakeSpectrumTexture(texname, tex2world, tp);
+            if (st) (*graphicsState.spectrumTextures)[name] = st;
         }
     } else
         Error("Texture type \"%s\" unknown.", type.c_str());
@@ -1261,6 +1398,7 @@ void pbrtTexture(const std::string &name, const std::string &type,
 
 void pbrtMaterial(const std::string &name, const ParamSet &params) {
     VERIFY_WORLD("Material");
+    ResolvePendingTextures();
     ParamSet emptyParams;
     TextureParams mp(params, emptyParams, *graphicsState.floatTextures,
                      *graphicsState.spectrumTextures);
@@ -1277,6 +1415,7 @@ void pbrtMaterial(const std::string &name, const ParamSet &params) {
 
 void pbrtMakeNamedMaterial(const std::string &name, const ParamSet &params) {
     VERIFY_WORLD("MakeNamedMaterial");
+    ResolvePendingTextures();
     // error checking, warning if replace, what to use for transform?
     ParamSet emptyParams;
     TextureParams mp(params, emptyParams, *graphicsState.floatTextures,
@@ -1350,6 +1489,7 @@ void pbrtAreaLightSource(const std::string &name, const ParamSet &params) {
 
 void pbrtShape(const std::string &name, const ParamSet &params) {
     VERIFY_WORLD("Shape");
+    ResolvePendingTextures();
     std::vector<std::shared_ptr<Primitive>> prims;
     std::vector<std::shared_ptr<AreaLight>> areaLights;
     if (PbrtOptions.cat || (PbrtOptions.toPly && name != "trianglemesh")) {
@@ -1453,9 +1593,16 @@ bool shapeMaySetMaterialParameters(const ParamSet &ps) {
         if (param->name != "alpha" && param->name != "shadowalpha")
             return true;
 
-    // Special case spheres, which are the most common non-mesh primitive.
+    // Special case spheres, which are the most common non-mesh primitive,
+    // and the quads that block faces are exported as.
+    static const char *shapeFloats[] = {"radius", "l1", "l2", "dir", "u0",
+                                        "v0", "u1", "v1", "alpha"};
     for (const auto &param : ps.floats)
-        if (param->nValues == 1 && param->name != "radius")
+        if (param->nValues == 1 &&
+            std::find_if(std::begin(shapeFloats), std::end(shapeFloats),
+                         [&](const char *name) {
+                             return param->name == name;
+                         }) == std::end(shapeFloats))
             return true;
 
     // Extra special case strings, since plymesh uses "filename", curve "type",
@@ -1611,6 +1758,7 @@ void pbrtObjectInstance(const std::string &name) {
 
 void pbrtWorldEnd() {
     VERIFY_WORLD("WorldEnd");
+    ResolvePendingTextures();
     // Ensure there are no pushed graphics states
     while (pushedGraphicsStates.size()) {
         Warning("Missing end to pbrtAttributeBegin()");
@@ -1628,6 +1776,9 @@ void pbrtWorldEnd() {
     } else {
         std::unique_ptr<Integrator> integrator(renderOptions->MakeIntegrator());
         std::unique_ptr<Scene> scene(renderOptions->MakeScene());
+        // All textures have been created, so decoded images are no longer
+        // needed
+        ClearDecodedImageCache();
 
         // This is kind of ugly; we directly override the current profiler
         // state to switch from parsing/scene construction related stuff to
@@ -1651,6 +1802,11 @@ void pbrtWorldEnd() {
     currentApiState = APIState::OptionsBlock;
     ImageTexture<Float, Float>::ClearCache();
     ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    ImageTexture<RGBA8, Spectrum>::ClearCache();
+    AtlasTexture<Float, Float>::ClearCache();
+    AtlasTexture<RGBSpectrum, Spectrum>::ClearCache();
+    TextureAreaLight::ClearCache();
+    ClearTextureCache();
     renderOptions.reset(new RenderOptions);
 
     if (!PbrtOptions.cat && !PbrtOptions.toPly) {
@@ -1670,7 +1826,239 @@ void pbrtWorldEnd() {
                                  namedCoordinateSystems.end());
 }
 
+STAT_PERCENT("Scene/Hidden quads culled", nCulledQuads, nCullCandidates);
+
+// Removes pairs of coplanar, fully overlapping quads that face in opposite
+// directions, such as the two faces between adjacent opaque blocks. Only
+// quads without alpha, area lights, or light-transmitting materials are
+// considered, since neither face of such a pair can ever be seen.
+void CullHiddenQuads(std::vector<std::shared_ptr<Primitive>> *prims) {
+    ProfilePhase _(Prof::SceneConstruction);
+    // Quantize face bounds so that faces from different transformations
+    // still match up
+    struct FaceKey {
+        int axis;
+        int64_t p[6];
+        bool operator==(const FaceKey &k) const {
+            return axis == k.axis && std::equal(p, p + 6, k.p);
+        }
+    };
+    struct FaceKeyHash {
+        size_t operator()(const FaceKey &k) const {
+            size_t h = k.axis;
+            for (int i = 0; i < 6; ++i)
+                h = h * 0x9e3779b97f4a7c15ull + std::hash<int64_t>()(k.p[i]);
+            return h;
+        }
+    };
+    // Indices of the candidate quads facing the positive and negative
+    // directions for each face
+    std::unordered_map<FaceKey, std::vector<size_t>[2], FaceKeyHash> faces;
+    for (size_t i = 0; i < prims->size(); ++i) {
+        const GeometricPrimitive *prim =
+            dynamic_cast<const GeometricPrimitive *>((*prims)[i].get());
+        if (!prim || prim->GetAreaLight() || !prim->GetMaterial() ||
+            !prim->GetMaterial()->IsOpaque())
+            continue;
+        QuadFace face;
+        if (!GetQuadFace(*prim->GetShape(), &face) || face.alphaMask) continue;
+        ++nCullCandidates;
+        FaceKey key;
+        key.axis = face.axis;
+        for (int c = 0; c < 3; ++c) {
+            key.p[c] = std::llround(face.bounds.pMin[c] * 4096);
+            key.p[3 + c] = std::llround(face.bounds.pMax[c] * 4096);
+        }
+        faces[key][face.positive ? 0 : 1].push_back(i);
+    }
+
+    // Drop both quads of each back-to-back pair
+    std::vector<bool> culled(prims->size(), false);
+    for (const auto &f : faces) {
+        size_t nPairs = std::min(f.second[0].size(), f.second[1].size());
+        for (size_t j = 0; j < nPairs; ++j)
+            culled[f.second[0][j]] = culled[f.second[1][j]] = true;
+        nCulledQuads += 2 * nPairs;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < prims->size(); ++i)
+        if (!culled[i]) (*prims)[n++] = std::move((*prims)[i]);
+    LOG(INFO) << "Culled " << prims->size() - n << " hidden quads";
+    prims->resize(n);
+}
+
+STAT_COUNTER("Scene/Quads merged", nQuadsMerged);
+STAT_COUNTER("Scene/Merged quads created", nMergedQuadsCreated);
+
+// Greedily replaces rectangles of adjacent, coplanar quads that share a
+// material, medium, alpha texture, tint and texture rectangle with single
+// larger quads. The merged quad's texture coordinates run once over the original
+// rectangle per quad it covers, so only quads whose rectangles span whole
+// texture periods, and whose material and alpha textures all repeat with
+// that period, are merged; their textures then tile exactly as before.
+void MergeCoplanarQuads(std::vector<std::shared_ptr<Primitive>> *prims) {
+    ProfilePhase _(Prof::SceneConstruction);
+    // Quads that end up under the same key are on the same plane, share
+    // their orientation and appearance, and lie on the same grid
+    struct MergeKey {
+        int frame[3];
+        bool reverseOrientation;
+        int objectAxis;
+        Float l1, l2, dir, u0, v0, u1, v1, tint[3];
+        const Material *material;
+        const Texture<Float> *alphaMask;
+        const Medium *inside, *outside;
+        int64_t plane, uOffset, vOffset;
+        bool operator<(const MergeKey &k) const {
+            return std::tie(frame[0], frame[1], frame[2], reverseOrientation,
+                            objectAxis, l1, l2, dir, u0, v0, u1, v1, tint[0],
+                            tint[1], tint[2], material, alphaMask, inside,
+                            outside, plane, uOffset, vOffset) <
+                   std::tie(k.frame[0], k.frame[1], k.frame[2],
+                            k.reverseOrientation, k.objectAxis, k.l1, k.l2,
+                            k.dir, k.u0, k.v0, k.u1, k.v1, k.tint[0],
+                            k.tint[1], k.tint[2], k.material,
+                            k.alphaMask, k.inside, k.outside, k.plane,
+                            k.uOffset, k.vOffset);
+        }
+    };
+    static const int uAxis[3] = {1, 0, 1};
+    static const int vAxis[3] = {2, 2, 0};
+    // Splits a world-space coordinate, in units of the quad size, into a
+    // grid cell and the grid's offset from the origin
+    auto gridCell = [](Float x, int64_t *offset) {
+        int64_t q = std::llround(x * 4096);
+        *offset = ((q % 4096) + 4096) % 4096;
+        return (q - *offset) / 4096;
+    };
+
+    // Bucket the candidate quads by _MergeKey_, indexing them by grid cell
+    std::map<MergeKey, std::map<std::pair<int64_t, int64_t>, size_t>> groups;
+    std::vector<QuadFace> faces(prims->size());
+    for (size_t i = 0; i < prims->size(); ++i) {
+        const GeometricPrimitive *prim =
+            dynamic_cast<const GeometricPrimitive *>((*prims)[i].get());
+        if (!prim || prim->GetAreaLight() ||
+            (prim->GetMaterial() && !prim->GetMaterial()->texturesPeriodic))
+            continue;
+        QuadFace &face = faces[i];
+        const Shape &shape = *prim->GetShape();
+        if (!GetQuadFace(shape, &face) ||
+            (face.alphaMask && !face.alphaMask->IsPeriodic()))
+            continue;
+        Float Du = face.u1 - face.u0, Dv = face.v1 - face.v0;
+        if (Du == 0 || Dv == 0 || Du != std::round(Du) || Dv != std::round(Dv))
+            continue;
+
+        MergeKey key;
+        int ua = uAxis[face.objectAxis], va = vAxis[face.objectAxis];
+        Vector3f uWorld, vWorld;
+        for (int c = 0; c < 3; ++c) {
+            Vector3f e;
+            e[c] = 1;
+            e = (*shape.ObjectToWorld)(e);
+            int axis = e.x != 0 ? 0 : (e.y != 0 ? 1 : 2);
+            key.frame[c] = 2 * axis + (e[axis] < 0 ? 1 : 0);
+            if (c == ua) uWorld = e;
+            if (c == va) vWorld = e;
+        }
+        key.reverseOrientation = shape.reverseOrientation;
+        key.objectAxis = face.objectAxis;
+        key.l1 = face.l1;
+        key.l2 = face.l2;
+        key.dir = face.dir;
+        key.u0 = face.u0;
+        key.v0 = face.v0;
+        key.u1 = face.u1;
+        key.v1 = face.v1;
+        face.tint.ToRGB(key.tint);
+        key.material = prim->GetMaterial();
+        key.alphaMask = face.alphaMask.get();
+        key.inside = prim->GetMediumInterface().inside;
+        key.outside = prim->GetMediumInterface().outside;
+        Point3f pCenter = (*shape.ObjectToWorld)(face.pObj);
+        key.plane = std::llround(pCenter[face.axis] * 4096);
+        int64_t i0 = gridCell(Dot(Vector3f(pCenter), uWorld) / face.l1,
+                              &key.uOffset);
+        int64_t j0 = gridCell(Dot(Vector3f(pCenter), vWorld) / face.l2,
+                              &key.vOffset);
+        // Exact duplicates are left alone
+        groups[key].insert(std::make_pair(std::make_pair(j0, i0), i));
+    }
+
+    // Cover each group's cells with rectangles, growing each one first
+    // along its row and then by whole rows
+    std::vector<bool> merged(prims->size(), false);
+    std::vector<std::shared_ptr<Primitive>> newPrims;
+    for (auto &group : groups) {
+        auto &cells = group.second;
+        while (!cells.empty()) {
+            int64_t j0 = cells.begin()->first.first;
+            int64_t i0 = cells.begin()->first.second;
+            size_t first = cells.begin()->second;
+            int w = 1, h = 1;
+            while (cells.count(std::make_pair(j0, i0 + w))) ++w;
+            while (true) {
+                bool rowFull = true;
+                for (int k = 0; k < w && rowFull; ++k)
+                    rowFull = cells.count(std::make_pair(j0 + h, i0 + k)) != 0;
+                if (!rowFull) break;
+                ++h;
+            }
+            for (int dj = 0; dj < h; ++dj)
+                for (int di = 0; di < w; ++di) {
+                    auto iter = cells.find(std::make_pair(j0 + dj, i0 + di));
+                    if (w * h > 1) merged[iter->second] = true;
+                    cells.erase(iter);
+                }
+            if (w * h == 1) continue;
+
+            // Create the merged quad, centered on the rectangle
+            const GeometricPrimitive *prim =
+                static_cast<const GeometricPrimitive *>((*prims)[first].get());
+            const Shape &shape = *prim->GetShape();
+            const QuadFace &f = faces[first];
+            Vector3f offset;
+            offset[uAxis[f.objectAxis]] = (w - 1) * f.l1 / 2;
+            offset[vAxis[f.objectAxis]] = (h - 1) * f.l2 / 2;
+            Transform o2w = *shape.ObjectToWorld *
+                            Translate(Vector3f(f.pObj + offset));
+            Transform *ObjToWorld = transformCache.Lookup(o2w);
+            Transform *WorldToObj = transformCache.Lookup(Inverse(o2w));
+            Float l1 = w * f.l1, l2 = h * f.l2;
+            Float u1 = f.u0 + w * (f.u1 - f.u0), v1 = f.v0 + h * (f.v1 - f.v0);
+            std::shared_ptr<Shape> quad;
+            if (f.objectAxis == 0)
+                quad = std::make_shared<QuadX>(
+                    ObjToWorld, WorldToObj, shape.reverseOrientation, l1, l2,
+                    f.dir, f.u0, f.v0, u1, v1, f.alphaMask, f.tint);
+            else if (f.objectAxis == 1)
+                quad = std::make_shared<QuadY>(
+                    ObjToWorld, WorldToObj, shape.reverseOrientation, l1, l2,
+                    f.dir, f.u0, f.v0, u1, v1, f.alphaMask, f.tint);
+            else
+                quad = std::make_shared<QuadZ>(
+                    ObjToWorld, WorldToObj, shape.reverseOrientation, l1, l2,
+                    f.dir, f.u0, f.v0, u1, v1, f.alphaMask, f.tint);
+            newPrims.push_back(std::make_shared<GeometricPrimitive>(
+                quad, prim->GetSharedMaterial(), nullptr,
+                prim->GetMediumInterface()));
+            nQuadsMerged += w * h;
+            ++nMergedQuadsCreated;
+        }
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < prims->size(); ++i)
+        if (!merged[i]) (*prims)[n++] = std::move((*prims)[i]);
+    prims->resize(n);
+    LOG(INFO) << "Merged quads into " << newPrims.size() << " larger quads";
+    prims->insert(prims->end(), newPrims.begin(), newPrims.end());
+}
+
 Scene *RenderOptions::MakeScene() {
+    if (PbrtOptions.cullHiddenFaces) CullHiddenQuads(&primitives);
+    if (PbrtOptions.mergeQuads) MergeCoplanarQuads(&primitives);
     std::shared_ptr<Primitive> accelerator =
         MakeAccelerator(AcceleratorName, std::move(primitives), AcceleratorParams);
     if (!accelerator) accelerator = std::make_shared<BVHAccel>(primitives);
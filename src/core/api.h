@@ -91,6 +91,13 @@ void pbrtWorldEnd();
 void pbrtParseFile(std::string filename);
 void pbrtParseString(std::string str);
 
+// Scene Preprocessing Declarations
+
+// Applied to the scene's primitives for the --cullfaces and --mergefaces
+// options
+void CullHiddenQuads(std::vector<std::shared_ptr<Primitive>> *prims);
+void MergeCoplanarQuads(std::vector<std::shared_ptr<Primitive>> *prims);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_API_H
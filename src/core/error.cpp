@@ -59,7 +59,7 @@ static std::string StringVaprintf(const std::string &fmt, va_list args) {
     return str;
 }
 
-static void processError(Loc *loc, const char *format, va_list args,
+static void processError(const Loc *loc, const char *format, va_list args,
                          const char *errorType) {
     // Build up an entire formatted error string and print it all at once;
     // this way, if multiple threads are printing messages at once, they
@@ -90,14 +90,16 @@ void Warning(const char *format, ...) {
     if (PbrtOptions.quiet) return;
     va_list args;
     va_start(args, format);
-    processError(parserLoc, format, args, "Warning");
+    processError(threadParserLoc ? threadParserLoc : parserLoc, format, args,
+                 "Warning");
     va_end(args);
 }
 
 void Error(const char *format, ...) {
     va_list args;
     va_start(args, format);
-    processError(parserLoc, format, args, "Error");
+    processError(threadParserLoc ? threadParserLoc : parserLoc, format, args,
+                 "Error");
     va_end(args);
 }
 
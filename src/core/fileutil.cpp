@@ -35,8 +35,13 @@
 #include "fileutil.h"
 #include <cstdlib>
 #include <climits>
-#ifndef PBRT_IS_WINDOWS
+#include <algorithm>
+#ifdef PBRT_IS_WINDOWS
+#include <windows.h>
+#else
 #include <libgen.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #endif
 
 namespace pbrt {
@@ -88,6 +93,24 @@ std::string DirectoryContaining(const std::string &filename) {
     return filename;
 }
 
+static void ListFiles(const std::string &dirname, const std::string &prefix,
+                      const std::string &extension,
+                      std::vector<std::string> *files) {
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((dirname + "\\*").c_str(), &data);
+    if (find == INVALID_HANDLE_VALUE) return;
+    do {
+        std::string name = data.cFileName;
+        if (name == "." || name == "..") continue;
+        if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            ListFiles(dirname + "\\" + name, prefix + name + "/", extension,
+                      files);
+        else if (HasExtension(name, extension))
+            files->push_back(prefix + name);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+}
+
 #else
 
 bool IsAbsolutePath(const std::string &filename) {
@@ -120,8 +143,35 @@ std::string DirectoryContaining(const std::string &filename) {
     return result;
 }
 
+static void ListFiles(const std::string &dirname, const std::string &prefix,
+                      const std::string &extension,
+                      std::vector<std::string> *files) {
+    DIR *dir = opendir(dirname.c_str());
+    if (!dir) return;
+    while (struct dirent *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..") continue;
+        std::string path = dirname + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) continue;
+        if (S_ISDIR(st.st_mode))
+            ListFiles(path, prefix + name + "/", extension, files);
+        else if (HasExtension(name, extension))
+            files->push_back(prefix + name);
+    }
+    closedir(dir);
+}
+
 #endif
 
+std::vector<std::string> ListFiles(const std::string &dirname,
+                                   const std::string &extension) {
+    std::vector<std::string> files;
+    ListFiles(dirname, "", extension, &files);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
 void SetSearchDirectory(const std::string &dirname) {
     searchDirectory = dirname;
 }
@@ -41,6 +41,7 @@
 // core/fileutil.h*
 #include "pbrt.h"
 #include <string>
+#include <vector>
 #include <cctype>
 #include <string.h>
 
@@ -52,6 +53,11 @@ std::string AbsolutePath(const std::string &filename);
 std::string ResolveFilename(const std::string &filename);
 std::string DirectoryContaining(const std::string &filename);
 void SetSearchDirectory(const std::string &dirname);
+// Returns the paths, relative to _dirname_ and with '/' separators, of the
+// files under _dirname_ and its subdirectories whose names end in
+// _extension_, in sorted order.
+std::vector<std::string> ListFiles(const std::string &dirname,
+                                   const std::string &extension);
 
 inline bool HasExtension(const std::string &value, const std::string &ending) {
     if (ending.size() > value.size()) return false;
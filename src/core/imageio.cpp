@@ -35,7 +35,12 @@
 #include "ext/lodepng.h"
 #include "ext/targa.h"
 #include "fileutil.h"
+#include "parallel.h"
 #include "spectrum.h"
+#include "stats.h"
+#include <algorithm>
+#include <map>
+#include <mutex>
 
 #include <ImfRgba.h>
 #include <ImfRgbaFile.h>
@@ -50,8 +55,12 @@ static void WriteImageTGA(const std::string &name, const uint8_t *pixels,
                           int xRes, int yRes, int totalXRes, int totalYRes,
                           int xOffset, int yOffset);
 static RGBSpectrum *ReadImageTGA(const std::string &name, int *w, int *h);
-static RGBSpectrum *ReadImagePNG(const std::string &name, int *w, int *h);
-static float *ReadImagePNGAlpha(const std::string &name, int *w, int *h);
+static RGBSpectrum *ReadImage8(const std::string &name, int *w, int *h);
+static float *ReadImage8Alpha(const std::string &name, int *w, int *h,
+                              bool alphaChannel);
+static RGBA8 *ReadImage8RGBA8(const std::string &name, int *w, int *h);
+static std::shared_ptr<const DecodedImage> DecodePaletted(
+    const std::string &name);
 static bool WriteImagePFM(const std::string &filename, const Float *rgb,
                           int xres, int yres);
 static RGBSpectrum *ReadImagePFM(const std::string &filename, int *xres,
@@ -66,9 +75,9 @@ std::unique_ptr<RGBSpectrum[]> ReadImage(const std::string &name,
     else if (HasExtension(name, ".tga"))
         return std::unique_ptr<RGBSpectrum[]>(
             ReadImageTGA(name, &resolution->x, &resolution->y));
-    else if (HasExtension(name, ".png"))
+    else if (HasExtension(name, ".png") || IsPalettedImageFile(name))
         return std::unique_ptr<RGBSpectrum[]>(
-            ReadImagePNG(name, &resolution->x, &resolution->y));
+            ReadImage8(name, &resolution->x, &resolution->y));
     else if (HasExtension(name, ".pfm"))
         return std::unique_ptr<RGBSpectrum[]>(
             ReadImagePFM(name, &resolution->x, &resolution->y));
@@ -80,10 +89,23 @@ std::unique_ptr<RGBSpectrum[]> ReadImage(const std::string &name,
 }
 
 std::unique_ptr<Float[]> ReadImageAlpha(const std::string &name,
+                                        Point2i *resolution,
+                                        bool alphaChannel) {
+    if (HasExtension(name, ".png") || IsPalettedImageFile(name))
+        return std::unique_ptr<Float[]>(ReadImage8Alpha(
+            name, &resolution->x, &resolution->y, alphaChannel));
+    Error("Unable to load image stored in format \"%s\" for filename \"%s\".",
+          strrchr(name.c_str(), '.') ? (strrchr(name.c_str(), '.') + 1)
+                                     : "(unknown)",
+          name.c_str());
+    return nullptr;
+}
+
+std::unique_ptr<RGBA8[]> ReadImageRGBA8(const std::string &name,
                                         Point2i *resolution) {
-    if (HasExtension(name, ".png"))
-        return std::unique_ptr<Float[]>(
-            ReadImagePNGAlpha(name, &resolution->x, &resolution->y));
+    if (HasExtension(name, ".png") || IsPalettedImageFile(name))
+        return std::unique_ptr<RGBA8[]>(
+            ReadImage8RGBA8(name, &resolution->x, &resolution->y));
     Error("Unable to load image stored in format \"%s\" for filename \"%s\".",
           strrchr(name.c_str(), '.') ? (strrchr(name.c_str(), '.') + 1)
                                      : "(unknown)",
@@ -268,67 +290,117 @@ static RGBSpectrum *ReadImageTGA(const std::string &name, int *width,
     return ret;
 }
 
-static RGBSpectrum *ReadImagePNG(const std::string &name, int *width,
-                                 int *height) {
-    unsigned char *rgb;
+// DecodedImage Cache Definitions
+STAT_COUNTER("Texture/8-bit images decoded", nImagesDecoded);
+STAT_PERCENT("Texture/Decoded image cache hits", nDecodedImageHits,
+             nDecodedImageLookups);
+
+static std::mutex decodedImagesMutex;
+static std::map<std::string, std::shared_ptr<const DecodedImage>>
+    decodedImages;
+
+static std::shared_ptr<const DecodedImage> DecodePNG(const std::string &name) {
+    unsigned char *rgba;
     unsigned w, h;
-    unsigned int error = lodepng_decode24_file(&rgb, &w, &h, name.c_str());
-    unsigned int ch = 3;
+    unsigned int error = lodepng_decode32_file(&rgba, &w, &h, name.c_str());
     if (error != 0) {
-        error = lodepng_decode32_file(&rgb, &w, &h, name.c_str());
-        ch = 4;
-        if(error != 0) {
-            Error("Error reading PNG \"%s\": %s", name.c_str(),
-                  lodepng_error_text(error));
-            return nullptr;
-        }
+        Error("Error reading PNG \"%s\": %s", name.c_str(),
+              lodepng_error_text(error));
+        return nullptr;
     }
-    *width = w;
-    *height = h;
+    std::shared_ptr<DecodedImage> image = std::make_shared<DecodedImage>();
+    image->resolution = Point2i(w, h);
+    image->texels.reset(new RGBA8[w * h]);
+    const unsigned char *src = rgba;
+    for (unsigned int i = 0; i < w * h; ++i, src += 4)
+        image->texels[i] = RGBA8{src[0], src[1], src[2], src[3]};
+    free(rgba);
+    ++nImagesDecoded;
+    LOG(INFO) << StringPrintf("Read PNG image %s (%d x %d)", name.c_str(), w,
+                              h);
+    return image;
+}
 
-    RGBSpectrum *ret = new RGBSpectrum[*width * *height];
-    unsigned char *src = rgb;
-    for (unsigned int y = 0; y < h; ++y) {
-        for (unsigned int x = 0; x < w; ++x, src += ch) {
-            Float c[3];
-            c[0] = src[0] / 255.f;
-            c[1] = src[1] / 255.f;
-            c[2] = src[2] / 255.f;
-            ret[y * *width + x] = RGBSpectrum::FromRGB(c);
+std::shared_ptr<const DecodedImage> GetDecodedImage(const std::string &name) {
+    ++nDecodedImageLookups;
+    {
+        std::lock_guard<std::mutex> lock(decodedImagesMutex);
+        auto iter = decodedImages.find(name);
+        if (iter != decodedImages.end()) {
+            ++nDecodedImageHits;
+            return iter->second;
         }
     }
+    // Decode without holding the lock so that other images can be decoded
+    // concurrently; failures are cached too, so they're reported once
+    std::shared_ptr<const DecodedImage> image =
+        IsPalettedImageFile(name) ? DecodePaletted(name) : DecodePNG(name);
+    std::lock_guard<std::mutex> lock(decodedImagesMutex);
+    return decodedImages.insert(std::make_pair(name, image)).first->second;
+}
 
-    free(rgb);
-    LOG(INFO) << StringPrintf("Read PNG image %s (%d x %d)",
-                              name.c_str(), *width, *height);
-    return ret;
+void PreloadDecodedImages(const std::vector<std::string> &names) {
+    std::vector<std::string> pngs;
+    {
+        std::lock_guard<std::mutex> lock(decodedImagesMutex);
+        for (const std::string &name : names)
+            if ((HasExtension(name, ".png") || IsPalettedImageFile(name)) &&
+                decodedImages.find(name) == decodedImages.end())
+                pngs.push_back(name);
+    }
+    std::sort(pngs.begin(), pngs.end());
+    pngs.erase(std::unique(pngs.begin(), pngs.end()), pngs.end());
+    ParallelFor([&](int64_t i) { GetDecodedImage(pngs[i]); }, pngs.size());
 }
 
-static float *ReadImagePNGAlpha(const std::string &name, int *width,
-                                 int *height) {
-    unsigned char *rgb;
-    unsigned w, h;
-    unsigned int error = lodepng_decode32_file(&rgb, &w, &h, name.c_str());
-    unsigned int ch = 4;
-    if (error != 0) {
-        Error("Error reading PNG \"%s\": %s", name.c_str(),
-              lodepng_error_text(error));
-        return nullptr;
+void ClearDecodedImageCache() {
+    std::lock_guard<std::mutex> lock(decodedImagesMutex);
+    decodedImages.clear();
+}
+
+static RGBSpectrum *ReadImage8(const std::string &name, int *width,
+                               int *height) {
+    std::shared_ptr<const DecodedImage> image = GetDecodedImage(name);
+    if (!image) return nullptr;
+    *width = image->resolution.x;
+    *height = image->resolution.y;
+
+    RGBSpectrum *ret = new RGBSpectrum[*width * *height];
+    for (int i = 0; i < *width * *height; ++i) {
+        const RGBA8 &texel = image->texels[i];
+        Float c[3];
+        c[0] = texel.r / 255.f;
+        c[1] = texel.g / 255.f;
+        c[2] = texel.b / 255.f;
+        ret[i] = RGBSpectrum::FromRGB(c);
     }
-    *width = w;
-    *height = h;
+    return ret;
+}
+
+static float *ReadImage8Alpha(const std::string &name, int *width,
+                              int *height, bool alphaChannel) {
+    std::shared_ptr<const DecodedImage> image = GetDecodedImage(name);
+    if (!image) return nullptr;
+    *width = image->resolution.x;
+    *height = image->resolution.y;
 
     float *ret = new float[*width * *height];
-    unsigned char *src = rgb;
-    for (unsigned int y = 0; y < h; ++y) {
-        for (unsigned int x = 0; x < w; ++x, src += ch) {
-            ret[y * *width + x] = (*src)/255.;
-        }
-    }
+    for (int i = 0; i < *width * *height; ++i)
+        ret[i] = (alphaChannel ? image->texels[i].a : image->texels[i].r) /
+                 255.;
+    return ret;
+}
 
-    free(rgb);
-    LOG(INFO) << StringPrintf("Read PNG image %s (%d x %d)",
-                              name.c_str(), *width, *height);
+static RGBA8 *ReadImage8RGBA8(const std::string &name, int *width,
+                              int *height) {
+    std::shared_ptr<const DecodedImage> image = GetDecodedImage(name);
+    if (!image) return nullptr;
+    *width = image->resolution.x;
+    *height = image->resolution.y;
+
+    RGBA8 *ret = new RGBA8[*width * *height];
+    std::copy(image->texels.get(),
+              image->texels.get() + *width * *height, ret);
     return ret;
 }
 
@@ -527,4 +599,131 @@ fail:
     return false;
 }
 
+// Paletted Image Definitions
+
+// Paletted image files hold an RGBA palette of at most 256 colors and one
+// 8-bit palette index per pixel:
+//     "pbrtpal\0"
+//     int32 version, width, height, nColors (little-endian)
+//     nColors x RGBA8 palette
+//     width * height uint8 indices, top row first
+static const char palettedMagic[8] = {'p', 'b', 'r', 't', 'p', 'a', 'l', 0};
+static PBRT_CONSTEXPR int32_t palettedVersion = 1;
+
+bool IsPalettedImageFile(const std::string &filename) {
+    return HasExtension(filename, ".paletted");
+}
+
+static bool ReadInt32LE(FILE *fp, int32_t *v) {
+    uint8_t b[4];
+    if (fread(b, 1, 4, fp) != 4) return false;
+    *v = int32_t(uint32_t(b[0]) | (uint32_t(b[1]) << 8) |
+                 (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24));
+    return true;
+}
+
+static bool WriteInt32LE(FILE *fp, int32_t v) {
+    uint8_t b[4] = {uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16),
+                    uint8_t(v >> 24)};
+    return fwrite(b, 1, 4, fp) == 4;
+}
+
+static std::shared_ptr<const DecodedImage> DecodePaletted(
+    const std::string &name) {
+    FILE *fp = fopen(name.c_str(), "rb");
+    if (!fp) {
+        Error("Unable to open paletted image \"%s\"", name.c_str());
+        return nullptr;
+    }
+    char magic[8];
+    int32_t version, width, height, nColors;
+    RGBA8 palette[256];
+    std::shared_ptr<DecodedImage> image;
+    std::unique_ptr<uint8_t[]> indices;
+    if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, palettedMagic, 8) != 0 ||
+        !ReadInt32LE(fp, &version) || !ReadInt32LE(fp, &width) ||
+        !ReadInt32LE(fp, &height) || !ReadInt32LE(fp, &nColors)) {
+        Error("\"%s\": not a paletted image", name.c_str());
+        goto fail;
+    }
+    if (version != palettedVersion || width <= 0 || height <= 0 ||
+        nColors < 1 || nColors > 256) {
+        Error("\"%s\": unsupported paletted image (version %d, %d x %d, %d "
+              "colors)", name.c_str(), version, width, height, nColors);
+        goto fail;
+    }
+    if (fread(palette, sizeof(RGBA8), nColors, fp) != size_t(nColors)) {
+        Error("\"%s\": premature end of file", name.c_str());
+        goto fail;
+    }
+    indices.reset(new uint8_t[width * height]);
+    if (fread(indices.get(), 1, width * height, fp) != size_t(width * height)) {
+        Error("\"%s\": premature end of file", name.c_str());
+        goto fail;
+    }
+    fclose(fp);
+
+    image = std::make_shared<DecodedImage>();
+    image->resolution = Point2i(width, height);
+    image->texels.reset(new RGBA8[width * height]);
+    for (int i = 0; i < width * height; ++i) {
+        if (indices[i] >= nColors) {
+            Error("\"%s\": palette index %d out of range", name.c_str(),
+                  indices[i]);
+            return nullptr;
+        }
+        image->texels[i] = palette[indices[i]];
+    }
+    ++nImagesDecoded;
+    LOG(INFO) << StringPrintf("Read paletted image %s (%d x %d, %d colors)",
+                              name.c_str(), width, height, nColors);
+    return image;
+
+fail:
+    fclose(fp);
+    return nullptr;
+}
+
+bool WritePalettedImage(const std::string &name, const RGBA8 *texels,
+                        const Point2i &resolution) {
+    // Find the image's distinct colors
+    int nTexels = resolution.x * resolution.y;
+    std::vector<RGBA8> palette;
+    std::unique_ptr<uint8_t[]> indices(new uint8_t[nTexels]);
+    std::map<uint32_t, uint8_t> colorIndex;
+    for (int i = 0; i < nTexels; ++i) {
+        const RGBA8 &c = texels[i];
+        uint32_t key = uint32_t(c.r) | (uint32_t(c.g) << 8) |
+                       (uint32_t(c.b) << 16) | (uint32_t(c.a) << 24);
+        auto iter = colorIndex.find(key);
+        if (iter == colorIndex.end()) {
+            if (palette.size() == 256) {
+                Error("\"%s\": image has more than 256 colors and can't be "
+                      "paletted", name.c_str());
+                return false;
+            }
+            iter = colorIndex.insert(std::make_pair(key, palette.size())).first;
+            palette.push_back(c);
+        }
+        indices[i] = iter->second;
+    }
+
+    FILE *fp = fopen(name.c_str(), "wb");
+    if (!fp) {
+        Error("Unable to open output paletted image \"%s\"", name.c_str());
+        return false;
+    }
+    bool ok = fwrite(palettedMagic, 1, 8, fp) == 8 &&
+              WriteInt32LE(fp, palettedVersion) &&
+              WriteInt32LE(fp, resolution.x) &&
+              WriteInt32LE(fp, resolution.y) &&
+              WriteInt32LE(fp, palette.size()) &&
+              fwrite(palette.data(), sizeof(RGBA8), palette.size(), fp) ==
+                  palette.size() &&
+              fwrite(indices.get(), 1, nTexels, fp) == size_t(nTexels);
+    if (fclose(fp) != 0) ok = false;
+    if (!ok) Error("Error writing paletted image \"%s\"", name.c_str());
+    return ok;
+}
+
 }  // namespace pbrt
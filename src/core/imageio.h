@@ -42,6 +42,8 @@
 #include "pbrt.h"
 #include "geometry.h"
 #include <cctype>
+#include <memory>
+#include <vector>
 
 namespace pbrt {
 
@@ -49,8 +51,43 @@ namespace pbrt {
 std::unique_ptr<RGBSpectrum[]> ReadImage(const std::string &name,
                                          Point2i *resolution);
 
+// Reads one channel of an 8-bit image as an alpha mask: the red channel,
+// as alpha masks always have been read, unless _alphaChannel_ is true.
 std::unique_ptr<Float[]> ReadImageAlpha(const std::string &name,
-                                         Point2i *resolution);
+                                        Point2i *resolution,
+                                        bool alphaChannel = false);
+
+// Returns the 8-bit texels of a PNG or paletted image as stored, without
+// converting them to floating point.
+std::unique_ptr<RGBA8[]> ReadImageRGBA8(const std::string &name,
+                                        Point2i *resolution);
+
+// DecodedImage Declarations
+
+// The 8-bit RGBA texels of a PNG or paletted image file. The readers above
+// share these through a cache keyed by filename, so that an image used for
+// both color and alpha textures, or by several textures, is decoded once.
+struct DecodedImage {
+    Point2i resolution;
+    std::unique_ptr<RGBA8[]> texels;
+};
+
+// Returns the cached texels of the 8-bit image _name_, decoding it first
+// if needed, or nullptr if it can't be read.
+std::shared_ptr<const DecodedImage> GetDecodedImage(const std::string &name);
+// Decodes the 8-bit images among _names_ into the cache in parallel.
+void PreloadDecodedImages(const std::vector<std::string> &names);
+// Releases the cache's references to decoded images; call once the
+// textures that read them have been created.
+void ClearDecodedImageCache();
+
+// Paletted images (".paletted") store up to 256 distinct RGBA colors and
+// an 8-bit palette index per texel, a compact form for the small, few-color
+// textures of resource packs. Writing fails if _texels_ has more than 256
+// colors; rows are given top first, as PNGs store them.
+bool IsPalettedImageFile(const std::string &filename);
+bool WritePalettedImage(const std::string &name, const RGBA8 *texels,
+                        const Point2i &resolution);
 
 RGBSpectrum *ReadImageEXR(const std::string &name, int *width,
                           int *height, Bounds2i *dataWindow = nullptr,
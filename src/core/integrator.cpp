@@ -41,6 +41,7 @@
 #include "integrator.h"
 #include "progressreporter.h"
 #include "camera.h"
+#include "lightdistrib.h"
 #include "stats.h"
 
 namespace pbrt {
@@ -105,6 +106,23 @@ Spectrum UniformSampleOneLight(const Interaction &it, const Scene &scene,
                           scene, sampler, arena, handleMedia) / lightPdf;
 }
 
+Spectrum UniformSampleOneLight(const Interaction &it, const Scene &scene,
+                               MemoryArena &arena, Sampler &sampler,
+                               const LightDistribution &lightDistrib,
+                               bool handleMedia) {
+    ProfilePhase p(Prof::DirectLighting);
+    // Choose a single light to sample for the point and normal of _it_
+    if (scene.lights.empty()) return Spectrum(0.f);
+    Float lightPdf;
+    int lightNum = lightDistrib.Sample(it, sampler.Get1D(), &lightPdf);
+    if (lightNum < 0 || lightPdf == 0) return Spectrum(0.f);
+    const std::shared_ptr<Light> &light = scene.lights[lightNum];
+    Point2f uLight = sampler.Get2D();
+    Point2f uScattering = sampler.Get2D();
+    return EstimateDirect(it, uScattering, *light, uLight,
+                          scene, sampler, arena, handleMedia) / lightPdf;
+}
+
 Spectrum EstimateDirect(const Interaction &it, const Point2f &uScattering,
                         const Light &light, const Point2f &uLight,
                         const Scene &scene, Sampler &sampler,
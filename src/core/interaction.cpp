@@ -37,6 +37,8 @@
 #include "primitive.h"
 #include "shape.h"
 #include "light.h"
+#include "material.h"
+#include "reflection.h"
 
 namespace pbrt {
 
@@ -95,9 +97,23 @@ void SurfaceInteraction::ComputeScatteringFunctions(const RayDifferential &ray,
                                                     MemoryArena &arena,
                                                     bool allowMultipleLobes,
                                                     TransportMode mode) {
-    ComputeDifferentials(ray);
+    // Only estimate the texture footprint if the material's textures use it
+    const Material *material = primitive->GetMaterial();
+    bool differentials = !material || material->needsDifferentials;
+    if (differentials)
+        ComputeDifferentials(ray);
+    else {
+        dudx = dvdx = dudy = dvdy = 0;
+        dpdx = dpdy = Vector3f(0, 0, 0);
+    }
     primitive->ComputeScatteringFunctions(this, arena, mode,
                                           allowMultipleLobes);
+    // Specular bounces build their rays' differentials from the footprint
+    // here, whether or not the material's textures need it
+    if (!differentials && bsdf &&
+        bsdf->NumComponents(BxDFType(BSDF_SPECULAR | BSDF_REFLECTION |
+                                     BSDF_TRANSMISSION)) > 0)
+        ComputeDifferentials(ray);
 }
 
 void SurfaceInteraction::ComputeDifferentials(
@@ -154,6 +154,10 @@ class SurfaceInteraction : public Interaction {
     // index with an intersection point for use in Ptex texture lookups.
     // If Ptex isn't being used, then this value is ignored.
     int faceIndex = 0;
+
+    // The color of shapes with per-face or per-vertex tints at the point;
+    // materials that support tinting scale their reflectance by it.
+    RGBSpectrum tint = RGBSpectrum(1.f);
 };
 
 }  // namespace pbrt
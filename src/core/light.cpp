@@ -37,6 +37,7 @@
 #include "sampling.h"
 #include "stats.h"
 #include "paramset.h"
+#include "shapes/quad.h"
 
 namespace pbrt {
 
@@ -56,6 +57,23 @@ Light::Light(int flags, const Transform &LightToWorld,
 
 Light::~Light() {}
 
+LightBounds ShapeLightBounds(const Shape &shape, Float phi, bool twoSided) {
+    LightBounds lb;
+    lb.bounds = shape.WorldBound();
+    lb.phi = phi;
+    lb.cosTheta_e = 0;
+    lb.twoSided = twoSided;
+    QuadFace face;
+    if (GetQuadFace(shape, &face)) {
+        lb.w[face.axis] = face.positive ? 1 : -1;
+        lb.cosTheta_o = 1;
+    } else {
+        lb.w = Vector3f(0, 0, 1);
+        lb.cosTheta_o = -1;
+    }
+    return lb;
+}
+
 bool VisibilityTester::Unoccluded(const Scene &scene) const {
     return !scene.IntersectP(p0.SpawnRayTo(p1));
 }
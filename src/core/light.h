@@ -58,6 +58,20 @@ inline bool IsDeltaLight(int flags) {
            flags & (int)LightFlags::DeltaDirection;
 }
 
+// LightBounds Declarations
+
+// A conservative bound on where a light is and in which directions it
+// emits, used to estimate its importance when sampling many lights. Its
+// surface normals lie within angle $\theta_o$ of _w_ and it emits no light
+// further than $\theta_e$ beyond them.
+struct LightBounds {
+    Bounds3f bounds;
+    Vector3f w;
+    Float phi = 0;
+    Float cosTheta_o, cosTheta_e;
+    bool twoSided;
+};
+
 // Light Declarations
 class Light {
   public:
@@ -77,6 +91,9 @@ class Light {
                                Float *pdfDir) const = 0;
     virtual void Pdf_Le(const Ray &ray, const Normal3f &nLight, Float *pdfPos,
                         Float *pdfDir) const = 0;
+    // Lights that aren't bounded in space (e.g. infinite lights) return
+    // false and are sampled without regard to the receiving point.
+    virtual bool Bounds(LightBounds *bounds) const { return false; }
 
     // Light Public Data
     const int flags;
@@ -111,6 +128,11 @@ class AreaLight : public Light {
     virtual Spectrum L(const Interaction &intr, const Vector3f &w) const = 0;
 };
 
+// Returns the bounds of a light that emits diffusely from _shape_ with
+// total power _phi_. Axis-aligned quads get a tight normal cone; other
+// shapes are bounded as if they emitted in every direction.
+LightBounds ShapeLightBounds(const Shape &shape, Float phi, bool twoSided);
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_LIGHT_H
@@ -39,12 +39,23 @@
 #include "scene.h"
 #include "stats.h"
 #include "integrator.h"
+#include <algorithm>
 #include <numeric>
 
 namespace pbrt {
 
 LightDistribution::~LightDistribution() {}
 
+int LightDistribution::Sample(const Interaction &ref, Float u,
+                              Float *pdf) const {
+    int lightNum = Lookup(ref.p)->SampleDiscrete(u, pdf);
+    return (*pdf > 0) ? lightNum : -1;
+}
+
+Float LightDistribution::Pdf(const Interaction &ref, int lightIndex) const {
+    return Lookup(ref.p)->DiscretePDF(lightIndex);
+}
+
 std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
     const std::string &name, const Scene &scene) {
     if (name == "uniform" || scene.lights.size() == 1)
@@ -56,6 +67,9 @@ std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
     else if (name == "spatial")
         return std::unique_ptr<LightDistribution>{
             new SpatialLightDistribution(scene)};
+    else if (name == "bvh")
+        return std::unique_ptr<LightDistribution>{
+            new BVHLightDistribution(scene)};
     else {
         Error(
             "Light sample distribution type \"%s\" unknown. Using \"spatial\".",
@@ -299,4 +313,337 @@ SpatialLightDistribution::ComputeDistribution(Point3i pi) const {
     return new Distribution1D(&lightContrib[0], int(lightContrib.size()));
 }
 
+///////////////////////////////////////////////////////////////////////////
+// BVHLightDistribution
+
+STAT_MEMORY_COUNTER("Memory/Light BVH", lightBVHBytes);
+STAT_COUNTER("BVHLightDistribution/Lights in BVH", nBVHLights);
+STAT_INT_DISTRIBUTION("BVHLightDistribution/Nodes visited per sample",
+                      nNodesPerSample);
+
+static const uint64_t invalidBitTrail = ~uint64_t(0);
+
+static Float SafeACos(Float x) { return std::acos(Clamp(x, -1, 1)); }
+
+static Float SafeSqrt(Float x) { return std::sqrt(std::max(x, Float(0))); }
+
+// Returns the angle between the unit vectors _a_ and _b_, computed so that
+// it stays accurate when they are nearly parallel.
+static Float AngleBetween(const Vector3f &a, const Vector3f &b) {
+    if (Dot(a, b) < 0)
+        return Pi - 2 * std::asin(std::min<Float>(1, (a + b).Length() / 2));
+    return 2 * std::asin(std::min<Float>(1, (b - a).Length() / 2));
+}
+
+// Returns bounds for the lights of both _a_ and _b_. The cone of normals
+// is the smallest one that contains both cones.
+static LightBounds Union(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0) return b;
+    if (b.phi == 0) return a;
+    LightBounds lb;
+    lb.bounds = Union(a.bounds, b.bounds);
+    lb.phi = a.phi + b.phi;
+    lb.cosTheta_e = std::min(a.cosTheta_e, b.cosTheta_e);
+    lb.twoSided = a.twoSided || b.twoSided;
+
+    Float theta_a = SafeACos(a.cosTheta_o), theta_b = SafeACos(b.cosTheta_o);
+    Float theta_d = AngleBetween(a.w, b.w);
+    if (std::min(theta_d + theta_b, Pi) <= theta_a) {
+        lb.w = a.w;
+        lb.cosTheta_o = a.cosTheta_o;
+    } else if (std::min(theta_d + theta_a, Pi) <= theta_b) {
+        lb.w = b.w;
+        lb.cosTheta_o = b.cosTheta_o;
+    } else {
+        // Rotate _a.w_ toward _b.w_ to the center of the merged cone
+        Float theta_o = (theta_a + theta_d + theta_b) / 2;
+        Vector3f wr = Cross(a.w, b.w);
+        if (theta_o >= Pi || wr.LengthSquared() == 0) {
+            lb.w = a.w;
+            lb.cosTheta_o = -1;
+        } else {
+            lb.w = Normalize(Rotate(Degrees(theta_o - theta_a), wr)(a.w));
+            lb.cosTheta_o = std::cos(theta_o);
+        }
+    }
+    return lb;
+}
+
+// Returns a conservative estimate of the light that arrives at _p_ from
+// the lights inside _lb_: it is only zero if none of them can illuminate
+// _p_. For points on surfaces, _n_ is the surface normal and the cosine
+// factor at _p_ is bounded as well; it is zero for points in media.
+static Float Importance(const LightBounds &lb, const Point3f &p,
+                        const Normal3f &n) {
+    // Compute the clamped squared distance to the center of the bounds
+    Point3f pc;
+    Float radius;
+    lb.bounds.BoundingSphere(&pc, &radius);
+    Float d2 = DistanceSquared(p, pc);
+    if (d2 == 0) return lb.phi;
+    Vector3f wi = (p - pc) / std::sqrt(d2);
+    d2 = std::max(d2, lb.bounds.Diagonal().Length() / 2);
+
+    // $\cos(\theta_a - \theta_b)$ and $\sin(\theta_a - \theta_b)$, with
+    // the difference of the angles clamped to be nonnegative
+    auto cosSubClamped = [](Float sinTheta_a, Float cosTheta_a,
+                            Float sinTheta_b, Float cosTheta_b) -> Float {
+        if (cosTheta_a > cosTheta_b) return 1;
+        return cosTheta_a * cosTheta_b + sinTheta_a * sinTheta_b;
+    };
+    auto sinSubClamped = [](Float sinTheta_a, Float cosTheta_a,
+                            Float sinTheta_b, Float cosTheta_b) -> Float {
+        if (cosTheta_a > cosTheta_b) return 0;
+        return sinTheta_a * cosTheta_b - cosTheta_a * sinTheta_b;
+    };
+
+    // Compute the angle $\theta_w$ between _p_ and the cone's axis
+    Float cosTheta_w = Dot(lb.w, wi);
+    if (lb.twoSided) cosTheta_w = std::abs(cosTheta_w);
+    Float sinTheta_w = SafeSqrt(1 - cosTheta_w * cosTheta_w);
+
+    // Bound the angle $\theta_b$ that the bounds subtend as seen from _p_
+    Float cosTheta_b = -1;
+    if (DistanceSquared(p, pc) > radius * radius)
+        cosTheta_b = SafeSqrt(1 - radius * radius / DistanceSquared(p, pc));
+    Float sinTheta_b = SafeSqrt(1 - cosTheta_b * cosTheta_b);
+
+    // Compute the minimum emission angle $\theta'$ toward _p_ and cull
+    // lights that can't emit toward it
+    Float sinTheta_o = SafeSqrt(1 - lb.cosTheta_o * lb.cosTheta_o);
+    Float cosTheta_x =
+        cosSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, lb.cosTheta_o);
+    Float sinTheta_x =
+        sinSubClamped(sinTheta_w, cosTheta_w, sinTheta_o, lb.cosTheta_o);
+    Float cosThetap =
+        cosSubClamped(sinTheta_x, cosTheta_x, sinTheta_b, cosTheta_b);
+    if (cosThetap <= lb.cosTheta_e) return 0;
+
+    Float importance = lb.phi * cosThetap / d2;
+    if (n != Normal3f(0, 0, 0)) {
+        Float cosTheta_i = AbsDot(wi, n);
+        Float sinTheta_i = SafeSqrt(1 - cosTheta_i * cosTheta_i);
+        importance *=
+            cosSubClamped(sinTheta_i, cosTheta_i, sinTheta_b, cosTheta_b);
+    }
+    return std::max<Float>(importance, 0);
+}
+
+// The surface area orientation heuristic: the cost of a node with bounds
+// _lb_ scales with its power, its surface area and the solid angle of the
+// directions it emits into. Splits across the long axis of _bounds_ are
+// preferred.
+static Float EvaluateCost(const LightBounds &lb, const Bounds3f &bounds,
+                          int dim) {
+    Float theta_o = SafeACos(lb.cosTheta_o), theta_e = SafeACos(lb.cosTheta_e);
+    Float theta_w = std::min(theta_o + theta_e, Pi);
+    Float sinTheta_o = SafeSqrt(1 - lb.cosTheta_o * lb.cosTheta_o);
+    Float M_omega = 2 * Pi * (1 - lb.cosTheta_o) +
+                    Pi / 2 * (2 * theta_w * sinTheta_o -
+                              std::cos(theta_o - 2 * theta_w) -
+                              2 * theta_o * sinTheta_o + lb.cosTheta_o);
+    Vector3f d = bounds.Diagonal();
+    Float Kr = d[bounds.MaximumExtent()] / d[dim];
+    return lb.phi * M_omega * Kr * lb.bounds.SurfaceArea();
+}
+
+BVHLightDistribution::BVHLightDistribution(const Scene &scene)
+    : powerDistrib(ComputeLightPowerDistribution(scene)),
+      lightBitTrails(scene.lights.size(), invalidBitTrail) {
+    std::vector<BVHLight> bvhLights;
+    for (size_t i = 0; i < scene.lights.size(); ++i) {
+        LightBounds lb;
+        if (!scene.lights[i]->Bounds(&lb))
+            unboundedLights.push_back(i);
+        else if (lb.phi > 0)
+            bvhLights.push_back({int(i), lb});
+    }
+    nBVHLights += bvhLights.size();
+    if (!bvhLights.empty()) {
+        nodes.reserve(2 * bvhLights.size() - 1);
+        BuildBVH(bvhLights, 0, bvhLights.size(), 0, 0);
+    }
+    lightBVHBytes += nodes.size() * sizeof(LightBVHNode) +
+                     lightBitTrails.size() * sizeof(uint64_t);
+    LOG(INFO) << "BVHLightDistribution: " << bvhLights.size() <<
+        " lights in BVH, " << unboundedLights.size() << " unbounded";
+}
+
+int BVHLightDistribution::BuildBVH(std::vector<BVHLight> &lights, int start,
+                                   int end, uint64_t bitTrail, int depth) {
+    CHECK_LT(start, end);
+    // Initialize a leaf node for a single light
+    if (end - start == 1) {
+        int nodeIndex = nodes.size();
+        nodes.push_back({lights[start].bounds, lights[start].lightIndex, true});
+        lightBitTrails[lights[start].lightIndex] = bitTrail;
+        return nodeIndex;
+    }
+
+    // Compute the bounds of the lights and of their centroids
+    Bounds3f bounds, centroidBounds;
+    for (int i = start; i < end; ++i) {
+        const Bounds3f &b = lights[i].bounds.bounds;
+        bounds = Union(bounds, b);
+        centroidBounds = Union(centroidBounds, (b.pMin + b.pMax) / 2);
+    }
+
+    // Find the bucket split with the lowest cost along any axis. Deep in
+    // the tree, fall back to splitting in the middle so that bit trails
+    // fit in 64 bits.
+    const int nBuckets = 12;
+    Float minCost = Infinity;
+    int minCostSplitBucket = -1, minCostSplitDim = -1;
+    for (int dim = 0; dim < 3 && depth < 32; ++dim) {
+        if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) continue;
+        // Compute the light bounds and light counts of each bucket
+        LightBounds bucketBounds[nBuckets];
+        int bucketCount[nBuckets] = {0};
+        for (int i = start; i < end; ++i) {
+            const Bounds3f &b = lights[i].bounds.bounds;
+            Point3f pc = (b.pMin + b.pMax) / 2;
+            int bucket = std::min(
+                int(nBuckets * centroidBounds.Offset(pc)[dim]), nBuckets - 1);
+            bucketBounds[bucket] = Union(bucketBounds[bucket], lights[i].bounds);
+            ++bucketCount[bucket];
+        }
+
+        // Compute the cost of splitting after each bucket
+        for (int i = 0; i < nBuckets - 1; ++i) {
+            LightBounds b0, b1;
+            int count0 = 0, count1 = 0;
+            for (int j = 0; j <= i; ++j) {
+                b0 = Union(b0, bucketBounds[j]);
+                count0 += bucketCount[j];
+            }
+            for (int j = i + 1; j < nBuckets; ++j) {
+                b1 = Union(b1, bucketBounds[j]);
+                count1 += bucketCount[j];
+            }
+            if (count0 == 0 || count1 == 0) continue;
+            Float cost = EvaluateCost(b0, bounds, dim) +
+                         EvaluateCost(b1, bounds, dim);
+            if (cost < minCost) {
+                minCost = cost;
+                minCostSplitBucket = i;
+                minCostSplitDim = dim;
+            }
+        }
+    }
+
+    // Partition the lights according to the chosen split
+    int mid;
+    if (minCostSplitDim == -1)
+        mid = (start + end) / 2;
+    else {
+        BVHLight *pmid = std::partition(
+            &lights[start], &lights[end - 1] + 1, [=](const BVHLight &l) {
+                const Bounds3f &b = l.bounds.bounds;
+                Point3f pc = (b.pMin + b.pMax) / 2;
+                int bucket = std::min(
+                    int(nBuckets * centroidBounds.Offset(pc)[minCostSplitDim]),
+                    nBuckets - 1);
+                return bucket <= minCostSplitBucket;
+            });
+        mid = pmid - &lights[0];
+        if (mid == start || mid == end) mid = (start + end) / 2;
+    }
+
+    // Build the children; the first one directly follows this node
+    int nodeIndex = nodes.size();
+    nodes.push_back({LightBounds(), -1, false});
+    CHECK_LT(depth, 64);
+    int child0 = BuildBVH(lights, start, mid, bitTrail, depth + 1);
+    CHECK_EQ(nodeIndex + 1, child0);
+    int child1 = BuildBVH(lights, mid, end, bitTrail | (uint64_t(1) << depth),
+                          depth + 1);
+    nodes[nodeIndex].bounds = Union(nodes[child0].bounds, nodes[child1].bounds);
+    nodes[nodeIndex].childOrLightIndex = child1;
+    return nodeIndex;
+}
+
+Float BVHLightDistribution::PInfinite() const {
+    if (unboundedLights.empty()) return 0;
+    return Float(unboundedLights.size()) /
+           Float(unboundedLights.size() + (nodes.empty() ? 0 : 1));
+}
+
+const Distribution1D *BVHLightDistribution::Lookup(const Point3f &p) const {
+    return powerDistrib.get();
+}
+
+int BVHLightDistribution::Sample(const Interaction &ref, Float u,
+                                 Float *pdf) const {
+    ProfilePhase _(Prof::LightDistribLookup);
+    *pdf = 0;
+    // Choose one of the unbounded lights with probability _pInfinite_
+    Float pInfinite = PInfinite();
+    if (u < pInfinite) {
+        int n = unboundedLights.size();
+        int index = std::min(int(u / pInfinite * n), n - 1);
+        *pdf = pInfinite / n;
+        return unboundedLights[index];
+    }
+    if (nodes.empty()) return -1;
+
+    // Traverse the BVH, choosing children by their importance at _ref_
+    u = std::min((u - pInfinite) / (1 - pInfinite), OneMinusEpsilon);
+    Float p = 1 - pInfinite;
+    int nodeIndex = 0, nVisited = 1;
+    while (!nodes[nodeIndex].isLeaf) {
+        const LightBVHNode &node = nodes[nodeIndex];
+        Float ci[2] = {
+            Importance(nodes[nodeIndex + 1].bounds, ref.p, ref.n),
+            Importance(nodes[node.childOrLightIndex].bounds, ref.p, ref.n)};
+        if (ci[0] == 0 && ci[1] == 0) return -1;
+        Float p0 = ci[0] / (ci[0] + ci[1]);
+        if (u < p0) {
+            u = std::min(u / p0, OneMinusEpsilon);
+            p *= p0;
+            nodeIndex = nodeIndex + 1;
+        } else {
+            u = std::min((u - p0) / (1 - p0), OneMinusEpsilon);
+            p *= 1 - p0;
+            nodeIndex = node.childOrLightIndex;
+        }
+        ++nVisited;
+    }
+    ReportValue(nNodesPerSample, nVisited);
+    // A tree that is a single leaf still can't choose unreachable lights
+    if (nodeIndex == 0 && Importance(nodes[0].bounds, ref.p, ref.n) == 0)
+        return -1;
+    *pdf = p;
+    return nodes[nodeIndex].childOrLightIndex;
+}
+
+Float BVHLightDistribution::Pdf(const Interaction &ref, int lightIndex) const {
+    Float pInfinite = PInfinite();
+    uint64_t bitTrail = lightBitTrails[lightIndex];
+    if (bitTrail == invalidBitTrail) {
+        if (std::find(unboundedLights.begin(), unboundedLights.end(),
+                      lightIndex) != unboundedLights.end())
+            return pInfinite / unboundedLights.size();
+        return 0;
+    }
+
+    // Follow the light's bit trail down the BVH, accumulating the
+    // probabilities of the choices that lead to it
+    Float p = 1 - pInfinite;
+    int nodeIndex = 0;
+    while (!nodes[nodeIndex].isLeaf) {
+        const LightBVHNode &node = nodes[nodeIndex];
+        Float ci[2] = {
+            Importance(nodes[nodeIndex + 1].bounds, ref.p, ref.n),
+            Importance(nodes[node.childOrLightIndex].bounds, ref.p, ref.n)};
+        int child = bitTrail & 1;
+        if (ci[child] == 0) return 0;
+        p *= ci[child] / (ci[0] + ci[1]);
+        nodeIndex = child ? node.childOrLightIndex : nodeIndex + 1;
+        bitTrail >>= 1;
+    }
+    if (nodeIndex == 0 && Importance(nodes[0].bounds, ref.p, ref.n) == 0)
+        return 0;
+    return p;
+}
+
 }  // namespace pbrt
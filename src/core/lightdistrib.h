@@ -36,6 +36,7 @@
 #include "pbrt.h"
 #include "geometry.h"
 #include "sampling.h"
+#include "light.h"
 #include <atomic>
 #include <functional>
 #include <mutex>
@@ -54,6 +55,16 @@ class LightDistribution {
     // Given a point |p| in space, this method returns a (hopefully
     // effective) sampling distribution for light sources at that point.
     virtual const Distribution1D *Lookup(const Point3f &p) const = 0;
+
+    // Chooses a light for estimating direct lighting at |ref|, using its
+    // position and, for surfaces, its normal. Returns the light's index in
+    // the scene's lights and sets |*pdf| to the discrete probability of
+    // choosing it, or returns -1 if no light can contribute. The default
+    // implementations sample the distribution returned by Lookup().
+    virtual int Sample(const Interaction &ref, Float u, Float *pdf) const;
+    // Returns the probability that Sample() chooses light |lightIndex| at
+    // |ref|.
+    virtual Float Pdf(const Interaction &ref, int lightIndex) const;
 };
 
 std::unique_ptr<LightDistribution> CreateLightSampleDistribution(
@@ -124,6 +135,55 @@ class SpatialLightDistribution : public LightDistribution {
     size_t hashTableSize;
 };
 
+// A light bounding volume hierarchy: lights are clustered by position and
+// by the cone of their emission directions, and Sample() descends the
+// tree choosing each child with probability proportional to an estimate
+// of its contribution at the reference point. The cost of sampling and of
+// Pdf() is logarithmic in the number of lights, which makes it suitable
+// for scenes with many thousands of small emitters. Lights without
+// spatial bounds (e.g. infinite lights) are chosen uniformly, each as
+// often as the whole tree.
+//
+// Lookup() can't account for the receiving point in constant time, so it
+// returns a distribution proportional to power; it is what the light
+// subpaths of bidirectional methods are started from.
+class BVHLightDistribution : public LightDistribution {
+  public:
+    BVHLightDistribution(const Scene &scene);
+    const Distribution1D *Lookup(const Point3f &p) const;
+    int Sample(const Interaction &ref, Float u, Float *pdf) const;
+    Float Pdf(const Interaction &ref, int lightIndex) const;
+
+  private:
+    // BVHLightDistribution Private Types
+    struct LightBVHNode {
+        LightBounds bounds;
+        // For interior nodes, the first child directly follows the node
+        // and this is the index of the second child; for leaves, it is the
+        // index of the light in the scene's lights.
+        int childOrLightIndex;
+        bool isLeaf;
+    };
+    struct BVHLight {
+        int lightIndex;
+        LightBounds bounds;
+    };
+
+    // BVHLightDistribution Private Methods
+    int BuildBVH(std::vector<BVHLight> &lights, int start, int end,
+                 uint64_t bitTrail, int depth);
+    Float PInfinite() const;
+
+    // BVHLightDistribution Private Data
+    std::unique_ptr<Distribution1D> powerDistrib;
+    std::vector<int> unboundedLights;
+    std::vector<LightBVHNode> nodes;
+    // For each of the scene's lights, the path from the root to its leaf:
+    // bit i is set if the second child is taken at depth i. Lights that
+    // aren't in the tree have a trail of ~0.
+    std::vector<uint64_t> lightBitTrails;
+};
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_LIGHTDISTRIB_H
@@ -56,8 +56,19 @@ class Material {
                                             TransportMode mode,
                                             bool allowMultipleLobes) const = 0;
     virtual ~Material();
+    // Returns true if no light can pass through surfaces with this
+    // material, so that hidden geometry behind them may be culled.
+    virtual bool IsOpaque() const { return false; }
     static void Bump(const std::shared_ptr<Texture<Float>> &d,
                      SurfaceInteraction *si);
+
+    // Material Public Data
+    // False if none of the material's textures use ray differentials, so
+    // that intersections with it can skip computing them
+    bool needsDifferentials = true;
+    // True if all of the material's textures are periodic in (u,v), so
+    // that quads tiling them may be merged
+    bool texturesPeriodic = false;
 };
 
 }  // namespace pbrt
@@ -44,12 +44,20 @@
 #include "texture.h"
 #include "stats.h"
 #include "parallel.h"
+#include "texcache.h"
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
 
 namespace pbrt {
 
 STAT_COUNTER("Texture/EWA lookups", nEWALookups);
 STAT_COUNTER("Texture/Trilinear lookups", nTrilerpLookups);
 STAT_MEMORY_COUNTER("Memory/Texture MIP maps", mipMapMemory);
+STAT_PERCENT("Texture/MIP map levels built", nMIPMapLevelsBuilt,
+             nMIPMapLevels);
+STAT_PERCENT("Texture/Paletted MIP map levels", nPalettedLevels,
+             nPalettingCandidates);
 
 // MIPMap Helper Declarations
 enum class ImageWrap { Repeat, Black, Clamp };
@@ -58,23 +66,113 @@ struct ResampleWeight {
     Float weight[4];
 };
 
+// TexelTraits give the type that a _MIPMap<T>_ filters its texels in and
+// returns from lookups, and conversions between it and the stored type.
+template <typename T>
+struct TexelTraits {
+    typedef T Value;
+    static const T &Decode(const T &texel) { return texel; }
+    static const T &Encode(const T &value) { return value; }
+};
+
+// 8-bit sRGB texels take a third of the memory of _RGBSpectrum_ texels
+// and are decoded to linear _RGBSpectrum_ values through a table, so
+// point-sampled lookups return exactly what converting the image to
+// floating point up front would. Coarser levels keep only color, with
+// opaque alpha.
+template <>
+struct TexelTraits<RGBA8> {
+    typedef RGBSpectrum Value;
+    static RGBSpectrum Decode(const RGBA8 &texel) {
+        Float rgb[3] = {SRGB8ToLinear[texel.r], SRGB8ToLinear[texel.g],
+                        SRGB8ToLinear[texel.b]};
+        return RGBSpectrum::FromRGB(rgb);
+    }
+    static RGBA8 Encode(const RGBSpectrum &value) {
+        Float rgb[3];
+        value.ToRGB(rgb);
+        auto encode = [](Float v) {
+            return (uint8_t)Clamp(255.f * GammaCorrect(v) + 0.5f, 0.f, 255.f);
+        };
+        return RGBA8{encode(rgb[0]), encode(rgb[1]), encode(rgb[2]), 255};
+    }
+};
+
+// Levels with few distinct texels can be stored as an 8-bit index per
+// texel into a palette of at most 256 texels. _PalettizeTexels()_ returns
+// false if _texels_ can't be, as for texel types other than _RGBA8_.
+template <typename T>
+bool PalettizeTexels(const BlockedArray<T> &texels, std::vector<T> *palette,
+                     std::unique_ptr<BlockedArray<uint8_t>> *indices) {
+    return false;
+}
+
+inline bool PalettizeTexels(const BlockedArray<RGBA8> &texels,
+                            std::vector<RGBA8> *palette,
+                            std::unique_ptr<BlockedArray<uint8_t>> *indices) {
+    int uSize = texels.uSize(), vSize = texels.vSize();
+    std::unique_ptr<uint8_t[]> index(new uint8_t[uSize * vSize]);
+    std::unordered_map<uint32_t, uint8_t> colorIndex;
+    for (int t = 0; t < vSize; ++t)
+        for (int s = 0; s < uSize; ++s) {
+            const RGBA8 &c = texels(s, t);
+            uint32_t key = uint32_t(c.r) | (uint32_t(c.g) << 8) |
+                           (uint32_t(c.b) << 16) | (uint32_t(c.a) << 24);
+            auto iter = colorIndex.find(key);
+            if (iter == colorIndex.end()) {
+                if (palette->size() == 256) {
+                    palette->clear();
+                    return false;
+                }
+                iter = colorIndex.insert(std::make_pair(key, palette->size()))
+                           .first;
+                palette->push_back(c);
+            }
+            index[t * uSize + s] = iter->second;
+        }
+    palette->shrink_to_fit();
+    indices->reset(new BlockedArray<uint8_t>(uSize, vSize, index.get()));
+    return true;
+}
+
 // MIPMap Declarations
 template <typename T>
 class MIPMap {
   public:
+    typedef typename TexelTraits<T>::Value Value;
+
     // MIPMap Public Methods
+    // MIPMaps that are only point sampled (_nearest_) keep the image as
+    // given, without resampling it or building coarser levels. Levels are
+    // built the first time they're used, so images that are never looked
+    // up, or only at their finest level, don't pay for the rest.
     MIPMap(const Point2i &resolution, const T *data, bool doTri = false,
-           Float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat);
+           Float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat,
+           bool nearest = false);
+    // MIPMaps of tiled image files use the file's levels, paging their
+    // texels in through the texture cache. Tiled images store their top
+    // row first; _flipY_ flips them for texture space, where (0,0) is at
+    // the lower left.
+    MIPMap(std::unique_ptr<TiledImage> tiles, bool flipY, bool doTri = false,
+           Float maxAniso = 8.f, ImageWrap wrapMode = ImageWrap::Repeat,
+           bool nearest = false);
     int Width() const { return resolution[0]; }
     int Height() const { return resolution[1]; }
-    int Levels() const { return pyramid.size(); }
-    const T &Texel(int level, int s, int t) const;
-    T Lookup(const Point2f &st, Float width = 0.f) const;
-    T Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
+    int Levels() const { return nLevels; }
+    Point2i LevelResolution(int level) const {
+        if (tiles) return tiles->LevelResolution(level);
+        return Point2i(std::max(1, resolution[0] >> level),
+                       std::max(1, resolution[1] >> level));
+    }
+    ImageWrap WrapMode() const { return wrapMode; }
+    T Texel(int level, int s, int t) const;
+    Value Lookup(const Point2f &st, Float width = 0.f) const;
+    Value Lookup(const Point2f &st, Vector2f dstdx, Vector2f dstdy) const;
 
   private:
     // MIPMap Private Methods
-    std::unique_ptr<ResampleWeight[]> resampleWeights(int oldRes, int newRes) {
+    static std::unique_ptr<ResampleWeight[]> resampleWeights(int oldRes,
+                                                             int newRes) {
         CHECK_GE(newRes, oldRes);
         std::unique_ptr<ResampleWeight[]> wt(new ResampleWeight[newRes]);
         Float filterwidth = 2.f;
@@ -94,20 +192,91 @@ class MIPMap {
         }
         return wt;
     }
-    Float clamp(Float v) { return Clamp(v, 0.f, Infinity); }
-    RGBSpectrum clamp(const RGBSpectrum &v) { return v.Clamp(0.f, Infinity); }
-    SampledSpectrum clamp(const SampledSpectrum &v) {
+    static Float clamp(Float v) { return Clamp(v, 0.f, Infinity); }
+    static RGBSpectrum clamp(const RGBSpectrum &v) {
         return v.Clamp(0.f, Infinity);
     }
-    T triangle(int level, const Point2f &st) const;
-    T EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+    static SampledSpectrum clamp(const SampledSpectrum &v) {
+        return v.Clamp(0.f, Infinity);
+    }
+    // Initializes the EWA filter weights, once, though MIPMaps may be
+    // created concurrently
+    static void InitWeightLut() {
+        static std::once_flag weightLutInitialized;
+        std::call_once(weightLutInitialized, []() {
+            for (int i = 0; i < WeightLUTSize; ++i) {
+                Float alpha = 2;
+                Float r2 = Float(i) / Float(WeightLUTSize - 1);
+                weightLut[i] = std::exp(-alpha * r2) - std::exp(-alpha);
+            }
+        });
+    }
+    // Builds in-memory level _level_, and the finer levels it's filtered
+    // from, if that hasn't been done yet; safe to call concurrently
+    void EnsureLevel(int level) const {
+        if (levelBuilt[level].load(std::memory_order_acquire)) return;
+        std::call_once(levelOnce[level], [&]() {
+            BuildLevel(level);
+            levelBuilt[level].store(true, std::memory_order_release);
+        });
+    }
+    void BuildLevel(int level) const;
+    std::unique_ptr<T[]> ResampleImage() const;
+    // Stores _level_ as palette indices if _PalettizeTexels()_ can
+    // palettize it and records the memory it uses
+    void PalettizeLevel(int level) const {
+        ++nPalettingCandidates;
+        size_t nTexels = pyramid[level]->uSize() * pyramid[level]->vSize();
+        if (PalettizeTexels(*pyramid[level], &palettes[level],
+                            &paletteIndices[level])) {
+            ++nPalettedLevels;
+            pyramid[level].reset();
+            mipMapMemory += nTexels + palettes[level].size() * sizeof(T);
+        } else
+            mipMapMemory += nTexels * sizeof(T);
+    }
+    Value triangle(int level, const Point2f &st) const;
+    Value EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const;
+    static void FromTile(const float *v, int nChannels, Float *texel) {
+        if (nChannels == 1)
+            *texel = v[0];
+        else {
+            Float rgb[3] = {v[0], v[1], v[2]};
+            *texel = RGBSpectrum::FromRGB(rgb).y();
+        }
+    }
+    static void FromTile(const float *v, int nChannels, RGBSpectrum *texel) {
+        if (nChannels == 1)
+            *texel = RGBSpectrum(v[0]);
+        else {
+            Float rgb[3] = {v[0], v[1], v[2]};
+            *texel = RGBSpectrum::FromRGB(rgb);
+        }
+    }
+    static void FromTile(const float *v, int nChannels, RGBA8 *texel) {
+        RGBSpectrum rgb;
+        FromTile(v, nChannels, &rgb);
+        *texel = TexelTraits<RGBA8>::Encode(rgb);
+    }
 
     // MIPMap Private Data
     const bool doTrilinear;
+    const bool nearest;
     const Float maxAnisotropy;
     const ImageWrap wrapMode;
     Point2i resolution;
-    std::vector<std::unique_ptr<BlockedArray<T>>> pyramid;
+    int nLevels;
+    // The image in-memory levels are built from, until level 0 is built
+    mutable std::unique_ptr<T[]> image;
+    Point2i imageResolution;
+    mutable std::vector<std::unique_ptr<BlockedArray<T>>> pyramid;
+    // Paletted levels have a null _pyramid_ entry and are stored here
+    mutable std::vector<std::vector<T>> palettes;
+    mutable std::vector<std::unique_ptr<BlockedArray<uint8_t>>> paletteIndices;
+    mutable std::unique_ptr<std::once_flag[]> levelOnce;
+    mutable std::unique_ptr<std::atomic<bool>[]> levelBuilt;
+    std::unique_ptr<TiledImage> tiles;
+    bool flipY = false;
     static PBRT_CONSTEXPR int WeightLUTSize = 128;
     static Float weightLut[WeightLUTSize];
 };
@@ -115,134 +284,185 @@ class MIPMap {
 // MIPMap Method Definitions
 template <typename T>
 MIPMap<T>::MIPMap(const Point2i &res, const T *img, bool doTrilinear,
-                  Float maxAnisotropy, ImageWrap wrapMode)
+                  Float maxAnisotropy, ImageWrap wrapMode, bool nearest)
     : doTrilinear(doTrilinear),
+      nearest(nearest),
       maxAnisotropy(maxAnisotropy),
       wrapMode(wrapMode),
-      resolution(res) {
-    ProfilePhase _(Prof::MIPMapCreation);
+      resolution(res),
+      image(new T[res.x * res.y]),
+      imageResolution(res) {
+    std::copy(img, img + res.x * res.y, image.get());
+    // Filtered MIPMaps are built from the image resampled to a power-of-two
+    // resolution
+    if (!nearest)
+        resolution = Point2i(RoundUpPow2(res[0]), RoundUpPow2(res[1]));
+    nLevels = nearest ? 1 : 1 + Log2Int(std::max(resolution[0], resolution[1]));
+    nMIPMapLevels += nLevels;
+    pyramid.resize(nLevels);
+    palettes.resize(nLevels);
+    paletteIndices.resize(nLevels);
+    levelOnce.reset(new std::once_flag[nLevels]);
+    levelBuilt.reset(new std::atomic<bool>[nLevels]);
+    for (int i = 0; i < nLevels; ++i) levelBuilt[i] = false;
+    InitWeightLut();
+}
 
-    std::unique_ptr<T[]> resampledImage = nullptr;
-    if (!IsPowerOf2(resolution[0]) || !IsPowerOf2(resolution[1])) {
-        // Resample image to power-of-two resolution
-        Point2i resPow2(RoundUpPow2(resolution[0]), RoundUpPow2(resolution[1]));
-        LOG(INFO) << "Resampling MIPMap from " << resolution << " to " <<
-            resPow2 << ". Ratio= " << (Float(resPow2.x * resPow2.y) /
-                                       Float(resolution.x * resolution.y));
-        // Resample image in $s$ direction
-        std::unique_ptr<ResampleWeight[]> sWeights =
-            resampleWeights(resolution[0], resPow2[0]);
-        resampledImage.reset(new T[resPow2[0] * resPow2[1]]);
-
-        // Apply _sWeights_ to zoom in $s$ direction
-        ParallelFor([&](int t) {
-            for (int s = 0; s < resPow2[0]; ++s) {
-                // Compute texel $(s,t)$ in $s$-zoomed image
-                resampledImage[t * resPow2[0] + s] = 0.f;
-                for (int j = 0; j < 4; ++j) {
-                    int origS = sWeights[s].firstTexel + j;
-                    if (wrapMode == ImageWrap::Repeat)
-                        origS = Mod(origS, resolution[0]);
-                    else if (wrapMode == ImageWrap::Clamp)
-                        origS = Clamp(origS, 0, resolution[0] - 1);
-                    if (origS >= 0 && origS < (int)resolution[0])
-                        resampledImage[t * resPow2[0] + s] +=
-                            sWeights[s].weight[j] *
-                            img[t * resolution[0] + origS];
-                }
+template <typename T>
+std::unique_ptr<T[]> MIPMap<T>::ResampleImage() const {
+    // Resample image to power-of-two resolution
+    const Point2i &resPow2 = resolution;
+    const T *img = image.get();
+    LOG(INFO) << "Resampling MIPMap from " << imageResolution << " to " <<
+        resPow2 << ". Ratio= " << (Float(resPow2.x * resPow2.y) /
+                                   Float(imageResolution.x * imageResolution.y));
+    // Resample image in $s$ direction
+    std::unique_ptr<ResampleWeight[]> sWeights =
+        resampleWeights(imageResolution[0], resPow2[0]);
+    std::unique_ptr<Value[]> resampledValues(
+        new Value[resPow2[0] * resPow2[1]]);
+
+    // Apply _sWeights_ to zoom in $s$ direction
+    ParallelFor([&](int t) {
+        for (int s = 0; s < resPow2[0]; ++s) {
+            // Compute texel $(s,t)$ in $s$-zoomed image
+            resampledValues[t * resPow2[0] + s] = 0.f;
+            for (int j = 0; j < 4; ++j) {
+                int origS = sWeights[s].firstTexel + j;
+                if (wrapMode == ImageWrap::Repeat)
+                    origS = Mod(origS, imageResolution[0]);
+                else if (wrapMode == ImageWrap::Clamp)
+                    origS = Clamp(origS, 0, imageResolution[0] - 1);
+                if (origS >= 0 && origS < (int)imageResolution[0])
+                    resampledValues[t * resPow2[0] + s] +=
+                        sWeights[s].weight[j] *
+                        TexelTraits<T>::Decode(
+                            img[t * imageResolution[0] + origS]);
             }
-        }, resolution[1], 16);
-
-        // Resample image in $t$ direction
-        std::unique_ptr<ResampleWeight[]> tWeights =
-            resampleWeights(resolution[1], resPow2[1]);
-        std::vector<T *> resampleBufs;
-        int nThreads = MaxThreadIndex();
-        for (int i = 0; i < nThreads; ++i)
-            resampleBufs.push_back(new T[resPow2[1]]);
-        ParallelFor([&](int s) {
-            T *workData = resampleBufs[ThreadIndex];
-            for (int t = 0; t < resPow2[1]; ++t) {
-                workData[t] = 0.f;
-                for (int j = 0; j < 4; ++j) {
-                    int offset = tWeights[t].firstTexel + j;
-                    if (wrapMode == ImageWrap::Repeat)
-                        offset = Mod(offset, resolution[1]);
-                    else if (wrapMode == ImageWrap::Clamp)
-                        offset = Clamp(offset, 0, (int)resolution[1] - 1);
-                    if (offset >= 0 && offset < (int)resolution[1])
-                        workData[t] += tWeights[t].weight[j] *
-                                       resampledImage[offset * resPow2[0] + s];
-                }
+        }
+    }, imageResolution[1], 16);
+
+    // Resample image in $t$ direction
+    std::unique_ptr<ResampleWeight[]> tWeights =
+        resampleWeights(imageResolution[1], resPow2[1]);
+    std::vector<Value *> resampleBufs;
+    int nThreads = MaxThreadIndex();
+    for (int i = 0; i < nThreads; ++i)
+        resampleBufs.push_back(new Value[resPow2[1]]);
+    std::unique_ptr<T[]> resampledImage(new T[resPow2[0] * resPow2[1]]);
+    ParallelFor([&](int s) {
+        Value *workData = resampleBufs[ThreadIndex];
+        for (int t = 0; t < resPow2[1]; ++t) {
+            workData[t] = 0.f;
+            for (int j = 0; j < 4; ++j) {
+                int offset = tWeights[t].firstTexel + j;
+                if (wrapMode == ImageWrap::Repeat)
+                    offset = Mod(offset, imageResolution[1]);
+                else if (wrapMode == ImageWrap::Clamp)
+                    offset = Clamp(offset, 0, (int)imageResolution[1] - 1);
+                if (offset >= 0 && offset < (int)imageResolution[1])
+                    workData[t] += tWeights[t].weight[j] *
+                                   resampledValues[offset * resPow2[0] + s];
             }
-            for (int t = 0; t < resPow2[1]; ++t)
-                resampledImage[t * resPow2[0] + s] = clamp(workData[t]);
-        }, resPow2[0], 32);
-        for (auto ptr : resampleBufs) delete[] ptr;
-        resolution = resPow2;
-    }
-    // Initialize levels of MIPMap from image
-    int nLevels = 1 + Log2Int(std::max(resolution[0], resolution[1]));
-    pyramid.resize(nLevels);
+        }
+        for (int t = 0; t < resPow2[1]; ++t)
+            resampledImage[t * resPow2[0] + s] =
+                TexelTraits<T>::Encode(clamp(workData[t]));
+    }, resPow2[0], 32);
+    for (auto ptr : resampleBufs) delete[] ptr;
+    return resampledImage;
+}
 
-    // Initialize most detailed level of MIPMap
-    pyramid[0].reset(
-        new BlockedArray<T>(resolution[0], resolution[1],
-                            resampledImage ? resampledImage.get() : img));
-    for (int i = 1; i < nLevels; ++i) {
+template <typename T>
+void MIPMap<T>::BuildLevel(int level) const {
+    ProfilePhase _(Prof::MIPMapCreation);
+    ++nMIPMapLevelsBuilt;
+    if (level == 0) {
+        // Initialize most detailed level of MIPMap
+        if (resolution == imageResolution)
+            pyramid[0].reset(new BlockedArray<T>(resolution[0], resolution[1],
+                                                 image.get()));
+        else
+            pyramid[0].reset(new BlockedArray<T>(
+                resolution[0], resolution[1], ResampleImage().get()));
+        image.reset();
+    } else {
         // Initialize $i$th MIPMap level from $i-1$st level
-        int sRes = std::max(1, pyramid[i - 1]->uSize() / 2);
-        int tRes = std::max(1, pyramid[i - 1]->vSize() / 2);
-        pyramid[i].reset(new BlockedArray<T>(sRes, tRes));
+        EnsureLevel(level - 1);
+        Point2i res = LevelResolution(level);
+        int sRes = res[0], tRes = res[1];
+        pyramid[level].reset(new BlockedArray<T>(sRes, tRes));
 
         // Filter four texels from finer level of pyramid
+        auto texel = [&](int s, int t) {
+            return TexelTraits<T>::Decode(Texel(level - 1, s, t));
+        };
         ParallelFor([&](int t) {
             for (int s = 0; s < sRes; ++s)
-                (*pyramid[i])(s, t) =
-                    .25f * (Texel(i - 1, 2 * s, 2 * t) +
-                            Texel(i - 1, 2 * s + 1, 2 * t) +
-                            Texel(i - 1, 2 * s, 2 * t + 1) +
-                            Texel(i - 1, 2 * s + 1, 2 * t + 1));
+                (*pyramid[level])(s, t) = TexelTraits<T>::Encode(
+                    .25f * (texel(2 * s, 2 * t) + texel(2 * s + 1, 2 * t) +
+                            texel(2 * s, 2 * t + 1) +
+                            texel(2 * s + 1, 2 * t + 1)));
         }, tRes, 16);
     }
+    PalettizeLevel(level);
+}
 
-    // Initialize EWA filter weights if needed
-    if (weightLut[0] == 0.) {
-        for (int i = 0; i < WeightLUTSize; ++i) {
-            Float alpha = 2;
-            Float r2 = Float(i) / Float(WeightLUTSize - 1);
-            weightLut[i] = std::exp(-alpha * r2) - std::exp(-alpha);
-        }
-    }
-    mipMapMemory += (4 * resolution[0] * resolution[1] * sizeof(T)) / 3;
+template <typename T>
+MIPMap<T>::MIPMap(std::unique_ptr<TiledImage> tiledImage, bool flipY,
+                  bool doTrilinear, Float maxAnisotropy, ImageWrap wrapMode,
+                  bool nearest)
+    : doTrilinear(doTrilinear),
+      nearest(nearest),
+      maxAnisotropy(maxAnisotropy),
+      wrapMode(wrapMode),
+      resolution(tiledImage->LevelResolution(0)),
+      nLevels(nearest ? 1 : tiledImage->Levels()),
+      tiles(std::move(tiledImage)),
+      flipY(flipY) {
+    InitWeightLut();
 }
 
 template <typename T>
-const T &MIPMap<T>::Texel(int level, int s, int t) const {
-    CHECK_LT(level, pyramid.size());
-    const BlockedArray<T> &l = *pyramid[level];
+T MIPMap<T>::Texel(int level, int s, int t) const {
+    CHECK_LT(level, Levels());
+    Point2i res = LevelResolution(level);
     // Compute texel $(s,t)$ accounting for boundary conditions
     switch (wrapMode) {
     case ImageWrap::Repeat:
-        s = Mod(s, l.uSize());
-        t = Mod(t, l.vSize());
+        s = Mod(s, res.x);
+        t = Mod(t, res.y);
         break;
     case ImageWrap::Clamp:
-        s = Clamp(s, 0, l.uSize() - 1);
-        t = Clamp(t, 0, l.vSize() - 1);
+        s = Clamp(s, 0, res.x - 1);
+        t = Clamp(t, 0, res.y - 1);
         break;
-    case ImageWrap::Black: {
-        static const T black = 0.f;
-        if (s < 0 || s >= (int)l.uSize() || t < 0 || t >= (int)l.vSize())
-            return black;
+    case ImageWrap::Black:
+        if (s < 0 || s >= res.x || t < 0 || t >= res.y)
+            return TexelTraits<T>::Encode(Value(0.f));
         break;
     }
+    if (!tiles) {
+        EnsureLevel(level);
+        if (pyramid[level]) return (*pyramid[level])(s, t);
+        return palettes[level][(*paletteIndices[level])(s, t)];
     }
-    return l(s, t);
+
+    // Look up the texel in its tile of the tiled image
+    if (flipY) t = res.y - 1 - t;
+    int tileSize = tiles->TileSize(), nChannels = tiles->Channels();
+    const float *tile =
+        GetTextureTile(*tiles, level, s / tileSize, t / tileSize);
+    T texel;
+    FromTile(&tile[((t % tileSize) * tileSize + s % tileSize) * nChannels],
+             nChannels, &texel);
+    return texel;
 }
 
 template <typename T>
-T MIPMap<T>::Lookup(const Point2f &st, Float width) const {
+typename MIPMap<T>::Value MIPMap<T>::Lookup(const Point2f &st,
+                                            Float width) const {
+    if (nearest) return triangle(0, st);
     ++nTrilerpLookups;
     ProfilePhase p(Prof::TexFiltTrilerp);
     // Compute MIPMap level for trilinear filtering
@@ -252,7 +472,7 @@ T MIPMap<T>::Lookup(const Point2f &st, Float width) const {
     if (level < 0)
         return triangle(0, st);
     else if (level >= Levels() - 1)
-        return Texel(Levels() - 1, 0, 0);
+        return TexelTraits<T>::Decode(Texel(Levels() - 1, 0, 0));
     else {
         int iLevel = std::floor(level);
         Float delta = level - iLevel;
@@ -261,16 +481,20 @@ T MIPMap<T>::Lookup(const Point2f &st, Float width) const {
 }
 
 template <typename T>
-T MIPMap<T>::triangle(int level, const Point2f &st) const {
+typename MIPMap<T>::Value MIPMap<T>::triangle(int level,
+                                              const Point2f &st) const {
     level = Clamp(level, 0, Levels() - 1);
-    Float s = st[0] * pyramid[level]->uSize();
-    Float t = st[1] * pyramid[level]->vSize();
+    Point2i res = LevelResolution(level);
+    Float s = st[0] * res.x;
+    Float t = st[1] * res.y;
     int s0 = std::floor(s), t0 = std::floor(t);
-    return Texel(level, s0, t0);
+    return TexelTraits<T>::Decode(Texel(level, s0, t0));
 }
 
 template <typename T>
-T MIPMap<T>::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const {
+typename MIPMap<T>::Value MIPMap<T>::Lookup(const Point2f &st, Vector2f dst0,
+                                            Vector2f dst1) const {
+    if (nearest) return triangle(0, st);
     if (doTrilinear) {
         Float width = std::max(std::max(std::abs(dst0[0]), std::abs(dst0[1])),
                                std::max(std::abs(dst1[0]), std::abs(dst1[1])));
@@ -299,15 +523,18 @@ T MIPMap<T>::Lookup(const Point2f &st, Vector2f dst0, Vector2f dst1) const {
 }
 
 template <typename T>
-T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
-    if (level >= Levels()) return Texel(Levels() - 1, 0, 0);
+typename MIPMap<T>::Value MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0,
+                                        Vector2f dst1) const {
+    if (level >= Levels())
+        return TexelTraits<T>::Decode(Texel(Levels() - 1, 0, 0));
     // Convert EWA coordinates to appropriate scale for level
-    st[0] = st[0] * pyramid[level]->uSize() - 0.5f;
-    st[1] = st[1] * pyramid[level]->vSize() - 0.5f;
-    dst0[0] *= pyramid[level]->uSize();
-    dst0[1] *= pyramid[level]->vSize();
-    dst1[0] *= pyramid[level]->uSize();
-    dst1[1] *= pyramid[level]->vSize();
+    Point2i res = LevelResolution(level);
+    st[0] = st[0] * res.x - 0.5f;
+    st[1] = st[1] * res.y - 0.5f;
+    dst0[0] *= res.x;
+    dst0[1] *= res.y;
+    dst1[0] *= res.x;
+    dst1[1] *= res.y;
 
     // Compute ellipse coefficients to bound EWA filter region
     Float A = dst0[1] * dst0[1] + dst1[1] * dst1[1] + 1;
@@ -328,7 +555,7 @@ T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
     int t1 = std::floor(st[1] + 2 * invDet * vSqrt);
 
     // Scan over ellipse bound and compute quadratic equation
-    T sum(0.f);
+    Value sum(0.f);
     Float sumWts = 0;
     for (int it = t0; it <= t1; ++it) {
         Float tt = it - st[1];
@@ -340,7 +567,7 @@ T MIPMap<T>::EWA(int level, Point2f st, Vector2f dst0, Vector2f dst1) const {
                 int index =
                     std::min((int)(r2 * WeightLUTSize), WeightLUTSize - 1);
                 Float weight = weightLut[index];
-                sum += Texel(level, is, it) * weight;
+                sum += TexelTraits<T>::Decode(Texel(level, is, it)) * weight;
                 sumWts += weight;
             }
         }
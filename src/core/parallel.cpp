@@ -87,6 +87,9 @@ class ParallelForLoop {
     int activeWorkers = 0;
     ParallelForLoop *next = nullptr;
     int nX = -1;
+    // Set for the single-iteration loops of EnqueueTask(), which nobody
+    // waits on; the worker that runs them frees them.
+    bool isTask = false;
 
     // ParallelForLoop Private Methods
     bool Finished() const {
@@ -109,6 +112,18 @@ void Barrier::Wait() {
 
 static std::condition_variable workListCondition;
 
+// Unlinks _loop_, if it's still in _workList_, once its last iterations
+// have been claimed. Threads helping with their own loops can't assume
+// it's at the head of the list, since worker threads running tasks may
+// have started loops of their own since.
+static void RemoveFromWorkList(ParallelForLoop *loop) {
+    for (ParallelForLoop **prev = &workList; *prev; prev = &(*prev)->next)
+        if (*prev == loop) {
+            *prev = loop->next;
+            return;
+        }
+}
+
 static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     LOG(INFO) << "Started execution in worker thread " << tIndex;
     ThreadIndex = tIndex;
@@ -174,7 +189,12 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
 
             // Update _loop_ to reflect completion of iterations
             loop.activeWorkers--;
-            if (loop.Finished()) workListCondition.notify_all();
+            if (loop.Finished()) {
+                if (loop.isTask)
+                    delete &loop;
+                else
+                    workListCondition.notify_all();
+            }
         }
     }
     LOG(INFO) << "Exiting worker thread " << tIndex;
@@ -213,7 +233,7 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
 
         // Update _loop_ to reflect iterations this thread will run
         loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
+        if (loop.nextIndex == loop.maxIndex) RemoveFromWorkList(&loop);
         loop.activeWorkers++;
 
         // Run loop indices in _[indexStart, indexEnd)_
@@ -238,6 +258,23 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count,
     }
 }
 
+void EnqueueTask(std::function<void()> task) {
+    CHECK(threads.size() > 0 || MaxThreadIndex() == 1);
+    if (threads.empty()) {
+        task();
+        return;
+    }
+
+    ParallelForLoop *loop =
+        new ParallelForLoop([task](int64_t) { task(); }, 1, 1,
+                            CurrentProfilerState());
+    loop->isTask = true;
+    std::lock_guard<std::mutex> lock(workListMutex);
+    loop->next = workList;
+    workList = loop;
+    workListCondition.notify_all();
+}
+
 PBRT_THREAD_LOCAL int ThreadIndex;
 
 int MaxThreadIndex() {
@@ -273,7 +310,7 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count) {
 
         // Update _loop_ to reflect iterations this thread will run
         loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
+        if (loop.nextIndex == loop.maxIndex) RemoveFromWorkList(&loop);
         loop.activeWorkers++;
 
         // Run loop indices in _[indexStart, indexEnd)_
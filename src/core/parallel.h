@@ -45,6 +45,8 @@
 #include <condition_variable>
 #include <functional>
 #include <atomic>
+#include <future>
+#include <memory>
 
 namespace pbrt {
 
@@ -101,6 +103,19 @@ class Barrier {
 void ParallelFor(std::function<void(int64_t)> func, int64_t count,
                  int chunkSize = 1);
 extern PBRT_THREAD_LOCAL int ThreadIndex;
+// Queues |task| to run once on a worker thread; without worker threads,
+// it runs before EnqueueTask() returns.
+void EnqueueTask(std::function<void()> task);
+// Runs |func| asynchronously on the thread pool and returns a future for
+// its result.
+template <typename F>
+std::shared_future<typename std::result_of<F()>::type> RunAsync(F func) {
+    using T = typename std::result_of<F()>::type;
+    auto task = std::make_shared<std::packaged_task<T()>>(std::move(func));
+    std::shared_future<T> future = task->get_future().share();
+    EnqueueTask([task]() { (*task)(); });
+    return future;
+}
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count);
 int MaxThreadIndex();
 int NumSystemCores();
@@ -758,9 +758,12 @@ std::shared_ptr<Texture<Spectrum>> TextureParams::GetSpectrumTextureOrNull(
 
     // We have a texture name, from either the shape or the material's
     // parameters.
-    if (spectrumTextures.find(name) != spectrumTextures.end())
+    if (spectrumTextures.find(name) != spectrumTextures.end()) {
+        texturesNeedDifferentials |=
+            spectrumTextures[name]->NeedsDifferentials();
+        texturesPeriodic &= spectrumTextures[name]->IsPeriodic();
         return spectrumTextures[name];
-    else {
+    } else {
         Error("Couldn't find spectrum texture named \"%s\" for parameter \"%s\"",
               name.c_str(), n.c_str());
         return nullptr;
@@ -808,9 +811,11 @@ std::shared_ptr<Texture<Float>> TextureParams::GetFloatTextureOrNull(
 
     // We have a texture name, from either the shape or the material's
     // parameters.
-    if (floatTextures.find(name) != floatTextures.end())
+    if (floatTextures.find(name) != floatTextures.end()) {
+        texturesNeedDifferentials |= floatTextures[name]->NeedsDifferentials();
+        texturesPeriodic &= floatTextures[name]->IsPeriodic();
         return floatTextures[name];
-    else {
+    } else {
         Error("Couldn't find float texture named \"%s\" for parameter \"%s\"",
               name.c_str(), n.c_str());
         return nullptr;
@@ -213,6 +213,10 @@ class TextureParams {
                                           materialParams.FindOneSpectrum(n, d));
     }
     void ReportUnused() const;
+    // Returns true if any texture looked up so far uses ray differentials
+    bool TexturesNeedDifferentials() const { return texturesNeedDifferentials; }
+    // Returns true if every texture looked up so far is periodic in (u,v)
+    bool TexturesPeriodic() const { return texturesPeriodic; }
     const ParamSet &GetGeomParams() const { return geomParams; }
     const ParamSet &GetMaterialParams() const { return materialParams; }
 
@@ -221,6 +225,8 @@ class TextureParams {
     std::map<std::string, std::shared_ptr<Texture<Float>>> &floatTextures;
     std::map<std::string, std::shared_ptr<Texture<Spectrum>>> &spectrumTextures;
     const ParamSet &geomParams, &materialParams;
+    mutable bool texturesNeedDifferentials = false;
+    mutable bool texturesPeriodic = true;
 };
 
 }  // namespace pbrt
@@ -60,6 +60,7 @@
 namespace pbrt {
 
 Loc *parserLoc;
+PBRT_THREAD_LOCAL const Loc *threadParserLoc;
 
 static std::string toString(string_view s) {
     return std::string(s.data(), s.size());
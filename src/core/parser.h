@@ -59,6 +59,10 @@ struct Loc {
 
 // If not nullptr, stores the current file location of the parser.
 extern Loc *parserLoc;
+// If not nullptr, used in place of _parserLoc_ for messages from the
+// current thread, e.g. by a task created for a statement the parser has
+// since moved past.
+extern PBRT_THREAD_LOCAL const Loc *threadParserLoc;
 
 // Reimplement enough of absl/std::string_view as needed for the below
 // (Bringing on the abseil dependency at this point just for this seems
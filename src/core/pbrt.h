@@ -123,6 +123,7 @@ template <int nSpectrumSamples>
 class CoefficientSpectrum;
 class RGBSpectrum;
 class SampledSpectrum;
+struct RGBA8;
 #ifdef PBRT_SAMPLED_SPECTRUM
   typedef SampledSpectrum Spectrum;
 #else
@@ -152,6 +153,7 @@ struct BSSRDFTable;
 class Light;
 class VisibilityTester;
 class AreaLight;
+class LightDistribution;
 struct Distribution1D;
 class Distribution2D;
 #ifdef PBRT_FLOAT_AS_DOUBLE
@@ -179,6 +181,12 @@ struct Options {
     bool quickRender = false;
     bool quiet = false;
     bool cat = false, toPly = false;
+    bool cullHiddenFaces = false;
+    bool mergeQuads = false;
+    // Budget for the tiles of tiled image files kept in memory
+    int textureCacheMB = 512;
+    // Directory of BVHs saved by earlier runs; empty to always build them
+    std::string bvhCacheDir;
     std::string imageFile;
     // x0, x1, y0, y1
     Float cropWindow[2][2];
@@ -43,6 +43,21 @@ STAT_MEMORY_COUNTER("Memory/Primitives", primitiveMemory);
 
 // Primitive Method Definitions
 Primitive::~Primitive() {}
+bool Aggregate::Intersect(const Ray &r, SurfaceInteraction *isect) const {
+    PrimitiveHit closest;
+    if (!IntersectHit(r, &closest)) return false;
+    // Only build the _SurfaceInteraction_ for the closest hit
+    closest.primitive->ComputeIntersection(r, closest, isect);
+    return true;
+}
+
+void Aggregate::ComputeIntersection(const Ray &r, const PrimitiveHit &hit,
+                                    SurfaceInteraction *isect) const {
+    LOG(FATAL) <<
+        "Aggregate::ComputeIntersection() method"
+        "called; should have gone to GeometricPrimitive";
+}
+
 const AreaLight *Aggregate::GetAreaLight() const {
     LOG(FATAL) <<
         "Aggregate::GetAreaLight() method"
@@ -88,6 +103,39 @@ bool TransformedPrimitive::Intersect(const Ray &r,
     return true;
 }
 
+bool TransformedPrimitive::IntersectHit(const Ray &r,
+                                        PrimitiveHit *hit) const {
+    // Find the instance's closest hit in its own space, remembering the
+    // primitive that was hit so that the intersection can be computed
+    // without intersecting again
+    Transform InterpolatedPrimToWorld;
+    PrimitiveToWorld.Interpolate(r.time, &InterpolatedPrimToWorld);
+    Ray ray = Inverse(InterpolatedPrimToWorld)(r);
+    PrimitiveHit instanceHit;
+    if (!primitive->IntersectHit(ray, &instanceHit)) return false;
+    r.tMax = ray.tMax;
+    hit->primitive = this;
+    hit->instancePrimitive = instanceHit.primitive;
+    hit->shapeHit = instanceHit.shapeHit;
+    return true;
+}
+
+void TransformedPrimitive::ComputeIntersection(const Ray &r,
+                                               const PrimitiveHit &hit,
+                                               SurfaceInteraction *isect) const {
+    Transform InterpolatedPrimToWorld;
+    PrimitiveToWorld.Interpolate(r.time, &InterpolatedPrimToWorld);
+    Ray ray = Inverse(InterpolatedPrimToWorld)(r);
+    PrimitiveHit instanceHit;
+    instanceHit.primitive = hit.instancePrimitive;
+    instanceHit.shapeHit = hit.shapeHit;
+    hit.instancePrimitive->ComputeIntersection(ray, instanceHit, isect);
+    // Transform instance's intersection data to world space
+    if (!InterpolatedPrimToWorld.IsIdentity())
+        *isect = InterpolatedPrimToWorld(*isect);
+    CHECK_GE(Dot(isect->n, isect->shading.n), 0);
+}
+
 bool TransformedPrimitive::IntersectP(const Ray &r) const {
     Transform InterpolatedPrimToWorld;
     PrimitiveToWorld.Interpolate(r.time, &InterpolatedPrimToWorld);
@@ -129,6 +177,27 @@ bool GeometricPrimitive::Intersect(const Ray &r,
     return true;
 }
 
+bool GeometricPrimitive::IntersectHit(const Ray &r, PrimitiveHit *hit) const {
+    if (!shape->IntersectHit(r, &hit->shapeHit)) return false;
+    r.tMax = hit->shapeHit.t;
+    hit->primitive = this;
+    return true;
+}
+
+void GeometricPrimitive::ComputeIntersection(const Ray &r,
+                                             const PrimitiveHit &hit,
+                                             SurfaceInteraction *isect) const {
+    shape->ComputeInteraction(r, hit.shapeHit, isect);
+    isect->primitive = this;
+    CHECK_GE(Dot(isect->n, isect->shading.n), 0.);
+    // Initialize _SurfaceInteraction::mediumInterface_ after _Shape_
+    // intersection
+    if (mediumInterface.IsMediumTransition())
+        isect->mediumInterface = mediumInterface;
+    else
+        isect->mediumInterface = MediumInterface(r.medium);
+}
+
 const AreaLight *GeometricPrimitive::GetAreaLight() const {
     return areaLight.get();
 }
@@ -47,6 +47,16 @@
 
 namespace pbrt {
 
+// PrimitiveHit Declarations
+struct PrimitiveHit {
+    const Primitive *primitive = nullptr;
+    // For hits inside an object instance, _primitive_ is the
+    // _TransformedPrimitive_ and _instancePrimitive_ is the primitive that
+    // was hit in the instance's space
+    const Primitive *instancePrimitive = nullptr;
+    ShapeHit shapeHit;
+};
+
 // Primitive Declarations
 class Primitive {
   public:
@@ -55,6 +65,11 @@ class Primitive {
     virtual Bounds3f WorldBound() const = 0;
     virtual bool Intersect(const Ray &r, SurfaceInteraction *) const = 0;
     virtual bool IntersectP(const Ray &r) const = 0;
+    // Two-phase intersection, as with _Shape::IntersectHit()_; _r.tMax_ is
+    // updated as with _Intersect()_
+    virtual bool IntersectHit(const Ray &r, PrimitiveHit *hit) const = 0;
+    virtual void ComputeIntersection(const Ray &r, const PrimitiveHit &hit,
+                                     SurfaceInteraction *isect) const = 0;
     virtual const AreaLight *GetAreaLight() const = 0;
     virtual const Material *GetMaterial() const = 0;
     virtual void ComputeScatteringFunctions(SurfaceInteraction *isect,
@@ -70,12 +85,22 @@ class GeometricPrimitive : public Primitive {
     virtual Bounds3f WorldBound() const;
     virtual bool Intersect(const Ray &r, SurfaceInteraction *isect) const;
     virtual bool IntersectP(const Ray &r) const;
+    bool IntersectHit(const Ray &r, PrimitiveHit *hit) const;
+    void ComputeIntersection(const Ray &r, const PrimitiveHit &hit,
+                             SurfaceInteraction *isect) const;
     GeometricPrimitive(const std::shared_ptr<Shape> &shape,
                        const std::shared_ptr<Material> &material,
                        const std::shared_ptr<AreaLight> &areaLight,
                        const MediumInterface &mediumInterface);
     const AreaLight *GetAreaLight() const;
     const Material *GetMaterial() const;
+    const std::shared_ptr<Shape> &GetShape() const { return shape; }
+    const std::shared_ptr<Material> &GetSharedMaterial() const {
+        return material;
+    }
+    const MediumInterface &GetMediumInterface() const {
+        return mediumInterface;
+    }
     void ComputeScatteringFunctions(SurfaceInteraction *isect,
                                     MemoryArena &arena, TransportMode mode,
                                     bool allowMultipleLobes) const;
@@ -96,6 +121,9 @@ class TransformedPrimitive : public Primitive {
                          const AnimatedTransform &PrimitiveToWorld);
     bool Intersect(const Ray &r, SurfaceInteraction *in) const;
     bool IntersectP(const Ray &r) const;
+    bool IntersectHit(const Ray &r, PrimitiveHit *hit) const;
+    void ComputeIntersection(const Ray &r, const PrimitiveHit &hit,
+                             SurfaceInteraction *isect) const;
     const AreaLight *GetAreaLight() const { return nullptr; }
     const Material *GetMaterial() const { return nullptr; }
     void ComputeScatteringFunctions(SurfaceInteraction *isect,
@@ -119,6 +147,12 @@ class TransformedPrimitive : public Primitive {
 class Aggregate : public Primitive {
   public:
     // Aggregate Public Methods
+
+    // Aggregates implement _IntersectHit()_; the hits they report refer to
+    // the primitives they hold, which then compute the intersection
+    bool Intersect(const Ray &r, SurfaceInteraction *isect) const;
+    void ComputeIntersection(const Ray &r, const PrimitiveHit &hit,
+                             SurfaceInteraction *isect) const;
     const AreaLight *GetAreaLight() const;
     const Material *GetMaterial() const;
     void ComputeScatteringFunctions(SurfaceInteraction *isect,
@@ -126,6 +160,9 @@ class Aggregate : public Primitive {
                                     bool allowMultipleLobes) const;
 };
 
+// A scene's primitives, shared with aggregates that refer to them by index
+typedef std::vector<std::shared_ptr<Primitive>> PrimitiveStore;
+
 }  // namespace pbrt
 
 #endif  // PBRT_CORE_PRIMITIVE_H
@@ -156,6 +156,89 @@ Point2f UniformSampleTriangle(const Point2f &u) {
     return Point2f(1 - su0, u[1] * su0);
 }
 
+// The projection of the rectangle with corner _s_ and orthogonal edges _ex_
+// and _ey_ onto the unit sphere around _p_, expressed in the local frame of
+// Urena et al., "An Area-Preserving Parametrization for Spherical
+// Rectangles" (2013).
+struct SphericalRectangle {
+    SphericalRectangle(const Point3f &p, const Point3f &s, const Vector3f &ex,
+                       const Vector3f &ey) {
+        Float exl = ex.Length(), eyl = ey.Length();
+        x = ex / exl;
+        y = ey / eyl;
+        z = Cross(x, y);
+        Vector3f d = s - p;
+        x0 = Dot(d, x);
+        y0 = Dot(d, y);
+        z0 = Dot(d, z);
+        // Flip _z_ so that it points away from the rectangle
+        if (z0 > 0) {
+            z = -z;
+            z0 = -z0;
+        }
+        x1 = x0 + exl;
+        y1 = y0 + eyl;
+        if (z0 == 0 || exl == 0 || eyl == 0) {
+            solidAngle = 0;
+            return;
+        }
+
+        // Compute the normals of the planes through _p_ and each edge
+        Vector3f v00(x0, y0, z0), v01(x0, y1, z0);
+        Vector3f v10(x1, y0, z0), v11(x1, y1, z0);
+        n0 = Normalize(Cross(v00, v10));
+        n1 = Normalize(Cross(v10, v11));
+        n2 = Normalize(Cross(v11, v01));
+        n3 = Normalize(Cross(v01, v00));
+
+        // The solid angle is the excess of the interior angles over $2\pi$
+        g0 = std::acos(Clamp(-Dot(n0, n1), -1, 1));
+        g1 = std::acos(Clamp(-Dot(n1, n2), -1, 1));
+        g2 = std::acos(Clamp(-Dot(n2, n3), -1, 1));
+        g3 = std::acos(Clamp(-Dot(n3, n0), -1, 1));
+        solidAngle = std::max((Float)0, g0 + g1 + g2 + g3 - 2 * Pi);
+    }
+
+    Vector3f x, y, z, n0, n1, n2, n3;
+    Float x0, y0, z0, x1, y1;
+    Float g0, g1, g2, g3, solidAngle;
+};
+
+Point3f SampleSphericalRectangle(const Point3f &p, const Point3f &s,
+                                 const Vector3f &ex, const Vector3f &ey,
+                                 const Point2f &u, Float *pdf) {
+    SphericalRectangle rect(p, s, ex, ey);
+    if (rect.solidAngle == 0) {
+        *pdf = 0;
+        return s + u[0] * ex + u[1] * ey;
+    }
+    *pdf = 1 / rect.solidAngle;
+
+    // Invert the solid angle of the sub-rectangle left of $x_u$ to find $x_u$
+    Float au = u[0] * rect.solidAngle - rect.g2 - rect.g3;
+    Float b0 = rect.n0.z, b1 = rect.n2.z;
+    Float fu = (std::cos(au) * b0 - b1) / std::sin(au);
+    Float cu = std::copysign(1 / std::sqrt(fu * fu + b0 * b0), fu);
+    cu = Clamp(cu, -OneMinusEpsilon, OneMinusEpsilon);
+    Float xu = -(cu * rect.z0) / std::sqrt(1 - cu * cu);
+    xu = Clamp(xu, rect.x0, rect.x1);
+
+    // Sample $y_v$ uniformly in the projected height along $x_u$
+    Float d = std::sqrt(xu * xu + rect.z0 * rect.z0);
+    Float h0 = rect.y0 / std::sqrt(d * d + rect.y0 * rect.y0);
+    Float h1 = rect.y1 / std::sqrt(d * d + rect.y1 * rect.y1);
+    Float hv = Lerp(u[1], h0, h1), hv2 = hv * hv;
+    Float yv = (hv2 < 1 - 1e-6f) ? (hv * d) / std::sqrt(1 - hv2) : rect.y1;
+    yv = Clamp(yv, rect.y0, rect.y1);
+    return p + xu * rect.x + yv * rect.y + rect.z0 * rect.z;
+}
+
+Float SphericalRectanglePdf(const Point3f &p, const Point3f &s,
+                            const Vector3f &ex, const Vector3f &ey) {
+    Float solidAngle = SphericalRectangle(p, s, ex, ey).solidAngle;
+    return solidAngle > 0 ? 1 / solidAngle : 0;
+}
+
 Distribution2D::Distribution2D(const Float *func, int nu, int nv) {
     pConditionalV.reserve(nv);
     for (int v = 0; v < nv; ++v) {
@@ -120,6 +120,11 @@ Float UniformConePdf(Float thetamax);
 Point2f UniformSampleDisk(const Point2f &u);
 Point2f ConcentricSampleDisk(const Point2f &u);
 Point2f UniformSampleTriangle(const Point2f &u);
+Point3f SampleSphericalRectangle(const Point3f &p, const Point3f &s,
+                                 const Vector3f &ex, const Vector3f &ey,
+                                 const Point2f &u, Float *pdf);
+Float SphericalRectanglePdf(const Point3f &p, const Point3f &s,
+                            const Vector3f &ex, const Vector3f &ey);
 class Distribution2D {
   public:
     // Distribution2D Public Methods
@@ -53,6 +53,26 @@ Shape::Shape(const Transform *ObjectToWorld, const Transform *WorldToObject,
 
 Bounds3f Shape::WorldBound() const { return (*ObjectToWorld)(ObjectBound()); }
 
+bool Shape::IntersectHit(const Ray &ray, ShapeHit *hit,
+                         bool testAlphaTexture) const {
+    Float tHit;
+    SurfaceInteraction isect;
+    if (!Intersect(ray, &tHit, &isect, testAlphaTexture)) return false;
+    hit->t = tHit;
+    return true;
+}
+
+void Shape::ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                               SurfaceInteraction *isect) const {
+    // Intersect again; nothing closer than the hit can be found, while
+    // limiting _tMax_ to _hit.t_ could miss it due to the error bounds
+    Ray r = ray;
+    r.tMax = Infinity;
+    Float tHit;
+    bool found = Intersect(r, &tHit, isect);
+    CHECK(found);
+}
+
 Interaction Shape::Sample(const Interaction &ref, const Point2f &u,
                           Float *pdf) const {
     Interaction intr = Sample(u, pdf);
@@ -47,6 +47,20 @@
 
 namespace pbrt {
 
+// ShapeHit Declarations
+
+// What a shape records about a hit while the closest one is being found;
+// _Shape::ComputeInteraction()_ turns it into a full _SurfaceInteraction_.
+// Apart from _t_, the meaning of the fields is up to each shape: e.g. the
+// hit point and surface parameters, barycentrics, or a face index.
+struct ShapeHit {
+    Float t;
+    Point3f p;
+    Point2f uv;
+    Float b[3];
+    int index;
+};
+
 // Shape Declarations
 class Shape {
   public:
@@ -63,6 +77,14 @@ class Shape {
                             bool testAlphaTexture = true) const {
         return Intersect(ray, nullptr, nullptr, testAlphaTexture);
     }
+    // Two-phase intersection: _IntersectHit()_ only fills in _hit_, which
+    // must be left untouched if there's no hit, and _ComputeInteraction()_
+    // later builds the _SurfaceInteraction_ for the hit that turned out to
+    // be the closest. The defaults are implemented with _Intersect()_.
+    virtual bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                              bool testAlphaTexture = true) const;
+    virtual void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                                    SurfaceInteraction *isect) const;
     virtual Float Area() const = 0;
     // Sample a point on the surface of the shape and return the PDF with
     // respect to area on the surface.
@@ -187,6 +187,14 @@ Float InterpolateSpectrumSamples(const Float *lambda, const Float *vals, int n,
     return Lerp(t, vals[offset], vals[offset + 1]);
 }
 
+static const Float *InitSRGB8ToLinear() {
+    static Float table[256];
+    for (int v = 0; v < 256; ++v) table[v] = InverseGammaCorrect(v / 255.f);
+    return table;
+}
+
+const Float *const SRGB8ToLinear = InitSRGB8ToLinear();
+
 const Float CIE_X[nCIESamples] = {
     // CIE X function values
     0.0001299000f,   0.0001458470f,   0.0001638021f,   0.0001840037f,
@@ -506,6 +506,17 @@ inline SampledSpectrum Lerp(Float t, const SampledSpectrum &s1,
     return (1 - t) * s1 + t * s2;
 }
 
+// RGBA8 Declarations
+
+// A texel as stored in 8-bit images: sRGB-encoded color and linear alpha.
+struct RGBA8 {
+    uint8_t r, g, b, a;
+};
+
+// The linear value of each 8-bit sRGB encoding _v_,
+// _InverseGammaCorrect(v / 255.f)_.
+extern const Float *const SRGB8ToLinear;
+
 void ResampleLinearSpectrum(const Float *lambdaIn, const Float *vIn, int nIn,
                             Float lambdaMin, Float lambdaMax, int nOut,
                             Float *vOut);
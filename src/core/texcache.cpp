@@ -0,0 +1,311 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/texcache.cpp*
+#include "texcache.h"
+#include "fileutil.h"
+#include "stats.h"
+#include <atomic>
+#include <list>
+#include <unordered_map>
+
+namespace pbrt {
+
+STAT_PERCENT("Texture/Tile cache hits", nTileHits, nTileLookups);
+STAT_COUNTER("Texture/Tiles evicted", nTilesEvicted);
+STAT_MEMORY_COUNTER("Memory/Texture tiles read", tileBytesRead);
+
+static const char tiledMagic[8] = {'p', 'b', 'r', 't', 't', 'i', 'l', 'e'};
+static const int tiledVersion = 1;
+
+// Tiled image files are little-endian; values are swapped on big-endian
+// hosts as they're read and written.
+static bool HostIsLittleEndian() {
+    const uint32_t one = 1;
+    return *reinterpret_cast<const uint8_t *>(&one) == 1;
+}
+
+static void SwapBytes(void *values, size_t count) {
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(values);
+    for (size_t i = 0; i < count; ++i, bytes += 4) {
+        std::swap(bytes[0], bytes[3]);
+        std::swap(bytes[1], bytes[2]);
+    }
+}
+
+// TiledImage Method Definitions
+bool IsTiledImageFile(const std::string &filename) {
+    return HasExtension(filename, ".tiled");
+}
+
+static int TilesAcross(int res, int tileSize) {
+    return (res + tileSize - 1) / tileSize;
+}
+
+std::unique_ptr<TiledImage> TiledImage::Open(const std::string &filename) {
+    static std::atomic<uint64_t> nextId{0};
+    std::unique_ptr<TiledImage> image(new TiledImage(filename));
+    image->id = nextId++;
+    image->file.open(filename, std::ios::binary);
+    char magic[8];
+    int32_t header[4];
+    if (!image->file.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + 8, tiledMagic) ||
+        !image->file.read(reinterpret_cast<char *>(header), sizeof(header))) {
+        Error("%s: not a tiled image file", filename.c_str());
+        return nullptr;
+    }
+    if (!HostIsLittleEndian()) SwapBytes(header, 4);
+    if (header[0] != tiledVersion) {
+        Error("%s: tiled image file version %d is unsupported",
+              filename.c_str(), header[0]);
+        return nullptr;
+    }
+    image->tileSize = header[1];
+    image->nChannels = header[2];
+    int nLevels = header[3];
+    if (image->tileSize <= 0 ||
+        (image->nChannels != 1 && image->nChannels != 3) || nLevels <= 0) {
+        Error("%s: invalid tiled image file header", filename.c_str());
+        return nullptr;
+    }
+    std::vector<int32_t> res(2 * nLevels);
+    if (!image->file.read(reinterpret_cast<char *>(res.data()),
+                          res.size() * sizeof(int32_t))) {
+        Error("%s: premature end of tiled image file", filename.c_str());
+        return nullptr;
+    }
+    if (!HostIsLittleEndian()) SwapBytes(res.data(), res.size());
+
+    // Compute the file offsets of the levels' tiles
+    uint64_t offset = sizeof(tiledMagic) + sizeof(header) +
+                      res.size() * sizeof(int32_t);
+    for (int level = 0; level < nLevels; ++level) {
+        Point2i r(res[2 * level], res[2 * level + 1]);
+        if (r.x <= 0 || r.y <= 0) {
+            Error("%s: invalid tiled image level resolution",
+                  filename.c_str());
+            return nullptr;
+        }
+        image->levelResolution.push_back(r);
+        image->levelOffset.push_back(offset);
+        offset += uint64_t(TilesAcross(r.x, image->tileSize)) *
+                  TilesAcross(r.y, image->tileSize) * image->TileBytes();
+    }
+    LOG(INFO) << "Opened tiled image " << filename << " ("
+              << image->levelResolution[0] << ", " << nLevels << " levels)";
+    return image;
+}
+
+bool TiledImage::ReadTile(int level, int tx, int ty, float *texels) const {
+    const Point2i &res = levelResolution[level];
+    CHECK(tx >= 0 && tx < TilesAcross(res.x, tileSize) && ty >= 0 &&
+          ty < TilesAcross(res.y, tileSize));
+    uint64_t offset =
+        levelOffset[level] +
+        (uint64_t(ty) * TilesAcross(res.x, tileSize) + tx) * TileBytes();
+    {
+        std::lock_guard<std::mutex> lock(fileMutex);
+        file.clear();
+        if (!file.seekg(offset) ||
+            !file.read(reinterpret_cast<char *>(texels), TileBytes())) {
+            Error("%s: unable to read tile (%d, %d) of level %d",
+                  filename.c_str(), tx, ty, level);
+            return false;
+        }
+    }
+    if (!HostIsLittleEndian()) SwapBytes(texels, TileBytes() / sizeof(float));
+    tileBytesRead += TileBytes();
+    return true;
+}
+
+bool WriteTiledImage(const std::string &filename, int tileSize, int nChannels,
+                     const std::vector<Point2i> &levelResolution,
+                     const std::vector<std::vector<float>> &levels) {
+    CHECK(nChannels == 1 || nChannels == 3);
+    CHECK_EQ(levelResolution.size(), levels.size());
+    std::ofstream file(filename, std::ios::binary);
+    std::vector<int32_t> header = {tiledVersion, tileSize, nChannels,
+                                   int32_t(levels.size())};
+    for (const Point2i &res : levelResolution) {
+        header.push_back(res.x);
+        header.push_back(res.y);
+    }
+    if (!HostIsLittleEndian()) SwapBytes(header.data(), header.size());
+    file.write(tiledMagic, sizeof(tiledMagic));
+    file.write(reinterpret_cast<const char *>(header.data()),
+               header.size() * sizeof(int32_t));
+
+    std::vector<float> tile(tileSize * tileSize * nChannels);
+    for (size_t level = 0; level < levels.size(); ++level) {
+        const Point2i &res = levelResolution[level];
+        CHECK_EQ(levels[level].size(), size_t(res.x) * res.y * nChannels);
+        for (int ty = 0; ty < TilesAcross(res.y, tileSize); ++ty)
+            for (int tx = 0; tx < TilesAcross(res.x, tileSize); ++tx) {
+                // Copy the tile's texels, padding it with zeros
+                std::fill(tile.begin(), tile.end(), 0.f);
+                for (int y = 0; y < tileSize; ++y)
+                    for (int x = 0; x < tileSize; ++x) {
+                        int s = tx * tileSize + x, t = ty * tileSize + y;
+                        if (s >= res.x || t >= res.y) continue;
+                        for (int c = 0; c < nChannels; ++c)
+                            tile[(y * tileSize + x) * nChannels + c] =
+                                levels[level][(t * res.x + s) * nChannels + c];
+                    }
+                if (!HostIsLittleEndian()) SwapBytes(tile.data(), tile.size());
+                file.write(reinterpret_cast<const char *>(tile.data()),
+                           tile.size() * sizeof(float));
+            }
+    }
+    if (!file) {
+        Error("%s: unable to write tiled image file", filename.c_str());
+        return false;
+    }
+    return true;
+}
+
+// TextureCache Local Definitions
+struct TileKey {
+    uint64_t imageId;
+    int level, tx, ty;
+    bool operator==(const TileKey &k) const {
+        return imageId == k.imageId && level == k.level && tx == k.tx &&
+               ty == k.ty;
+    }
+};
+
+struct TileKeyHash {
+    size_t operator()(const TileKey &k) const {
+        uint64_t h = k.imageId * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t(k.level) << 48) ^ (uint64_t(k.ty) << 24) ^ k.tx;
+        return h ^ (h >> 29);
+    }
+};
+
+typedef std::shared_ptr<const std::vector<float>> TilePtr;
+
+// The cache is split into shards with separate locks and LRU lists, each
+// with an equal part of the budget; a shard always keeps its most
+// recently used tile.
+class TextureCacheShard {
+  public:
+    TilePtr Lookup(const TileKey &key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto iter = tiles.find(key);
+        if (iter == tiles.end()) return nullptr;
+        // Move the tile to the front of the LRU list
+        lru.splice(lru.begin(), lru, iter->second);
+        return iter->second->second;
+    }
+    TilePtr Insert(const TileKey &key, TilePtr tile, size_t budget) {
+        std::lock_guard<std::mutex> lock(mutex);
+        // Another thread may have read the same tile meanwhile
+        auto iter = tiles.find(key);
+        if (iter != tiles.end()) return iter->second->second;
+        lru.emplace_front(key, tile);
+        tiles[key] = lru.begin();
+        bytes += tile->size() * sizeof(float);
+        while (bytes > budget && lru.size() > 1) {
+            bytes -= lru.back().second->size() * sizeof(float);
+            tiles.erase(lru.back().first);
+            lru.pop_back();
+            ++nTilesEvicted;
+        }
+        return tile;
+    }
+    void Clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        tiles.clear();
+        lru.clear();
+        bytes = 0;
+    }
+
+  private:
+    std::mutex mutex;
+    std::list<std::pair<TileKey, TilePtr>> lru;
+    std::unordered_map<TileKey, std::list<std::pair<TileKey, TilePtr>>::iterator,
+                       TileKeyHash>
+        tiles;
+    size_t bytes = 0;
+};
+
+static PBRT_CONSTEXPR int nCacheShards = 16;
+static TextureCacheShard cacheShards[nCacheShards];
+
+// Each thread's most recently used tiles; holding references to them
+// keeps them valid after they're evicted.
+static PBRT_CONSTEXPR int nRecentTiles = 4;
+struct RecentTiles {
+    TileKey keys[nRecentTiles];
+    TilePtr tiles[nRecentTiles];
+    int next = 0;
+};
+static PBRT_THREAD_LOCAL RecentTiles *recentTiles;
+
+// TextureCache Function Definitions
+const float *GetTextureTile(const TiledImage &image, int level, int tx,
+                            int ty) {
+    ++nTileLookups;
+    TileKey key{image.Id(), level, tx, ty};
+    if (!recentTiles) recentTiles = new RecentTiles;
+    for (int i = 0; i < nRecentTiles; ++i)
+        if (recentTiles->tiles[i] && recentTiles->keys[i] == key) {
+            ++nTileHits;
+            return recentTiles->tiles[i]->data();
+        }
+
+    TextureCacheShard &shard = cacheShards[TileKeyHash()(key) % nCacheShards];
+    TilePtr tile = shard.Lookup(key);
+    if (tile)
+        ++nTileHits;
+    else {
+        // Read the tile without holding the shard's lock
+        std::shared_ptr<std::vector<float>> texels =
+            std::make_shared<std::vector<float>>(image.TileBytes() /
+                                                 sizeof(float));
+        image.ReadTile(level, tx, ty, texels->data());
+        size_t budget = size_t(PbrtOptions.textureCacheMB) << 20;
+        tile = shard.Insert(key, texels, budget / nCacheShards);
+    }
+    int slot = recentTiles->next;
+    recentTiles->next = (slot + 1) % nRecentTiles;
+    recentTiles->keys[slot] = key;
+    recentTiles->tiles[slot] = tile;
+    return tile->data();
+}
+
+void ClearTextureCache() {
+    for (TextureCacheShard &shard : cacheShards) shard.Clear();
+}
+
+}  // namespace pbrt
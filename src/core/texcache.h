@@ -0,0 +1,118 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_TEXCACHE_H
+#define PBRT_CORE_TEXCACHE_H
+
+// core/texcache.h*
+#include "pbrt.h"
+#include "geometry.h"
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace pbrt {
+
+// Tiled image files (".tiled") hold a precomputed MIP map pyramid of
+// floating-point texels, split into square tiles so that images too large
+// to keep in memory can be paged in a tile at a time through the texture
+// cache. "imgtool maketiled" writes them from any image pbrt can read.
+//
+// A file starts with the string "pbrttile" and the int32 values version,
+// tile size, channel count (1 or 3) and level count, followed by the
+// width and height of each level. Then come each level's tiles in
+// scanline order, each tile holding tileSize^2 texels of float32 channels
+// in scanline order; tiles at the right and bottom edges are padded to
+// full size. As in other image files, the first row is the top of the
+// image. All values are little-endian.
+bool IsTiledImageFile(const std::string &filename);
+
+class TiledImage {
+  public:
+    // TiledImage Public Methods
+    // Returns nullptr, after reporting an error, if the file can't be read.
+    static std::unique_ptr<TiledImage> Open(const std::string &filename);
+    int Levels() const { return levelResolution.size(); }
+    Point2i LevelResolution(int level) const { return levelResolution[level]; }
+    int TileSize() const { return tileSize; }
+    int Channels() const { return nChannels; }
+    size_t TileBytes() const {
+        return sizeof(float) * tileSize * tileSize * nChannels;
+    }
+    // Identifies the image in the texture cache; unlike its address, it is
+    // never reused.
+    uint64_t Id() const { return id; }
+    // Reads tile (tx, ty) of |level| into |texels|, which must have room
+    // for TileBytes().
+    bool ReadTile(int level, int tx, int ty, float *texels) const;
+
+  private:
+    // TiledImage Private Methods
+    TiledImage(const std::string &filename) : filename(filename) {}
+
+    // TiledImage Private Data
+    const std::string filename;
+    mutable std::ifstream file;
+    mutable std::mutex fileMutex;
+    uint64_t id;
+    int tileSize, nChannels;
+    std::vector<Point2i> levelResolution;
+    // File offsets of each level's first tile
+    std::vector<uint64_t> levelOffset;
+};
+
+// Writes a tiled image file with the given levels, whose texels are
+// stored in scanline order with |nChannels| floats each.
+bool WriteTiledImage(const std::string &filename, int tileSize, int nChannels,
+                     const std::vector<Point2i> &levelResolution,
+                     const std::vector<std::vector<float>> &levels);
+
+// Returns the texels of tile (tx, ty) of |level| of |image|, reading it
+// if it isn't in the texture cache. The cache evicts the least recently
+// used tiles to stay within the budget set with --texturecache-mb. The
+// returned pointer remains valid until the calling thread's next call;
+// each thread keeps its last few tiles, so runs of lookups in the same
+// tiles don't contend for the cache's locks.
+const float *GetTextureTile(const TiledImage &image, int level, int tx, int ty);
+
+// Releases all of the tiles in the texture cache.
+void ClearTextureCache();
+
+}  // namespace pbrt
+
+#endif  // PBRT_CORE_TEXCACHE_H
@@ -86,6 +86,16 @@ static int NoisePerm[2 * NoisePermSize] = {
 
 // Texture Method Definitions
 TextureMapping2D::~TextureMapping2D() { }
+
+void TextureMapping2D::MapN(const SurfaceInteraction *si, int n, Point2f *st,
+                            Vector2f *dstdx, Vector2f *dstdy) const {
+    for (int i = 0; i < n; ++i) {
+        Vector2f dx, dy;
+        st[i] = Map(si[i], &dx, &dy);
+        if (dstdx) dstdx[i] = dx;
+        if (dstdy) dstdy[i] = dy;
+    }
+}
 TextureMapping3D::~TextureMapping3D() { }
 
 UVMapping2D::UVMapping2D(Float su, Float sv, Float du, Float dv)
@@ -98,6 +108,18 @@ Point2f UVMapping2D::Map(const SurfaceInteraction &si, Vector2f *dstdx,
     return Point2f(su * si.uv[0] + du, sv * si.uv[1] + dv);
 }
 
+void UVMapping2D::MapN(const SurfaceInteraction *si, int n, Point2f *st,
+                       Vector2f *dstdx, Vector2f *dstdy) const {
+    for (int i = 0; i < n; ++i)
+        st[i] = Point2f(su * si[i].uv[0] + du, sv * si[i].uv[1] + dv);
+    if (dstdx)
+        for (int i = 0; i < n; ++i)
+            dstdx[i] = Vector2f(su * si[i].dudx, sv * si[i].dvdx);
+    if (dstdy)
+        for (int i = 0; i < n; ++i)
+            dstdy[i] = Vector2f(su * si[i].dudy, sv * si[i].dvdy);
+}
+
 Point2f SphericalMapping2D::Map(const SurfaceInteraction &si, Vector2f *dstdx,
                                 Vector2f *dstdy) const {
     Point2f st = sphere(si.p);
@@ -44,6 +44,7 @@
 #include "geometry.h"
 #include "transform.h"
 #include "memory.h"
+#include "interaction.h"
 
 namespace pbrt {
 
@@ -54,6 +55,10 @@ class TextureMapping2D {
     virtual ~TextureMapping2D();
     virtual Point2f Map(const SurfaceInteraction &si, Vector2f *dstdx,
                         Vector2f *dstdy) const = 0;
+    // Maps each of the _n_ points _si[i]_ as _Map()_ does; _dstdx_ and
+    // _dstdy_ may be nullptr if the differentials aren't needed.
+    virtual void MapN(const SurfaceInteraction *si, int n, Point2f *st,
+                      Vector2f *dstdx, Vector2f *dstdy) const;
 };
 
 class UVMapping2D : public TextureMapping2D {
@@ -62,6 +67,15 @@ class UVMapping2D : public TextureMapping2D {
     UVMapping2D(Float su = 1, Float sv = 1, Float du = 0, Float dv = 0);
     Point2f Map(const SurfaceInteraction &si, Vector2f *dstdx,
                 Vector2f *dstdy) const;
+    void MapN(const SurfaceInteraction *si, int n, Point2f *st,
+              Vector2f *dstdx, Vector2f *dstdy) const;
+    Point2f Map(const Point2f &uv) const {
+        return Point2f(su * uv[0] + du, sv * uv[1] + dv);
+    }
+    // Returns true if adding integers to (u,v) adds integers to (s,t)
+    bool HasIntegerScale() const {
+        return su == std::round(su) && sv == std::round(sv);
+    }
 
   private:
     const Float su, sv, du, dv;
@@ -131,11 +145,30 @@ class IdentityMapping3D : public TextureMapping3D {
     const Transform WorldToTexture;
 };
 
+// The number of points that textures evaluating batches of points work on
+// at a time, bounding the temporary storage they need.
+static PBRT_CONSTEXPR int TextureBatchSize = 64;
+
 template <typename T>
 class Texture {
   public:
     // Texture Interface
     virtual T Evaluate(const SurfaceInteraction &) const = 0;
+    // Evaluates the texture at each of the _n_ points _si[i]_ into
+    // _values[i]_, giving the same results as _Evaluate()_. Textures
+    // override this to make one virtual call into the textures they're
+    // built from per batch, rather than one per point.
+    virtual void EvaluateN(const SurfaceInteraction *si, int n,
+                           T *values) const {
+        for (int i = 0; i < n; ++i) values[i] = Evaluate(si[i]);
+    }
+    // Returns false if _Evaluate()_ doesn't use the differentials of the
+    // _SurfaceInteraction_, so that they needn't be computed.
+    virtual bool NeedsDifferentials() const { return true; }
+    // Returns true if the texture is unchanged by adding integers to the
+    // (u,v) coordinates, so that quads each covering whole periods of it
+    // can be merged.
+    virtual bool IsPeriodic() const { return false; }
     virtual ~Texture() {}
 };
 
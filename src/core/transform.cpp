@@ -235,8 +235,40 @@ Transform LookAt(const Point3f &pos, const Point3f &look, const Vector3f &up) {
     return Transform(Inverse(cameraToWorld), cameraToWorld);
 }
 
+void Transform::Classify() {
+    isTranslation = isAxisPermutation = false;
+    if (m.m[3][0] != 0 || m.m[3][1] != 0 || m.m[3][2] != 0 || m.m[3][3] != 1)
+        return;
+    // Each row of the upper 3x3 must hold a single +/-1, each in a
+    // different column
+    bool used[3] = {false, false, false};
+    for (int i = 0; i < 3; ++i) {
+        int nNonZero = 0;
+        for (int j = 0; j < 3; ++j) {
+            if (m.m[i][j] == 0) continue;
+            if (std::abs(m.m[i][j]) != 1 || used[j] || ++nNonZero > 1)
+                return;
+            used[j] = true;
+            axis[i] = j;
+        }
+        if (nNonZero == 0) return;
+    }
+    isAxisPermutation = true;
+    // Matrix4x4's Inverse() isn't exact for these, so compute the inverse
+    // directly: it's the transposed permutation and negated translation.
+    mInv = Matrix4x4(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1);
+    for (int i = 0; i < 3; ++i) {
+        mInv.m[axis[i]][i] = m.m[i][axis[i]];
+        mInv.m[axis[i]][3] = -m.m[i][axis[i]] * m.m[i][3];
+    }
+    isTranslation = (axis[0] == 0 && axis[1] == 1 && axis[2] == 2 &&
+                     m.m[0][0] == 1 && m.m[1][1] == 1 && m.m[2][2] == 1);
+}
+
 Bounds3f Transform::operator()(const Bounds3f &b) const {
     const Transform &M = *this;
+    // Axis permutations map the box's extreme corners to extreme corners
+    if (isAxisPermutation) return Bounds3f(M(b.pMin), M(b.pMax));
     Bounds3f ret(M(Point3f(b.pMin.x, b.pMin.y, b.pMin.z)));
     ret = Union(ret, M(Point3f(b.pMax.x, b.pMin.y, b.pMin.z)));
     ret = Union(ret, M(Point3f(b.pMin.x, b.pMax.y, b.pMin.z)));
@@ -266,6 +298,15 @@ SurfaceInteraction Transform::operator()(const SurfaceInteraction &si) const {
 
     // Transform remaining members of _SurfaceInteraction_
     const Transform &t = *this;
+    if (isTranslation) {
+        // Only the position changes under a translation
+        ret = si;
+        ret.p = (*this)(si.p, si.pError, &ret.pError);
+        ret.n = Normalize(si.n);
+        ret.wo = Normalize(si.wo);
+        ret.shading.n = Faceforward(Normalize(si.shading.n), ret.n);
+        return ret;
+    }
     ret.n = Normalize(t(si.n));
     ret.wo = Normalize(t(si.wo));
     ret.time = si.time;
@@ -293,6 +334,7 @@ SurfaceInteraction Transform::operator()(const SurfaceInteraction &si) const {
     //    ret.n = Faceforward(ret.n, ret.shading.n);
     ret.shading.n = Faceforward(ret.shading.n, ret.n);
     ret.faceIndex = si.faceIndex;
+    ret.tint = si.tint;
     return ret;
 }
 
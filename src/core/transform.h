@@ -121,9 +121,12 @@ class Transform {
                       mat[2][2], mat[2][3], mat[3][0], mat[3][1], mat[3][2],
                       mat[3][3]);
         mInv = Inverse(m);
+        Classify();
+    }
+    Transform(const Matrix4x4 &m) : m(m), mInv(Inverse(m)) { Classify(); }
+    Transform(const Matrix4x4 &m, const Matrix4x4 &mInv) : m(m), mInv(mInv) {
+        Classify();
     }
-    Transform(const Matrix4x4 &m) : m(m), mInv(Inverse(m)) {}
-    Transform(const Matrix4x4 &m, const Matrix4x4 &mInv) : m(m), mInv(mInv) {}
     void Print(FILE *f) const;
     friend Transform Inverse(const Transform &t) {
         return Transform(t.mInv, t.m);
@@ -153,6 +156,12 @@ class Transform {
                 m.m[3][0] == 0.f && m.m[3][1] == 0.f && m.m[3][2] == 0.f &&
                 m.m[3][3] == 1.f);
     }
+    // Returns true if the transformation is a pure translation.
+    bool IsTranslation() const { return isTranslation; }
+    // Returns true if the transformation maps each axis to a (possibly
+    // negated) axis without scaling, followed by a translation. Points and
+    // vectors are then transformed with a single term per component.
+    bool IsAxisPermutation() const { return isAxisPermutation; }
     const Matrix4x4 &GetMatrix() const { return m; }
     const Matrix4x4 &GetInverseMatrix() const { return mInv; }
     bool HasScale() const {
@@ -199,8 +208,15 @@ class Transform {
     }
 
   private:
+    // Transform Private Methods
+    void Classify();
+
     // Transform Private Data
     Matrix4x4 m, mInv;
+    // Set by Classify(); for axis permutations, component _i_ of a
+    // transformed point or vector only depends on component _axis[i]_.
+    bool isTranslation = true, isAxisPermutation = true;
+    uint8_t axis[3] = {0, 1, 2};
     friend class AnimatedTransform;
     friend struct Quaternion;
 };
@@ -220,6 +236,10 @@ bool SolveLinearSystem2x2(const Float A[2][2], const Float B[2], Float *x0,
 // Transform Inline Functions
 template <typename T>
 inline Point3<T> Transform::operator()(const Point3<T> &p) const {
+    if (isAxisPermutation)
+        return Point3<T>(m.m[0][axis[0]] * p[axis[0]] + m.m[0][3],
+                         m.m[1][axis[1]] * p[axis[1]] + m.m[1][3],
+                         m.m[2][axis[2]] * p[axis[2]] + m.m[2][3]);
     T x = p.x, y = p.y, z = p.z;
     T xp = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3];
     T yp = m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z + m.m[1][3];
@@ -234,6 +254,11 @@ inline Point3<T> Transform::operator()(const Point3<T> &p) const {
 
 template <typename T>
 inline Vector3<T> Transform::operator()(const Vector3<T> &v) const {
+    if (isTranslation) return v;
+    if (isAxisPermutation)
+        return Vector3<T>(m.m[0][axis[0]] * v[axis[0]],
+                          m.m[1][axis[1]] * v[axis[1]],
+                          m.m[2][axis[2]] * v[axis[2]]);
     T x = v.x, y = v.y, z = v.z;
     return Vector3<T>(m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z,
                       m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z,
@@ -242,6 +267,12 @@ inline Vector3<T> Transform::operator()(const Vector3<T> &v) const {
 
 template <typename T>
 inline Normal3<T> Transform::operator()(const Normal3<T> &n) const {
+    // The inverse transpose of an axis permutation is the permutation itself
+    if (isTranslation) return n;
+    if (isAxisPermutation)
+        return Normal3<T>(m.m[0][axis[0]] * n[axis[0]],
+                          m.m[1][axis[1]] * n[axis[1]],
+                          m.m[2][axis[2]] * n[axis[2]]);
     T x = n.x, y = n.y, z = n.z;
     return Normal3<T>(mInv.m[0][0] * x + mInv.m[1][0] * y + mInv.m[2][0] * z,
                       mInv.m[0][1] * x + mInv.m[1][1] * y + mInv.m[2][1] * z,
@@ -277,6 +308,13 @@ inline RayDifferential Transform::operator()(const RayDifferential &r) const {
 template <typename T>
 inline Point3<T> Transform::operator()(const Point3<T> &p,
                                        Vector3<T> *pError) const {
+    if (isAxisPermutation) {
+        // The only rounding error comes from adding the translation
+        for (int i = 0; i < 3; ++i)
+            (*pError)[i] = gamma(3) * (std::abs(p[axis[i]]) +
+                                       std::abs(m.m[i][3]));
+        return (*this)(p);
+    }
     T x = p.x, y = p.y, z = p.z;
     // Compute transformed coordinates from point _pt_
     T xp = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3];
@@ -303,6 +341,13 @@ template <typename T>
 inline Point3<T> Transform::operator()(const Point3<T> &pt,
                                        const Vector3<T> &ptError,
                                        Vector3<T> *absError) const {
+    if (isAxisPermutation) {
+        for (int i = 0; i < 3; ++i)
+            (*absError)[i] = (gamma(3) + (T)1) * ptError[axis[i]] +
+                             gamma(3) * (std::abs(pt[axis[i]]) +
+                                         std::abs(m.m[i][3]));
+        return (*this)(pt);
+    }
     T x = pt.x, y = pt.y, z = pt.z;
     T xp = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3];
     T yp = m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z + m.m[1][3];
@@ -336,6 +381,11 @@ inline Point3<T> Transform::operator()(const Point3<T> &pt,
 template <typename T>
 inline Vector3<T> Transform::operator()(const Vector3<T> &v,
                                         Vector3<T> *absError) const {
+    if (isAxisPermutation) {
+        // Permuting and negating components is exact
+        *absError = Vector3<T>(0, 0, 0);
+        return (*this)(v);
+    }
     T x = v.x, y = v.y, z = v.z;
     absError->x =
         gamma(3) * (std::abs(m.m[0][0] * v.x) + std::abs(m.m[0][1] * v.y) +
@@ -355,6 +405,11 @@ template <typename T>
 inline Vector3<T> Transform::operator()(const Vector3<T> &v,
                                         const Vector3<T> &vError,
                                         Vector3<T> *absError) const {
+    if (isAxisPermutation) {
+        for (int i = 0; i < 3; ++i)
+            (*absError)[i] = (gamma(3) + (T)1) * vError[axis[i]];
+        return (*this)(v);
+    }
     T x = v.x, y = v.y, z = v.z;
     absError->x =
         (gamma(3) + (T)1) *
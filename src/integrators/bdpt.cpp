@@ -377,7 +377,10 @@ void BDPTIntegrator::Render(const Scene &scene) {
                     // distribution on any of the vertices of the camera
                     // path is unlikely to be a good strategy. We use the
                     // PowerLightDistribution by default here, which
-                    // doesn't use the point passed to it.
+                    // doesn't use the point passed to it; the "bvh"
+                    // strategy also returns a power distribution here, so
+                    // that light subpaths and their MIS densities don't
+                    // depend on the camera vertex.
                     const Distribution1D *lightDistr =
                         lightDistribution->Lookup(cameraVertices[0].p());
                     // Now trace the light subpath
@@ -65,6 +65,7 @@ class DiffuseAreaLight : public AreaLight {
                        Float *pdfDir) const;
     void Pdf_Le(const Ray &, const Normal3f &, Float *pdfPos,
                 Float *pdfDir) const;
+    bool Bounds(LightBounds *bounds) const;
 
   protected:
     // DiffuseAreaLight Protected Data
@@ -46,20 +46,31 @@ InfiniteAreaLight::InfiniteAreaLight(const Transform &LightToWorld,
     : Light((int)LightFlags::Infinite, LightToWorld, MediumInterface(),
             nSamples) {
     // Read texel data from _texmap_ and initialize _Lmap_
-    Point2i resolution;
-    std::unique_ptr<RGBSpectrum[]> texels(nullptr);
-    if (texmap != "") {
-        texels = ReadImage(texmap, &resolution);
-        if (texels)
-            for (int i = 0; i < resolution.x * resolution.y; ++i)
-                texels[i] *= L.ToRGBSpectrum();
+    if (IsTiledImageFile(texmap)) {
+        // Tiled images are paged in as needed, so _L_ is applied to
+        // looked-up values instead
+        std::unique_ptr<TiledImage> tiles = TiledImage::Open(texmap);
+        if (tiles) {
+            Lmap.reset(new MIPMap<RGBSpectrum>(std::move(tiles), false));
+            texelScale = L.ToRGBSpectrum();
+        }
     }
-    if (!texels) {
-        resolution.x = resolution.y = 1;
-        texels = std::unique_ptr<RGBSpectrum[]>(new RGBSpectrum[1]);
-        texels[0] = L.ToRGBSpectrum();
+    if (!Lmap) {
+        Point2i resolution;
+        std::unique_ptr<RGBSpectrum[]> texels(nullptr);
+        if (texmap != "" && !IsTiledImageFile(texmap)) {
+            texels = ReadImage(texmap, &resolution);
+            if (texels)
+                for (int i = 0; i < resolution.x * resolution.y; ++i)
+                    texels[i] *= L.ToRGBSpectrum();
+        }
+        if (!texels) {
+            resolution.x = resolution.y = 1;
+            texels = std::unique_ptr<RGBSpectrum[]>(new RGBSpectrum[1]);
+            texels[0] = L.ToRGBSpectrum();
+        }
+        Lmap.reset(new MIPMap<RGBSpectrum>(resolution, texels.get()));
     }
-    Lmap.reset(new MIPMap<RGBSpectrum>(resolution, texels.get()));
 
     // Initialize sampling PDFs for infinite area light
 
@@ -73,7 +84,7 @@ InfiniteAreaLight::InfiniteAreaLight(const Transform &LightToWorld,
             Float sinTheta = std::sin(Pi * (v + .5f) / height);
             for (int u = 0; u < width; ++u) {
                 Float up = (u + .5f) / (Float)width;
-                img[u + v * width] = Lmap->Lookup(Point2f(up, vp), fwidth).y();
+                img[u + v * width] = LookupL(Point2f(up, vp), fwidth).y();
                 img[u + v * width] *= sinTheta;
             }
         },
@@ -85,14 +96,14 @@ InfiniteAreaLight::InfiniteAreaLight(const Transform &LightToWorld,
 
 Spectrum InfiniteAreaLight::Power() const {
     return Pi * worldRadius * worldRadius *
-           Spectrum(Lmap->Lookup(Point2f(.5f, .5f), .5f),
+           Spectrum(LookupL(Point2f(.5f, .5f), .5f),
                     SpectrumType::Illuminant);
 }
 
 Spectrum InfiniteAreaLight::Le(const RayDifferential &ray) const {
     Vector3f w = Normalize(WorldToLight(ray.d));
     Point2f st(SphericalPhi(w) * Inv2Pi, SphericalTheta(w) * InvPi);
-    return Spectrum(Lmap->Lookup(st), SpectrumType::Illuminant);
+    return Spectrum(LookupL(st), SpectrumType::Illuminant);
 }
 
 Spectrum InfiniteAreaLight::Sample_Li(const Interaction &ref, const Point2f &u,
@@ -118,7 +129,7 @@ Spectrum InfiniteAreaLight::Sample_Li(const Interaction &ref, const Point2f &u,
     // Return radiance value for infinite light direction
     *vis = VisibilityTester(ref, Interaction(ref.p + *wi * (2 * worldRadius),
                                              ref.time, mediumInterface));
-    return Spectrum(Lmap->Lookup(uv), SpectrumType::Illuminant);
+    return Spectrum(LookupL(uv), SpectrumType::Illuminant);
 }
 
 Float InfiniteAreaLight::Pdf_Li(const Interaction &, const Vector3f &w) const {
@@ -159,7 +170,7 @@ Spectrum InfiniteAreaLight::Sample_Le(const Point2f &u1, const Point2f &u2,
     // Compute _InfiniteAreaLight_ ray PDFs
     *pdfDir = sinTheta == 0 ? 0 : mapPdf / (2 * Pi * Pi * sinTheta);
     *pdfPos = 1 / (Pi * worldRadius * worldRadius);
-    return Spectrum(Lmap->Lookup(uv), SpectrumType::Illuminant);
+    return Spectrum(LookupL(uv), SpectrumType::Illuminant);
 }
 
 void InfiniteAreaLight::Pdf_Le(const Ray &ray, const Normal3f &, Float *pdfPos,
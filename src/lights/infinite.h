@@ -69,8 +69,16 @@ class InfiniteAreaLight : public Light {
                 Float *pdfDir) const;
 
   private:
+    // InfiniteAreaLight Private Methods
+    RGBSpectrum LookupL(const Point2f &st, Float width = 0.f) const {
+        return texelScale * Lmap->Lookup(st, width);
+    }
+
     // InfiniteAreaLight Private Data
     std::unique_ptr<MIPMap<RGBSpectrum>> Lmap;
+    // Scale for _Lmap_'s texels, which are stored premultiplied by the
+    // light's radiance unless they're paged in from a tiled image
+    RGBSpectrum texelScale = RGBSpectrum(1.f);
     Point3f worldCenter;
     Float worldRadius;
     std::unique_ptr<Distribution2D> distribution;
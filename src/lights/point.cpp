@@ -54,6 +54,16 @@ Spectrum PointLight::Sample_Li(const Interaction &ref, const Point2f &u,
 
 Spectrum PointLight::Power() const { return 4 * Pi * I; }
 
+bool PointLight::Bounds(LightBounds *bounds) const {
+    bounds->bounds = Bounds3f(pLight);
+    bounds->w = Vector3f(0, 0, 1);
+    bounds->phi = 4 * Pi * I.y();
+    bounds->cosTheta_o = -1;
+    bounds->cosTheta_e = 0;
+    bounds->twoSided = false;
+    return true;
+}
+
 Float PointLight::Pdf_Li(const Interaction &, const Vector3f &) const {
     return 0;
 }
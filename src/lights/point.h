@@ -63,6 +63,7 @@ class PointLight : public Light {
                        Float *pdfDir) const;
     void Pdf_Le(const Ray &, const Normal3f &, Float *pdfPos,
                 Float *pdfDir) const;
+    bool Bounds(LightBounds *bounds) const;
 
   private:
     // PointLight Private Data
@@ -76,6 +76,19 @@ Spectrum SpotLight::Power() const {
     return I * 2 * Pi * (1 - .5f * (cosFalloffStart + cosTotalWidth));
 }
 
+bool SpotLight::Bounds(LightBounds *bounds) const {
+    // The light is bounded by its intensity, which it emits in full inside
+    // the falloff cone, fading out to the edge of the spotlight
+    bounds->bounds = Bounds3f(pLight);
+    bounds->w = Normalize(LightToWorld(Vector3f(0, 0, 1)));
+    bounds->phi = 4 * Pi * I.y();
+    bounds->cosTheta_o = cosFalloffStart;
+    bounds->cosTheta_e = std::cos(std::acos(cosTotalWidth) -
+                                  std::acos(cosFalloffStart));
+    bounds->twoSided = false;
+    return true;
+}
+
 Float SpotLight::Pdf_Li(const Interaction &, const Vector3f &) const {
     return 0.f;
 }
@@ -61,6 +61,7 @@ class SpotLight : public Light {
                        Float *pdfDir) const;
     void Pdf_Le(const Ray &, const Normal3f &, Float *pdfPos,
                 Float *pdfDir) const;
+    bool Bounds(LightBounds *bounds) const;
 
   private:
     // SpotLight Private Data
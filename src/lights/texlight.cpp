@@ -36,10 +36,113 @@
 #include "paramset.h"
 #include "sampling.h"
 #include "shapes/triangle.h"
+#include "textures/imagemap.h"
+#include "textures/atlas.h"
 #include "stats.h"
+#include <tuple>
 
 namespace pbrt {
 
+STAT_COUNTER("Scene/Texture light emission distributions", nEmissionDistributions);
+
+// Emission of image textures only depends on (u,v), so quads that show the
+// same part of an image share their _QuadEmission_.
+typedef std::tuple<const Texture<Spectrum> *, Float, Float, Float, Float>
+    QuadEmissionKey;
+static std::map<QuadEmissionKey, std::shared_ptr<const QuadEmission>>
+    quadEmissionCache;
+
+// Finds the (u,v) mapping and resolution of _Lemit_ if it's a _Tex_ image
+// texture with a (u,v) mapping.
+template <typename Tex>
+static bool GetImageMapping(const Texture<Spectrum> &Lemit,
+                            const UVMapping2D **mapping, Point2i *res) {
+    const Tex *image = dynamic_cast<const Tex *>(&Lemit);
+    if (!image || !image->GetUVMapping()) return false;
+    *mapping = image->GetUVMapping();
+    *res = image->Resolution();
+    return true;
+}
+
+static std::shared_ptr<const QuadEmission> ComputeQuadEmission(
+    const Texture<Spectrum> &Lemit, const Shape &shape, const QuadFace &face) {
+    // Choose one cell per texel the quad covers for image and atlas
+    // textures, up to 256 cells per side
+    int ns = 16, nt = 16, texelsS = ns, texelsT = nt;
+    bool cacheable = false;
+    const UVMapping2D *mapping = nullptr;
+    Point2i res;
+    if (GetImageMapping<ImageTexture<RGBSpectrum, Spectrum>>(Lemit, &mapping,
+                                                             &res) ||
+        GetImageMapping<ImageTexture<RGBA8, Spectrum>>(Lemit, &mapping,
+                                                       &res) ||
+        GetImageMapping<AtlasTexture<RGBSpectrum, Spectrum>>(Lemit, &mapping,
+                                                             &res)) {
+        Point2f st00 = mapping->Map(QuadFaceUV(face, Point2f(0, 0)));
+        auto texels = [&](const Point2f &st) {
+            Vector2f d = st - st00;
+            return std::max(1, (int)std::ceil(std::max(std::abs(d.x) * res.x,
+                                                       std::abs(d.y) * res.y) -
+                                              1e-3f));
+        };
+        texelsS = texels(mapping->Map(QuadFaceUV(face, Point2f(1, 0))));
+        texelsT = texels(mapping->Map(QuadFaceUV(face, Point2f(0, 1))));
+        ns = std::min(texelsS, 256);
+        nt = std::min(texelsT, 256);
+        cacheable = true;
+    }
+    QuadEmissionKey key(&Lemit, face.u0, face.v0, face.u1, face.v1);
+    if (cacheable) {
+        auto iter = quadEmissionCache.find(key);
+        if (iter != quadEmissionCache.end()) return iter->second;
+    }
+
+    std::shared_ptr<QuadEmission> emission = std::make_shared<QuadEmission>();
+    std::vector<Float> func(ns * nt);
+    // Evaluate the emission on a grid of points in each cell, spaced less
+    // than a texel apart and inset slightly from the cell's edges, so that
+    // each cell sees every texel it overlaps; a row of points at a time
+    const Float inset = 1e-3f;
+    int ks = (texelsS + ns - 1) / ns, kt = (texelsT + nt - 1) / nt;
+    int nPoints = ns * (ks + 1);
+    Float weight = 1 / Float(nPoints * nt * (kt + 1));
+    std::vector<SurfaceInteraction> si(nPoints);
+    std::vector<Spectrum> L(nPoints);
+    for (int t = 0; t < nt; ++t)
+        for (int j = 0; j <= kt; ++j) {
+            Float tt = (t + inset + (1 - 2 * inset) * j / kt) / nt;
+            for (int s = 0; s < ns; ++s)
+                for (int i = 0; i <= ks; ++i) {
+                    Point2f st((s + inset + (1 - 2 * inset) * i / ks) / ns,
+                               tt);
+                    SurfaceInteraction &p = si[s * (ks + 1) + i];
+                    p.p = (*shape.ObjectToWorld)(QuadFacePoint(face, st));
+                    p.uv = QuadFaceUV(face, st);
+                    p.shape = &shape;
+                }
+            Lemit.EvaluateN(si.data(), nPoints, L.data());
+            for (int s = 0; s < ns; ++s) {
+                Float &f = func[t * ns + s];
+                for (int i = 0; i <= ks; ++i) {
+                    const Spectrum &Lp = L[s * (ks + 1) + i];
+                    emission->average += Lp * weight;
+                    f = std::max(f, Lp.y());
+                }
+            }
+        }
+
+    // Only importance sample emission that varies over the quad
+    if (*std::max_element(func.begin(), func.end()) !=
+        *std::min_element(func.begin(), func.end())) {
+        emission->distribution.reset(new Distribution2D(func.data(), ns, nt));
+        ++nEmissionDistributions;
+    }
+    if (cacheable) quadEmissionCache[key] = emission;
+    return emission;
+}
+
+void TextureAreaLight::ClearCache() { quadEmissionCache.clear(); }
+
 // TextureAreaLight Method Definitions
 TextureAreaLight::TextureAreaLight(const Transform &LightToWorld,
                                    const MediumInterface &mediumInterface,
@@ -60,13 +163,48 @@ TextureAreaLight::TextureAreaLight(const Transform &LightToWorld,
             "The system has numerous assumptions, implicit and explicit, "
             "that this transform will have no scale factors in it. "
             "Proceed at your own risk; your image may have errors.");
+    if (Lemit && GetQuadFace(*shape, &face))
+        emission = ComputeQuadEmission(*Lemit, *shape, face);
 }
 
 Spectrum TextureAreaLight::Power() const {
-    return scale * area * Pi;
+    return scale * (emission ? emission->average : Spectrum(1.f)) * area * Pi;
+}
+
+bool TextureAreaLight::Bounds(LightBounds *bounds) const {
+    // L() doesn't depend on the side of the shape that is seen
+    *bounds = ShapeLightBounds(*shape, Power().y(), true);
+    return true;
+}
+
+Interaction TextureAreaLight::QuadInteraction(const Point2f &st) const {
+    Interaction it;
+    it.p = (*shape->ObjectToWorld)(QuadFacePoint(face, st), Vector3f(0, 0, 0),
+                                   &it.pError);
+    it.n[face.axis] = face.positive ? 1 : -1;
+    it.mediumInterface = mediumInterface;
+    return it;
+}
+
+Point2f TextureAreaLight::QuadParameters(const Point3f &p) const {
+    return QuadFaceParameters(face, (*shape->WorldToObject)(p));
+}
+
+Spectrum TextureAreaLight::Emitted(const Interaction &intr,
+                                   const Point2f &st) const {
+    SurfaceInteraction si;
+    si.p = intr.p;
+    si.n = intr.n;
+    si.time = intr.time;
+    si.uv = QuadFaceUV(face, st);
+    si.shape = shape.get();
+    return scale * Lemit->Evaluate(si);
 }
 
 Spectrum TextureAreaLight::L(const Interaction &intr, const Vector3f &w) const {
+    // Look up the texel directly for quads
+    if (emission) return Emitted(intr, QuadParameters(intr.p));
+
     Ray ray(intr.p+w, -w);
     Float hit;
     SurfaceInteraction isect;
@@ -78,7 +216,27 @@ Spectrum TextureAreaLight::Sample_Li(const Interaction &ref, const Point2f &u,
                                      Vector3f *wi, Float *pdf,
                                      VisibilityTester *vis) const {
     ProfilePhase _(Prof::LightSample);
-    Interaction pShape = shape->Sample(ref, u, pdf);
+    Interaction pShape;
+    if (const Distribution2D *distrib = Distribution()) {
+        // Sample a texel in proportion to its emission
+        Float mapPdf;
+        Point2f st = distrib->SampleContinuous(u, &mapPdf);
+        pShape = QuadInteraction(st);
+        pShape.time = ref.time;
+        Vector3f w = pShape.p - ref.p;
+        if (mapPdf == 0 || w.LengthSquared() == 0) {
+            *pdf = 0;
+            return 0.f;
+        }
+        *wi = Normalize(w);
+        // Convert from area measure to solid angle measure
+        *pdf = mapPdf / area * w.LengthSquared() / AbsDot(pShape.n, -*wi);
+        if (std::isinf(*pdf)) *pdf = 0;
+        *vis = VisibilityTester(ref, pShape);
+        return Emitted(pShape, st);
+    }
+
+    pShape = shape->Sample(ref, u, pdf);
     pShape.mediumInterface = mediumInterface;
     if (*pdf == 0 || (pShape.p - ref.p).LengthSquared() == 0) {
         *pdf = 0;
@@ -93,7 +251,20 @@ Spectrum TextureAreaLight::Sample_Li(const Interaction &ref, const Point2f &u,
 Float TextureAreaLight::Pdf_Li(const Interaction &ref,
                                const Vector3f &wi) const {
     ProfilePhase _(Prof::LightPdf);
-    return shape->Pdf(ref, wi);
+    const Distribution2D *distrib = Distribution();
+    if (!distrib) return shape->Pdf(ref, wi);
+
+    // Find where _wi_ leaves the light and its density there
+    Ray ray = ref.SpawnRay(wi);
+    ShapeHit hit;
+    if (!shape->IntersectHit(ray, &hit, false)) return 0;
+    Point3f p = ray(hit.t);
+    Normal3f n;
+    n[face.axis] = 1;
+    Float pdf = distrib->Pdf(QuadParameters(p)) / area *
+                DistanceSquared(ref.p, p) / AbsDot(n, wi);
+    if (std::isinf(pdf)) pdf = 0.f;
+    return pdf;
 }
 
 Spectrum TextureAreaLight::Sample_Le(const Point2f &u1, const Point2f &u2,
@@ -101,7 +272,14 @@ Spectrum TextureAreaLight::Sample_Le(const Point2f &u1, const Point2f &u2,
                                      Float *pdfPos, Float *pdfDir) const {
     ProfilePhase _(Prof::LightSample);
     // Sample a point on the area light's _Shape_, _pShape_
-    Interaction pShape = shape->Sample(u1, pdfPos);
+    Interaction pShape;
+    if (const Distribution2D *distrib = Distribution()) {
+        Float mapPdf;
+        pShape = QuadInteraction(distrib->SampleContinuous(u1, &mapPdf));
+        pShape.time = time;
+        *pdfPos = mapPdf / area;
+    } else
+        pShape = shape->Sample(u1, pdfPos);
     pShape.mediumInterface = mediumInterface;
     *nLight = pShape.n;
 
@@ -122,7 +300,10 @@ void TextureAreaLight::Pdf_Le(const Ray &ray, const Normal3f &n, Float *pdfPos,
     ProfilePhase _(Prof::LightPdf);
     Interaction it(ray.o, n, Vector3f(), Vector3f(n), ray.time,
                    mediumInterface);
-    *pdfPos = shape->Pdf(it);
+    if (const Distribution2D *distrib = Distribution())
+        *pdfPos = distrib->Pdf(QuadParameters(ray.o)) / area;
+    else
+        *pdfPos = shape->Pdf(it);
     *pdfDir = CosineHemispherePdf(Dot(n, ray.d));
 }
 
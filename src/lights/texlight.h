@@ -42,9 +42,21 @@
 #include "pbrt.h"
 #include "light.h"
 #include "primitive.h"
+#include "sampling.h"
+#include "shapes/quad.h"
 
 namespace pbrt {
 
+// QuadEmission Declarations
+
+// The emission of a texture over an axis-aligned quad: its average and a
+// distribution over the quad's texels for importance sampling, which is
+// left empty when the emission is uniform.
+struct QuadEmission {
+    Spectrum average;
+    std::unique_ptr<Distribution2D> distribution;
+};
+
 // TextureAreaLight Declarations
 class TextureAreaLight : public AreaLight {
   public:
@@ -64,13 +76,27 @@ class TextureAreaLight : public AreaLight {
                        Float *pdfDir) const;
     void Pdf_Le(const Ray &, const Normal3f &, Float *pdfPos,
                 Float *pdfDir) const;
+    bool Bounds(LightBounds *bounds) const;
+    static void ClearCache();
 
   protected:
+    // TextureAreaLight Protected Methods
+    Interaction QuadInteraction(const Point2f &st) const;
+    Point2f QuadParameters(const Point3f &p) const;
+    Spectrum Emitted(const Interaction &intr, const Point2f &st) const;
+    const Distribution2D *Distribution() const {
+        return emission ? emission->distribution.get() : nullptr;
+    }
+
     // TextureAreaLight Protected Data
     std::shared_ptr<Texture<Spectrum>> Lemit;
     std::shared_ptr<Shape> shape;
     const Spectrum scale;
     const Float area;
+    // Lights on axis-aligned quads sample and look up their emission in
+    // the quad's parameterization
+    QuadFace face;
+    std::shared_ptr<const QuadEmission> emission;
 };
 
 std::shared_ptr<AreaLight> CreateTextureAreaLight(
@@ -46,13 +46,21 @@ static void usage(const char *msg = nullptr) {
 
     fprintf(stderr, R"(usage: pbrt [<options>] <filename.pbrt...>
 Rendering options:
+  --bvhcache <dir>     Save BVHs to the given directory and reuse them when
+                       a scene with the same geometry is rendered again.
   --cropwindow <x0,x1,y0,y1> Specify an image crop window.
+  --cullfaces          Remove back-to-back quads between opaque blocks
+                       before building the acceleration structure.
   --help               Print this help text.
+  --mergefaces         Merge adjacent coplanar quads that share a material
+                       into larger quads with repeating texture coordinates.
   --nthreads <num>     Use specified number of threads for rendering.
   --outfile <filename> Write the final image to the given filename.
   --quick              Automatically reduce a number of quality settings to
                        render more quickly.
   --quiet              Suppress all text output other than error messages.
+  --texturecache-mb <num> Keep at most this many megabytes of tiles of tiled
+                       (.tiled) texture images in memory. Default: 512.
 
 Logging options:
   --logdir <dir>       Specify directory that log files should be written to.
@@ -91,6 +99,12 @@ int main(int argc, char *argv[]) {
             if (i + 1 == argc)
                 usage("missing value after --outfile argument");
             options.imageFile = argv[++i];
+        } else if (!strcmp(argv[i], "--bvhcache") || !strcmp(argv[i], "-bvhcache")) {
+            if (i + 1 == argc)
+                usage("missing value after --bvhcache argument");
+            options.bvhCacheDir = argv[++i];
+        } else if (!strncmp(argv[i], "--bvhcache=", 11)) {
+            options.bvhCacheDir = &argv[i][11];
         } else if (!strcmp(argv[i], "--cropwindow") || !strcmp(argv[i], "-cropwindow")) {
             if (i + 4 >= argc)
                 usage("missing value after --cropwindow argument");
@@ -113,6 +127,23 @@ int main(int argc, char *argv[]) {
             FLAGS_minloglevel = atoi(argv[++i]);
         } else if (!strncmp(argv[i], "--minloglevel=", 14)) {
             FLAGS_minloglevel = atoi(&argv[i][14]);
+        } else if (!strcmp(argv[i], "--cullfaces") ||
+                   !strcmp(argv[i], "-cullfaces")) {
+            options.cullHiddenFaces = true;
+        } else if (!strcmp(argv[i], "--mergefaces") ||
+                   !strcmp(argv[i], "-mergefaces")) {
+            options.mergeQuads = true;
+        } else if (!strcmp(argv[i], "--texturecache-mb") ||
+                   !strcmp(argv[i], "-texturecache-mb")) {
+            if (i + 1 == argc)
+                usage("missing value after --texturecache-mb argument");
+            options.textureCacheMB = atoi(argv[++i]);
+            if (options.textureCacheMB <= 0)
+                usage("--texturecache-mb value must be greater than zero");
+        } else if (!strncmp(argv[i], "--texturecache-mb=", 18)) {
+            options.textureCacheMB = atoi(&argv[i][18]);
+            if (options.textureCacheMB <= 0)
+                usage("--texturecache-mb value must be greater than zero");
         } else if (!strcmp(argv[i], "--quick") || !strcmp(argv[i], "-quick")) {
             options.quickRender = true;
         } else if (!strcmp(argv[i], "--quiet") || !strcmp(argv[i], "-quiet")) {
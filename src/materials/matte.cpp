@@ -54,6 +54,7 @@ void MatteMaterial::ComputeScatteringFunctions(SurfaceInteraction *si,
     Spectrum r = Kd->Evaluate(*si).Clamp();
     if (tintMap)
         r *= tintMap->Evaluate(*si);
+    if (si->tint != RGBSpectrum(1.f)) r *= Spectrum(si->tint);
     Float sig = Clamp(sigma->Evaluate(*si), 0, 90);
     if (!r.IsBlack()) {
         if (sig == 0)
@@ -56,6 +56,7 @@ class MatteMaterial : public Material {
     void ComputeScatteringFunctions(SurfaceInteraction *si, MemoryArena &arena,
                                     TransportMode mode,
                                     bool allowMultipleLobes) const;
+    bool IsOpaque() const { return true; }
 
   private:
     // MatteMaterial Private Data
@@ -59,6 +59,7 @@ class MetalMaterial : public Material {
     void ComputeScatteringFunctions(SurfaceInteraction *si, MemoryArena &arena,
                                     TransportMode mode,
                                     bool allowMultipleLobes) const;
+    bool IsOpaque() const { return true; }
 
   private:
     // MetalMaterial Private Data
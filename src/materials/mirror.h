@@ -56,6 +56,7 @@ class MirrorMaterial : public Material {
     void ComputeScatteringFunctions(SurfaceInteraction *si, MemoryArena &arena,
                                     TransportMode mode,
                                     bool allowMultipleLobes) const;
+    bool IsOpaque() const { return true; }
 
   private:
     // MirrorMaterial Private Data
@@ -61,6 +61,7 @@ class PlasticMaterial : public Material {
     void ComputeScatteringFunctions(SurfaceInteraction *si, MemoryArena &arena,
                                     TransportMode mode,
                                     bool allowMultipleLobes) const;
+    bool IsOpaque() const { return true; }
 
   private:
     // PlasticMaterial Private Data
@@ -63,6 +63,7 @@ class SubstrateMaterial : public Material {
     void ComputeScatteringFunctions(SurfaceInteraction *si, MemoryArena &arena,
                                     TransportMode mode,
                                     bool allowMultipleLobes) const;
+    bool IsOpaque() const { return true; }
 
   private:
     // SubstrateMaterial Private Data
@@ -136,14 +136,18 @@ Bounds3f Curve::ObjectBound() const {
 
 bool Curve::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
                       bool testAlphaTexture) const {
-    ProfilePhase p(isect ? Prof::CurveIntersect : Prof::CurveIntersectP);
-    ++nTests;
-    // Transform _Ray_ to object space
-    Vector3f oErr, dErr;
-    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
+    ShapeHit hit;
+    if (!IntersectHit(r, tHit ? &hit : nullptr, testAlphaTexture))
+        return false;
+    if (tHit) {
+        *tHit = hit.t;
+        ComputeInteraction(r, hit, isect);
+    }
+    return true;
+}
 
+Transform Curve::ObjectToRay(const Ray &ray, Point3f cpObj[4]) const {
     // Compute object-space control points for curve segment, _cpObj_
-    Point3f cpObj[4];
     cpObj[0] = BlossomBezier(common->cpObj, uMin, uMin, uMin);
     cpObj[1] = BlossomBezier(common->cpObj, uMin, uMin, uMax);
     cpObj[2] = BlossomBezier(common->cpObj, uMin, uMax, uMax);
@@ -168,8 +172,19 @@ bool Curve::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
         Vector3f dy;
         CoordinateSystem(ray.d, &dx, &dy);
     }
+    return LookAt(ray.o, ray.o + ray.d, dx);
+}
+
+bool Curve::IntersectHit(const Ray &r, ShapeHit *hit,
+                         bool testAlphaTexture) const {
+    ProfilePhase p(hit ? Prof::CurveIntersect : Prof::CurveIntersectP);
+    ++nTests;
+    // Transform _Ray_ to object space
+    Vector3f oErr, dErr;
+    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
 
-    Transform objectToRay = LookAt(ray.o, ray.o + ray.d, dx);
+    Point3f cpObj[4];
+    Transform objectToRay = ObjectToRay(ray, cpObj);
     Point3f cp[4] = {objectToRay(cpObj[0]), objectToRay(cpObj[1]),
                      objectToRay(cpObj[2]), objectToRay(cpObj[3])};
 
@@ -225,13 +240,11 @@ bool Curve::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
     int maxDepth = Clamp(r0, 0, 10);
     ReportValue(refinementLevel, maxDepth);
 
-    return recursiveIntersect(ray, tHit, isect, cp, Inverse(objectToRay), uMin,
-                              uMax, maxDepth);
+    return recursiveIntersect(ray, hit, cp, uMin, uMax, maxDepth);
 }
 
-bool Curve::recursiveIntersect(const Ray &ray, Float *tHit,
-                               SurfaceInteraction *isect, const Point3f cp[4],
-                               const Transform &rayToObject, Float u0, Float u1,
+bool Curve::recursiveIntersect(const Ray &ray, ShapeHit *shapeHit,
+                               const Point3f cp[4], Float u0, Float u1,
                                int depth) const {
     Float rayLength = ray.d.Length();
 
@@ -279,11 +292,11 @@ bool Curve::recursiveIntersect(const Ray &ray, Float *tHit,
                         0.5 * maxWidth > zMax)
                 continue;
 
-            hit |= recursiveIntersect(ray, tHit, isect, cps, rayToObject,
-                                      u[seg], u[seg + 1], depth - 1);
+            hit |= recursiveIntersect(ray, shapeHit, cps, u[seg], u[seg + 1],
+                                      depth - 1);
             // If we found an intersection and this is a shadow ray,
             // we can exit out immediately.
-            if (hit && !tHit) return true;
+            if (hit && !shapeHit) return true;
         }
         return hit;
     } else {
@@ -309,14 +322,13 @@ bool Curve::recursiveIntersect(const Ray &ray, Float *tHit,
         // Compute $u$ coordinate of curve intersection point and _hitWidth_
         Float u = Clamp(Lerp(w, u0, u1), u0, u1);
         Float hitWidth = Lerp(u, common->width[0], common->width[1]);
-        Normal3f nHit;
         if (common->type == CurveType::Ribbon) {
             // Scale _hitWidth_ based on ribbon orientation
             Float sin0 = std::sin((1 - u) * common->normalAngle) *
                          common->invSinNormalAngle;
             Float sin1 =
                 std::sin(u * common->normalAngle) * common->invSinNormalAngle;
-            nHit = sin0 * common->n[0] + sin1 * common->n[1];
+            Normal3f nHit = sin0 * common->n[0] + sin1 * common->n[1];
             hitWidth *= AbsDot(nHit, ray.d) / rayLength;
         }
 
@@ -334,45 +346,63 @@ bool Curve::recursiveIntersect(const Ray &ray, Float *tHit,
         Float v = (edgeFunc > 0) ? 0.5f + ptCurveDist / hitWidth
                                  : 0.5f - ptCurveDist / hitWidth;
 
-        // Compute hit _t_ and partial derivatives for curve intersection
-        if (tHit != nullptr) {
-            // FIXME: this tHit isn't quite right for ribbons...
-            *tHit = pc.z / rayLength;
-            // Compute error bounds for curve intersection
-            Vector3f pError(2 * hitWidth, 2 * hitWidth, 2 * hitWidth);
-
-            // Compute $\dpdu$ and $\dpdv$ for curve intersection
-            Vector3f dpdu, dpdv;
-            EvalBezier(common->cpObj, u, &dpdu);
-            CHECK_NE(Vector3f(0, 0, 0), dpdu) << "u = " << u << ", cp = " <<
-                common->cpObj[0] << ", " << common->cpObj[1] << ", " <<
-                common->cpObj[2] << ", " << common->cpObj[3];
-
-            if (common->type == CurveType::Ribbon)
-                dpdv = Normalize(Cross(nHit, dpdu)) * hitWidth;
-            else {
-                // Compute curve $\dpdv$ for flat and cylinder curves
-                Vector3f dpduPlane = (Inverse(rayToObject))(dpdu);
-                Vector3f dpdvPlane =
-                    Normalize(Vector3f(-dpduPlane.y, dpduPlane.x, 0)) *
-                    hitWidth;
-                if (common->type == CurveType::Cylinder) {
-                    // Rotate _dpdvPlane_ to give cylindrical appearance
-                    Float theta = Lerp(v, -90., 90.);
-                    Transform rot = Rotate(-theta, dpduPlane);
-                    dpdvPlane = rot(dpdvPlane);
-                }
-                dpdv = rayToObject(dpdvPlane);
-            }
-            *isect = (*ObjectToWorld)(SurfaceInteraction(
-                ray(*tHit), pError, Point2f(u, v), -ray.d, dpdu, dpdv,
-                Normal3f(0, 0, 0), Normal3f(0, 0, 0), ray.time, this));
+        // Record hit _t_ and curve parameters for the intersection
+        if (shapeHit != nullptr) {
+            // FIXME: this t isn't quite right for ribbons...
+            shapeHit->t = pc.z / rayLength;
+            shapeHit->uv = Point2f(u, v);
+            shapeHit->b[0] = hitWidth;
         }
         ++nHits;
         return true;
     }
 }
 
+void Curve::ComputeInteraction(const Ray &r, const ShapeHit &hit,
+                               SurfaceInteraction *isect) const {
+    // Recompute the object-space ray and ray coordinate system
+    Vector3f oErr, dErr;
+    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
+    Point3f cpObj[4];
+    Transform objectToRay = ObjectToRay(ray, cpObj);
+    Transform rayToObject = Inverse(objectToRay);
+    Float u = hit.uv[0], v = hit.uv[1], hitWidth = hit.b[0];
+
+    // Compute error bounds for curve intersection
+    Vector3f pError(2 * hitWidth, 2 * hitWidth, 2 * hitWidth);
+
+    // Compute $\dpdu$ and $\dpdv$ for curve intersection
+    Vector3f dpdu, dpdv;
+    EvalBezier(common->cpObj, u, &dpdu);
+    CHECK_NE(Vector3f(0, 0, 0), dpdu) << "u = " << u << ", cp = " <<
+        common->cpObj[0] << ", " << common->cpObj[1] << ", " <<
+        common->cpObj[2] << ", " << common->cpObj[3];
+
+    if (common->type == CurveType::Ribbon) {
+        Float sin0 = std::sin((1 - u) * common->normalAngle) *
+                     common->invSinNormalAngle;
+        Float sin1 =
+            std::sin(u * common->normalAngle) * common->invSinNormalAngle;
+        Normal3f nHit = sin0 * common->n[0] + sin1 * common->n[1];
+        dpdv = Normalize(Cross(nHit, dpdu)) * hitWidth;
+    } else {
+        // Compute curve $\dpdv$ for flat and cylinder curves
+        Vector3f dpduPlane = objectToRay(dpdu);
+        Vector3f dpdvPlane =
+            Normalize(Vector3f(-dpduPlane.y, dpduPlane.x, 0)) * hitWidth;
+        if (common->type == CurveType::Cylinder) {
+            // Rotate _dpdvPlane_ to give cylindrical appearance
+            Float theta = Lerp(v, -90., 90.);
+            Transform rot = Rotate(-theta, dpduPlane);
+            dpdvPlane = rot(dpdvPlane);
+        }
+        dpdv = rayToObject(dpdvPlane);
+    }
+    *isect = (*ObjectToWorld)(SurfaceInteraction(
+        ray(hit.t), pError, Point2f(u, v), -ray.d, dpdu, dpdv,
+        Normal3f(0, 0, 0), Normal3f(0, 0, 0), ray.time, this));
+}
+
 Float Curve::Area() const {
     // Compute object-space control points for curve segment, _cpObj_
     Point3f cpObj[4];
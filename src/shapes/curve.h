@@ -72,15 +72,18 @@ class Curve : public Shape {
     Bounds3f ObjectBound() const;
     bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
                    bool testAlphaTexture) const;
+    bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                      bool testAlphaTexture) const;
+    void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                            SurfaceInteraction *isect) const;
     Float Area() const;
     Interaction Sample(const Point2f &u, Float *pdf) const;
 
   private:
     // Curve Private Methods
-    bool recursiveIntersect(const Ray &r, Float *tHit,
-                            SurfaceInteraction *isect, const Point3f cp[4],
-                            const Transform &rayToObject, Float u0, Float u1,
-                            int depth) const;
+    Transform ObjectToRay(const Ray &ray, Point3f cpObj[4]) const;
+    bool recursiveIntersect(const Ray &r, ShapeHit *hit, const Point3f cp[4],
+                            Float u0, Float u1, int depth) const;
 
     // Curve Private Data
     const std::shared_ptr<CurveCommon> common;
@@ -1,192 +1,235 @@
 // shapes/quad.cpp*
 #include "textures/constant.h"
 #include "shapes/quad.h"
+#include "shapes/quadmesh.h"
 #include "paramset.h"
 #include "efloat.h"
+#include "sampling.h"
 #include "stats.h"
 
 namespace pbrt {
 
-bool QuadX::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
-                     bool testAlphaTexture) const {
-    // Transform _Ray_ to object space
-    ProfilePhase p(Prof::ShapeIntersect);
-    Vector3f oErr, dErr;
-    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
-
-    if(ray.d.x == 0) return false;
-
-    Float thit = -ray.o.x/ray.d.x;
-    if (thit <= 0 || thit >= ray.tMax)
-        return false;
-
-    Point3f phit = ray(thit);
-    if (!inRange(phit.y, phit.z))
-        return false;
-    
-    Float u = phit.y/l1 +.5, v = phit.z/l2 +.5;
-    u = Du*u + u0, v = Dv*v + v0;
-
-    // Initialize _DifferentialGeometry_ from parametric information
-    Vector3f dpdv(0, 0, l2/Dv), dpdu(0, l1/Du, 0);
-    Normal3f dn(0, 0, 0);
-
-    // Compute error bounds for disk intersection
-    Vector3f pError(0, 0, 0);
-
-    SurfaceInteraction isectLocal(phit, pError, Point2f(v, u),
-                                  -ray.d, dpdv, dpdu, dn, dn,
-                                  ray.time, this);
+// The object-space axes that _l1_ and _l2_ run along for each quad axis
+static const int uAxis[3] = {1, 0, 1};
+static const int vAxis[3] = {2, 2, 0};
+
+// The quad itself, flat along _axis_, so that long quads don't get cubic
+// bounds
+Bounds3f Quad::ObjectBound() const {
+    Vector3f half;
+    half[uAxis[axis]] = l1 / 2;
+    half[vAxis[axis]] = l2 / 2;
+    return Bounds3f(Point3f() - half, Point3f() + half);
+}
 
-    // Test intersection against alpha texture, if present
-    if (testAlphaTexture && alphaMask) {
-        if (alphaMask->Evaluate(isectLocal) == 0)
-            return false;
-    }
+bool Quad::GetWorldFace(QuadFace *face) const {
+    if (!ObjectToWorld->IsAxisPermutation()) return false;
+    face->bounds = (*ObjectToWorld)(ObjectBound());
+    int axis = Axis();
+    Normal3f n;
+    n[axis] = reverseOrientation ? -dir : dir;
+    n = (*ObjectToWorld)(n);
+    face->axis = n.x != 0 ? 0 : (n.y != 0 ? 1 : 2);
+    face->positive = n[face->axis] > 0;
+    face->pObj = Point3f(0, 0, 0);
+    face->objectAxis = axis;
+    face->l1 = l1;
+    face->l2 = l2;
+    face->dir = dir;
+    face->u0 = u0;
+    face->v0 = v0;
+    face->u1 = u1;
+    face->v1 = v1;
+    face->alphaMask = alphaMask;
+    face->tint = tint;
+    return true;
+}
 
-    // For IntersectP
-    if (isect == nullptr)
-        return true;
+bool GetQuadFace(const Shape &shape, QuadFace *face) {
+    if (const Quad *quad = dynamic_cast<const Quad *>(&shape))
+        return quad->GetWorldFace(face);
+    if (const MeshQuad *quad = dynamic_cast<const MeshQuad *>(&shape))
+        return quad->GetWorldFace(face);
+    return false;
+}
 
-    // Initialize _SurfaceInteraction_ from parametric information
-    *isect = (*ObjectToWorld)(isectLocal);
+Point3f QuadFacePoint(const QuadFace &face, const Point2f &st) {
+    Point3f p = face.pObj;
+    p[uAxis[face.objectAxis]] += (st[0] - .5f) * face.l1;
+    p[vAxis[face.objectAxis]] += (st[1] - .5f) * face.l2;
+    return p;
+}
 
-    // Update _tHit_
-    *tHit = thit;
-    return true;
+Point2f QuadFaceParameters(const QuadFace &face, const Point3f &pObj) {
+    Vector3f d = pObj - face.pObj;
+    return Point2f(Clamp(d[uAxis[face.objectAxis]] / face.l1 + .5f, 0, 1),
+                   Clamp(d[vAxis[face.objectAxis]] / face.l2 + .5f, 0, 1));
 }
 
-Interaction QuadX::Sample(const Point2f &_u, Float *pdf) const {
-    Float u = _u.x, v = _u.y;
-    Point3f pObj(0, ((u-u0)/Du-.5)*l1, ((v-v0)/Dv-.5)*l2);
-    Interaction it;
-    it.n = Normalize((*ObjectToWorld)(Normal3f(dir, 0, 0)));
-    if (reverseOrientation) it.n *= -1;
-    it.p = (*ObjectToWorld)(pObj, Vector3f(0, 0, 0), &it.pError);
-    *pdf = 1 / Area();
-    return it;
+Point2f QuadFaceUV(const QuadFace &face, const Point2f &st) {
+    return Point2f(Lerp(st[1], face.v0, face.v1), Lerp(st[0], face.u0, face.u1));
 }
 
-bool QuadY::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
-                     bool testAlphaTexture) const {
+bool Quad::IntersectHit(const Ray &r, ShapeHit *hit,
+                        bool testAlphaTexture) const {
     // Transform _Ray_ to object space
     ProfilePhase p(Prof::ShapeIntersect);
     Vector3f oErr, dErr;
     Ray ray = (*WorldToObject)(r, &oErr, &dErr);
 
-    if(ray.d.y == 0) return false;
+    if (ray.d[axis] == 0) return false;
 
-    Float thit = -ray.o.y/ray.d.y;
+    Float thit = -ray.o[axis] / ray.d[axis];
     if (thit <= 0 || thit >= ray.tMax)
         return false;
 
     Point3f phit = ray(thit);
-    if (!inRange(phit.x, phit.z))
+    int ua = uAxis[axis], va = vAxis[axis];
+    if (!inRange(phit[ua], phit[va]))
         return false;
 
-    Float u = phit.x/l1 +.5, v = phit.z/l2 +.5;
+    Float u = phit[ua]/l1 +.5, v = phit[va]/l2 +.5;
     u = Du*u + u0, v = Dv*v + v0;
 
+    // Test intersection against alpha texture, if present, using its
+    // coverage mask to avoid building a _SurfaceInteraction_ if possible
+    if (testAlphaTexture && alphaMask) {
+        if (alphaCoverage) {
+            if (!alphaCoverage->Covered(Point2f(v, u)))
+                return false;
+        } else {
+            ShapeHit alphaHit{thit, phit, Point2f(u, v)};
+            SurfaceInteraction isectLocal;
+            ComputeObjectInteraction(ray, alphaHit, &isectLocal);
+            if (alphaMask->Evaluate(isectLocal) == 0)
+                return false;
+        }
+    }
+
+    hit->t = thit;
+    hit->p = phit;
+    hit->uv = Point2f(u, v);
+    return true;
+}
+
+void Quad::ComputeObjectInteraction(const Ray &ray, const ShapeHit &hit,
+                                    SurfaceInteraction *isect) const {
     // Initialize _DifferentialGeometry_ from parametric information
-    Vector3f dpdv(0, 0, l2/Dv), dpdu(l1/Du, 0, 0);
+    Vector3f dpdu, dpdv;
+    dpdu[vAxis[axis]] = l2/Dv;
+    dpdv[uAxis[axis]] = l1/Du;
     Normal3f dn(0, 0, 0);
 
-    // Compute error bounds for disk intersection
+    // Compute error bounds for quad intersection
     Vector3f pError(0, 0, 0);
 
-    SurfaceInteraction isectLocal(phit, pError, Point2f(v, u),
-                                  -ray.d, dpdv, dpdu, dn, dn,
-                                  ray.time, this);
+    *isect = SurfaceInteraction(hit.p, pError, Point2f(hit.uv[1], hit.uv[0]),
+                                -ray.d, dpdu, dpdv, dn, dn, ray.time, this);
 
-    // Test intersection against alpha texture, if present
-    if (testAlphaTexture && alphaMask) {
-        if (alphaMask->Evaluate(isectLocal) == 0)
-            return false;
-    }
+    // The quad faces along _dir_, matching the normal Sample() returns
+    Normal3f n;
+    n[axis] = reverseOrientation ? -dir : dir;
+    isect->n = isect->shading.n = n;
+    isect->tint = tint;
+}
+
+void Quad::ComputeInteraction(const Ray &r, const ShapeHit &hit,
+                              SurfaceInteraction *isect) const {
+    Ray ray = (*WorldToObject)(r);
+    SurfaceInteraction isectLocal;
+    ComputeObjectInteraction(ray, hit, &isectLocal);
+    *isect = (*ObjectToWorld)(isectLocal);
+}
+
+bool Quad::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
+                     bool testAlphaTexture) const {
+    ShapeHit hit;
+    if (!IntersectHit(ray, &hit, testAlphaTexture))
+        return false;
 
     // For IntersectP
     if (isect == nullptr)
         return true;
 
-    // Initialize _SurfaceInteraction_ from parametric information
-    *isect = (*ObjectToWorld)(isectLocal);
-
-    // Update _tHit_
-    *tHit = thit;
+    ComputeInteraction(ray, hit, isect);
+    *tHit = hit.t;
     return true;
 }
 
-Interaction QuadY::Sample(const Point2f &_u, Float *pdf) const {
-    Float u = _u.x, v = _u.y;
-    Point3f pObj(((u-u0)/Du-.5)*l1, 0, ((v-v0)/Dv-.5)*l2);
+Interaction Quad::Sample(const Point2f &u, Float *pdf) const {
+    Point3f pObj;
+    pObj[uAxis[axis]] = (u[0] - .5) * l1;
+    pObj[vAxis[axis]] = (u[1] - .5) * l2;
     Interaction it;
-    it.n = Normalize((*ObjectToWorld)(Normal3f(0, dir, 0)));
+    Normal3f n;
+    n[axis] = dir;
+    it.n = Normalize((*ObjectToWorld)(n));
     if (reverseOrientation) it.n *= -1;
     it.p = (*ObjectToWorld)(pObj, Vector3f(0, 0, 0), &it.pError);
     *pdf = 1 / Area();
     return it;
 }
 
-bool QuadZ::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
-                     bool testAlphaTexture) const {
-    // Transform _Ray_ to object space
-    ProfilePhase p(Prof::ShapeIntersect);
-    Vector3f oErr, dErr;
-    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
-
-    if(ray.d.z == 0) return false;
-
-    Float thit = -ray.o.z/ray.d.z;
-    if (thit <= 0 || thit >= ray.tMax)
-        return false;
-
-    Point3f phit = ray(thit);
-    if (!inRange(phit.y, phit.x))
-        return false;
-
-    Float u = phit.y/l1 +.5, v = phit.x/l2 +.5;
-    u = Du*u + u0, v = Dv*v + v0;
-
-    // Initialize _DifferentialGeometry_ from parametric information
-    Vector3f dpdv(l2/Dv, 0, 0), dpdu(0, l1/Du, 0);
-    Normal3f dn(0, 0, 0);
-
-    // Compute error bounds for disk intersection
-    Vector3f pError(0, 0, 0);
-
-    SurfaceInteraction isectLocal(phit, pError, Point2f(v, u),
-                                  -ray.d, dpdv, dpdu, dn, dn,
-                                  ray.time, this);
-
-    // Test intersection against alpha texture, if present
-    if (testAlphaTexture && alphaMask) {
-        if (alphaMask->Evaluate(isectLocal) == 0)
-            return false;
-    }
-
-    // For IntersectP
-    if (isect == nullptr)
-        return true;
-
-    // Initialize _SurfaceInteraction_ from parametric information
-    *isect = (*ObjectToWorld)(isectLocal);
+// Quads that subtend very small or nearly hemispherical solid angles are
+// area sampled, where the spherical parameterization loses precision.
+static bool UseSphericalSampling(Float pdf) {
+    const Float MinSolidAngle = 3e-4f, MaxSolidAngle = 6.22f;
+    return pdf > 1 / MaxSolidAngle && pdf < 1 / MinSolidAngle;
+}
 
-    // Update _tHit_
-    *tHit = thit;
-    return true;
+void Quad::WorldRectangle(Point3f *s, Vector3f *ex, Vector3f *ey) const {
+    Vector3f e1, e2;
+    e1[uAxis[axis]] = l1;
+    e2[vAxis[axis]] = l2;
+    *s = (*ObjectToWorld)(Point3f(0, 0, 0) - e1 / 2 - e2 / 2);
+    *ex = (*ObjectToWorld)(e1);
+    *ey = (*ObjectToWorld)(e2);
 }
 
-Interaction QuadZ::Sample(const Point2f &_u, Float *pdf) const {
-    Float u = _u.x, v = _u.y;
-    Point3f pObj(((v-v0)/Dv-.5)*l2, ((u-u0)/Du-.5)*l1, 0);
+Interaction Quad::Sample(const Interaction &ref, const Point2f &u,
+                         Float *pdf) const {
+    // Sample the solid angle the quad subtends at _ref_
+    Point3f s;
+    Vector3f ex, ey;
+    WorldRectangle(&s, &ex, &ey);
+    Point3f pWorld = SampleSphericalRectangle(ref.p, s, ex, ey, u, pdf);
+    if (!UseSphericalSampling(*pdf)) return Shape::Sample(ref, u, pdf);
+
+    // Project the sampled point onto the quad in object space
+    Point3f pObj = (*WorldToObject)(pWorld);
+    pObj[axis] = 0;
+    pObj[uAxis[axis]] = Clamp(pObj[uAxis[axis]], -l1 / 2, l1 / 2);
+    pObj[vAxis[axis]] = Clamp(pObj[vAxis[axis]], -l2 / 2, l2 / 2);
     Interaction it;
-    it.n = Normalize((*ObjectToWorld)(Normal3f(0, 0, dir)));
+    Normal3f n;
+    n[axis] = dir;
+    it.n = Normalize((*ObjectToWorld)(n));
     if (reverseOrientation) it.n *= -1;
     it.p = (*ObjectToWorld)(pObj, Vector3f(0, 0, 0), &it.pError);
-    *pdf = 1 / Area();
     return it;
 }
 
+Float Quad::Pdf(const Interaction &ref, const Vector3f &wi) const {
+    Point3f s;
+    Vector3f ex, ey;
+    WorldRectangle(&s, &ex, &ey);
+    Float pdf = SphericalRectanglePdf(ref.p, s, ex, ey);
+    if (!UseSphericalSampling(pdf)) return Shape::Pdf(ref, wi);
+
+    // Ignore any alpha texture, as Shape::Pdf() does
+    ShapeHit hit;
+    if (!IntersectHit(ref.SpawnRay(wi), &hit, false)) return 0;
+    return pdf;
+}
+
+Float Quad::SolidAngle(const Point3f &p, int nSamples) const {
+    Point3f s;
+    Vector3f ex, ey;
+    WorldRectangle(&s, &ex, &ey);
+    Float pdf = SphericalRectanglePdf(p, s, ex, ey);
+    return pdf > 0 ? 1 / pdf : 0;
+}
+
 template<class T>
 static std::shared_ptr<T> CreateQuadShape(
     const Transform *o2w, const Transform *w2o, bool reverseOrientation,
@@ -199,6 +242,8 @@ static std::shared_ptr<T> CreateQuadShape(
     Float u1  = params.FindOneFloat("u1", 1);
     Float v1  = params.FindOneFloat("v1", 1);
     Float dir = params.FindOneFloat("dir", 1);
+    RGBSpectrum tint =
+        params.FindOneSpectrum("tint", Spectrum(1.f)).ToRGBSpectrum();
 
     std::shared_ptr<Texture<Float>> alphaTex;
     std::string alphaTexName = params.FindTexture("alpha");
@@ -212,7 +257,7 @@ static std::shared_ptr<T> CreateQuadShape(
         alphaTex.reset(new ConstantTexture<Float>(0.f));
 
     return std::make_shared<T>(o2w, w2o, reverseOrientation, l1, l2, dir,
-                               u0, v0, u1, v1, alphaTex);
+                               u0, v0, u1, v1, alphaTex, tint);
 }
 
 std::shared_ptr<QuadX> CreateQuadXShape(
@@ -8,9 +8,31 @@
 
 // shapes/quad.h*
 #include "shape.h"
+#include "textures/imagemap.h"
+#include <map>
 
 namespace pbrt {
 
+// QuadFace Declarations
+
+// A description of an axis-aligned quad, used by the passes over quads
+// that run when the scene is built.
+struct QuadFace {
+    // The quad's world-space extent; it is flat along _axis_
+    Bounds3f bounds;
+    int axis;
+    // Whether the quad faces toward +_axis_
+    bool positive;
+    // The quad as it would be passed to QuadX, QuadY or QuadZ, centered at
+    // _pObj_ in the shape's object space
+    Point3f pObj;
+    int objectAxis;
+    Float l1, l2, dir, u0, v0, u1, v1;
+    std::shared_ptr<Texture<Float>> alphaMask;
+    const AlphaCoverage *alphaCoverage;
+    RGBSpectrum tint;
+};
+
 // Quad Declarations
 class Quad : public Shape {
   public:
@@ -18,29 +40,36 @@ class Quad : public Shape {
     Quad(const Transform *o2w, const Transform *w2o, bool ro,
          Float l1, Float l2, Float dir,
          Float u0, Float v0, Float u1, Float v1,
-         const std::shared_ptr<Texture<Float>> &alphaMask):
+         const std::shared_ptr<Texture<Float>> &alphaMask, int axis,
+         const RGBSpectrum &tint = RGBSpectrum(1.f)):
           Shape(o2w, w2o, ro), l1(l1), l2(l2), dir(dir),
           u0(u0), v0(v0), u1(u1), v1(v1),
           alphaMask(alphaMask),
-          Du(u1 - u0), Dv(v1 - v0) { } ;
+          alphaCoverage(GetAlphaCoverage(alphaMask.get())),
+          Du(u1 - u0), Dv(v1 - v0), axis(axis), tint(tint) { } ;
 
     bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
-                   bool testAlphaTexture) const {
-        LOG(FATAL) << "Quad::Intersect not implemented.";
-        return false;
+                   bool testAlphaTexture) const;
+    bool IntersectP(const Ray &ray, bool testAlphaTexture) const {
+        ShapeHit hit;
+        return IntersectHit(ray, &hit, testAlphaTexture);
     }
+    bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                      bool testAlphaTexture) const;
+    void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                            SurfaceInteraction *isect) const;
 
-    Interaction Sample(const Point2f &u, Float *pdf) const {
-        LOG(FATAL) << "Quad::Sample not implemented.";
-        return Interaction();
-    }
+    Interaction Sample(const Point2f &u, Float *pdf) const;
+    Interaction Sample(const Interaction &ref, const Point2f &u,
+                       Float *pdf) const;
+    Float Pdf(const Interaction &ref, const Vector3f &wi) const;
+    Float SolidAngle(const Point3f &p, int nSamples = 0) const;
 
-    Bounds3f ObjectBound() const {
-        Float rad = std::max(l1, l2)/2;
-        Point3f p1(-rad, -rad, -rad), p2(rad, rad, rad);
-        return Bounds3f(p1, p2);
-    }
+    Bounds3f ObjectBound() const;
     Float Area() const { return l1*l2; };
+    // Returns the axis the quad is perpendicular to in object space
+    int Axis() const { return axis; }
+    bool GetWorldFace(QuadFace *face) const;
 
   protected:
     // Quad Private Method 
@@ -48,8 +77,17 @@ class Quad : public Shape {
     bool inRange(Float x, Float y) const {
         return (-l1/2 <= x) && (x <= l1/2) && (-l2/2 <= y) && (y <= l2/2);
     }
+    // Returns the world-space corner and edges of the quad
+    void WorldRectangle(Point3f *s, Vector3f *ex, Vector3f *ey) const;
+    // Builds the object-space interaction for a hit of the object-space
+    // _ray_
+    void ComputeObjectInteraction(const Ray &ray, const ShapeHit &hit,
+                                  SurfaceInteraction *isect) const;
 
     std::shared_ptr<Texture<Float>> alphaMask;
+    const AlphaCoverage *alphaCoverage;
+    const int axis;
+    const RGBSpectrum tint;
 };
 
 // QuadX Deckarations
@@ -59,11 +97,10 @@ class QuadX : public Quad {
     QuadX(const Transform *o2w, const Transform *w2o, bool ro,
           Float l1, Float l2, Float dir,
           Float u0, Float v0, Float u1, Float v1,
-          const std::shared_ptr<Texture<Float>> &alphaMask):
-          Quad(o2w, w2o, ro, l1, l2, dir, u0, v0, u1, v1, alphaMask) { }
-    bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
-                   bool testAlphaTexture) const;
-    Interaction Sample(const Point2f &u, Float *pdf) const;
+          const std::shared_ptr<Texture<Float>> &alphaMask,
+          const RGBSpectrum &tint = RGBSpectrum(1.f)):
+          Quad(o2w, w2o, ro, l1, l2, dir, u0, v0, u1, v1, alphaMask, 0,
+               tint) { }
 };
 
 // QuadY Deckarations
@@ -73,11 +110,10 @@ class QuadY : public Quad {
     QuadY(const Transform *o2w, const Transform *w2o, bool ro,
           Float l1, Float l2, Float dir,
           Float u0, Float v0, Float u1, Float v1,
-          const std::shared_ptr<Texture<Float>> &alphaMask):
-          Quad(o2w, w2o, ro, l1, l2, dir, u0, v0, u1, v1, alphaMask) { }
-    bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
-                   bool testAlphaTexture) const;
-    Interaction Sample(const Point2f &u, Float *pdf) const;
+          const std::shared_ptr<Texture<Float>> &alphaMask,
+          const RGBSpectrum &tint = RGBSpectrum(1.f)):
+          Quad(o2w, w2o, ro, l1, l2, dir, u0, v0, u1, v1, alphaMask, 1,
+               tint) { }
 };
 
 // QuadZ Deckarations
@@ -87,13 +123,23 @@ class QuadZ : public Quad {
     QuadZ(const Transform *o2w, const Transform *w2o, bool ro,
           Float l1, Float l2, Float dir,
           Float u0, Float v0, Float u1, Float v1,
-          const std::shared_ptr<Texture<Float>> &alphaMask):
-          Quad(o2w, w2o, ro, l1, l2, dir, u0, v0, u1, v1, alphaMask) { }
-    bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
-                   bool testAlphaTexture) const;
-    Interaction Sample(const Point2f &u, Float *pdf) const;
+          const std::shared_ptr<Texture<Float>> &alphaMask,
+          const RGBSpectrum &tint = RGBSpectrum(1.f)):
+          Quad(o2w, w2o, ro, l1, l2, dir, u0, v0, u1, v1, alphaMask, 2,
+               tint) { }
 };
 
+// Fills in _face_ for QuadX, QuadY, QuadZ and MeshQuad shapes whose
+// transformation keeps them axis aligned; returns false otherwise.
+bool GetQuadFace(const Shape &shape, QuadFace *face);
+
+// Map between parametric coordinates $(s,t) \in [0,1]^2$ over the quad
+// described by _face_, with _s_ along _l1_ and _t_ along _l2_, and points
+// in its shape's object space or the (u,v) it hands to textures.
+Point3f QuadFacePoint(const QuadFace &face, const Point2f &st);
+Point2f QuadFaceParameters(const QuadFace &face, const Point3f &pObj);
+Point2f QuadFaceUV(const QuadFace &face, const Point2f &st);
+
 std::shared_ptr<QuadX> CreateQuadXShape(
     const Transform *o2w, const Transform *w2o, bool reverseOrientation,
     const ParamSet &params,
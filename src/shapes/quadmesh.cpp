@@ -0,0 +1,276 @@
+// shapes/quadmesh.cpp*
+#include "shapes/quadmesh.h"
+#include "textures/constant.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_MEMORY_COUNTER("Memory/Quad meshes", quadMeshBytes);
+STAT_RATIO("Scene/Quads per quad mesh", nQuadsTotal, nQuadMeshes);
+
+// The in-plane axes of a quad perpendicular to each axis, chosen so that
+// (u, v) follow the same conventions as QuadX, QuadY and QuadZ.
+static const int uAxis[3] = {1, 0, 1};
+static const int vAxis[3] = {2, 2, 0};
+
+// QuadMesh Method Definitions
+QuadMesh::QuadMesh(int nQuads, const Point3f *P, const int *axis,
+                   const Float *dir, const Float *l1, const Float *l2,
+                   const Float *UV,
+                   const std::shared_ptr<Texture<Float>> &alphaMask,
+                   const RGBSpectrum *Tint)
+    : nQuads(nQuads),
+      p(new Point3f[nQuads]),
+      extent(new Vector2f[nQuads]),
+      uv(new Float[4 * nQuads]),
+      flags(new uint8_t[nQuads]),
+      alphaMask(alphaMask),
+      alphaCoverage(GetAlphaCoverage(alphaMask.get())) {
+    ++nQuadMeshes;
+    nQuadsTotal += nQuads;
+    quadMeshBytes += sizeof(*this) +
+                     nQuads * (sizeof(Point3f) + sizeof(Vector2f) +
+                               4 * sizeof(Float) + sizeof(uint8_t) +
+                               (Tint ? sizeof(RGBSpectrum) : 0));
+    if (Tint) tint.reset(new RGBSpectrum[nQuads]);
+
+    for (int i = 0; i < nQuads; ++i) {
+        p[i] = P[i];
+        extent[i] = Vector2f(l1 ? l1[i] : 1, l2 ? l2[i] : 1);
+        for (int j = 0; j < 4; ++j)
+            uv[4 * i + j] = UV ? UV[4 * i + j] : ((j < 2) ? 0 : 1);
+        flags[i] = uint8_t(axis[i]) | ((dir && dir[i] < 0) ? 4 : 0);
+        if (Tint) tint[i] = Tint[i];
+    }
+}
+
+// MeshQuad Method Definitions
+Bounds3f MeshQuad::ObjectBound() const {
+    int axis = mesh->flags[index] & 3;
+    Vector3f half;
+    half[uAxis[axis]] = mesh->extent[index].x / 2;
+    half[vAxis[axis]] = mesh->extent[index].y / 2;
+    return Bounds3f(mesh->p[index] - half, mesh->p[index] + half);
+}
+
+Float MeshQuad::Area() const {
+    return mesh->extent[index].x * mesh->extent[index].y;
+}
+
+bool MeshQuad::IntersectHit(const Ray &r, ShapeHit *hit,
+                            bool testAlphaTexture) const {
+    ProfilePhase prof(Prof::ShapeIntersect);
+    // Transform _Ray_ to object space
+    Vector3f oErr, dErr;
+    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
+
+    // Intersect the ray with the quad's plane
+    int axis = mesh->flags[index] & 3, ua = uAxis[axis], va = vAxis[axis];
+    const Point3f &pc = mesh->p[index];
+    if (ray.d[axis] == 0) return false;
+    Float thit = (pc[axis] - ray.o[axis]) / ray.d[axis];
+    if (thit <= 0 || thit >= ray.tMax) return false;
+
+    // See if the hit is inside the quad
+    Point3f phit = ray(thit);
+    phit[axis] = pc[axis];
+    Float l1 = mesh->extent[index].x, l2 = mesh->extent[index].y;
+    Float x = phit[ua] - pc[ua], y = phit[va] - pc[va];
+    if (x < -l1 / 2 || x > l1 / 2 || y < -l2 / 2 || y > l2 / 2) return false;
+
+    // Compute the texture coordinates the way the quads do
+    const Float *rect = &mesh->uv[4 * index];
+    Float Du = rect[2] - rect[0], Dv = rect[3] - rect[1];
+    Float u = Du * (x / l1 + .5f) + rect[0];
+    Float v = Dv * (y / l2 + .5f) + rect[1];
+
+    // Test intersection against alpha texture, if present, using its
+    // coverage mask to avoid building a _SurfaceInteraction_ if possible
+    ShapeHit quadHit{thit, phit, Point2f(u, v)};
+    if (testAlphaTexture && mesh->alphaMask) {
+        if (mesh->alphaCoverage) {
+            if (!mesh->alphaCoverage->Covered(Point2f(v, u))) return false;
+        } else {
+            SurfaceInteraction isectLocal;
+            ComputeObjectInteraction(ray, quadHit, &isectLocal);
+            if (mesh->alphaMask->Evaluate(isectLocal) == 0) return false;
+        }
+    }
+    *hit = quadHit;
+    return true;
+}
+
+void MeshQuad::ComputeObjectInteraction(const Ray &ray, const ShapeHit &hit,
+                                        SurfaceInteraction *isect) const {
+    int axis = mesh->flags[index] & 3;
+    const Float *rect = &mesh->uv[4 * index];
+    Float Du = rect[2] - rect[0], Dv = rect[3] - rect[1];
+    Vector3f dpdu, dpdv;
+    dpdu[vAxis[axis]] = mesh->extent[index].y / Dv;
+    dpdv[uAxis[axis]] = mesh->extent[index].x / Du;
+    Normal3f dn(0, 0, 0);
+    Vector3f pError = gamma(5) * Abs((Vector3f)hit.p);
+    pError[axis] = 0;
+    *isect = SurfaceInteraction(hit.p, pError, Point2f(hit.uv[1], hit.uv[0]),
+                                -ray.d, dpdu, dpdv, dn, dn, ray.time, this);
+
+    // The quad faces along its _dir_, matching the normal Sample() returns
+    Normal3f n;
+    n[axis] = ((mesh->flags[index] & 4) != 0) != reverseOrientation ? -1 : 1;
+    isect->n = isect->shading.n = n;
+    if (mesh->tint) isect->tint = mesh->tint[index];
+}
+
+void MeshQuad::ComputeInteraction(const Ray &r, const ShapeHit &hit,
+                                  SurfaceInteraction *isect) const {
+    SurfaceInteraction isectLocal;
+    ComputeObjectInteraction((*WorldToObject)(r), hit, &isectLocal);
+    *isect = (*ObjectToWorld)(isectLocal);
+}
+
+bool MeshQuad::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
+                         bool testAlphaTexture) const {
+    ShapeHit hit;
+    if (!IntersectHit(ray, &hit, testAlphaTexture)) return false;
+    if (isect == nullptr) return true;
+    ComputeInteraction(ray, hit, isect);
+    *tHit = hit.t;
+    return true;
+}
+
+bool MeshQuad::IntersectP(const Ray &ray, bool testAlphaTexture) const {
+    ShapeHit hit;
+    return IntersectHit(ray, &hit, testAlphaTexture);
+}
+
+Interaction MeshQuad::Sample(const Point2f &u, Float *pdf) const {
+    int axis = mesh->flags[index] & 3;
+    Point3f pObj = mesh->p[index];
+    pObj[uAxis[axis]] += (u[0] - .5f) * mesh->extent[index].x;
+    pObj[vAxis[axis]] += (u[1] - .5f) * mesh->extent[index].y;
+    Normal3f n;
+    n[axis] = (mesh->flags[index] & 4) ? -1 : 1;
+    Interaction it;
+    it.n = Normalize((*ObjectToWorld)(n));
+    if (reverseOrientation) it.n *= -1;
+    it.p = (*ObjectToWorld)(pObj, Vector3f(0, 0, 0), &it.pError);
+    *pdf = 1 / Area();
+    return it;
+}
+
+bool MeshQuad::GetWorldFace(QuadFace *face) const {
+    if (!ObjectToWorld->IsAxisPermutation()) return false;
+    int axis = mesh->flags[index] & 3;
+    face->bounds = (*ObjectToWorld)(ObjectBound());
+    Normal3f n;
+    n[axis] = ((mesh->flags[index] & 4) != 0) != reverseOrientation ? -1 : 1;
+    n = (*ObjectToWorld)(n);
+    face->axis = n.x != 0 ? 0 : (n.y != 0 ? 1 : 2);
+    face->positive = n[face->axis] > 0;
+    face->pObj = mesh->p[index];
+    face->objectAxis = axis;
+    face->l1 = mesh->extent[index].x;
+    face->l2 = mesh->extent[index].y;
+    face->dir = (mesh->flags[index] & 4) ? -1 : 1;
+    const Float *rect = &mesh->uv[4 * index];
+    face->u0 = rect[0];
+    face->v0 = rect[1];
+    face->u1 = rect[2];
+    face->v1 = rect[3];
+    face->alphaMask = mesh->alphaMask;
+    face->tint = mesh->tint ? mesh->tint[index] : RGBSpectrum(1.f);
+    return true;
+}
+
+std::vector<std::shared_ptr<Shape>> CreateQuadMesh(
+    const Transform *ObjectToWorld, const Transform *WorldToObject,
+    bool reverseOrientation, int nQuads, const Point3f *P, const int *axis,
+    const Float *dir, const Float *l1, const Float *l2, const Float *uv,
+    const std::shared_ptr<Texture<Float>> &alphaMask,
+    const RGBSpectrum *tint) {
+    std::shared_ptr<QuadMesh> mesh = std::make_shared<QuadMesh>(
+        nQuads, P, axis, dir, l1, l2, uv, alphaMask, tint);
+    mesh->quads.reserve(nQuads);
+    quadMeshBytes += nQuads * sizeof(MeshQuad);
+    std::vector<std::shared_ptr<Shape>> quads;
+    quads.reserve(nQuads);
+    for (int i = 0; i < nQuads; ++i) {
+        mesh->quads.push_back(MeshQuad(ObjectToWorld, WorldToObject,
+                                       reverseOrientation, mesh.get(), i));
+        // Alias the mesh's reference count rather than allocating a
+        // control block for each quad
+        quads.push_back(std::shared_ptr<Shape>(mesh, &mesh->quads[i]));
+    }
+    return quads;
+}
+
+std::vector<std::shared_ptr<Shape>> CreateQuadMeshShape(
+    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
+    const ParamSet &params,
+    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures) {
+    int nq, naxis;
+    const Point3f *P = params.FindPoint3f("P", &nq);
+    const int *axis = params.FindInt("axis", &naxis);
+    if (!P || !axis) {
+        Error("\"P\" and \"axis\" must be provided with quadmesh.");
+        return {};
+    }
+    if (naxis != nq) {
+        Error("Number of \"axis\" values %d for quadmesh doesn't match the "
+              "number of quads %d.", naxis, nq);
+        return {};
+    }
+    for (int i = 0; i < nq; ++i)
+        if (axis[i] < 0 || axis[i] > 2) {
+            Error("quadmesh has out of-bounds axis %d.", axis[i]);
+            return {};
+        }
+
+    // Per-quad values may also be given once for the whole mesh
+    auto findPerQuad = [&](const char *name, int n,
+                           std::vector<Float> *values) -> const Float * {
+        int nv;
+        const Float *v = params.FindFloat(name, &nv);
+        if (!v) return nullptr;
+        if (nv == n * nq) return v;
+        if (nv == n) {
+            for (int i = 0; i < nq; ++i) values->insert(values->end(), v, v + n);
+            return values->data();
+        }
+        Error("Expected %d or %d \"%s\" values for quadmesh, but got %d. "
+              "Ignoring them.", n, n * nq, name, nv);
+        return nullptr;
+    };
+    std::vector<Float> dirValues, l1Values, l2Values, uvValues;
+    const Float *dir = findPerQuad("dir", 1, &dirValues);
+    const Float *l1 = findPerQuad("l1", 1, &l1Values);
+    const Float *l2 = findPerQuad("l2", 1, &l2Values);
+    const Float *uv = findPerQuad("uv", 4, &uvValues);
+    int nt;
+    const Spectrum *tintSpectra = params.FindSpectrum("tint", &nt);
+    std::vector<RGBSpectrum> tint;
+    if (tintSpectra && nt != 1 && nt != nq)
+        Error("Expected 1 or %d \"tint\" values for quadmesh, but got %d. "
+              "Ignoring them.", nq, nt);
+    else if (tintSpectra)
+        for (int i = 0; i < nq; ++i)
+            tint.push_back(tintSpectra[nt == 1 ? 0 : i].ToRGBSpectrum());
+
+    std::shared_ptr<Texture<Float>> alphaTex;
+    std::string alphaTexName = params.FindTexture("alpha");
+    if (alphaTexName != "") {
+        if (floatTextures->find(alphaTexName) != floatTextures->end())
+            alphaTex = (*floatTextures)[alphaTexName];
+        else
+            Error("Couldn't find float texture \"%s\" for \"alpha\" parameter",
+                  alphaTexName.c_str());
+    } else if (params.FindOneFloat("alpha", 1.f) == 0.f)
+        alphaTex.reset(new ConstantTexture<Float>(0.f));
+
+    return CreateQuadMesh(o2w, w2o, reverseOrientation, nq, P, axis, dir, l1,
+                          l2, uv, alphaTex,
+                          tint.empty() ? nullptr : tint.data());
+}
+
+}  // namespace pbrt
@@ -0,0 +1,97 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_SHAPES_QUADMESH_H
+#define PBRT_SHAPES_QUADMESH_H
+
+// shapes/quadmesh.h*
+#include "shape.h"
+#include "shapes/quad.h"
+#include <map>
+#include <vector>
+
+namespace pbrt {
+
+struct QuadMesh;
+
+// MeshQuad Declarations
+
+// An axis-aligned quad stored in a QuadMesh. It intersects like the
+// QuadX, QuadY and QuadZ shapes, but all of its data lives in the mesh.
+class MeshQuad : public Shape {
+  public:
+    // MeshQuad Public Methods
+    MeshQuad(const Transform *ObjectToWorld, const Transform *WorldToObject,
+             bool reverseOrientation, const QuadMesh *mesh, int quadNumber)
+        : Shape(ObjectToWorld, WorldToObject, reverseOrientation),
+          mesh(mesh),
+          index(quadNumber) {}
+    Bounds3f ObjectBound() const;
+    bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
+                   bool testAlphaTexture = true) const;
+    bool IntersectP(const Ray &ray, bool testAlphaTexture = true) const;
+    bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                      bool testAlphaTexture = true) const;
+    void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                            SurfaceInteraction *isect) const;
+    Float Area() const;
+    Interaction Sample(const Point2f &u, Float *pdf) const;
+    bool GetWorldFace(QuadFace *face) const;
+
+  private:
+    // MeshQuad Private Methods
+    void ComputeObjectInteraction(const Ray &ray, const ShapeHit &hit,
+                                  SurfaceInteraction *isect) const;
+
+    // MeshQuad Private Data
+    const QuadMesh *mesh;
+    int index;
+};
+
+// QuadMesh Declarations
+
+// Quads are stored in structure-of-arrays form, sharing the mesh's
+// transformation; this needs 37 bytes per quad. Each quad still has its
+// own 48-byte MeshQuad view and GeometricPrimitive, which brings the total
+// to about 200 bytes per quad in a scene (against about 550 for quady).
+struct QuadMesh {
+    // QuadMesh Public Methods
+    QuadMesh(int nQuads, const Point3f *P, const int *axis, const Float *dir,
+             const Float *l1, const Float *l2, const Float *uv,
+             const std::shared_ptr<Texture<Float>> &alphaMask,
+             const RGBSpectrum *tint = nullptr);
+
+    // QuadMesh Data
+    const int nQuads;
+    // Quad centers in object space
+    std::unique_ptr<Point3f[]> p;
+    // Edge lengths along the quad's u and v axes
+    std::unique_ptr<Vector2f[]> extent;
+    // Texture rectangles, as (u0, v0, u1, v1)
+    std::unique_ptr<Float[]> uv;
+    // Normal axis in the low two bits; bit 2 is set for a negative _dir_
+    std::unique_ptr<uint8_t[]> flags;
+    // Per-quad tint colors, if given
+    std::unique_ptr<RGBSpectrum[]> tint;
+    std::shared_ptr<Texture<Float>> alphaMask;
+    const AlphaCoverage *alphaCoverage;
+    // The shapes handed out for each quad; they share ownership of the mesh
+    std::vector<MeshQuad> quads;
+};
+
+std::vector<std::shared_ptr<Shape>> CreateQuadMesh(
+    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
+    int nQuads, const Point3f *P, const int *axis, const Float *dir,
+    const Float *l1, const Float *l2, const Float *uv,
+    const std::shared_ptr<Texture<Float>> &alphaMask,
+    const RGBSpectrum *tint = nullptr);
+std::vector<std::shared_ptr<Shape>> CreateQuadMeshShape(
+    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
+    const ParamSet &params,
+    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures);
+
+}  // namespace pbrt
+
+#endif  // PBRT_SHAPES_QUADMESH_H
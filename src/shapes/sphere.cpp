@@ -46,8 +46,8 @@ Bounds3f Sphere::ObjectBound() const {
                     Point3f(radius, radius, zMax));
 }
 
-bool Sphere::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
-                       bool testAlphaTexture) const {
+bool Sphere::IntersectHit(const Ray &r, ShapeHit *hit,
+                          bool testAlphaTexture) const {
     ProfilePhase p(Prof::ShapeIntersect);
     Float phi;
     Point3f pHit;
@@ -104,6 +104,18 @@ bool Sphere::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
             return false;
     }
 
+    hit->t = (Float)tShapeHit;
+    hit->p = pHit;
+    hit->uv = Point2f(phi, 0);
+    return true;
+}
+
+void Sphere::ComputeInteraction(const Ray &r, const ShapeHit &hit,
+                                SurfaceInteraction *isect) const {
+    Vector3f d = (*WorldToObject)(r.d);
+    const Point3f &pHit = hit.p;
+    Float phi = hit.uv[0];
+
     // Find parametric representation of sphere hit
     Float u = phi / phiMax;
     Float theta = std::acos(Clamp(pHit.z / radius, -1, 1));
@@ -147,11 +159,17 @@ bool Sphere::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
 
     // Initialize _SurfaceInteraction_ from parametric information
     *isect = (*ObjectToWorld)(SurfaceInteraction(pHit, pError, Point2f(u, v),
-                                                 -ray.d, dpdu, dpdv, dndu, dndv,
-                                                 ray.time, this));
+                                                 -d, dpdu, dpdv, dndu, dndv,
+                                                 r.time, this));
+}
 
+bool Sphere::Intersect(const Ray &r, Float *tHit, SurfaceInteraction *isect,
+                       bool testAlphaTexture) const {
+    ShapeHit hit;
+    if (!IntersectHit(r, &hit, testAlphaTexture)) return false;
+    ComputeInteraction(r, hit, isect);
     // Update _tHit_ for quadric intersection
-    *tHit = (Float)tShapeHit;
+    *tHit = hit.t;
     return true;
 }
 
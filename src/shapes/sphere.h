@@ -61,6 +61,10 @@ class Sphere : public Shape {
     bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
                    bool testAlphaTexture) const;
     bool IntersectP(const Ray &ray, bool testAlphaTexture) const;
+    bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                      bool testAlphaTexture) const;
+    void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                            SurfaceInteraction *isect) const;
     Float Area() const;
     Interaction Sample(const Point2f &u, Float *pdf) const;
     Interaction Sample(const Interaction &ref, const Point2f &u,
@@ -56,7 +56,7 @@ TriangleMesh::TriangleMesh(
     int nVertices, const Point3f *P, const Vector3f *S, const Normal3f *N,
     const Point2f *UV, const std::shared_ptr<Texture<Float>> &alphaMask,
     const std::shared_ptr<Texture<Float>> &shadowAlphaMask,
-    const int *fIndices)
+    const int *fIndices, const RGBSpectrum *Tint)
     : nTriangles(nTriangles),
       nVertices(nVertices),
       vertexIndices(vertexIndices, vertexIndices + 3 * nTriangles),
@@ -67,7 +67,8 @@ TriangleMesh::TriangleMesh(
     triMeshBytes += sizeof(*this) + this->vertexIndices.size() * sizeof(int) +
                     nVertices * (sizeof(*P) + (N ? sizeof(*N) : 0) +
                                  (S ? sizeof(*S) : 0) + (UV ? sizeof(*UV) : 0) +
-                                 (fIndices ? sizeof(*fIndices) : 0));
+                                 (fIndices ? sizeof(*fIndices) : 0) +
+                                 (Tint ? sizeof(*Tint) : 0));
 
     // Transform mesh vertices to world space
     p.reset(new Point3f[nVertices]);
@@ -89,6 +90,10 @@ TriangleMesh::TriangleMesh(
 
     if (fIndices)
         faceIndices = std::vector<int>(fIndices, fIndices + nTriangles);
+    if (Tint) {
+        tint.reset(new RGBSpectrum[nVertices]);
+        std::copy(Tint, Tint + nVertices, tint.get());
+    }
 }
 
 std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
@@ -97,10 +102,10 @@ std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
     int nVertices, const Point3f *p, const Vector3f *s, const Normal3f *n,
     const Point2f *uv, const std::shared_ptr<Texture<Float>> &alphaMask,
     const std::shared_ptr<Texture<Float>> &shadowAlphaMask,
-    const int *faceIndices) {
+    const int *faceIndices, const RGBSpectrum *tint) {
     std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>(
         *ObjectToWorld, nTriangles, vertexIndices, nVertices, p, s, n, uv,
-        alphaMask, shadowAlphaMask, faceIndices);
+        alphaMask, shadowAlphaMask, faceIndices, tint);
     std::vector<std::shared_ptr<Shape>> tris;
     tris.reserve(nTriangles);
     for (int i = 0; i < nTriangles; ++i)
@@ -185,8 +190,8 @@ Bounds3f Triangle::WorldBound() const {
     return Union(Bounds3f(p0, p1), p2);
 }
 
-bool Triangle::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
-                         bool testAlphaTexture) const {
+bool Triangle::IntersectHit(const Ray &ray, ShapeHit *hit,
+                            bool testAlphaTexture) const {
     ProfilePhase p(Prof::TriIntersect);
     ++nTests;
     // Get triangle vertices in _p0_, _p1_, and _p2_
@@ -290,11 +295,36 @@ bool Triangle::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
                    std::abs(invDet);
     if (t <= deltaT) return false;
 
-    // Compute triangle partial derivatives
-    Vector3f dpdu, dpdv;
-    Point2f uv[3];
-    GetUVs(uv);
+    // The triangle is degenerate if it has no area; the intersection is
+    // bogus
+    if (Cross(p2 - p0, p1 - p0).LengthSquared() == 0) return false;
+
+    // Test intersection against alpha texture, if present
+    if (testAlphaTexture && mesh->alphaMask) {
+        Point2f uv[3];
+        GetUVs(uv);
+        Vector3f dpdu, dpdv;
+        ComputePartials(uv, &dpdu, &dpdv);
+        Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
+        Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
+        SurfaceInteraction isectLocal(pHit, Vector3f(0, 0, 0), uvHit, -ray.d,
+                                      dpdu, dpdv, Normal3f(0, 0, 0),
+                                      Normal3f(0, 0, 0), ray.time, this);
+        if (mesh->alphaMask->Evaluate(isectLocal) == 0) return false;
+    }
+    hit->t = t;
+    hit->b[0] = b0;
+    hit->b[1] = b1;
+    hit->b[2] = b2;
+    ++nHits;
+    return true;
+}
 
+void Triangle::ComputePartials(const Point2f uv[3], Vector3f *dpdu,
+                               Vector3f *dpdv) const {
+    const Point3f &p0 = mesh->p[v[0]];
+    const Point3f &p1 = mesh->p[v[1]];
+    const Point3f &p2 = mesh->p[v[2]];
     // Compute deltas for triangle partial derivatives
     Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
     Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
@@ -302,19 +332,27 @@ bool Triangle::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
     bool degenerateUV = std::abs(determinant) < 1e-8;
     if (!degenerateUV) {
         Float invdet = 1 / determinant;
-        dpdu = (duv12[1] * dp02 - duv02[1] * dp12) * invdet;
-        dpdv = (-duv12[0] * dp02 + duv02[0] * dp12) * invdet;
+        *dpdu = (duv12[1] * dp02 - duv02[1] * dp12) * invdet;
+        *dpdv = (-duv12[0] * dp02 + duv02[0] * dp12) * invdet;
     }
-    if (degenerateUV || Cross(dpdu, dpdv).LengthSquared() == 0) {
+    if (degenerateUV || Cross(*dpdu, *dpdv).LengthSquared() == 0)
         // Handle zero determinant for triangle partial derivative matrix
-        Vector3f ng = Cross(p2 - p0, p1 - p0);
-        if (ng.LengthSquared() == 0)
-            // The triangle is actually degenerate; the intersection is
-            // bogus.
-            return false;
+        CoordinateSystem(Normalize(Cross(p2 - p0, p1 - p0)), dpdu, dpdv);
+}
 
-        CoordinateSystem(Normalize(ng), &dpdu, &dpdv);
-    }
+void Triangle::ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                                  SurfaceInteraction *isect) const {
+    const Point3f &p0 = mesh->p[v[0]];
+    const Point3f &p1 = mesh->p[v[1]];
+    const Point3f &p2 = mesh->p[v[2]];
+    Float b0 = hit.b[0], b1 = hit.b[1], b2 = hit.b[2];
+
+    // Compute triangle partial derivatives
+    Vector3f dpdu, dpdv;
+    Point2f uv[3];
+    GetUVs(uv);
+    ComputePartials(uv, &dpdu, &dpdv);
+    Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
 
     // Compute error bounds for triangle intersection
     Float xAbsSum =
@@ -329,19 +367,15 @@ bool Triangle::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
     Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
     Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
 
-    // Test intersection against alpha texture, if present
-    if (testAlphaTexture && mesh->alphaMask) {
-        SurfaceInteraction isectLocal(pHit, Vector3f(0, 0, 0), uvHit, -ray.d,
-                                      dpdu, dpdv, Normal3f(0, 0, 0),
-                                      Normal3f(0, 0, 0), ray.time, this);
-        if (mesh->alphaMask->Evaluate(isectLocal) == 0) return false;
-    }
-
     // Fill in _SurfaceInteraction_ from triangle hit
     *isect = SurfaceInteraction(pHit, pError, uvHit, -ray.d, dpdu, dpdv,
                                 Normal3f(0, 0, 0), Normal3f(0, 0, 0), ray.time,
                                 this, faceIndex);
 
+    if (mesh->tint)
+        isect->tint = b0 * mesh->tint[v[0]] + b1 * mesh->tint[v[1]] +
+                      b2 * mesh->tint[v[2]];
+
     // Override surface normal in _isect_ for triangle
     isect->n = isect->shading.n = Normal3f(Normalize(Cross(dp02, dp12)));
     if (mesh->n || mesh->s) {
@@ -419,8 +453,15 @@ bool Triangle::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
         isect->n = Faceforward(isect->n, isect->shading.n);
     else if (reverseOrientation ^ transformSwapsHandedness)
         isect->n = isect->shading.n = -isect->n;
-    *tHit = t;
-    ++nHits;
+}
+
+
+bool Triangle::Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
+                         bool testAlphaTexture) const {
+    ShapeHit hit;
+    if (!IntersectHit(ray, &hit, testAlphaTexture)) return false;
+    ComputeInteraction(ray, hit, isect);
+    *tHit = hit.t;
     return true;
 }
 
@@ -715,6 +756,16 @@ std::vector<std::shared_ptr<Shape>> CreateTriangleMeshShape(
         faceIndices = nullptr;
     }
 
+    int nti;
+    const Spectrum *tintSpectra = params.FindSpectrum("tint", &nti);
+    std::unique_ptr<RGBSpectrum[]> tint;
+    if (tintSpectra && nti != npi)
+        Error("Number of \"tint\"s for triangle mesh must match \"P\"s");
+    else if (tintSpectra) {
+        tint.reset(new RGBSpectrum[npi]);
+        for (int i = 0; i < npi; ++i) tint[i] = tintSpectra[i].ToRGBSpectrum();
+    }
+
     std::shared_ptr<Texture<Float>> alphaTex;
     std::string alphaTexName = params.FindTexture("alpha");
     if (alphaTexName != "") {
@@ -740,7 +791,8 @@ std::vector<std::shared_ptr<Shape>> CreateTriangleMeshShape(
         shadowAlphaTex.reset(new ConstantTexture<Float>(0.f));
 
     return CreateTriangleMesh(o2w, w2o, reverseOrientation, nvi / 3, vi, npi, P,
-                              S, N, uvs, alphaTex, shadowAlphaTex, faceIndices);
+                              S, N, uvs, alphaTex, shadowAlphaTex, faceIndices,
+                              tint.get());
 }
 
 }  // namespace pbrt
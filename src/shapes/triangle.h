@@ -55,7 +55,7 @@ struct TriangleMesh {
                  const Vector3f *S, const Normal3f *N, const Point2f *uv,
                  const std::shared_ptr<Texture<Float>> &alphaMask,
                  const std::shared_ptr<Texture<Float>> &shadowAlphaMask,
-                 const int *faceIndices);
+                 const int *faceIndices, const RGBSpectrum *tint = nullptr);
 
     // TriangleMesh Data
     const int nTriangles, nVertices;
@@ -66,6 +66,8 @@ struct TriangleMesh {
     std::unique_ptr<Point2f[]> uv;
     std::shared_ptr<Texture<Float>> alphaMask, shadowAlphaMask;
     std::vector<int> faceIndices;
+    // Per-vertex tint colors, interpolated into _SurfaceInteraction::tint_
+    std::unique_ptr<RGBSpectrum[]> tint;
 };
 
 class Triangle : public Shape {
@@ -84,6 +86,10 @@ class Triangle : public Shape {
     bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
                    bool testAlphaTexture = true) const;
     bool IntersectP(const Ray &ray, bool testAlphaTexture = true) const;
+    bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                      bool testAlphaTexture = true) const;
+    void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                            SurfaceInteraction *isect) const;
     Float Area() const;
 
     using Shape::Sample;  // Bring in the other Sample() overload.
@@ -95,6 +101,8 @@ class Triangle : public Shape {
 
   private:
     // Triangle Private Methods
+    void ComputePartials(const Point2f uv[3], Vector3f *dpdu,
+                         Vector3f *dpdv) const;
     void GetUVs(Point2f uv[3]) const {
         if (mesh->uv) {
             uv[0] = mesh->uv[v[0]];
@@ -119,7 +127,7 @@ std::vector<std::shared_ptr<Shape>> CreateTriangleMesh(
     const Vector3f *s, const Normal3f *n, const Point2f *uv,
     const std::shared_ptr<Texture<Float>> &alphaTexture,
     const std::shared_ptr<Texture<Float>> &shadowAlphaTexture,
-    const int *faceIndices = nullptr);
+    const int *faceIndices = nullptr, const RGBSpectrum *tint = nullptr);
 std::vector<std::shared_ptr<Shape>> CreateTriangleMeshShape(
     const Transform *o2w, const Transform *w2o, bool reverseOrientation,
     const ParamSet &params,
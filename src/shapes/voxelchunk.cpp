@@ -0,0 +1,299 @@
+// shapes/voxelchunk.cpp*
+#include "shapes/voxelchunk.h"
+#include "textures/constant.h"
+#include "paramset.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_MEMORY_COUNTER("Memory/Voxel chunks", voxelChunkBytes);
+STAT_COUNTER("Scene/Voxel chunk faces", nVoxelFaces);
+STAT_INT_DISTRIBUTION("Intersections/Voxel chunk cells visited per ray",
+                      nCellsVisited);
+
+// The in-plane axes of a face perpendicular to each axis, chosen so that
+// (u, v) follow the same conventions as QuadX, QuadY and QuadZ.
+static const int uAxis[3] = {1, 0, 1};
+static const int vAxis[3] = {2, 2, 0};
+
+// VoxelChunk Method Definitions
+VoxelChunk::VoxelChunk(const Transform *ObjectToWorld,
+                       const Transform *WorldToObject, bool reverseOrientation,
+                       const Point3i &resolution, std::vector<uint16_t> b,
+                       std::vector<Float> uv,
+                       const std::shared_ptr<Texture<Float>> &alphaMask,
+                       std::vector<RGBSpectrum> tint)
+    : Shape(ObjectToWorld, WorldToObject, reverseOrientation),
+      resolution(resolution),
+      blocks(std::move(b)),
+      faceUV(std::move(uv)),
+      faceTint(std::move(tint)),
+      alphaMask(alphaMask),
+      alphaCoverage(GetAlphaCoverage(alphaMask.get())) {
+    CHECK_EQ(blocks.size(), resolution.x * resolution.y * resolution.z);
+    voxelChunkBytes += sizeof(*this) + blocks.size() * sizeof(uint16_t) +
+                       faceUV.size() * sizeof(Float) +
+                       faceTint.size() * sizeof(RGBSpectrum);
+
+    // Compute the bounds of the occupied cells and the number of faces
+    int nFaces = 0;
+    for (int z = 0; z < resolution.z; ++z)
+        for (int y = 0; y < resolution.y; ++y)
+            for (int x = 0; x < resolution.x; ++x) {
+                Point3i p(x, y, z);
+                if (!Solid(p)) continue;
+                bounds = Union(bounds, Bounds3f(Point3f(x, y, z),
+                                                Point3f(x + 1, y + 1, z + 1)));
+                for (int axis = 0; axis < 3; ++axis)
+                    for (int step = -1; step <= 1; step += 2) {
+                        Point3i n = p;
+                        n[axis] += step;
+                        if (!Solid(n)) ++nFaces;
+                    }
+            }
+    area = nFaces;
+    nVoxelFaces += nFaces;
+}
+
+Bounds3f VoxelChunk::ObjectBound() const { return bounds; }
+
+bool VoxelChunk::IntersectFace(const Ray &ray, Float t, int axis,
+                               const Point3i &cell, bool positive,
+                               ShapeHit *hit, bool testAlphaTexture) const {
+    // Compute the hit point on the face of _cell_, snapping it to the plane
+    Point3f pHit = ray(t);
+    pHit[axis] = cell[axis] + (positive ? 1 : 0);
+    int ua = uAxis[axis], va = vAxis[axis];
+    Float fu = Clamp(pHit[ua] - cell[ua], 0, 1);
+    Float fv = Clamp(pHit[va] - cell[va], 0, 1);
+
+    // Find the texture rectangle for this face of the block; the hit's
+    // index identifies the face of the block id
+    int face = 6 * (blocks[Offset(cell)] - 1) + 2 * axis + (positive ? 1 : 0);
+    size_t offset = 4 * size_t(face);
+    Float u0 = 0, v0 = 0, u1 = 1, v1 = 1;
+    if (offset + 4 <= faceUV.size()) {
+        u0 = faceUV[offset];
+        v0 = faceUV[offset + 1];
+        u1 = faceUV[offset + 2];
+        v1 = faceUV[offset + 3];
+    }
+    Float Du = u1 - u0, Dv = v1 - v0;
+    Float u = Du * fu + u0, v = Dv * fv + v0;
+    ShapeHit faceHit{t, pHit, Point2f(u, v), {Du, Dv, 0}, face};
+
+    // Test intersection against alpha texture, if present, using its
+    // coverage mask to avoid building a _SurfaceInteraction_ if possible
+    if (testAlphaTexture && alphaMask) {
+        if (alphaCoverage) {
+            if (!alphaCoverage->Covered(Point2f(v, u))) return false;
+        } else {
+            SurfaceInteraction isectLocal;
+            ComputeObjectInteraction(ray, faceHit, &isectLocal);
+            if (alphaMask->Evaluate(isectLocal) == 0) return false;
+        }
+    }
+    if (hit) *hit = faceHit;
+    return true;
+}
+
+void VoxelChunk::ComputeObjectInteraction(const Ray &ray, const ShapeHit &hit,
+                                          SurfaceInteraction *isect) const {
+    // Initialize _SurfaceInteraction_ the same way the quads do
+    int axis = (hit.index % 6) / 2;
+    Vector3f dpdu, dpdv;
+    dpdu[vAxis[axis]] = 1 / hit.b[1];
+    dpdv[uAxis[axis]] = 1 / hit.b[0];
+    Normal3f dn(0, 0, 0);
+    Vector3f pError = gamma(5) * Abs((Vector3f)hit.p);
+    pError[axis] = 0;
+    *isect = SurfaceInteraction(hit.p, pError, Point2f(hit.uv[1], hit.uv[0]),
+                                -ray.d, dpdu, dpdv, dn, dn, ray.time, this);
+
+    // Faces always point out of the solid cell
+    Normal3f n;
+    n[axis] = (hit.index & 1) ? 1 : -1;
+    if (reverseOrientation) n = -n;
+    isect->n = isect->shading.n = n;
+    if (size_t(hit.index) < faceTint.size()) isect->tint = faceTint[hit.index];
+}
+
+void VoxelChunk::ComputeInteraction(const Ray &r, const ShapeHit &hit,
+                                    SurfaceInteraction *isect) const {
+    SurfaceInteraction isectLocal;
+    ComputeObjectInteraction((*WorldToObject)(r), hit, &isectLocal);
+    *isect = (*ObjectToWorld)(isectLocal);
+}
+
+bool VoxelChunk::Intersect(const Ray &ray, Float *tHit,
+                           SurfaceInteraction *isect,
+                           bool testAlphaTexture) const {
+    ShapeHit hit;
+    if (!IntersectHit(ray, isect ? &hit : nullptr, testAlphaTexture))
+        return false;
+    if (isect == nullptr) return true;
+    ComputeInteraction(ray, hit, isect);
+    *tHit = hit.t;
+    return true;
+}
+
+bool VoxelChunk::IntersectHit(const Ray &r, ShapeHit *hit,
+                              bool testAlphaTexture) const {
+    ProfilePhase p(Prof::ShapeIntersect);
+    // Transform _Ray_ to object space and clip it to the occupied cells
+    Vector3f oErr, dErr;
+    Ray ray = (*WorldToObject)(r, &oErr, &dErr);
+    Float t0, t1;
+    if (!bounds.IntersectP(ray, &t0, &t1)) return false;
+
+    // Set up 3D-DDA for ray through the chunk
+    Point3f pEnter = ray(t0);
+    Point3i cell, step;
+    Float tNext[3], invDir[3];
+    int enterAxis = -1;
+    Float tEnter = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+        cell[axis] = Clamp(int(std::floor(pEnter[axis])), bounds.pMin[axis],
+                           bounds.pMax[axis] - 1);
+        invDir[axis] = 1 / ray.d[axis];
+        if (ray.d[axis] == 0) {
+            step[axis] = 0;
+            tNext[axis] = Infinity;
+            continue;
+        }
+        step[axis] = ray.d[axis] > 0 ? 1 : -1;
+        Float plane = cell[axis] + (step[axis] > 0 ? 1 : 0);
+        tNext[axis] = (plane - ray.o[axis]) * invDir[axis];
+        // Track which slab the ray entered the bounds through
+        Float tSlab = ((step[axis] > 0 ? bounds.pMin[axis] : bounds.pMax[axis]) -
+                       ray.o[axis]) * invDir[axis];
+        if (tSlab > 0 && tSlab >= tEnter) {
+            tEnter = tSlab;
+            enterAxis = axis;
+        }
+    }
+
+    // Handle a hit on the face the ray enters the chunk through
+    int nVisited = 1;
+    bool solid = Solid(cell);
+    if (solid && t0 > 0 && enterAxis != -1 &&
+        IntersectFace(ray, t0, enterAxis, cell, step[enterAxis] < 0, hit,
+                      testAlphaTexture)) {
+        ReportValue(nCellsVisited, nVisited);
+        return true;
+    }
+
+    // Walk the cells along the ray, reporting the first boundary between a
+    // solid and an empty cell
+    while (true) {
+        int axis = (tNext[0] < tNext[1])
+                       ? ((tNext[0] < tNext[2]) ? 0 : 2)
+                       : ((tNext[1] < tNext[2]) ? 1 : 2);
+        Float t = tNext[axis];
+        if (t >= ray.tMax) break;
+        Point3i next = cell;
+        next[axis] += step[axis];
+        bool nextSolid = Solid(next);
+        if (solid != nextSolid && t > 0) {
+            const Point3i &solidCell = solid ? cell : next;
+            bool positive = (step[axis] > 0) == solid;
+            if (IntersectFace(ray, t, axis, solidCell, positive, hit,
+                              testAlphaTexture)) {
+                ReportValue(nCellsVisited, nVisited);
+                return true;
+            }
+        }
+        if (next[axis] < bounds.pMin[axis] || next[axis] >= bounds.pMax[axis])
+            break;
+        cell = next;
+        solid = nextSolid;
+        ++nVisited;
+        tNext[axis] =
+            (cell[axis] + (step[axis] > 0 ? 1 : 0) - ray.o[axis]) * invDir[axis];
+    }
+    ReportValue(nCellsVisited, nVisited);
+    return false;
+}
+
+bool VoxelChunk::IntersectP(const Ray &ray, bool testAlphaTexture) const {
+    return IntersectHit(ray, nullptr, testAlphaTexture);
+}
+
+Interaction VoxelChunk::Sample(const Point2f &u, Float *pdf) const {
+    LOG(FATAL) << "VoxelChunk::Sample not implemented; use quads for "
+                  "emissive blocks.";
+    return Interaction();
+}
+
+std::shared_ptr<Shape> CreateVoxelChunkShape(
+    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
+    const ParamSet &params,
+    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures) {
+    int nres;
+    const int *res = params.FindInt("resolution", &nres);
+    if (!res || nres != 3) {
+        Error("Three \"resolution\" values must be provided with voxelchunk.");
+        return nullptr;
+    }
+    Point3i resolution(res[0], res[1], res[2]);
+    if (resolution.x <= 0 || resolution.y <= 0 || resolution.z <= 0) {
+        Error("Invalid voxelchunk resolution %d %d %d.", res[0], res[1],
+              res[2]);
+        return nullptr;
+    }
+
+    int nb;
+    const int *b = params.FindInt("blocks", &nb);
+    if (!b || nb != resolution.x * resolution.y * resolution.z) {
+        Error("voxelchunk needs %d \"blocks\" values, but %d were provided.",
+              resolution.x * resolution.y * resolution.z, b ? nb : 0);
+        return nullptr;
+    }
+    std::vector<uint16_t> blocks(nb);
+    for (int i = 0; i < nb; ++i) {
+        if (b[i] < 0 || b[i] > 65535) {
+            Error("voxelchunk block id %d out of range.", b[i]);
+            return nullptr;
+        }
+        blocks[i] = b[i];
+    }
+
+    int nuv;
+    const Float *uv = params.FindFloat("faceuv", &nuv);
+    std::vector<Float> faceUV;
+    if (uv) {
+        if (nuv % 24 != 0)
+            Warning("Number of \"faceuv\" values %d for voxelchunk isn't a "
+                    "multiple of 24. Discarding extra.", nuv);
+        faceUV.assign(uv, uv + (nuv / 24) * 24);
+    }
+
+    int ntint;
+    const Spectrum *tint = params.FindSpectrum("facetint", &ntint);
+    std::vector<RGBSpectrum> faceTint;
+    if (tint) {
+        if (ntint % 6 != 0)
+            Warning("Number of \"facetint\" values %d for voxelchunk isn't a "
+                    "multiple of 6. Discarding extra.", ntint);
+        for (int i = 0; i < (ntint / 6) * 6; ++i)
+            faceTint.push_back(tint[i].ToRGBSpectrum());
+    }
+
+    std::shared_ptr<Texture<Float>> alphaTex;
+    std::string alphaTexName = params.FindTexture("alpha");
+    if (alphaTexName != "") {
+        if (floatTextures->find(alphaTexName) != floatTextures->end())
+            alphaTex = (*floatTextures)[alphaTexName];
+        else
+            Error("Couldn't find float texture \"%s\" for \"alpha\" parameter",
+                  alphaTexName.c_str());
+    } else if (params.FindOneFloat("alpha", 1.f) == 0.f)
+        alphaTex.reset(new ConstantTexture<Float>(0.f));
+
+    return std::make_shared<VoxelChunk>(o2w, w2o, reverseOrientation,
+                                        resolution, std::move(blocks),
+                                        std::move(faceUV), alphaTex,
+                                        std::move(faceTint));
+}
+
+}  // namespace pbrt
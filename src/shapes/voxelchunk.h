@@ -0,0 +1,85 @@
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_SHAPES_VOXELCHUNK_H
+#define PBRT_SHAPES_VOXELCHUNK_H
+
+// shapes/voxelchunk.h*
+#include "shape.h"
+#include "textures/imagemap.h"
+#include <map>
+#include <vector>
+
+namespace pbrt {
+
+// VoxelChunk Declarations
+
+// A dense grid of unit-sized blocks occupying [0,nx]x[0,ny]x[0,nz] in
+// object space. Each cell stores a block id (0 is empty); a face is
+// present wherever a solid cell borders an empty cell or the edge of the
+// grid, so the chunk renders exactly like the culled per-face
+// quadx/quady/quadz shapes the exporter used to emit. Rays are
+// intersected by 3D-DDA stepping through the cells they cross.
+class VoxelChunk : public Shape {
+  public:
+    // VoxelChunk Public Methods
+    VoxelChunk(const Transform *ObjectToWorld, const Transform *WorldToObject,
+               bool reverseOrientation, const Point3i &resolution,
+               std::vector<uint16_t> blocks, std::vector<Float> faceUV,
+               const std::shared_ptr<Texture<Float>> &alphaMask,
+               std::vector<RGBSpectrum> faceTint = {});
+    Bounds3f ObjectBound() const;
+    bool Intersect(const Ray &ray, Float *tHit, SurfaceInteraction *isect,
+                   bool testAlphaTexture) const;
+    bool IntersectP(const Ray &ray, bool testAlphaTexture) const;
+    // _hit_ may be nullptr if only whether there's a hit is needed
+    bool IntersectHit(const Ray &ray, ShapeHit *hit,
+                      bool testAlphaTexture) const;
+    void ComputeInteraction(const Ray &ray, const ShapeHit &hit,
+                            SurfaceInteraction *isect) const;
+    Float Area() const { return area; }
+    Interaction Sample(const Point2f &u, Float *pdf) const;
+
+  private:
+    // VoxelChunk Private Methods
+    int Offset(const Point3i &p) const {
+        return (p.z * resolution.y + p.y) * resolution.x + p.x;
+    }
+    bool Solid(const Point3i &p) const {
+        if (p.x < 0 || p.y < 0 || p.z < 0 || p.x >= resolution.x ||
+            p.y >= resolution.y || p.z >= resolution.z)
+            return false;
+        return blocks[Offset(p)] != 0;
+    }
+    bool IntersectFace(const Ray &ray, Float t, int axis, const Point3i &cell,
+                       bool positive, ShapeHit *hit,
+                       bool testAlphaTexture) const;
+    // Builds the object-space interaction for a hit of the object-space
+    // _ray_
+    void ComputeObjectInteraction(const Ray &ray, const ShapeHit &hit,
+                                  SurfaceInteraction *isect) const;
+
+    // VoxelChunk Private Data
+    const Point3i resolution;
+    const std::vector<uint16_t> blocks;
+    // Per block id (starting at 1), six faces ordered -x, +x, -y, +y, -z,
+    // +z, each with the (u0, v0, u1, v1) rectangle used by the quads.
+    const std::vector<Float> faceUV;
+    // Per block id, the tint colors of its six faces, in the same order
+    const std::vector<RGBSpectrum> faceTint;
+    const std::shared_ptr<Texture<Float>> alphaMask;
+    const AlphaCoverage *alphaCoverage;
+    Bounds3f bounds;
+    Float area;
+};
+
+std::shared_ptr<Shape> CreateVoxelChunkShape(
+    const Transform *o2w, const Transform *w2o, bool reverseOrientation,
+    const ParamSet &params,
+    std::map<std::string, std::shared_ptr<Texture<Float>>> *floatTextures);
+
+}  // namespace pbrt
+
+#endif  // PBRT_SHAPES_VOXELCHUNK_H
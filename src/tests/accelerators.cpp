@@ -0,0 +1,279 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "rng.h"
+#include "interaction.h"
+#include "parallel.h"
+#include "paramset.h"
+#include "fileutil.h"
+#include "primitive.h"
+#include "sampling.h"
+#include "accelerators/bvh.h"
+#include "accelerators/widebvh.h"
+#include "shapes/quadmesh.h"
+#include "shapes/triangle.h"
+#include <algorithm>
+#include <cstdio>
+
+using namespace pbrt;
+
+// Random triangles plus axis-aligned quads, whose bounds are flat
+static std::vector<std::shared_ptr<Primitive>> RandomPrimitives(
+    RNG &rng, int nTris = 2000, int nQuads = 1000) {
+    static Transform identity;
+    std::vector<Point3f> P;
+    std::vector<int> indices;
+    for (int i = 0; i < nTris; ++i) {
+        Point3f base(10 * rng.UniformFloat(), 10 * rng.UniformFloat(),
+                     10 * rng.UniformFloat());
+        for (int v = 0; v < 3; ++v) {
+            indices.push_back(P.size());
+            P.push_back(base + Vector3f(rng.UniformFloat() - .5f,
+                                        rng.UniformFloat() - .5f,
+                                        rng.UniformFloat() - .5f));
+        }
+    }
+    std::vector<std::shared_ptr<Shape>> shapes = CreateTriangleMesh(
+        &identity, &identity, false, nTris, indices.data(), P.size(), P.data(),
+        nullptr, nullptr, nullptr, nullptr, nullptr);
+
+    std::vector<Point3f> quadP;
+    std::vector<int> axis;
+    std::vector<Float> dir;
+    for (int i = 0; i < nQuads; ++i) {
+        quadP.push_back(Point3f(10 * rng.UniformFloat(), 10 * rng.UniformFloat(),
+                                10 * rng.UniformFloat()));
+        axis.push_back(std::min(2, int(3 * rng.UniformFloat())));
+        dir.push_back(rng.UniformFloat() < .5f ? -1 : 1);
+    }
+    std::vector<std::shared_ptr<Shape>> quads =
+        CreateQuadMesh(&identity, &identity, false, nQuads, quadP.data(),
+                       axis.data(), dir.data(), nullptr, nullptr, nullptr,
+                       nullptr);
+    shapes.insert(shapes.end(), quads.begin(), quads.end());
+
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (const auto &s : shapes)
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            s, nullptr, nullptr, MediumInterface()));
+    return prims;
+}
+
+// The 4- and 8-wide BVHs, with and without quantized bounds, find the same
+// closest hits and occlusion as the binary BVH they're collapsed from.
+TEST(WideBVH, MatchesBVH) {
+    RNG rng;
+    std::vector<std::shared_ptr<Primitive>> prims = RandomPrimitives(rng);
+    std::shared_ptr<Primitive> bvh = CreateBVHAccelerator(prims, ParamSet());
+    for (int config = 0; config < 4; ++config) {
+        int width = (config & 1) ? 8 : 4;
+        ParamSet ps;
+        std::unique_ptr<bool[]> compressed(new bool[1]);
+        compressed[0] = config >= 2;
+        ps.AddBool("compressed", std::move(compressed), 1);
+        std::shared_ptr<Primitive> wide = CreateWideBVHAccelerator(
+            width, std::make_shared<const PrimitiveStore>(prims), ps);
+        EXPECT_EQ(bvh->WorldBound(), wide->WorldBound());
+        for (int i = 0; i < 10000; ++i) {
+            // Rays from inside and outside the primitives' bounds; some are
+            // parallel to an axis
+            Point3f o(-5 + 20 * rng.UniformFloat(), -5 + 20 * rng.UniformFloat(),
+                      -5 + 20 * rng.UniformFloat());
+            Vector3f d = UniformSampleSphere(
+                Point2f(rng.UniformFloat(), rng.UniformFloat()));
+            if (i % 10 == 0) d[i % 3] = 0;
+            Float tMax =
+                rng.UniformFloat() < .5f ? Infinity : 20 * rng.UniformFloat();
+            Ray r0(o, d, tMax), r1(o, d, tMax);
+            SurfaceInteraction isect0, isect1;
+            bool hit = bvh->Intersect(r0, &isect0);
+            ASSERT_EQ(hit, wide->Intersect(r1, &isect1))
+                << config << ": " << i;
+            if (hit) {
+                EXPECT_EQ(r0.tMax, r1.tMax) << config << ": " << i;
+                EXPECT_EQ(isect0.p, isect1.p) << config << ": " << i;
+            }
+            Ray shadow(o, d, tMax);
+            EXPECT_EQ(bvh->IntersectP(shadow), wide->IntersectP(shadow))
+                << config << ": " << i;
+        }
+    }
+}
+
+// Primitives whose bounds share a centroid end up in one binary BVH leaf,
+// which the quantized nodes have to split across children.
+TEST(WideBVH, LargeLeaves) {
+    static Transform identity;
+    RNG rng;
+    const int nTris = 700;
+    std::vector<Point3f> P;
+    std::vector<int> indices;
+    for (int i = 0; i < nTris; ++i) {
+        Float s = .1f + rng.UniformFloat(), t = .1f + rng.UniformFloat();
+        for (Point3f p : {Point3f(-s, -s, -t), Point3f(s, -s, t),
+                          Point3f(0, s, 0)}) {
+            indices.push_back(P.size());
+            P.push_back(p);
+        }
+    }
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (const auto &s : CreateTriangleMesh(
+             &identity, &identity, false, nTris, indices.data(), P.size(),
+             P.data(), nullptr, nullptr, nullptr, nullptr, nullptr))
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            s, nullptr, nullptr, MediumInterface()));
+
+    std::shared_ptr<Primitive> bvh = CreateBVHAccelerator(prims, ParamSet());
+    ParamSet ps;
+    std::unique_ptr<bool[]> compressed(new bool[1]);
+    compressed[0] = true;
+    ps.AddBool("compressed", std::move(compressed), 1);
+    std::shared_ptr<Primitive> wide = CreateWideBVHAccelerator(
+        4, std::make_shared<const PrimitiveStore>(prims), ps);
+    for (int i = 0; i < 1000; ++i) {
+        Point3f o = Point3f(0, 0, 0) +
+                    3 * UniformSampleSphere(
+                            Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        Vector3f d = Normalize(Point3f(.5f * rng.UniformFloat() - .25f,
+                                       .5f * rng.UniformFloat() - .25f,
+                                       .5f * rng.UniformFloat() - .25f) -
+                               o);
+        Ray r0(o, d), r1(o, d);
+        SurfaceInteraction isect0, isect1;
+        bool hit = bvh->Intersect(r0, &isect0);
+        ASSERT_EQ(hit, wide->Intersect(r1, &isect1)) << i;
+        if (hit) EXPECT_EQ(r0.tMax, r1.tMax) << i;
+        EXPECT_EQ(bvh->IntersectP(Ray(o, d)), wide->IntersectP(Ray(o, d)))
+            << i;
+    }
+}
+
+// Random rays find the same closest hits and occlusion with _a_ and _b_
+static void ExpectSameHits(const Primitive &a, const Primitive &b, RNG &rng) {
+    EXPECT_EQ(a.WorldBound(), b.WorldBound());
+    for (int i = 0; i < 10000; ++i) {
+        Point3f o(-5 + 20 * rng.UniformFloat(), -5 + 20 * rng.UniformFloat(),
+                  -5 + 20 * rng.UniformFloat());
+        Vector3f d = UniformSampleSphere(
+            Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        Ray r0(o, d), r1(o, d);
+        SurfaceInteraction isect0, isect1;
+        bool hit = a.Intersect(r0, &isect0);
+        ASSERT_EQ(hit, b.Intersect(r1, &isect1)) << i;
+        if (hit) {
+            EXPECT_EQ(r0.tMax, r1.tMax) << i;
+            EXPECT_EQ(isect0.p, isect1.p) << i;
+        }
+        EXPECT_EQ(a.IntersectP(Ray(o, d)), b.IntersectP(Ray(o, d))) << i;
+    }
+}
+
+// Building with the thread pool gives the same tree as building serially,
+// including for nodes large enough to be binned in parallel.
+TEST(BVH, ParallelBuildMatchesSerial) {
+    RNG rng;
+    std::vector<std::shared_ptr<Primitive>> prims =
+        RandomPrimitives(rng, 80000, 20000);
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 1;
+    std::shared_ptr<Primitive> serial = CreateBVHAccelerator(prims, ParamSet());
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+    std::shared_ptr<Primitive> parallel =
+        CreateBVHAccelerator(prims, ParamSet());
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+
+    ExpectSameHits(*serial, *parallel, rng);
+}
+
+// A BVH written to the cache directory is used for the same primitives
+// when they're next given, and a damaged cache file is rebuilt.
+TEST(BVH, Cache) {
+    RNG rng;
+    std::vector<std::shared_ptr<Primitive>> prims = RandomPrimitives(rng);
+    std::shared_ptr<Primitive> bvh = CreateBVHAccelerator(prims, ParamSet());
+
+    std::string cacheDir = PbrtOptions.bvhCacheDir;
+    PbrtOptions.bvhCacheDir = ".";
+    std::vector<std::string> before = ListFiles(".", ".bvh");
+    std::shared_ptr<Primitive> written =
+        CreateBVHAccelerator(prims, ParamSet());
+    std::vector<std::string> after = ListFiles(".", ".bvh");
+    ASSERT_EQ(before.size() + 1, after.size());
+    std::string filename;
+    for (const std::string &f : after)
+        if (std::find(before.begin(), before.end(), f) == before.end())
+            filename = f;
+    ASSERT_FALSE(filename.empty());
+
+    std::shared_ptr<Primitive> read = CreateBVHAccelerator(prims, ParamSet());
+    ExpectSameHits(*bvh, *written, rng);
+    ExpectSameHits(*bvh, *read, rng);
+
+    // Truncate the cache file
+    FILE *f = fopen(filename.c_str(), "wb");
+    ASSERT_TRUE(f != nullptr);
+    fputs("pbrtbvh", f);
+    fclose(f);
+    std::shared_ptr<Primitive> rebuilt =
+        CreateBVHAccelerator(prims, ParamSet());
+    ExpectSameHits(*bvh, *rebuilt, rng);
+
+    PbrtOptions.bvhCacheDir = cacheDir;
+    EXPECT_EQ(0, remove(filename.c_str()));
+}
+
+// Spatial splits duplicate references to long, thin triangles and to the
+// quads, within the duplication budget; the SBVH, and a 4-wide BVH
+// collapsed from one, still find the same hits as the SAH BVH.
+TEST(BVH, SBVHMatchesSAH) {
+    RNG rng;
+    std::vector<std::shared_ptr<Primitive>> prims = RandomPrimitives(rng);
+    static Transform identity;
+    std::vector<Point3f> P;
+    std::vector<int> indices;
+    const int nSlivers = 500;
+    for (int i = 0; i < nSlivers; ++i) {
+        Point3f p(10 * rng.UniformFloat(), 10 * rng.UniformFloat(),
+                  10 * rng.UniformFloat());
+        Vector3f d = 8.f * UniformSampleSphere(
+                               Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        for (Point3f v : {p, p + d, p + d + Vector3f(.05f, .05f, .05f)}) {
+            indices.push_back(P.size());
+            P.push_back(v);
+        }
+    }
+    for (const auto &s : CreateTriangleMesh(
+             &identity, &identity, false, nSlivers, indices.data(), P.size(),
+             P.data(), nullptr, nullptr, nullptr, nullptr, nullptr))
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            s, nullptr, nullptr, MediumInterface()));
+
+    std::shared_ptr<BVHAccel> sah = CreateBVHAccelerator(prims, ParamSet());
+    EXPECT_EQ(prims.size(), sah->PrimitiveReferences());
+    for (Float maxDuplication : {1.f, 1.5f, 4.f}) {
+        ParamSet ps;
+        std::unique_ptr<std::string[]> splitMethod(new std::string[1]);
+        splitMethod[0] = "sbvh";
+        ps.AddString("splitmethod", std::move(splitMethod), 1);
+        std::unique_ptr<Float[]> dup(new Float[1]);
+        dup[0] = maxDuplication;
+        ps.AddFloat("maxduplication", std::move(dup), 1);
+        std::shared_ptr<BVHAccel> sbvh = CreateBVHAccelerator(prims, ps);
+        if (maxDuplication == 1)
+            EXPECT_EQ(prims.size(), sbvh->PrimitiveReferences());
+        else {
+            EXPECT_GT(sbvh->PrimitiveReferences(), prims.size())
+                << maxDuplication;
+            EXPECT_LE(sbvh->PrimitiveReferences(),
+                      maxDuplication * prims.size())
+                << maxDuplication;
+        }
+        ExpectSameHits(*sah, *sbvh, rng);
+        ExpectSameHits(*sah,
+                       *CreateWideBVHAccelerator(
+                           4, std::make_shared<const PrimitiveStore>(prims),
+                           ps),
+                       rng);
+    }
+}
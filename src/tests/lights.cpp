@@ -0,0 +1,208 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "lowdiscrepancy.h"
+#include "interaction.h"
+#include "imageio.h"
+#include "scene.h"
+#include "lightdistrib.h"
+#include "accelerators/bvh.h"
+#include "lights/diffuse.h"
+#include "lights/distant.h"
+#include "lights/point.h"
+#include "lights/texlight.h"
+#include "shapes/quad.h"
+#include "shapes/sphere.h"
+#include "textures/imagemap.h"
+#include "ext/lodepng.h"
+
+using namespace pbrt;
+
+// Checks that a texture light on a quad importance samples its texels
+// consistently with Pdf_Li() and reports the texture's power.
+TEST(TextureAreaLight, QuadEmission) {
+    // Write a mostly dark image with a few bright texels
+    const int width = 8, height = 8;
+    std::vector<unsigned char> rgb(3 * width * height, 0);
+    for (int i : {3, 20, 21, 50})
+        rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = 255;
+    const char *filename = "texlight.png";
+    ASSERT_EQ(0, lodepng_encode24_file(filename, rgb.data(), width, height));
+
+    std::shared_ptr<Texture<Spectrum>> Lemit =
+        std::make_shared<ImageTexture<RGBSpectrum, Spectrum>>(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename,
+            false, 8.f, ImageWrap::Repeat, 1.f, false, false);
+    Transform tr = Translate(Vector3f(.25, -.5, 1)), trInv = Inverse(tr);
+    // The quad shows the image's lower-right quadrant
+    std::shared_ptr<Shape> quad = std::make_shared<QuadZ>(
+        &tr, &trInv, false, 1.5, 2, -1, .5, .5, 1, 1, nullptr);
+    TextureAreaLight light(tr, MediumInterface(), Spectrum(1.f), 1, quad,
+                           Lemit);
+    // Power matches the emission integrated over stratified area samples
+    const int n = 64;
+    Float sumL = 0;
+    for (int y = 0; y < n; ++y)
+        for (int x = 0; x < n; ++x) {
+            Float pdf;
+            Interaction it = quad->Sample(
+                Point2f((x + .5f) / n, (y + .5f) / n), &pdf);
+            sumL += light.L(it, Vector3f(it.n)).y();
+        }
+    Float power = sumL / (n * n) * Pi * quad->Area();
+    EXPECT_GT(power, 0);
+    EXPECT_LT(std::abs(light.Power().y() - power), .02f * power);
+
+    Interaction ref(Point3f(0, 0, 0), Normal3f(0, 0, 1), Vector3f(),
+                    Vector3f(0, 0, 1), 0, MediumInterface());
+    const int count = 4096;
+    for (int i = 0; i < count; ++i) {
+        Point2f u(RadicalInverse(0, i), RadicalInverse(1, i));
+        Vector3f wi;
+        Float pdf;
+        VisibilityTester vis;
+        Spectrum L = light.Sample_Li(ref, u, &wi, &pdf, &vis);
+        // Samples only land on lit texels
+        EXPECT_GT(pdf, 0);
+        EXPECT_FLOAT_EQ(1.f, L.y()) << u;
+        EXPECT_LT(std::abs(light.Pdf_Li(ref, wi) - pdf), 1e-3f * pdf) << u;
+    }
+    TextureAreaLight::ClearCache();
+    ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    ClearDecodedImageCache();
+    remove(filename);
+}
+
+// Checks that a quad showing a texture with more texels than emission
+// distribution cells can still sample a bright texel inside a cell.
+TEST(TextureAreaLight, LargeTextureEmission) {
+    // One bright texel at a cell's corner and one inside another cell
+    const int width = 1024, height = 1024;
+    std::vector<unsigned char> rgb(3 * width * height, 0);
+    const int x = 517, y = 302;
+    for (int i : {4 * width + 4, y * width + x})
+        rgb[3 * i] = rgb[3 * i + 1] = rgb[3 * i + 2] = 255;
+    const char *filename = "texlight-large.png";
+    ASSERT_EQ(0, lodepng_encode24_file(filename, rgb.data(), width, height));
+
+    std::shared_ptr<Texture<Spectrum>> Lemit =
+        std::make_shared<ImageTexture<RGBSpectrum, Spectrum>>(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename,
+            false, 8.f, ImageWrap::Repeat, 1.f, false, false);
+    Transform tr, trInv;
+    std::shared_ptr<Shape> quad = std::make_shared<QuadZ>(
+        &tr, &trInv, false, 1, 1, 1, 0, 0, 1, 1, nullptr);
+    TextureAreaLight light(tr, MediumInterface(), Spectrum(1.f), 1, quad,
+                           Lemit);
+
+    // The quad's s runs along the image's (flipped) y and t along its x
+    Float pdf;
+    Interaction it = quad->Sample(
+        Point2f(1 - (y + .5f) / height, (x + .5f) / width), &pdf);
+    ASSERT_FLOAT_EQ(1.f, light.L(it, Vector3f(it.n)).y());
+    Interaction ref(it.p + Vector3f(0, 0, 1), Normal3f(0, 0, -1), Vector3f(),
+                    Vector3f(0, 0, -1), 0, MediumInterface());
+    EXPECT_GT(light.Pdf_Li(ref, Vector3f(0, 0, -1)), 0);
+
+    // Samples land in the cells around the lit texels
+    int nLit = 0;
+    for (int i = 0; i < 256; ++i) {
+        Point2f u(RadicalInverse(0, i), RadicalInverse(1, i));
+        Vector3f wi;
+        VisibilityTester vis;
+        Spectrum L = light.Sample_Li(ref, u, &wi, &pdf, &vis);
+        EXPECT_GT(pdf, 0) << u;
+        if (L.y() > 0) ++nLit;
+    }
+    EXPECT_GT(nLit, 0);
+    TextureAreaLight::ClearCache();
+    ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    ClearDecodedImageCache();
+    remove(filename);
+}
+
+// Checks that the light BVH chooses lights with the probabilities that
+// Pdf() reports, favors nearby lights and skips lights facing away.
+TEST(BVHLightDistribution, SampleMatchesPdf) {
+    // A ceiling of downward-facing quad lights with varying emission, a
+    // spherical light, a point light and an (unbounded) distant light
+    const int n = 10;
+    std::unique_ptr<Transform[]> transforms(new Transform[2 * n * n + 2]);
+    std::vector<std::shared_ptr<Primitive>> prims;
+    std::vector<std::shared_ptr<Light>> lights;
+    for (int i = 0; i < n * n; ++i) {
+        Transform *o2w = &transforms[2 * i], *w2o = &transforms[2 * i + 1];
+        *o2w = Translate(Vector3f(i % n, 2, i / n));
+        *w2o = Inverse(*o2w);
+        std::shared_ptr<Shape> quad = std::make_shared<QuadY>(
+            o2w, w2o, false, .5, .5, -1, 0, 0, 1, 1, nullptr);
+        auto light = std::make_shared<DiffuseAreaLight>(
+            *o2w, MediumInterface(), Spectrum(1 + i % 7), 1, quad);
+        lights.push_back(light);
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            quad, nullptr, light, MediumInterface()));
+    }
+    Transform *o2w = &transforms[2 * n * n], *w2o = &transforms[2 * n * n + 1];
+    *o2w = Translate(Vector3f(4, 1, -3));
+    *w2o = Inverse(*o2w);
+    std::shared_ptr<Shape> sphere =
+        std::make_shared<Sphere>(o2w, w2o, false, .25, -.25, .25, 360);
+    auto sphereLight = std::make_shared<DiffuseAreaLight>(
+        *o2w, MediumInterface(), Spectrum(4), 1, sphere);
+    lights.push_back(sphereLight);
+    prims.push_back(std::make_shared<GeometricPrimitive>(
+        sphere, nullptr, sphereLight, MediumInterface()));
+    lights.push_back(std::make_shared<PointLight>(
+        Translate(Vector3f(-2, 1, 5)), MediumInterface(), Spectrum(10)));
+    lights.push_back(std::make_shared<DistantLight>(
+        Transform(), Spectrum(1), Vector3f(0, 1, 0)));
+    Scene scene(std::make_shared<BVHAccel>(prims), lights);
+    BVHLightDistribution distrib(scene);
+
+    const int nLights = lights.size();
+    for (const Interaction &ref :
+         {Interaction(Point3f(2.2, 0, 7.1), Normal3f(0, 1, 0), Vector3f(),
+                      Vector3f(0, 1, 0), 0, MediumInterface()),
+          Interaction(Point3f(-1, 1.5, 3), Normal3f(1, 0, 0), Vector3f(),
+                      Vector3f(1, 0, 0), 0, MediumInterface()),
+          Interaction(Point3f(5, 1, 5), Normal3f(), Vector3f(),
+                      Vector3f(1, 0, 0), 0, MediumInterface()),
+          Interaction(Point3f(4.5, 3, 4.5), Normal3f(0, -1, 0), Vector3f(),
+                      Vector3f(0, -1, 0), 0, MediumInterface())}) {
+        std::vector<Float> pdfs(nLights);
+        Float sumPdf = 0;
+        for (int i = 0; i < nLights; ++i) sumPdf += (pdfs[i] = distrib.Pdf(ref, i));
+        bool aboveCeiling = ref.p.y > 2;
+        if (aboveCeiling) {
+            // The quads all face away; the others are still candidates
+            for (int i = 0; i < n * n; ++i) EXPECT_EQ(0, pdfs[i]);
+            EXPECT_GT(pdfs[n * n], 0);
+            EXPECT_LT(sumPdf, 1.0001);
+        } else
+            EXPECT_NEAR(1, sumPdf, 1e-4) << ref.p;
+        // The distant light is chosen as often as the whole BVH
+        EXPECT_FLOAT_EQ(.5f, pdfs[nLights - 1]);
+
+        std::vector<int> histogram(nLights, 0);
+        const int count = 100000;
+        for (int j = 0; j < count; ++j) {
+            Float pdf;
+            int light = distrib.Sample(ref, RadicalInverse(0, j), &pdf);
+            if (light == -1) {
+                EXPECT_TRUE(aboveCeiling);
+                continue;
+            }
+            ASSERT_TRUE(light >= 0 && light < nLights);
+            EXPECT_NEAR(pdfs[light], pdf, 1e-4f * pdf) << light;
+            ++histogram[light];
+        }
+        for (int i = 0; i < nLights; ++i)
+            EXPECT_NEAR(pdfs[i], Float(histogram[i]) / count,
+                        .01f * pdfs[i] + 1e-4f) << i;
+    }
+
+    // Lights closer to a point are more likely to be chosen
+    Interaction below(Point3f(2, 1.5, 2), Normal3f(0, 1, 0), Vector3f(),
+                      Vector3f(0, 1, 0), 0, MediumInterface());
+    EXPECT_GT(distrib.Pdf(below, 2 * n + 2), distrib.Pdf(below, 9 * n + 2));
+}
@@ -3,6 +3,7 @@
 #include "pbrt.h"
 #include "parallel.h"
 #include <atomic>
+#include <vector>
 
 using namespace pbrt;
 
@@ -37,3 +38,23 @@ TEST(Parallel, DoNothing) {
 
     ParallelCleanup();
 }
+
+TEST(Parallel, RunAsync) {
+    ParallelInit();
+
+    // Tasks may run loops of their own while the main thread runs others
+    std::vector<std::shared_future<int64_t>> futures;
+    for (int i = 0; i < 32; ++i)
+        futures.push_back(RunAsync([i]() {
+            std::atomic<int64_t> sum{0};
+            ParallelFor([&](int64_t j) { sum += j; }, 100 * i, 7);
+            return sum.load();
+        }));
+    std::atomic<int> counter{0};
+    ParallelFor([&](int64_t) { ++counter; }, 1000, 3);
+    EXPECT_EQ(1000, counter);
+    for (int i = 0; i < 32; ++i)
+        EXPECT_EQ(int64_t(100 * i) * (100 * i - 1) / 2, futures[i].get());
+
+    ParallelCleanup();
+}
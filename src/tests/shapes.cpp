@@ -3,16 +3,25 @@
 #include <cmath>
 #include <functional>
 #include "pbrt.h"
+#include "api.h"
+#include "primitive.h"
 #include "rng.h"
 #include "shape.h"
 #include "lowdiscrepancy.h"
 #include "sampling.h"
+#include "accelerators/bvh.h"
+#include "materials/matte.h"
 #include "shapes/cone.h"
+#include "shapes/curve.h"
 #include "shapes/cylinder.h"
 #include "shapes/disk.h"
 #include "shapes/paraboloid.h"
+#include "shapes/quad.h"
+#include "shapes/quadmesh.h"
 #include "shapes/sphere.h"
 #include "shapes/triangle.h"
+#include "shapes/voxelchunk.h"
+#include "textures/constant.h"
 
 using namespace pbrt;
 
@@ -369,6 +378,70 @@ TEST(Disk, SolidAngle) {
     EXPECT_LT(std::abs(solidAngle - disk.SolidAngle(p, nSamples)), .001);
 }
 
+TEST(Quad, SolidAngle) {
+    Transform tr = Translate(Vector3f(1, .5, -.8)) * RotateX(30);
+    Transform trInv = Inverse(tr);
+    QuadY quad(&tr, &trInv, false, 1.5, .75, 1, 0, 0, 1, 1, nullptr);
+
+    Point3f p(.5, -.8, .5);
+    const int nSamples = 128 * 1024;
+    Float solidAngle = mcSolidAngle(p, quad, nSamples);
+    EXPECT_LT(std::abs(solidAngle - quad.SolidAngle(p)), .001);
+    EXPECT_LT(std::abs(solidAngle - quad.Shape::SolidAngle(p, nSamples)),
+              .001);
+}
+
+// Checks spherical rectangle sampling against area sampling of the quad
+// and that it agrees with Pdf() for the sampled directions.
+TEST(Quad, Sampling) {
+    RNG rng(7);
+    for (int i = 0; i < 20; ++i) {
+        Transform tr = Translate(Vector3f(pUnif(rng, 2), pUnif(rng, 2),
+                                          pUnif(rng, 2))) *
+                       RotateX(360 * rng.UniformFloat());
+        Transform trInv = Inverse(tr);
+        QuadZ quad(&tr, &trInv, false, Lerp(rng.UniformFloat(), .1f, 3),
+                   Lerp(rng.UniformFloat(), .1f, 3), 1, 0, 0, 1, 1, nullptr);
+        Point3f pc(pUnif(rng, 4), pUnif(rng, 4), pUnif(rng, 4));
+        Interaction ref(pc, Normal3f(), Vector3f(), Vector3f(0, 0, 1), 0,
+                        MediumInterface{});
+
+        // Integrate a smooth function of direction over the quad's solid
+        // angle with both sampling methods
+        auto f = [](const Vector3f &w) { return (1 + w.x) * (1 + w.x); };
+        const int count = 64 * 1024;
+        double estimate = 0, areaEstimate = 0, solidAngleEstimate = 0;
+        int nMisses = 0;
+        for (int j = 0; j < count; ++j) {
+            Point2f u{RadicalInverse(0, j), RadicalInverse(1, j)};
+            Float pdf;
+            Interaction it = quad.Shape::Sample(ref, u, &pdf);
+            if (pdf > 0) areaEstimate += f(Normalize(it.p - pc)) / (count * pdf);
+
+            it = quad.Sample(ref, u, &pdf);
+            if (pdf == 0) continue;
+            Vector3f wi = Normalize(it.p - pc);
+            estimate += f(wi) / (count * pdf);
+            solidAngleEstimate += 1. / (count * pdf);
+            // Directions toward the quad's edges may narrowly miss it
+            Float pdfWi = quad.Pdf(ref, wi);
+            if (pdfWi == 0) {
+                ++nMisses;
+                continue;
+            }
+            EXPECT_LT(std::abs(pdfWi - pdf), 1e-3f * pdf)
+                << "pc = " << pc << ", quad " << i;
+        }
+        EXPECT_LT(nMisses, count / 1000);
+        EXPECT_LT(std::abs(estimate - areaEstimate), 2e-3f * areaEstimate)
+            << "pc = " << pc << ", quad " << i;
+        Float solidAngle = quad.SolidAngle(pc);
+        EXPECT_LT(std::abs(solidAngleEstimate - solidAngle),
+                  1e-3f * solidAngle + 1e-5f)
+            << "pc = " << pc << ", quad " << i;
+    }
+}
+
 // Check for incorrect self-intersection: assumes that the shape is convex,
 // such that if the dot product of an outgoing ray and the surface normal
 // at a point is positive, then a ray leaving that point in that direction
@@ -557,3 +630,462 @@ TEST(Triangle, BadCases) {
     SurfaceInteraction isect;
     EXPECT_FALSE(mesh[0]->Intersect(ray, &thit, &isect));
 }
+
+// Builds a random voxel chunk along with the per-face quads the exporter
+// would have emitted for it and checks that both give the same hits.
+TEST(VoxelChunk, MatchesQuads) {
+    RNG rng(4);
+    Point3i res(5, 4, 6);
+    std::vector<uint16_t> blocks(res.x * res.y * res.z);
+    for (uint16_t &b : blocks) b = rng.UniformFloat() < .4f ? 1 : 0;
+    std::vector<Float> faceUV;
+    for (int face = 0; face < 6; ++face) {
+        Float u0 = .25f * face, v0 = .5f;
+        faceUV.insert(faceUV.end(), {u0, v0, u0 + .25f, v0 + .5f});
+    }
+    Transform identity;
+    VoxelChunk chunk(&identity, &identity, false, res, blocks, faceUV,
+                     nullptr);
+
+    auto solid = [&](int x, int y, int z) {
+        if (x < 0 || y < 0 || z < 0 || x >= res.x || y >= res.y || z >= res.z)
+            return false;
+        return blocks[(z * res.y + y) * res.x + x] != 0;
+    };
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * blocks.size() * 6);
+    std::vector<std::shared_ptr<Shape>> quads;
+    for (int z = 0; z < res.z; ++z)
+        for (int y = 0; y < res.y; ++y)
+            for (int x = 0; x < res.x; ++x) {
+                if (!solid(x, y, z)) continue;
+                for (int face = 0; face < 6; ++face) {
+                    int axis = face / 2, step = (face & 1) ? 1 : -1;
+                    Point3i n(x, y, z);
+                    n[axis] += step;
+                    if (solid(n.x, n.y, n.z)) continue;
+                    Vector3f center(x + .5f, y + .5f, z + .5f);
+                    center[axis] += .5f * step;
+                    transforms.push_back(Translate(center));
+                    transforms.push_back(Inverse(transforms.back()));
+                    const Transform *o2w = &transforms[transforms.size() - 2];
+                    const Transform *w2o = &transforms.back();
+                    const Float *uv = &faceUV[4 * face];
+                    if (axis == 0)
+                        quads.push_back(std::make_shared<QuadX>(
+                            o2w, w2o, false, 1, 1, step, uv[0], uv[1], uv[2],
+                            uv[3], nullptr));
+                    else if (axis == 1)
+                        quads.push_back(std::make_shared<QuadY>(
+                            o2w, w2o, false, 1, 1, step, uv[0], uv[1], uv[2],
+                            uv[3], nullptr));
+                    else
+                        quads.push_back(std::make_shared<QuadZ>(
+                            o2w, w2o, false, 1, 1, step, uv[0], uv[1], uv[2],
+                            uv[3], nullptr));
+                }
+            }
+    EXPECT_EQ(quads.size(), chunk.Area());
+
+    int nHits = 0;
+    for (int i = 0; i < 20000; ++i) {
+        Point3f o(Lerp(rng.UniformFloat(), -3, 8), Lerp(rng.UniformFloat(), -3, 7),
+                  Lerp(rng.UniformFloat(), -3, 9));
+        Point3f target(Lerp(rng.UniformFloat(), 0, res.x),
+                       Lerp(rng.UniformFloat(), 0, res.y),
+                       Lerp(rng.UniformFloat(), 0, res.z));
+        Ray ray(o, target - o);
+
+        Float tChunk;
+        SurfaceInteraction isectChunk;
+        bool hitChunk = chunk.Intersect(ray, &tChunk, &isectChunk, true);
+        EXPECT_EQ(hitChunk, chunk.IntersectP(ray, true));
+
+        Ray rq = ray;
+        Float tQuad = Infinity;
+        SurfaceInteraction isectQuad;
+        for (const auto &q : quads) {
+            Float t;
+            SurfaceInteraction si;
+            if (q->Intersect(rq, &t, &si, true)) {
+                rq.tMax = tQuad = t;
+                isectQuad = si;
+            }
+        }
+        bool hitQuad = tQuad < Infinity;
+
+        // Skip rays that graze a cell edge, where either answer is fine.
+        if (hitChunk != hitQuad) {
+            Point3f p = hitChunk ? isectChunk.p : isectQuad.p;
+            int nOnEdge = 0;
+            for (int c = 0; c < 3; ++c)
+                if (std::abs(p[c] - std::round(p[c])) < 1e-3f) ++nOnEdge;
+            EXPECT_GE(nOnEdge, 2) << ray;
+            continue;
+        }
+        if (!hitChunk) continue;
+        ++nHits;
+        EXPECT_LT(std::abs(tChunk - tQuad), 1e-4f * tQuad + 1e-5f) << ray;
+        EXPECT_LT(Distance(isectChunk.p, isectQuad.p), 1e-3f) << ray;
+        EXPECT_LT(std::abs(isectChunk.uv[0] - isectQuad.uv[0]), 1e-3f) << ray;
+        EXPECT_LT(std::abs(isectChunk.uv[1] - isectQuad.uv[1]), 1e-3f) << ray;
+        EXPECT_LT(std::abs(AbsDot(isectChunk.n, isectQuad.n) - 1), 1e-4f);
+        // Faces point out of solid cells, so they face rays from outside.
+        if (!solid(std::floor(o.x), std::floor(o.y), std::floor(o.z)))
+            EXPECT_GT(Dot(isectChunk.n, -ray.d), 0) << ray;
+    }
+    EXPECT_GT(nHits, 1000);
+}
+
+TEST(QuadMesh, MatchesQuads) {
+    RNG rng(17);
+    const int nQuads = 64;
+    std::vector<Point3f> P;
+    std::vector<int> axis;
+    std::vector<Float> dir, l1, l2, uv;
+    for (int i = 0; i < nQuads; ++i) {
+        P.push_back(Point3f(pUnif(rng, 2), pUnif(rng, 2), pUnif(rng, 2)));
+        axis.push_back(std::min(2, int(3 * rng.UniformFloat())));
+        dir.push_back(rng.UniformFloat() < .5f ? -1 : 1);
+        l1.push_back(Lerp(rng.UniformFloat(), .1f, 2));
+        l2.push_back(Lerp(rng.UniformFloat(), .1f, 2));
+        Float u0 = rng.UniformFloat(), v0 = rng.UniformFloat();
+        uv.insert(uv.end(), {u0, v0, u0 + .5f, v0 + .25f});
+    }
+    Transform identity;
+    std::vector<std::shared_ptr<Shape>> meshQuads =
+        CreateQuadMesh(&identity, &identity, false, nQuads, P.data(),
+                       axis.data(), dir.data(), l1.data(), l2.data(),
+                       uv.data(), nullptr);
+    ASSERT_EQ(nQuads, meshQuads.size());
+
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nQuads);
+    for (int i = 0; i < nQuads; ++i) {
+        transforms.push_back(Translate(Vector3f(P[i])));
+        transforms.push_back(Inverse(transforms.back()));
+        const Transform *o2w = &transforms[2 * i], *w2o = &transforms[2 * i + 1];
+        const Float *r = &uv[4 * i];
+        std::shared_ptr<Shape> quad;
+        if (axis[i] == 0)
+            quad = std::make_shared<QuadX>(o2w, w2o, false, l1[i], l2[i],
+                                           dir[i], r[0], r[1], r[2], r[3],
+                                           nullptr);
+        else if (axis[i] == 1)
+            quad = std::make_shared<QuadY>(o2w, w2o, false, l1[i], l2[i],
+                                           dir[i], r[0], r[1], r[2], r[3],
+                                           nullptr);
+        else
+            quad = std::make_shared<QuadZ>(o2w, w2o, false, l1[i], l2[i],
+                                           dir[i], r[0], r[1], r[2], r[3],
+                                           nullptr);
+        EXPECT_FLOAT_EQ(quad->Area(), meshQuads[i]->Area());
+
+        for (int j = 0; j < 200; ++j) {
+            // Aim at the quad, or around it for half of the rays so that
+            // some of them miss
+            Point3f o(pUnif(rng, 5), pUnif(rng, 5), pUnif(rng, 5));
+            Bounds3f target = meshQuads[i]->ObjectBound();
+            if (j & 1) target = Expand(target, .5f);
+            Point3f pTarget = target.Lerp(Point3f(
+                rng.UniformFloat(), rng.UniformFloat(), rng.UniformFloat()));
+            Ray ray(o, pTarget - o);
+            Float tQuad, tMesh;
+            SurfaceInteraction isectQuad, isectMesh;
+            bool hitQuad = quad->Intersect(ray, &tQuad, &isectQuad);
+            bool hitMesh = meshQuads[i]->Intersect(ray, &tMesh, &isectMesh);
+            EXPECT_EQ(hitQuad, hitMesh) << ray;
+            EXPECT_EQ(hitMesh, meshQuads[i]->IntersectP(ray));
+            if (!hitQuad || !hitMesh) continue;
+            EXPECT_LT(std::abs(tQuad - tMesh), 1e-4f * tQuad);
+            EXPECT_LT(Distance(isectQuad.p, isectMesh.p), 1e-4f);
+            EXPECT_LT(std::abs(isectQuad.uv[0] - isectMesh.uv[0]), 1e-4f);
+            EXPECT_LT(std::abs(isectQuad.uv[1] - isectMesh.uv[1]), 1e-4f);
+            EXPECT_GT(AbsDot(isectQuad.n, isectMesh.n), .9999f);
+        }
+    }
+}
+
+// The deferred interaction must be identical to the one Intersect() builds.
+TEST(Shape, DeferredInteraction) {
+    RNG rng(23);
+    Transform o2w = Translate(Vector3f(.5, -.25, 1)) * RotateY(30);
+    Transform w2o = Inverse(o2w);
+    std::vector<std::shared_ptr<Shape>> shapes;
+    shapes.push_back(std::make_shared<Sphere>(&o2w, &w2o, false, 1.5, -1, 1,
+                                              300));
+    shapes.push_back(std::make_shared<QuadZ>(&o2w, &w2o, false, 2, 3, -1, 0,
+                                             0, 1, 1, nullptr));
+    Point3f P[3] = {Point3f(-1, -1, 0), Point3f(2, 0, .5), Point3f(0, 2, -1)};
+    int indices[3] = {0, 1, 2};
+    for (const auto &tri :
+         CreateTriangleMesh(&o2w, &w2o, false, 1, indices, 3, P, nullptr,
+                            nullptr, nullptr, nullptr, nullptr))
+        shapes.push_back(tri);
+    Point3f pq(.25, .5, -.5);
+    int axis = 1;
+    Float dir = 1, l1 = 2, l2 = 1.5, uv[4] = {0, 0, 1, 1};
+    for (const auto &q : CreateQuadMesh(&o2w, &w2o, false, 1, &pq, &axis,
+                                        &dir, &l1, &l2, uv, nullptr))
+        shapes.push_back(q);
+    Point3f cp[4] = {Point3f(-2, -1, 0), Point3f(-1, 2, 1), Point3f(1, -2, 0),
+                     Point3f(2, 1, -1)};
+    for (CurveType type : {CurveType::Flat, CurveType::Cylinder}) {
+        auto common = std::make_shared<CurveCommon>(cp, 1.5, .75, type,
+                                                    nullptr);
+        shapes.push_back(
+            std::make_shared<Curve>(&o2w, &w2o, false, common, 0, 1));
+    }
+    std::vector<uint16_t> blocks = {1, 0, 2, 1, 0, 1, 1, 0};
+    shapes.push_back(std::make_shared<VoxelChunk>(
+        &o2w, &w2o, false, Point3i(2, 2, 2), blocks, std::vector<Float>(),
+        nullptr));
+
+    for (const auto &shape : shapes) {
+        int nHits = 0;
+        for (int i = 0; i < 1000; ++i) {
+            Point3f o(pUnif(rng, 5), pUnif(rng, 5), pUnif(rng, 5));
+            Point3f target = shape->WorldBound().Lerp(Point3f(
+                rng.UniformFloat(), rng.UniformFloat(), rng.UniformFloat()));
+            Ray ray(o, target - o);
+            Float tHit;
+            SurfaceInteraction isect;
+            bool hit = shape->Intersect(ray, &tHit, &isect);
+            ShapeHit shapeHit;
+            ASSERT_EQ(hit, shape->IntersectHit(ray, &shapeHit));
+            EXPECT_EQ(hit, shape->IntersectP(ray));
+            if (!hit) continue;
+            ++nHits;
+            EXPECT_EQ(tHit, shapeHit.t);
+            SurfaceInteraction deferred;
+            shape->ComputeInteraction(ray, shapeHit, &deferred);
+            EXPECT_EQ(isect.p, deferred.p);
+            EXPECT_EQ(isect.n, deferred.n);
+            EXPECT_EQ(isect.uv, deferred.uv);
+            EXPECT_EQ(isect.dpdu, deferred.dpdu);
+            EXPECT_EQ(isect.shading.n, deferred.shading.n);
+        }
+        EXPECT_GT(nHits, 50);
+    }
+}
+
+// A grid of nx by ny unit QuadZs at height z, each covering (u,v) in [0,1]^2
+static std::vector<std::shared_ptr<Primitive>> QuadGrid(
+    int nx, int ny, Float z, std::vector<Transform> *transforms,
+    const std::shared_ptr<Material> &material,
+    const std::shared_ptr<Texture<Float>> &alphaMask) {
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (int y = 0; y < ny; ++y)
+        for (int x = 0; x < nx; ++x) {
+            transforms->push_back(Translate(Vector3f(x + .5f, y + .5f, z)));
+            transforms->push_back(Inverse(transforms->back()));
+            auto quad = std::make_shared<QuadZ>(
+                &transforms->end()[-2], &transforms->back(), false, 1, 1, 1,
+                0, 0, 1, 1, alphaMask);
+            prims.push_back(std::make_shared<GeometricPrimitive>(
+                quad, material, nullptr, MediumInterface()));
+        }
+    return prims;
+}
+
+class UTexture : public Texture<Float> {
+  public:
+    Float Evaluate(const SurfaceInteraction &si) const { return si.uv[0]; }
+};
+
+TEST(QuadFaces, CullHidden) {
+    std::vector<Transform> transforms;
+    transforms.reserve(100);
+    auto matte = std::make_shared<MatteMaterial>(
+        std::make_shared<ConstantTexture<Spectrum>>(.5f),
+        std::make_shared<ConstantTexture<Float>>(0.f), nullptr);
+    auto alpha = std::make_shared<ConstantTexture<Float>>(1.f);
+    // Back-to-back pairs of opaque quads without alpha are culled, unlike
+    // pairs with alpha or without material and unpaired quads
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (int z = 0; z < 4; ++z) {
+        std::shared_ptr<Material> material = z == 2 ? nullptr : matte;
+        std::shared_ptr<Texture<Float>> alphaMask = z == 1 ? alpha : nullptr;
+        auto grid = QuadGrid(1, 1, z, &transforms, material, alphaMask);
+        prims.push_back(grid[0]);
+        if (z == 3) break;
+        auto back = std::make_shared<QuadZ>(&transforms.end()[-2],
+                                            &transforms.back(), true, 1, 1, 1,
+                                            0, 0, 1, 1, alphaMask);
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            back, material, nullptr, MediumInterface()));
+    }
+
+    CullHiddenQuads(&prims);
+    EXPECT_EQ(5, prims.size());
+    for (const auto &prim : prims) EXPECT_NE(0, prim->WorldBound().pMin.z);
+}
+
+TEST(QuadFaces, MergeCoplanar) {
+    std::vector<Transform> transforms;
+    transforms.reserve(100);
+    auto periodic = std::make_shared<MatteMaterial>(
+        std::make_shared<ConstantTexture<Spectrum>>(.5f),
+        std::make_shared<ConstantTexture<Float>>(0.f), nullptr);
+    periodic->texturesPeriodic = true;
+    auto nonPeriodic = std::make_shared<MatteMaterial>(
+        std::make_shared<ConstantTexture<Spectrum>>(.5f),
+        std::make_shared<ConstantTexture<Float>>(0.f), nullptr);
+    // Only grids whose material and alpha textures are periodic merge
+    auto merging = QuadGrid(3, 2, 0, &transforms, periodic, nullptr);
+    std::vector<std::shared_ptr<Primitive>> prims = merging;
+    for (const auto &grid :
+         {QuadGrid(3, 2, 1, &transforms, nonPeriodic, nullptr),
+          QuadGrid(3, 2, 2, &transforms, periodic,
+                   std::make_shared<UTexture>()),
+          QuadGrid(3, 2, 3, &transforms, periodic,
+                   std::make_shared<ConstantTexture<Float>>(1.f))})
+        prims.insert(prims.end(), grid.begin(), grid.end());
+
+    MergeCoplanarQuads(&prims);
+    EXPECT_EQ(1 + 6 + 6 + 1, prims.size());
+    int nMerged = 0;
+    for (const auto &prim : prims) {
+        Bounds3f b = prim->WorldBound();
+        if (b.pMax.x - b.pMin.x < 2) continue;
+        ++nMerged;
+        EXPECT_EQ(3, b.pMax.x - b.pMin.x);
+        EXPECT_EQ(2, b.pMax.y - b.pMin.y);
+        if (b.pMin.z != 0) continue;
+
+        // The merged quad's texture coordinates repeat the original ones
+        RNG rng;
+        for (int i = 0; i < 100; ++i) {
+            Point3f o(3 * rng.UniformFloat(), 2 * rng.UniformFloat(), 1);
+            Ray ray(o, Vector3f(0, 0, -1)), rayMerged = ray;
+            SurfaceInteraction isect, isectMerged;
+            bool hit = false;
+            for (const auto &quad : merging)
+                hit |= quad->Intersect(ray, &isect);
+            ASSERT_TRUE(hit);
+            ASSERT_TRUE(prim->Intersect(rayMerged, &isectMerged));
+            for (int c = 0; c < 2; ++c)
+                EXPECT_NEAR(isect.uv[c], isectMerged.uv[c] -
+                                             std::floor(isectMerged.uv[c]),
+                            1e-4f) << o;
+        }
+    }
+    EXPECT_EQ(2, nMerged);
+}
+
+// Hits inside object instances are computed from the hit that the
+// instance's aggregate found, without intersecting again.
+TEST(Primitive, DeferredInstanceIntersection) {
+    RNG rng(5);
+    std::vector<Transform> shapeToInstance, instanceToShape;
+    shapeToInstance.reserve(8);
+    instanceToShape.reserve(8);
+    std::vector<std::shared_ptr<Primitive>> prims;
+    for (int i = 0; i < 8; ++i) {
+        shapeToInstance.push_back(Translate(
+            Vector3f(pUnif(rng, 2), pUnif(rng, 2), pUnif(rng, 2))));
+        instanceToShape.push_back(Inverse(shapeToInstance.back()));
+        const Transform *o2w = &shapeToInstance.back();
+        const Transform *w2o = &instanceToShape.back();
+        auto quad = std::make_shared<QuadY>(o2w, w2o, false, 1, 1, 1, 0, 0,
+                                            1, 1, nullptr);
+        auto sphere = std::make_shared<Sphere>(o2w, w2o, false, .3f, -.3f,
+                                               .3f, 360);
+        for (std::shared_ptr<Shape> shape : {std::shared_ptr<Shape>(quad),
+                                             std::shared_ptr<Shape>(sphere)})
+            prims.push_back(std::make_shared<GeometricPrimitive>(
+                shape, nullptr, nullptr, MediumInterface()));
+    }
+    std::shared_ptr<Primitive> instance = std::make_shared<BVHAccel>(prims);
+    Transform i2w = Translate(Vector3f(1, 0, -1)) * RotateX(40) *
+                    Scale(1, 2, 1);
+    AnimatedTransform instanceToWorld(&i2w, 0, &i2w, 1);
+    std::vector<std::shared_ptr<Primitive>> instances = {
+        std::make_shared<TransformedPrimitive>(instance, instanceToWorld)};
+    BVHAccel world(instances);
+
+    int nHits = 0;
+    for (int i = 0; i < 1000; ++i) {
+        Point3f o(pUnif(rng, 6), pUnif(rng, 6), pUnif(rng, 6));
+        Point3f target = world.WorldBound().Lerp(Point3f(
+            rng.UniformFloat(), rng.UniformFloat(), rng.UniformFloat()));
+        Ray ray(o, target - o), rayDeferred = ray;
+        SurfaceInteraction isect;
+        bool hit = instances[0]->Intersect(ray, &isect);
+        PrimitiveHit primHit;
+        ASSERT_EQ(hit, world.IntersectHit(rayDeferred, &primHit));
+        if (!hit) continue;
+        ++nHits;
+        EXPECT_EQ(ray.tMax, rayDeferred.tMax);
+        EXPECT_EQ(instances[0].get(), primHit.primitive);
+        SurfaceInteraction deferred;
+        primHit.primitive->ComputeIntersection(rayDeferred, primHit,
+                                               &deferred);
+        EXPECT_EQ(isect.primitive, deferred.primitive);
+        EXPECT_EQ(isect.p, deferred.p);
+        EXPECT_EQ(isect.n, deferred.n);
+        EXPECT_EQ(isect.uv, deferred.uv);
+        EXPECT_EQ(isect.shading.n, deferred.shading.n);
+    }
+    EXPECT_GT(nHits, 100);
+}
+
+// Shapes given per-vertex or per-face tints report them at hit points;
+// others leave the tint white.
+TEST(Shape, Tint) {
+    Transform o2w = Translate(Vector3f(1, 2, 3)), w2o = Inverse(o2w);
+    auto tintAt = [](const Shape &shape, const Point3f &o, const Vector3f &d) {
+        Float tHit;
+        SurfaceInteraction isect;
+        EXPECT_TRUE(shape.Intersect(Ray(o, d), &tHit, &isect)) << o;
+        return isect.tint;
+    };
+    auto rgb = [](Float r, Float g, Float b) {
+        Float v[3] = {r, g, b};
+        return RGBSpectrum::FromRGB(v);
+    };
+
+    // Triangles interpolate their vertices' tints
+    Point3f P[3] = {Point3f(0, 0, 0), Point3f(3, 0, 0), Point3f(0, 3, 0)};
+    int indices[3] = {0, 1, 2};
+    RGBSpectrum vertexTint[3] = {rgb(.3, .6, .9), rgb(.9, .6, .3),
+                                 rgb(0, 0, .6)};
+    auto tris = CreateTriangleMesh(&o2w, &w2o, false, 1, indices, 3, P,
+                                   nullptr, nullptr, nullptr, nullptr,
+                                   nullptr, nullptr, vertexTint);
+    RGBSpectrum t = tintAt(*tris[0], Point3f(2, 3, 5), Vector3f(0, 0, -1));
+    Float expected[3] = {.4, .4, .6}, actual[3];
+    t.ToRGB(actual);
+    for (int c = 0; c < 3; ++c) EXPECT_NEAR(expected[c], actual[c], 1e-5f);
+    tris = CreateTriangleMesh(&o2w, &w2o, false, 1, indices, 3, P, nullptr,
+                              nullptr, nullptr, nullptr, nullptr);
+    EXPECT_EQ(RGBSpectrum(1.f),
+              tintAt(*tris[0], Point3f(2, 3, 5), Vector3f(0, 0, -1)));
+
+    // Quads and quad mesh quads have one tint each
+    QuadZ quad(&o2w, &w2o, false, 1, 1, 1, 0, 0, 1, 1, nullptr,
+               rgb(.2, .5, .1));
+    EXPECT_EQ(rgb(.2, .5, .1),
+              tintAt(quad, Point3f(1, 2, 5), Vector3f(0, 0, -1)));
+    Point3f pq[2] = {Point3f(0, 0, 0), Point3f(2, 0, 0)};
+    int axis[2] = {2, 2};
+    RGBSpectrum quadTint[2] = {rgb(1, 0, 0), rgb(0, 1, 0)};
+    auto quads = CreateQuadMesh(&o2w, &w2o, false, 2, pq, axis, nullptr,
+                                nullptr, nullptr, nullptr, nullptr, quadTint);
+    for (int i = 0; i < 2; ++i)
+        EXPECT_EQ(quadTint[i],
+                  tintAt(*quads[i], o2w(pq[i]) + Vector3f(0, 0, 1),
+                         Vector3f(0, 0, -1)));
+
+    // Voxel chunk faces take the tint of their block id's face
+    std::vector<uint16_t> blocks = {1, 2};
+    std::vector<RGBSpectrum> faceTint;
+    for (int i = 0; i < 12; ++i) faceTint.push_back(RGBSpectrum(i / 12.f));
+    VoxelChunk chunk(&o2w, &w2o, false, Point3i(2, 1, 1), blocks, {}, nullptr,
+                     faceTint);
+    // -x face of block 1, +z face of block 2
+    EXPECT_EQ(faceTint[0],
+              tintAt(chunk, Point3f(0, 2.5, 3.5), Vector3f(1, 0, 0)));
+    EXPECT_EQ(faceTint[6 + 5],
+              tintAt(chunk, Point3f(2.5, 2.5, 5), Vector3f(0, 0, -1)));
+}
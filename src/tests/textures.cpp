@@ -0,0 +1,697 @@
+
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "api.h"
+#include "rng.h"
+#include "interaction.h"
+#include "imageio.h"
+#include "integrator.h"
+#include "material.h"
+#include "memory.h"
+#include "mipmap.h"
+#include "parallel.h"
+#include "primitive.h"
+#include "scene.h"
+#include "materials/mirror.h"
+#include "samplers/random.h"
+#include "shapes/quad.h"
+#include "texcache.h"
+#include "textures/atlas.h"
+#include "textures/constant.h"
+#include "textures/imagemap.h"
+#include "textures/mix.h"
+#include "textures/scale.h"
+#include "ext/lodepng.h"
+
+using namespace pbrt;
+
+TEST(ImageTexture, AlphaCoverageMatchesEvaluate) {
+    // Write a PNG with a random cutout alpha channel
+    const int width = 16, height = 8;
+    RNG rng;
+    std::vector<unsigned char> rgba(4 * width * height);
+    for (int i = 0; i < width * height; ++i) {
+        rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = 128;
+        uint32_t r = rng.UniformUInt32(3);
+        rgba[4 * i + 3] = (r == 0) ? 0 : ((r == 1) ? 255 : 1 + r * 40);
+    }
+    const char *filename = "alphacoverage.png";
+    ASSERT_EQ(0, lodepng_encode32_file(filename, rgba.data(), width, height));
+
+    for (ImageWrap wrap :
+         {ImageWrap::Repeat, ImageWrap::Clamp, ImageWrap::Black}) {
+        ImageTexture<Float, Float> tex(
+            std::unique_ptr<TextureMapping2D>(
+                new UVMapping2D(2, -3, .25, .5)),
+            filename, false, 8.f, wrap, 1.f, false, true, false, true);
+        const AlphaCoverage *coverage = GetAlphaCoverage(&tex);
+        ASSERT_TRUE(coverage != nullptr);
+
+        for (int i = 0; i < 10000; ++i) {
+            SurfaceInteraction si;
+            si.uv = Point2f(-2 + 4 * rng.UniformFloat(),
+                            -2 + 4 * rng.UniformFloat());
+            EXPECT_EQ(tex.Evaluate(si) != 0, coverage->Covered(si.uv))
+                << si.uv;
+        }
+    }
+    ImageTexture<Float, Float>::ClearCache();
+
+    // Textures that aren't loaded from an alpha channel have no mask
+    ImageTexture<Float, Float> lum(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename, false,
+        8.f, ImageWrap::Repeat, 1.f, false, false);
+    EXPECT_TRUE(GetAlphaCoverage(&lum) == nullptr);
+    ImageTexture<Float, Float>::ClearCache();
+    ClearDecodedImageCache();
+    remove(filename);
+}
+
+TEST(AtlasTexture, MatchesImageTexture) {
+    // Write two random RGBA images of different sizes
+    RNG rng;
+    const char *filenames[2] = {"atlas_a.png", "atlas_b.png"};
+    const int sizes[2] = {16, 8};
+    for (int f = 0; f < 2; ++f) {
+        std::vector<unsigned char> rgba(4 * sizes[f] * sizes[f]);
+        for (unsigned char &c : rgba) c = rng.UniformUInt32(256);
+        ASSERT_EQ(0, lodepng_encode32_file(filenames[f], rgba.data(),
+                                           sizes[f], sizes[f]));
+    }
+    std::vector<std::string> files(filenames, filenames + 2);
+
+    // Without differentials, both textures return the nearest texel
+    for (ImageWrap wrap :
+         {ImageWrap::Repeat, ImageWrap::Clamp, ImageWrap::Black}) {
+        for (int f = 0; f < 2; ++f) {
+            std::string name = f == 0 ? "atlas_a" : "atlas_b";
+            AtlasTexture<RGBSpectrum, Spectrum> atlas(
+                std::unique_ptr<TextureMapping2D>(new UVMapping2D(2, -3)),
+                AtlasInfo("", files, 1.f, true, false), name, wrap);
+            ImageTexture<RGBSpectrum, Spectrum> image(
+                std::unique_ptr<TextureMapping2D>(new UVMapping2D(2, -3)),
+                filenames[f], false, 8.f, wrap, 1.f, true, false);
+            EXPECT_EQ(Point2i(sizes[f], sizes[f]), atlas.Resolution());
+            for (int i = 0; i < 1000; ++i) {
+                SurfaceInteraction si;
+                si.uv = Point2f(-2 + 4 * rng.UniformFloat(),
+                                -2 + 4 * rng.UniformFloat());
+                EXPECT_EQ(image.Evaluate(si), atlas.Evaluate(si)) << si.uv;
+            }
+
+            // Alpha masks from either the red or the alpha channel
+            for (bool alphaChannel : {false, true}) {
+                AtlasTexture<Float, Float> atlasAlpha(
+                    std::unique_ptr<TextureMapping2D>(new UVMapping2D),
+                    AtlasInfo("", files, 1.f, false, true, alphaChannel),
+                    name, wrap);
+                ImageTexture<Float, Float> imageAlpha(
+                    std::unique_ptr<TextureMapping2D>(new UVMapping2D),
+                    filenames[f], false, 8.f, wrap, 1.f, false, true, false,
+                    alphaChannel);
+                const AlphaCoverage *coverage = GetAlphaCoverage(&atlasAlpha);
+                ASSERT_TRUE(coverage != nullptr);
+                for (int i = 0; i < 1000; ++i) {
+                    SurfaceInteraction si;
+                    si.uv = Point2f(-2 + 4 * rng.UniformFloat(),
+                                    -2 + 4 * rng.UniformFloat());
+                    Float alpha = imageAlpha.Evaluate(si);
+                    EXPECT_FLOAT_EQ(alpha, atlasAlpha.Evaluate(si)) << si.uv;
+                    EXPECT_EQ(alpha != 0, coverage->Covered(si.uv)) << si.uv;
+                }
+            }
+        }
+    }
+
+    // A footprint covering the whole image returns its average
+    AtlasTexture<Float, Float> atlas(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D),
+        AtlasInfo("", files, 1.f, false, false), "atlas_b",
+        ImageWrap::Repeat);
+    SurfaceInteraction si;
+    Float sum = 0;
+    for (int t = 0; t < 8; ++t)
+        for (int s = 0; s < 8; ++s) {
+            si.uv = Point2f((s + .5f) / 8, (t + .5f) / 8);
+            sum += atlas.Evaluate(si);
+        }
+    si.dudx = si.dvdy = 1;
+    EXPECT_NEAR(sum / 64, atlas.Evaluate(si), 1e-5f);
+
+    // Unknown names give a constant texture
+    AtlasTexture<Float, Float> missing(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D),
+        AtlasInfo("", files, 1.f, false, false), "atlas_c",
+        ImageWrap::Repeat);
+    EXPECT_EQ(.5f, missing.Evaluate(si));
+
+    AtlasTexture<Float, Float>::ClearCache();
+    AtlasTexture<RGBSpectrum, Spectrum>::ClearCache();
+    ImageTexture<Float, Float>::ClearCache();
+    ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    ClearDecodedImageCache();
+    for (const char *filename : filenames) remove(filename);
+}
+
+// Textures from one atlas, including alpha textures that share its
+// coverage masks, are created on several threads; the last definition of
+// a redefined texture is the one used.
+TEST(AtlasTexture, AsyncRedefinition) {
+    const char *filenames[2] = {"async_red.png", "async_green.png"};
+    for (int f = 0; f < 2; ++f) {
+        std::vector<unsigned char> rgba(4 * 4 * 4, 0);
+        for (int i = 0; i < 16; ++i) {
+            rgba[4 * i + f] = 255;
+            rgba[4 * i + 3] = 255;
+        }
+        ASSERT_EQ(0, lodepng_encode32_file(filenames[f], rgba.data(), 4, 4));
+    }
+    std::string atlas =
+        "\"atlas\" \"string filenames\" [\"async_red.png\" "
+        "\"async_green.png\"] \"string filter\" \"nearest\" ";
+    std::string scene = R"(
+LookAt 0 0 5  0 0 0  0 1 0
+Camera "orthographic" "float screenwindow" [-.5 .5 -.5 .5]
+Sampler "random" "integer pixelsamples" 1
+PixelFilter "box"
+Film "image" "integer xresolution" 2 "integer yresolution" 2
+    "string filename" "async_atlas.exr"
+Integrator "directlighting"
+WorldBegin
+)";
+    for (int i = 0; i < 8; ++i)
+        scene += StringPrintf("Texture \"alpha%d\" \"float\" ", i) + atlas +
+                 "\"string name\" \"async_red\" \"bool alpha\" \"true\"\n";
+    scene += "Texture \"L\" \"spectrum\" " + atlas +
+             "\"string name\" \"async_red\"\n";
+    scene += "Texture \"L\" \"spectrum\" \"constant\" \"rgb value\" [0 0 1]\n";
+    scene += "Texture \"L\" \"spectrum\" " + atlas +
+             "\"string name\" \"async_green\"\n";
+    scene += R"(
+AreaLightSource "texlight" "texture L" "L"
+Shape "quadz" "float l1" 2 "float l2" 2 "texture alpha" "alpha7"
+WorldEnd
+)";
+
+    // pbrtInit() replaces the options, which later tests rely on
+    Options savedOptions = PbrtOptions;
+    Options options;
+    options.quiet = true;
+    options.nThreads = 4;
+    pbrtInit(options);
+    pbrtParseString(scene);
+    pbrtCleanup();
+    PbrtOptions = savedOptions;
+
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> image = ReadImage("async_atlas.exr", &res);
+    ASSERT_TRUE(image != nullptr);
+    ASSERT_EQ(Point2i(2, 2), res);
+    for (int i = 0; i < 4; ++i) {
+        Float rgb[3];
+        image[i].ToRGB(rgb);
+        EXPECT_NEAR(0, rgb[0], 1e-3f) << i;
+        EXPECT_NEAR(1, rgb[1], 1e-3f) << i;
+        EXPECT_NEAR(0, rgb[2], 1e-3f) << i;
+    }
+    for (const char *filename : filenames) remove(filename);
+    EXPECT_EQ(0, remove("async_atlas.exr"));
+}
+
+// Only textures that repeat with a period dividing one in (u,v) report
+// being periodic, and materials only if all of their textures do.
+TEST(ImageTexture, Periodic) {
+    std::vector<unsigned char> rgb(3 * 4 * 4, 100);
+    const char *filename = "periodic.png";
+    ASSERT_EQ(0, lodepng_encode24_file(filename, rgb.data(), 4, 4));
+    auto imageTexture = [&](Float su, Float sv, ImageWrap wrap) {
+        return std::make_shared<ImageTexture<RGBSpectrum, Spectrum>>(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D(su, sv, .5f)),
+            filename, false, 8.f, wrap, 1.f, true, false);
+    };
+    EXPECT_TRUE(imageTexture(1, 1, ImageWrap::Repeat)->IsPeriodic());
+    EXPECT_TRUE(imageTexture(2, -3, ImageWrap::Repeat)->IsPeriodic());
+    EXPECT_FALSE(imageTexture(.5f, 1, ImageWrap::Repeat)->IsPeriodic());
+    EXPECT_FALSE(imageTexture(1, 1, ImageWrap::Clamp)->IsPeriodic());
+    EXPECT_FALSE(imageTexture(1, 1, ImageWrap::Black)->IsPeriodic());
+
+    std::map<std::string, std::shared_ptr<Texture<Float>>> floatTextures;
+    std::map<std::string, std::shared_ptr<Texture<Spectrum>>> spectrumTextures;
+    spectrumTextures["repeat"] = imageTexture(1, 1, ImageWrap::Repeat);
+    spectrumTextures["clamp"] = imageTexture(1, 1, ImageWrap::Clamp);
+    auto scale = std::make_shared<ScaleTexture<Spectrum, Spectrum>>(
+        spectrumTextures["repeat"], spectrumTextures["clamp"]);
+    EXPECT_FALSE(scale->IsPeriodic());
+    for (const char *name : {"repeat", "clamp"}) {
+        ParamSet geomParams, materialParams;
+        materialParams.AddTexture("Kd", name);
+        std::unique_ptr<Float[]> sigma(new Float[1]);
+        sigma[0] = 10;
+        materialParams.AddFloat("sigma", std::move(sigma), 1);
+        TextureParams tp(geomParams, materialParams, floatTextures,
+                         spectrumTextures);
+        EXPECT_TRUE(tp.TexturesPeriodic());
+        tp.GetSpectrumTexture("Kd", Spectrum(.5f));
+        tp.GetFloatTexture("sigma", 0.f);
+        EXPECT_EQ(std::string(name) == "repeat", tp.TexturesPeriodic());
+    }
+    EXPECT_EQ(0, remove(filename));
+}
+
+TEST(ImageTexture, RGBA8MatchesFloat) {
+    RNG rng;
+    const char *filename = "rgba8.png";
+    // A power-of-two image, and one that filtered lookups would resample
+    for (Point2i res : {Point2i(16, 8), Point2i(12, 5)}) {
+        // Write a random 8-bit PNG
+        std::vector<unsigned char> rgb(3 * res.x * res.y);
+        for (unsigned char &c : rgb) c = rng.UniformUInt32(256);
+        ASSERT_EQ(0, lodepng_encode24_file(filename, rgb.data(), res.x,
+                                           res.y));
+        bool pow2 = IsPowerOf2(res.x) && IsPowerOf2(res.y);
+
+        // Resampled 8-bit texels would be rounded, so only point-sampled
+        // textures of the second image keep them as they are
+        for (Float scale : {1.f, 2.5f}) {
+            ImageTexture<RGBSpectrum, Spectrum> floatTex(
+                std::unique_ptr<TextureMapping2D>(new UVMapping2D(2, -3, .25)),
+                filename, false, 8.f, ImageWrap::Repeat, scale, true, false,
+                !pow2);
+            ImageTexture<RGBA8, Spectrum> rgba8Tex(
+                std::unique_ptr<TextureMapping2D>(new UVMapping2D(2, -3, .25)),
+                filename, false, 8.f, ImageWrap::Repeat, scale, true, false,
+                !pow2);
+            for (int i = 0; i < 10000; ++i) {
+                SurfaceInteraction si;
+                si.uv = Point2f(-2 + 4 * rng.UniformFloat(),
+                                -2 + 4 * rng.UniformFloat());
+                // Point sampling gives exactly the same values
+                EXPECT_EQ(floatTex.Evaluate(si), rgba8Tex.Evaluate(si))
+                    << si.uv;
+
+                // Filtered lookups differ only by the quantization of the
+                // coarser levels
+                si.dudx = .05f * rng.UniformFloat();
+                si.dvdy = .05f * rng.UniformFloat();
+                Float a[3], b[3];
+                floatTex.Evaluate(si).ToRGB(a);
+                rgba8Tex.Evaluate(si).ToRGB(b);
+                for (int c = 0; c < 3; ++c)
+                    EXPECT_NEAR(a[c], b[c], .01f * scale) << si.uv;
+            }
+        }
+
+        // Imagemaps default to 8-bit storage unless they'd be resampled
+        std::map<std::string, std::shared_ptr<Texture<Float>>> floatTextures;
+        std::map<std::string, std::shared_ptr<Texture<Spectrum>>>
+            spectrumTextures;
+        for (const char *filter : {"ewa", "nearest"}) {
+            ParamSet geomParams, materialParams;
+            std::unique_ptr<std::string[]> f(new std::string[1]);
+            f[0] = filename;
+            materialParams.AddString("filename", std::move(f), 1);
+            std::unique_ptr<std::string[]> fl(new std::string[1]);
+            fl[0] = filter;
+            materialParams.AddString("filter", std::move(fl), 1);
+            TextureParams tp(geomParams, materialParams, floatTextures,
+                             spectrumTextures);
+            std::unique_ptr<Texture<Spectrum>> tex(
+                CreateImageSpectrumTexture(Transform(), tp));
+            bool rgba8 = dynamic_cast<ImageTexture<RGBA8, Spectrum> *>(
+                             tex.get()) != nullptr;
+            EXPECT_EQ(pow2 || std::string(filter) == "nearest", rgba8)
+                << res << " " << filter;
+        }
+        ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+        ImageTexture<RGBA8, Spectrum>::ClearCache();
+        ClearDecodedImageCache();
+    }
+    remove(filename);
+}
+
+TEST(MIPMap, Nearest) {
+    // Point-sampled MIPMaps keep non-power-of-two images as they are
+    const int width = 5, height = 3;
+    Float texels[width * height];
+    for (int i = 0; i < width * height; ++i) texels[i] = i;
+    MIPMap<Float> mipmap(Point2i(width, height), texels, false, 8.f,
+                         ImageWrap::Clamp, true);
+    EXPECT_EQ(1, mipmap.Levels());
+    EXPECT_EQ(width, mipmap.Width());
+    EXPECT_EQ(height, mipmap.Height());
+
+    RNG rng;
+    for (int i = 0; i < 1000; ++i) {
+        Point2f st(rng.UniformFloat(), rng.UniformFloat());
+        Float expected = texels[int(st[1] * height) * width + int(st[0] * width)];
+        EXPECT_EQ(expected, mipmap.Lookup(st, .5f));
+        EXPECT_EQ(expected,
+                  mipmap.Lookup(st, Vector2f(.3f, .1f), Vector2f(-.1f, .4f)));
+    }
+}
+
+TEST(ImageTexture, NearestIgnoresDifferentials) {
+    const int width = 6, height = 5;
+    RNG rng;
+    std::vector<unsigned char> rgb(3 * width * height);
+    for (unsigned char &c : rgb) c = rng.UniformUInt32(256);
+    const char *filename = "nearest.png";
+    ASSERT_EQ(0, lodepng_encode24_file(filename, rgb.data(), width, height));
+
+    ImageTexture<RGBA8, Spectrum> tex(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename, false,
+        8.f, ImageWrap::Repeat, 1.f, true, false, true);
+    EXPECT_FALSE(tex.NeedsDifferentials());
+    for (int i = 0; i < 1000; ++i) {
+        SurfaceInteraction si;
+        si.uv = Point2f(rng.UniformFloat(), rng.UniformFloat());
+        Spectrum point = tex.Evaluate(si);
+        // The texel the lookup returns is the one the PNG has there
+        int x = si.uv[0] * width, y = height - 1 - int(si.uv[1] * height);
+        Float r[3];
+        point.ToRGB(r);
+        EXPECT_EQ(SRGB8ToLinear[rgb[3 * (y * width + x)]], r[0]) << si.uv;
+
+        si.dudx = .3f * rng.UniformFloat();
+        si.dvdy = .3f * rng.UniformFloat();
+        EXPECT_EQ(point, tex.Evaluate(si)) << si.uv;
+    }
+    ImageTexture<RGBA8, Spectrum>::ClearCache();
+    ClearDecodedImageCache();
+    remove(filename);
+}
+
+// Records the ray of the first specular bounce
+class SpecularBounceIntegrator : public SamplerIntegrator {
+  public:
+    SpecularBounceIntegrator()
+        : SamplerIntegrator(nullptr, nullptr, Bounds2i()) {}
+    Spectrum Li(const RayDifferential &ray, const Scene &scene,
+                Sampler &sampler, MemoryArena &arena, int depth) const {
+        if (depth > 0) {
+            bounce = ray;
+            return Spectrum(0.f);
+        }
+        SurfaceInteraction isect;
+        if (!scene.Intersect(ray, &isect)) return Spectrum(0.f);
+        isect.ComputeScatteringFunctions(ray, arena);
+        p = isect.p;
+        return SpecularReflect(ray, isect, scene, sampler, arena, depth);
+    }
+    mutable RayDifferential bounce;
+    mutable Point3f p;
+};
+
+// Materials whose textures don't use differentials still give specular
+// bounces the footprint at the surface
+TEST(ImageTexture, ConstantMirrorKeepsDifferentials) {
+    Transform identity;
+    std::shared_ptr<Shape> quad = std::make_shared<QuadY>(
+        &identity, &identity, false, 10, 10, 1, 0, 0, 1, 1, nullptr);
+    std::shared_ptr<Material> mirror = std::make_shared<MirrorMaterial>(
+        std::make_shared<ConstantTexture<Spectrum>>(Spectrum(.9f)), nullptr);
+    mirror->needsDifferentials = false;
+    Scene scene(std::make_shared<GeometricPrimitive>(quad, mirror, nullptr,
+                                                     MediumInterface()),
+                std::vector<std::shared_ptr<Light>>());
+
+    RayDifferential ray(Point3f(.3f, 2, .1f),
+                        Normalize(Vector3f(.2f, -1, .1f)));
+    ray.hasDifferentials = true;
+    ray.rxOrigin = ray.o + Vector3f(.01f, 0, 0);
+    ray.ryOrigin = ray.o + Vector3f(0, 0, .01f);
+    ray.rxDirection = ray.ryDirection = ray.d;
+
+    SpecularBounceIntegrator integrator;
+    RandomSampler sampler(1);
+    sampler.StartPixel(Point2i(0, 0));
+    MemoryArena arena;
+    integrator.Li(ray, scene, sampler, arena, 0);
+    const RayDifferential &bounce = integrator.bounce;
+    ASSERT_TRUE(bounce.hasDifferentials);
+    EXPECT_GT(bounce.d.y, 0);
+    // Parallel differential rays reach the plane offset by their origins
+    EXPECT_NEAR(.01f, (bounce.rxOrigin - integrator.p).x, 1e-4f);
+    EXPECT_NEAR(.01f, (bounce.ryOrigin - integrator.p).z, 1e-4f);
+    EXPECT_NEAR(0, (bounce.rxOrigin - integrator.p).y, 1e-4f);
+}
+
+TEST(ImageTexture, ColorAndAlphaShareDecode) {
+    // Write a PNG whose alpha differs from its color
+    const int width = 4, height = 4;
+    RNG rng;
+    std::vector<unsigned char> rgba(4 * width * height);
+    for (int i = 0; i < width * height; ++i) {
+        rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = 200;
+        rgba[4 * i + 3] = rng.UniformUInt32(100);
+    }
+    const char *filename = "sharedecode.png";
+    ASSERT_EQ(0, lodepng_encode32_file(filename, rgba.data(), width, height));
+
+    std::shared_ptr<const DecodedImage> image = GetDecodedImage(filename);
+    ASSERT_TRUE(image != nullptr);
+    EXPECT_EQ(image, GetDecodedImage(filename));
+    EXPECT_EQ(Point2i(width, height), image->resolution);
+
+    // Textures of the same file's luminance and alpha are kept apart;
+    // alpha textures read the red channel unless asked for the alpha one
+    ImageTexture<Float, Float> lum(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename, false,
+        8.f, ImageWrap::Repeat, 1.f, false, false);
+    ImageTexture<Float, Float> red(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename, false,
+        8.f, ImageWrap::Repeat, 1.f, false, true);
+    ImageTexture<Float, Float> alpha(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename, false,
+        8.f, ImageWrap::Repeat, 1.f, false, true, false, true);
+    EXPECT_TRUE(GetAlphaCoverage(&lum) == nullptr);
+    EXPECT_TRUE(GetAlphaCoverage(&red) != nullptr);
+    EXPECT_TRUE(GetAlphaCoverage(&alpha) != nullptr);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x) {
+            SurfaceInteraction si;
+            si.uv = Point2f((x + .5f) / width, 1 - (y + .5f) / height);
+            EXPECT_FLOAT_EQ(200 / 255.f, lum.Evaluate(si));
+            EXPECT_FLOAT_EQ(200 / 255.f, red.Evaluate(si));
+            EXPECT_FLOAT_EQ(rgba[4 * (y * width + x) + 3] / 255.f,
+                            alpha.Evaluate(si));
+        }
+    ImageTexture<Float, Float>::ClearCache();
+    ClearDecodedImageCache();
+    remove(filename);
+}
+
+// Checks that textures read from a paletted image match those read from
+// the PNG it was made from.
+TEST(ImageTexture, PalettedMatchesPNG) {
+    // Write a PNG that uses a dozen colors with varying alpha
+    const int width = 16, height = 16;
+    RNG rng;
+    unsigned char colors[12][4];
+    for (auto &c : colors)
+        for (int j = 0; j < 4; ++j) c[j] = rng.UniformUInt32(256);
+    std::vector<unsigned char> rgba;
+    for (int i = 0; i < width * height; ++i) {
+        const unsigned char *c = colors[rng.UniformUInt32(12)];
+        rgba.insert(rgba.end(), c, c + 4);
+    }
+    const char *pngFilename = "palette.png";
+    const char *palettedFilename = "palette.paletted";
+    ASSERT_EQ(0,
+              lodepng_encode32_file(pngFilename, rgba.data(), width, height));
+    Point2i res;
+    std::unique_ptr<RGBA8[]> texels = ReadImageRGBA8(pngFilename, &res);
+    ASSERT_TRUE(texels != nullptr);
+    ASSERT_TRUE(WritePalettedImage(palettedFilename, texels.get(), res));
+
+    for (bool nearest : {false, true}) {
+        ImageTexture<RGBA8, Spectrum> png(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D), pngFilename,
+            false, 8.f, ImageWrap::Repeat, 1.f, true, false, nearest);
+        ImageTexture<RGBA8, Spectrum> paletted(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D),
+            palettedFilename, false, 8.f, ImageWrap::Repeat, 1.f, true, false,
+            nearest);
+        ImageTexture<Float, Float> pngAlpha(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D), pngFilename,
+            false, 8.f, ImageWrap::Repeat, 1.f, false, true, nearest);
+        ImageTexture<Float, Float> palettedAlpha(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D),
+            palettedFilename, false, 8.f, ImageWrap::Repeat, 1.f, false, true,
+            nearest);
+        for (int i = 0; i < 1000; ++i) {
+            SurfaceInteraction si;
+            si.uv = Point2f(rng.UniformFloat(), rng.UniformFloat());
+            si.dudx = .1f * rng.UniformFloat();
+            si.dvdy = .1f * rng.UniformFloat();
+            EXPECT_EQ(png.Evaluate(si), paletted.Evaluate(si)) << si.uv;
+            EXPECT_EQ(pngAlpha.Evaluate(si), palettedAlpha.Evaluate(si))
+                << si.uv;
+        }
+        ImageTexture<RGBA8, Spectrum>::ClearCache();
+        ImageTexture<Float, Float>::ClearCache();
+    }
+
+    // Images with too many colors can't be paletted
+    std::vector<RGBA8> gradient(2 * width * height);
+    for (int i = 0; i < 2 * width * height; ++i)
+        gradient[i] = RGBA8{uint8_t(i % 256), 0, 0, 255};
+    EXPECT_TRUE(WritePalettedImage(palettedFilename, gradient.data(),
+                                   Point2i(2 * width, height)));
+    gradient.back().g = 1;
+    EXPECT_FALSE(WritePalettedImage(palettedFilename, gradient.data(),
+                                    Point2i(2 * width, height)));
+
+    ClearDecodedImageCache();
+    remove(pngFilename);
+    remove(palettedFilename);
+}
+
+// Checks that a MIP map paged in from a tiled image file matches the one
+// built in memory, with a texture cache budget small enough that tiles are
+// evicted and read again.
+TEST(MIPMap, TiledMatchesInMemory) {
+    const int width = 300, height = 200;
+    RNG rng;
+    std::vector<RGBSpectrum> image(width * height);
+    for (RGBSpectrum &v : image) {
+        Float rgb[3] = {rng.UniformFloat(), rng.UniformFloat(),
+                        rng.UniformFloat()};
+        v = RGBSpectrum::FromRGB(rgb);
+    }
+    MIPMap<RGBSpectrum> mipmap(Point2i(width, height), image.data());
+
+    // Write the levels with their top rows first
+    std::vector<Point2i> levelResolution;
+    std::vector<std::vector<float>> levels;
+    for (int level = 0; level < mipmap.Levels(); ++level) {
+        Point2i res = mipmap.LevelResolution(level);
+        std::vector<float> values;
+        for (int t = res.y - 1; t >= 0; --t)
+            for (int s = 0; s < res.x; ++s) {
+                Float rgb[3];
+                mipmap.Texel(level, s, t).ToRGB(rgb);
+                values.insert(values.end(), rgb, rgb + 3);
+            }
+        levelResolution.push_back(res);
+        levels.push_back(values);
+    }
+    const char *filename = "mipmap.tiled";
+    ASSERT_TRUE(WriteTiledImage(filename, 16, 3, levelResolution, levels));
+
+    int textureCacheMB = PbrtOptions.textureCacheMB;
+    PbrtOptions.textureCacheMB = 1;
+    std::unique_ptr<TiledImage> tiles = TiledImage::Open(filename);
+    ASSERT_TRUE(tiles.get() != nullptr);
+    MIPMap<RGBSpectrum> tiled(std::move(tiles), true);
+    ASSERT_EQ(mipmap.Levels(), tiled.Levels());
+    for (int level = 0; level < mipmap.Levels(); ++level) {
+        Point2i res = mipmap.LevelResolution(level);
+        for (int t = 0; t < res.y; ++t)
+            for (int s = 0; s < res.x; ++s)
+                ASSERT_EQ(mipmap.Texel(level, s, t), tiled.Texel(level, s, t))
+                    << level << ": " << s << ", " << t;
+    }
+    for (int i = 0; i < 1000; ++i) {
+        Point2f st(rng.UniformFloat(), rng.UniformFloat());
+        Vector2f dst0(.02f * rng.UniformFloat(), .01f * rng.UniformFloat());
+        Vector2f dst1(-.01f * rng.UniformFloat(), .02f * rng.UniformFloat());
+        EXPECT_EQ(mipmap.Lookup(st, dst0, dst1), tiled.Lookup(st, dst0, dst1));
+        EXPECT_EQ(mipmap.Lookup(st, .01f), tiled.Lookup(st, .01f));
+    }
+    PbrtOptions.textureCacheMB = textureCacheMB;
+    ClearTextureCache();
+    remove(filename);
+}
+
+// MIP map levels are built on first use; reaching the coarsest level first,
+// from several threads at once, gives the same levels as building them in
+// order.
+TEST(MIPMap, LazyLevels) {
+    const int width = 100, height = 60;
+    RNG rng;
+    std::vector<Float> image(width * height);
+    for (Float &v : image) v = rng.UniformFloat();
+    MIPMap<Float> inOrder(Point2i(width, height), image.data());
+    MIPMap<Float> lazy(Point2i(width, height), image.data());
+    ASSERT_EQ(8, lazy.Levels());
+    EXPECT_EQ(Point2i(128, 64), lazy.LevelResolution(0));
+    EXPECT_EQ(Point2i(2, 1), lazy.LevelResolution(6));
+    EXPECT_EQ(Point2i(1, 1), lazy.LevelResolution(7));
+
+    for (int level = 0; level < inOrder.Levels(); ++level)
+        inOrder.Texel(level, 0, 0);
+    int nThreads = PbrtOptions.nThreads;
+    PbrtOptions.nThreads = 4;
+    ParallelInit();
+    std::vector<Float> coarse(64);
+    ParallelFor([&](int64_t i) {
+        coarse[i] = lazy.Lookup(Point2f((i + .5f) / 64, .5f), 1.f);
+    }, 64, 1);
+    ParallelCleanup();
+    PbrtOptions.nThreads = nThreads;
+    for (int i = 0; i < 64; ++i)
+        EXPECT_EQ(inOrder.Lookup(Point2f((i + .5f) / 64, .5f), 1.f), coarse[i]);
+
+    for (int level = 0; level < inOrder.Levels(); ++level) {
+        Point2i res = inOrder.LevelResolution(level);
+        for (int t = 0; t < res.y; ++t)
+            for (int s = 0; s < res.x; ++s)
+                ASSERT_EQ(inOrder.Texel(level, s, t), lazy.Texel(level, s, t))
+                    << level << ": " << s << ", " << t;
+    }
+}
+
+// Batched evaluation gives exactly the values that evaluating each point
+// does, across several batches.
+TEST(Texture, EvaluateNMatchesEvaluate) {
+    const int width = 16, height = 8;
+    RNG rng;
+    std::vector<unsigned char> rgb(3 * width * height);
+    for (unsigned char &c : rgb) c = rng.UniformUInt32(256);
+    const char *filename = "evaluaten.png";
+    ASSERT_EQ(0, lodepng_encode24_file(filename, rgb.data(), width, height));
+
+    auto image = std::make_shared<ImageTexture<RGBA8, Spectrum>>(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D(2, -3, .25)),
+        filename, false, 8.f, ImageWrap::Repeat, 1.5f, true, false);
+    auto nearest = std::make_shared<ImageTexture<RGBSpectrum, Spectrum>>(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D), filename, false,
+        8.f, ImageWrap::Clamp, 1.f, true, false, true);
+    auto luminance = std::make_shared<ImageTexture<Float, Float>>(
+        std::unique_ptr<TextureMapping2D>(new UVMapping2D(1, 1, .5, 0)),
+        filename, true, 8.f, ImageWrap::Repeat, 1.f, true, false);
+    auto constant = std::make_shared<ConstantTexture<Spectrum>>(Spectrum(.3f));
+    std::vector<std::shared_ptr<Texture<Spectrum>>> textures = {
+        image, nearest, constant,
+        std::make_shared<ScaleTexture<Spectrum, Spectrum>>(image, nearest),
+        std::make_shared<ScaleTexture<Float, Spectrum>>(luminance, image),
+        std::make_shared<MixTexture<Spectrum>>(constant, image, luminance),
+        std::make_shared<MixTexture<Spectrum>>(
+            image, std::make_shared<ScaleTexture<Spectrum, Spectrum>>(
+                       nearest, constant),
+            std::make_shared<ConstantTexture<Float>>(.25f))};
+
+    const int n = 3 * TextureBatchSize + 7;
+    std::vector<SurfaceInteraction> si(n);
+    for (SurfaceInteraction &s : si) {
+        s.uv = Point2f(-2 + 4 * rng.UniformFloat(), -2 + 4 * rng.UniformFloat());
+        s.dudx = .05f * rng.UniformFloat();
+        s.dvdy = .05f * rng.UniformFloat();
+    }
+    std::vector<Spectrum> values(n);
+    for (const auto &tex : textures) {
+        tex->EvaluateN(si.data(), n, values.data());
+        for (int i = 0; i < n; ++i)
+            EXPECT_EQ(tex->Evaluate(si[i]), values[i]) << i;
+    }
+    std::vector<Float> floats(n);
+    luminance->EvaluateN(si.data(), n, floats.data());
+    for (int i = 0; i < n; ++i) EXPECT_EQ(luminance->Evaluate(si[i]), floats[i]);
+
+    ImageTexture<RGBA8, Spectrum>::ClearCache();
+    ImageTexture<RGBSpectrum, Spectrum>::ClearCache();
+    ImageTexture<Float, Float>::ClearCache();
+    ClearDecodedImageCache();
+    remove(filename);
+}
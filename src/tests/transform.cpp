@@ -0,0 +1,72 @@
+#include "tests/gtest/gtest.h"
+#include "pbrt.h"
+#include "rng.h"
+#include "interaction.h"
+#include "transform.h"
+
+using namespace pbrt;
+
+TEST(Transform, Classify) {
+    EXPECT_TRUE(Transform().IsTranslation());
+    EXPECT_TRUE(Translate(Vector3f(1, -2, 3.5)).IsTranslation());
+    EXPECT_TRUE(Inverse(Translate(Vector3f(1, -2, 3.5))).IsTranslation());
+
+    Matrix4x4 perm(0, 0, 1, 4, -1, 0, 0, 5, 0, 1, 0, 6, 0, 0, 0, 1);
+    Transform p(perm);
+    EXPECT_FALSE(p.IsTranslation());
+    EXPECT_TRUE(p.IsAxisPermutation());
+    EXPECT_TRUE(Inverse(p).IsAxisPermutation());
+    EXPECT_TRUE(Scale(-1, 1, 1).IsAxisPermutation());
+
+    EXPECT_FALSE(Scale(2, 1, 1).IsAxisPermutation());
+    EXPECT_FALSE(Rotate(30, Vector3f(1, 1, 0)).IsAxisPermutation());
+    EXPECT_FALSE(Perspective(45, 1, 100).IsAxisPermutation());
+    Matrix4x4 dup(1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1);
+    EXPECT_FALSE(Transform(dup, dup).IsAxisPermutation());
+}
+
+// The axis permutation fast paths must match the general matrix code.
+TEST(Transform, AxisPermutationMatchesMatrix) {
+    RNG rng;
+    Matrix4x4 perm(0, 0, -1, 4.25, 1, 0, 0, -5, 0, 1, 0, 6.5, 0, 0, 0, 1);
+    Transform t(perm);
+    ASSERT_TRUE(t.IsAxisPermutation());
+    auto r = [&rng]() { return Lerp(rng.UniformFloat(), -100, 100); };
+    for (int i = 0; i < 1000; ++i) {
+        Point3f p(r(), r(), r());
+        Vector3f v(r(), r(), r());
+        Normal3f n(r(), r(), r());
+        Point3f pt = t(p);
+        Vector3f vt = t(v);
+        Normal3f nt = t(n);
+        const Matrix4x4 &m = t.GetMatrix(), &mInv = t.GetInverseMatrix();
+        for (int c = 0; c < 3; ++c) {
+            EXPECT_EQ(m.m[c][0] * p.x + m.m[c][1] * p.y + m.m[c][2] * p.z +
+                          m.m[c][3], pt[c]);
+            EXPECT_EQ(m.m[c][0] * v.x + m.m[c][1] * v.y + m.m[c][2] * v.z,
+                      vt[c]);
+            EXPECT_EQ(mInv.m[0][c] * n.x + mInv.m[1][c] * n.y +
+                          mInv.m[2][c] * n.z, nt[c]);
+        }
+
+        Bounds3f b(Point3f(r(), r(), r()), Point3f(r(), r(), r()));
+        Bounds3f bt = t(b);
+        for (int c = 0; c < 8; ++c) EXPECT_TRUE(Inside(t(b.Corner(c)), bt));
+    }
+}
+
+TEST(Transform, TranslationInteraction) {
+    Transform t = Translate(Vector3f(10, -3, 2));
+    SurfaceInteraction si(Point3f(1, 2, 3), Vector3f(0, 0, 0), Point2f(.25, .5),
+                          Vector3f(0, 0, -2), Vector3f(1, 0, 0),
+                          Vector3f(0, 1, 0), Normal3f(0, 0, 0),
+                          Normal3f(0, 0, 0), 0, nullptr);
+    SurfaceInteraction st = t(si);
+    EXPECT_EQ(Point3f(11, -1, 5), st.p);
+    EXPECT_EQ(si.dpdu, st.dpdu);
+    EXPECT_EQ(si.dpdv, st.dpdv);
+    EXPECT_EQ(Normal3f(0, 0, 1), st.n);
+    EXPECT_EQ(Vector3f(0, 0, -1), st.wo);
+    EXPECT_EQ(si.uv, st.uv);
+    EXPECT_GT(st.pError.x, 0);
+}
@@ -0,0 +1,384 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// textures/atlas.cpp*
+#include "textures/atlas.h"
+#include "fileutil.h"
+#include "imageio.h"
+#include "stats.h"
+
+namespace pbrt {
+
+STAT_COUNTER("Texture/Atlas entries", nAtlasEntries);
+STAT_MEMORY_COUNTER("Memory/Texture atlases", atlasBytes);
+
+static void convertIn(const RGBSpectrum &from, RGBSpectrum *to, Float scale,
+                      bool gamma) {
+    for (int i = 0; i < RGBSpectrum::nSamples; ++i)
+        (*to)[i] = scale * (gamma ? InverseGammaCorrect(from[i]) : from[i]);
+}
+
+static void convertIn(const Float &from, RGBSpectrum *to, Float scale,
+                      bool gamma) {
+    Float rgb[3] = {from, from, from};
+    *to = Spectrum::FromRGB(rgb);
+    for (int i = 0; i < RGBSpectrum::nSamples; ++i)
+        (*to)[i] = scale * (gamma ? InverseGammaCorrect((*to)[i]) : (*to)[i]);
+}
+
+static void convertIn(const RGBSpectrum &from, Float *to, Float scale,
+                      bool gamma) {
+    *to = scale * (gamma ? InverseGammaCorrect(from.y()) : from.y());
+}
+
+static void convertIn(const Float &from, Float *to, Float scale, bool gamma) {
+    *to = scale * (gamma ? InverseGammaCorrect(from) : from);
+}
+
+// Reads _filename_ into _image_, flipped in y so that texture coordinate
+// space has (0,0) at the lower left corner, substituting a grey texel if
+// it can't be read.
+template <typename Tfile, typename T>
+static void LoadImage(std::unique_ptr<Tfile[]> (*read)(const std::string &,
+                                                       Point2i *),
+                      const std::string &filename, Float scale, bool gamma,
+                      Point2i *resolution, std::vector<T> *image) {
+    std::unique_ptr<Tfile[]> texels = read(filename, resolution);
+    if (!texels) {
+        Warning("Creating a constant grey texture to replace \"%s\".",
+                filename.c_str());
+        *resolution = Point2i(1, 1);
+        texels.reset(new Tfile[1]);
+        texels[0] = Tfile(.5f);
+    }
+    image->resize(resolution->x * resolution->y);
+    for (int y = 0; y < resolution->y; ++y)
+        for (int x = 0; x < resolution->x; ++x)
+            convertIn(texels[(resolution->y - 1 - y) * resolution->x + x],
+                      &(*image)[y * resolution->x + x], scale, gamma);
+}
+
+static CoverageMask *MakeCoverageMask(int width, int height, ImageWrap wrap,
+                                      const Float *texels) {
+    return new CoverageMask(width, height, wrap, texels);
+}
+
+static CoverageMask *MakeCoverageMask(int, int, ImageWrap,
+                                      const RGBSpectrum *) {
+    return nullptr;
+}
+
+// Readers of alpha masks for _LoadImage()_
+static std::unique_ptr<Float[]> ReadRedChannel(const std::string &filename,
+                                               Point2i *resolution) {
+    return ReadImageAlpha(filename, resolution, false);
+}
+
+static std::unique_ptr<Float[]> ReadAlphaChannel(const std::string &filename,
+                                                 Point2i *resolution) {
+    return ReadImageAlpha(filename, resolution, true);
+}
+
+// TextureAtlas Method Definitions
+template <typename T>
+TextureAtlas<T>::TextureAtlas(const std::vector<std::string> &names,
+                              const std::vector<std::string> &filenames,
+                              Float scale, bool gamma, bool alpha,
+                              bool alphaChannel) {
+    ProfilePhase _(Prof::TextureLoading);
+    // Load the images and find the size of their MIP chains
+    PreloadDecodedImages(filenames);
+    std::vector<std::vector<T>> images(filenames.size());
+    size_t nTexels = 0;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        Point2i res;
+        if (alpha)
+            LoadImage(alphaChannel ? ReadAlphaChannel : ReadRedChannel,
+                      filenames[i], scale, gamma, &res, &images[i]);
+        else
+            LoadImage(ReadImage, filenames[i], scale, gamma, &res, &images[i]);
+        if (!entryIndices.insert(std::make_pair(names[i], (int)i)).second)
+            Warning("Atlas image \"%s\" has the same name as an earlier one.",
+                    filenames[i].c_str());
+
+        Entry entry;
+        entry.firstLevel = levels.size();
+        entry.nLevels = 1 + Log2Int(std::max(res.x, res.y));
+        entries.push_back(entry);
+        for (int level = 0; level < entry.nLevels; ++level) {
+            levels.push_back(Level{res.x, res.y, nTexels});
+            nTexels += res.x * res.y;
+            res = Point2i(std::max(1, res.x / 2), std::max(1, res.y / 2));
+        }
+    }
+
+    // Pack each image and its box-filtered MIP levels into _texels_
+    texels.reserve(nTexels);
+    for (size_t i = 0; i < images.size(); ++i) {
+        const Entry &entry = entries[i];
+        texels.insert(texels.end(), images[i].begin(), images[i].end());
+        std::vector<T>().swap(images[i]);
+        for (int level = 1; level < entry.nLevels; ++level) {
+            const Level &prev = levels[entry.firstLevel + level - 1];
+            const Level &l = levels[entry.firstLevel + level];
+            for (int t = 0; t < l.height; ++t)
+                for (int s = 0; s < l.width; ++s) {
+                    int s0 = std::min(2 * s, prev.width - 1);
+                    int s1 = std::min(2 * s + 1, prev.width - 1);
+                    int t0 = std::min(2 * t, prev.height - 1);
+                    int t1 = std::min(2 * t + 1, prev.height - 1);
+                    const T *p = &texels[prev.offset];
+                    T v = .25f * (p[t0 * prev.width + s0] +
+                                  p[t0 * prev.width + s1] +
+                                  p[t1 * prev.width + s0] +
+                                  p[t1 * prev.width + s1]);
+                    texels.push_back(v);
+                }
+        }
+    }
+    CHECK_EQ(nTexels, texels.size());
+    nAtlasEntries += entries.size();
+    atlasBytes += sizeof(*this) + texels.size() * sizeof(T) +
+                  levels.size() * sizeof(Level) +
+                  entries.size() * sizeof(Entry);
+}
+
+template <typename T>
+const T &TextureAtlas<T>::Texel(int entry, int level, int s, int t,
+                                ImageWrap wrap) const {
+    const Level &l = levels[entries[entry].firstLevel + level];
+    // Compute texel $(s,t)$ accounting for boundary conditions
+    switch (wrap) {
+    case ImageWrap::Repeat:
+        s = Mod(s, l.width);
+        t = Mod(t, l.height);
+        break;
+    case ImageWrap::Clamp:
+        s = Clamp(s, 0, l.width - 1);
+        t = Clamp(t, 0, l.height - 1);
+        break;
+    case ImageWrap::Black: {
+        static const T black = 0.f;
+        if (s < 0 || s >= l.width || t < 0 || t >= l.height) return black;
+        break;
+    }
+    }
+    return texels[l.offset + t * l.width + s];
+}
+
+template <typename T>
+T TextureAtlas<T>::Lookup(int entry, const Point2f &st, Float width,
+                          ImageWrap wrap) const {
+    int nLevels = entries[entry].nLevels;
+    Float level = nLevels - 1 + Log2(std::max(width, (Float)1e-8));
+    if (level < 0)
+        return Nearest(entry, 0, st, wrap);
+    else if (level >= nLevels - 1)
+        return Texel(entry, nLevels - 1, 0, 0, wrap);
+    else {
+        int iLevel = std::floor(level);
+        Float delta = level - iLevel;
+        return Lerp(delta, Nearest(entry, iLevel, st, wrap),
+                    Nearest(entry, iLevel + 1, st, wrap));
+    }
+}
+
+template <typename T>
+const CoverageMask *TextureAtlas<T>::GetCoverageMask(int entry,
+                                                     ImageWrap wrap) {
+    std::lock_guard<std::mutex> lock(coverageMasksMutex);
+    std::unique_ptr<CoverageMask> &mask =
+        coverageMasks[std::make_pair(entry, wrap)];
+    if (!mask) {
+        const Level &l = levels[entries[entry].firstLevel];
+        mask.reset(
+            MakeCoverageMask(l.width, l.height, wrap, &texels[l.offset]));
+    }
+    return mask.get();
+}
+
+// AtlasTexture Method Definitions
+template <typename Tmemory, typename Treturn>
+AtlasTexture<Tmemory, Treturn>::AtlasTexture(
+    std::unique_ptr<TextureMapping2D> mapping, const AtlasInfo &info,
+    const std::string &name, ImageWrap wrapMode, bool nearest)
+    : mapping(std::move(mapping)),
+      wrapMode(wrapMode),
+      nearest(nearest),
+      missing(0.f) {
+    atlas = GetAtlas(info);
+    entry = atlas->EntryIndex(name);
+    if (entry == -1) {
+        Warning("Atlas has no texture named \"%s\". Creating a constant grey "
+                "texture.", name.c_str());
+        convertIn(RGBSpectrum(.5f), &missing, info.scale, info.gamma);
+        return;
+    }
+
+    // Set up the fast coverage test if this is an alpha channel texture
+    const UVMapping2D *uvMapping = GetUVMapping();
+    if (info.alpha && uvMapping) {
+        const CoverageMask *mask = atlas->GetCoverageMask(entry, wrapMode);
+        if (mask) coverage.reset(new AlphaCoverage(mask, uvMapping));
+    }
+}
+
+template <typename Tmemory, typename Treturn>
+TextureAtlas<Tmemory> *AtlasTexture<Tmemory, Treturn>::GetAtlas(
+    const AtlasInfo &info) {
+    // Return _TextureAtlas_ from the atlas cache if present
+    {
+        std::lock_guard<std::mutex> lock(atlasesMutex);
+        auto iter = atlases.find(info);
+        if (iter != atlases.end()) return iter->second.get();
+    }
+
+    // Name the atlas entries after their paths relative to the directory,
+    // or, for a list of images, after their filenames, without extensions
+    std::vector<std::string> names, filenames;
+    if (!info.directory.empty()) {
+        for (const std::string &file : ListFiles(info.directory, ".png")) {
+            names.push_back(file.substr(0, file.size() - 4));
+            filenames.push_back(info.directory + "/" + file);
+        }
+        if (filenames.empty())
+            Warning("No PNG images found in atlas directory \"%s\".",
+                    info.directory.c_str());
+    } else {
+        for (const std::string &filename : info.filenames) {
+            size_t start = filename.find_last_of("/\\");
+            start = start == std::string::npos ? 0 : start + 1;
+            size_t end = filename.find_last_of('.');
+            if (end == std::string::npos || end < start) end = filename.size();
+            names.push_back(filename.substr(start, end - start));
+            filenames.push_back(filename);
+        }
+    }
+    std::unique_ptr<TextureAtlas<Tmemory>> atlas(new TextureAtlas<Tmemory>(
+        names, filenames, info.scale, info.gamma, info.alpha,
+        info.alphaChannel));
+
+    // Another thread may have built the same atlas meanwhile
+    std::lock_guard<std::mutex> lock(atlasesMutex);
+    auto iter = atlases.find(info);
+    if (iter != atlases.end()) return iter->second.get();
+    return (atlases[info] = std::move(atlas)).get();
+}
+
+template <typename Tmemory, typename Treturn>
+std::map<AtlasInfo, std::unique_ptr<TextureAtlas<Tmemory>>>
+    AtlasTexture<Tmemory, Treturn>::atlases;
+template <typename Tmemory, typename Treturn>
+std::mutex AtlasTexture<Tmemory, Treturn>::atlasesMutex;
+
+template <typename Tmemory, typename Treturn>
+static AtlasTexture<Tmemory, Treturn> *CreateAtlasTexture(
+    const Transform &tex2world, const TextureParams &tp) {
+    // Initialize 2D texture mapping _map_ from _tp_
+    std::unique_ptr<TextureMapping2D> map;
+    std::string type = tp.FindString("mapping", "uv");
+    if (type == "uv") {
+        Float su = tp.FindFloat("uscale", 1.);
+        Float sv = tp.FindFloat("vscale", 1.);
+        Float du = tp.FindFloat("udelta", 0.);
+        Float dv = tp.FindFloat("vdelta", 0.);
+        map.reset(new UVMapping2D(su, sv, du, dv));
+    } else if (type == "spherical")
+        map.reset(new SphericalMapping2D(Inverse(tex2world)));
+    else if (type == "cylindrical")
+        map.reset(new CylindricalMapping2D(Inverse(tex2world)));
+    else if (type == "planar")
+        map.reset(new PlanarMapping2D(tp.FindVector3f("v1", Vector3f(1, 0, 0)),
+                                      tp.FindVector3f("v2", Vector3f(0, 1, 0)),
+                                      tp.FindFloat("udelta", 0.f),
+                                      tp.FindFloat("vdelta", 0.f)));
+    else {
+        Error("2D texture mapping \"%s\" unknown", type.c_str());
+        map.reset(new UVMapping2D);
+    }
+
+    // Find the images to pack into the atlas
+    std::string directory = tp.FindFilename("directory");
+    std::vector<std::string> filenames;
+    bool allGamma = true;
+    if (directory.empty()) {
+        int nFilenames;
+        const std::string *names =
+            tp.GetGeomParams().FindString("filenames", &nFilenames);
+        for (int i = 0; i < nFilenames; ++i) {
+            filenames.push_back(ResolveFilename(names[i]));
+            allGamma &= HasExtension(names[i], ".tga") ||
+                        HasExtension(names[i], ".png");
+        }
+        if (filenames.empty())
+            Error("Atlas texture needs a \"directory\" or \"filenames\".");
+    }
+
+    // Initialize _AtlasTexture_ parameters
+    std::string wrap = tp.FindString("wrap", "repeat");
+    ImageWrap wrapMode = ImageWrap::Repeat;
+    if (wrap == "black")
+        wrapMode = ImageWrap::Black;
+    else if (wrap == "clamp")
+        wrapMode = ImageWrap::Clamp;
+    Float scale = tp.FindFloat("scale", 1.f);
+    bool gamma = tp.FindBool("gamma", allGamma);
+    bool alpha = tp.FindBool("alpha", false);
+    bool alphaChannel = tp.FindBool("alphachannel", false);
+    std::string name = tp.FindString("name", "");
+    std::string filter = tp.FindString("filter", "trilinear");
+    if (filter != "nearest" && filter != "trilinear")
+        Error("Atlas texture filter \"%s\" unknown. Using \"trilinear\".",
+              filter.c_str());
+    return new AtlasTexture<Tmemory, Treturn>(
+        std::move(map), AtlasInfo(directory, filenames, scale, gamma, alpha,
+                                  alphaChannel),
+        name, wrapMode, filter == "nearest");
+}
+
+AtlasTexture<Float, Float> *CreateAtlasFloatTexture(const Transform &tex2world,
+                                                    const TextureParams &tp) {
+    return CreateAtlasTexture<Float, Float>(tex2world, tp);
+}
+
+AtlasTexture<RGBSpectrum, Spectrum> *CreateAtlasSpectrumTexture(
+    const Transform &tex2world, const TextureParams &tp) {
+    return CreateAtlasTexture<RGBSpectrum, Spectrum>(tex2world, tp);
+}
+
+template class TextureAtlas<Float>;
+template class TextureAtlas<RGBSpectrum>;
+template class AtlasTexture<Float, Float>;
+template class AtlasTexture<RGBSpectrum, Spectrum>;
+
+}  // namespace pbrt
@@ -0,0 +1,215 @@
+
+/*
+    pbrt source code is Copyright(c) 1998-2016
+                        Matt Pharr, Greg Humphreys, and Wenzel Jakob.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#define NOMINMAX
+#pragma once
+#endif
+
+#ifndef PBRT_TEXTURES_ATLAS_H
+#define PBRT_TEXTURES_ATLAS_H
+
+// textures/atlas.h*
+#include "pbrt.h"
+#include "texture.h"
+#include "mipmap.h"
+#include "paramset.h"
+#include "textures/imagemap.h"
+#include <map>
+#include <mutex>
+
+namespace pbrt {
+
+// AtlasInfo Declarations
+struct AtlasInfo {
+    AtlasInfo(const std::string &directory,
+              const std::vector<std::string> &filenames, Float scale,
+              bool gamma, bool alpha, bool alphaChannel = false)
+        : directory(directory),
+          filenames(filenames),
+          scale(scale),
+          gamma(gamma),
+          alpha(alpha),
+          alphaChannel(alphaChannel) {}
+    std::string directory;
+    std::vector<std::string> filenames;
+    Float scale;
+    bool gamma, alpha, alphaChannel;
+    bool operator<(const AtlasInfo &a2) const {
+        if (directory != a2.directory) return directory < a2.directory;
+        if (filenames != a2.filenames) return filenames < a2.filenames;
+        if (scale != a2.scale) return scale < a2.scale;
+        if (gamma != a2.gamma) return !gamma;
+        if (alpha != a2.alpha) return alpha < a2.alpha;
+        return alphaChannel < a2.alphaChannel;
+    }
+};
+
+// TextureAtlas Declarations
+
+// Many small images packed into a single allocation. Each entry's
+// full-resolution texels are followed by its box-filtered MIP levels, and
+// entries are stored one after another, so the 16x16 textures of a
+// resource pack share a few contiguous pages rather than each having its
+// own _MIPMap_. Images keep their resolution: unlike _MIPMap_, entries
+// aren't resampled to power-of-two sizes.
+template <typename T>
+class TextureAtlas {
+  public:
+    // TextureAtlas Public Methods
+    TextureAtlas(const std::vector<std::string> &names,
+                 const std::vector<std::string> &filenames, Float scale,
+                 bool gamma, bool alpha, bool alphaChannel);
+    // Returns the index of the entry loaded as _name_, or -1 if there is
+    // none
+    int EntryIndex(const std::string &name) const {
+        auto iter = entryIndices.find(name);
+        return iter == entryIndices.end() ? -1 : iter->second;
+    }
+    int Entries() const { return entries.size(); }
+    Point2i Resolution(int entry) const {
+        const Level &l = levels[entries[entry].firstLevel];
+        return Point2i(l.width, l.height);
+    }
+    const T &Texel(int entry, int level, int s, int t, ImageWrap wrap) const;
+    // Point samples _entry_'s texels, choosing MIP levels for a filter of
+    // the given _width_ as _MIPMap::Lookup()_ does for trilinear filtering
+    T Lookup(int entry, const Point2f &st, Float width, ImageWrap wrap) const;
+    const CoverageMask *GetCoverageMask(int entry, ImageWrap wrap);
+
+  private:
+    // TextureAtlas Private Types
+    struct Level {
+        int width, height;
+        size_t offset;
+    };
+    struct Entry {
+        int firstLevel, nLevels;
+    };
+
+    // TextureAtlas Private Methods
+    T Nearest(int entry, int level, const Point2f &st, ImageWrap wrap) const {
+        const Level &l = levels[entries[entry].firstLevel + level];
+        return Texel(entry, level, std::floor(st[0] * l.width),
+                     std::floor(st[1] * l.height), wrap);
+    }
+
+    // TextureAtlas Private Data
+    std::map<std::string, int> entryIndices;
+    std::vector<Entry> entries;
+    std::vector<Level> levels;
+    std::vector<T> texels;
+    // Atlas textures may be created on several threads at once
+    std::map<std::pair<int, ImageWrap>, std::unique_ptr<CoverageMask>>
+        coverageMasks;
+    std::mutex coverageMasksMutex;
+};
+
+// AtlasTexture Declarations
+template <typename Tmemory, typename Treturn>
+class AtlasTexture : public Texture<Treturn> {
+  public:
+    // AtlasTexture Public Methods
+    AtlasTexture(std::unique_ptr<TextureMapping2D> mapping,
+                 const AtlasInfo &info, const std::string &name,
+                 ImageWrap wrapMode, bool nearest = false);
+    static void ClearCache() {
+        std::lock_guard<std::mutex> lock(atlasesMutex);
+        atlases.erase(atlases.begin(), atlases.end());
+    }
+    const AlphaCoverage *GetAlphaCoverage() const { return coverage.get(); }
+    const UVMapping2D *GetUVMapping() const {
+        return dynamic_cast<const UVMapping2D *>(mapping.get());
+    }
+    Point2i Resolution() const {
+        return entry >= 0 ? atlas->Resolution(entry) : Point2i(1, 1);
+    }
+    bool NeedsDifferentials() const { return !nearest; }
+    // Missing entries are constant; others repeat within their rectangle
+    bool IsPeriodic() const {
+        const UVMapping2D *uvMapping = GetUVMapping();
+        return entry < 0 || (wrapMode == ImageWrap::Repeat && uvMapping &&
+                             uvMapping->HasIntegerScale());
+    }
+    Treturn Evaluate(const SurfaceInteraction &si) const {
+        Vector2f dstdx, dstdy;
+        Point2f st = mapping->Map(si, &dstdx, &dstdy);
+        Tmemory mem = missing;
+        if (entry >= 0) {
+            Float width = 0;
+            if (!nearest)
+                width = 2 * std::max(
+                                std::max(std::abs(dstdx[0]), std::abs(dstdx[1])),
+                                std::max(std::abs(dstdy[0]), std::abs(dstdy[1])));
+            mem = atlas->Lookup(entry, st, width, wrapMode);
+        }
+        Treturn ret;
+        convertOut(mem, &ret);
+        return ret;
+    }
+
+  private:
+    // AtlasTexture Private Methods
+    static TextureAtlas<Tmemory> *GetAtlas(const AtlasInfo &info);
+    static void convertOut(const RGBSpectrum &from, Spectrum *to) {
+        Float rgb[3];
+        from.ToRGB(rgb);
+        *to = Spectrum::FromRGB(rgb);
+    }
+    static void convertOut(Float from, Float *to) { *to = from; }
+
+    // AtlasTexture Private Data
+    std::unique_ptr<TextureMapping2D> mapping;
+    TextureAtlas<Tmemory> *atlas;
+    int entry;
+    ImageWrap wrapMode;
+    bool nearest;
+    // Returned in place of an entry the atlas doesn't have
+    Tmemory missing;
+    std::unique_ptr<AlphaCoverage> coverage;
+    static std::map<AtlasInfo, std::unique_ptr<TextureAtlas<Tmemory>>> atlases;
+    static std::mutex atlasesMutex;
+};
+
+extern template class TextureAtlas<Float>;
+extern template class TextureAtlas<RGBSpectrum>;
+extern template class AtlasTexture<Float, Float>;
+extern template class AtlasTexture<RGBSpectrum, Spectrum>;
+
+AtlasTexture<Float, Float> *CreateAtlasFloatTexture(const Transform &tex2world,
+                                                    const TextureParams &tp);
+AtlasTexture<RGBSpectrum, Spectrum> *CreateAtlasSpectrumTexture(
+    const Transform &tex2world, const TextureParams &tp);
+
+}  // namespace pbrt
+
+#endif  // PBRT_TEXTURES_ATLAS_H
@@ -52,6 +52,11 @@ class ConstantTexture : public Texture<T> {
     // ConstantTexture Public Methods
     ConstantTexture(const T &value) : value(value) {}
     T Evaluate(const SurfaceInteraction &) const { return value; }
+    void EvaluateN(const SurfaceInteraction *, int n, T *values) const {
+        std::fill(values, values + n, value);
+    }
+    bool NeedsDifferentials() const { return false; }
+    bool IsPeriodic() const { return true; }
 
   private:
     T value;
@@ -33,38 +33,123 @@
 
 // textures/imagemap.cpp*
 #include "textures/imagemap.h"
+#include "textures/atlas.h"
 #include "imageio.h"
 #include "stats.h"
+#include <type_traits>
 
 namespace pbrt {
 
+STAT_MEMORY_COUNTER("Memory/Alpha coverage masks", coverageMaskBytes);
+
+// CoverageMask Method Definitions
+CoverageMask::CoverageMask(const MIPMap<Float> &mipmap)
+    : width(mipmap.Width()),
+      height(mipmap.Height()),
+      wrapMode(mipmap.WrapMode()),
+      bits((width * height + 63) / 64, 0) {
+    for (int t = 0; t < height; ++t)
+        for (int s = 0; s < width; ++s)
+            if (mipmap.Texel(0, s, t) != 0) {
+                int offset = t * width + s;
+                bits[offset >> 6] |= uint64_t(1) << (offset & 63);
+            }
+    coverageMaskBytes += sizeof(*this) + bits.size() * sizeof(uint64_t);
+}
+
+CoverageMask::CoverageMask(int width, int height, ImageWrap wrapMode,
+                           const Float *texels)
+    : width(width),
+      height(height),
+      wrapMode(wrapMode),
+      bits((width * height + 63) / 64, 0) {
+    for (int offset = 0; offset < width * height; ++offset)
+        if (texels[offset] != 0)
+            bits[offset >> 6] |= uint64_t(1) << (offset & 63);
+    coverageMaskBytes += sizeof(*this) + bits.size() * sizeof(uint64_t);
+}
+
 // ImageTexture Method Definitions
 template <typename Tmemory, typename Treturn>
 ImageTexture<Tmemory, Treturn>::ImageTexture(
     std::unique_ptr<TextureMapping2D> mapping, const std::string &filename,
     bool doTrilinear, Float maxAniso, ImageWrap wrapMode, Float scale,
-    bool gamma, bool alpha)
-    : mapping(std::move(mapping)){
-    mipmap =
-        GetTexture(filename, doTrilinear, maxAniso, wrapMode, scale, gamma, alpha);
+    bool gamma, bool alpha, bool nearest, bool alphaChannel)
+    : mapping(std::move(mapping)),
+      texelScale(ScaleAtLookup(filename) ? scale : 1),
+      nearest(nearest) {
+    mipmap = GetTexture(filename, doTrilinear, maxAniso, wrapMode, scale, gamma,
+                        alpha, nearest, alphaChannel);
+
+    // Set up the fast coverage test if this is an alpha channel texture
+    const UVMapping2D *uvMapping =
+        dynamic_cast<const UVMapping2D *>(this->mapping.get());
+    std::lock_guard<std::mutex> lock(texturesMutex);
+    auto iter = coverageMasks.find(TexInfo(filename, doTrilinear, maxAniso,
+                                           wrapMode, scale, gamma, alpha,
+                                           nearest, alphaChannel));
+    if (uvMapping && iter != coverageMasks.end() && iter->second)
+        coverage.reset(new AlphaCoverage(iter->second.get(), uvMapping));
 }
 
 template <typename Tmemory, typename Treturn>
 MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
     const std::string &filename, bool doTrilinear, Float maxAniso,
-    ImageWrap wrap, Float scale, bool gamma, bool alpha) {
+    ImageWrap wrap, Float scale, bool gamma, bool alpha, bool nearest,
+    bool alphaChannel) {
     // Return _MIPMap_ from texture cache if present
-    TexInfo texInfo(filename, doTrilinear, maxAniso, wrap, scale, gamma);
-    if (textures.find(texInfo) != textures.end())
-        return textures[texInfo].get();
+    TexInfo texInfo(filename, doTrilinear, maxAniso, wrap,
+                    ScaleAtLookup(filename) ? 1 : scale, gamma, alpha,
+                    nearest, alphaChannel);
+    {
+        std::lock_guard<std::mutex> lock(texturesMutex);
+        auto iter = textures.find(texInfo);
+        if (iter != textures.end()) return iter->second.get();
+    }
+
+    // Create _MIPMap_ for _filename_ without holding the lock, so that
+    // textures created asynchronously load in parallel
+    std::unique_ptr<MIPMap<Tmemory>> mipmap(CreateMIPMap(
+        filename, doTrilinear, maxAniso, wrap, scale, gamma, alpha, nearest,
+        alphaChannel));
+    std::unique_ptr<CoverageMask> mask;
+    if (alpha) mask.reset(MakeCoverageMask(*mipmap));
 
-    // Create _MIPMap_ for _filename_
+    // Another thread may have created the same _MIPMap_ meanwhile
+    std::lock_guard<std::mutex> lock(texturesMutex);
+    auto iter = textures.find(texInfo);
+    if (iter != textures.end()) return iter->second.get();
+    if (alpha) coverageMasks[texInfo] = std::move(mask);
+    return (textures[texInfo] = std::move(mipmap)).get();
+}
+
+template <typename Tmemory, typename Treturn>
+MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::CreateMIPMap(
+    const std::string &filename, bool doTrilinear, Float maxAniso,
+    ImageWrap wrap, Float scale, bool gamma, bool alpha, bool nearest,
+    bool alphaChannel) {
     ProfilePhase _(Prof::TextureLoading);
+    if (IsTiledImageFile(filename) && !alpha) {
+        // Tiled images are linear and already MIP mapped; their texels
+        // stay on disk until lookups need them
+        if (gamma)
+            Warning("%s: tiled images are linear; ignoring \"gamma\"",
+                    filename.c_str());
+        std::unique_ptr<TiledImage> tiles = TiledImage::Open(filename);
+        if (tiles)
+            return new MIPMap<Tmemory>(std::move(tiles), true, doTrilinear,
+                                       maxAniso, wrap, nearest);
+        Warning("Creating a constant grey texture to replace \"%s\".",
+                filename.c_str());
+        Tmemory grey(0.5f);
+        return new MIPMap<Tmemory>(Point2i(1, 1), &grey);
+    }
     Point2i resolution;
 
     if (alpha) {
         // Load PNG alpha part
-        std::unique_ptr<Float[]> texels = ReadImageAlpha(filename, &resolution);
+        std::unique_ptr<Float[]> texels =
+            ReadImageAlpha(filename, &resolution, alphaChannel);
         if (!texels) {
             Warning("Creating a constant grey texture to replace \"%s\".",
                     filename.c_str());
@@ -91,13 +176,12 @@ MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
             for (int i = 0; i < resolution.x * resolution.y; ++i)
                 convertIn(texels[i], &convertedTexels[i], scale, gamma);
             mipmap = new MIPMap<Tmemory>(resolution, convertedTexels.get(),
-                                         doTrilinear, maxAniso, wrap);
+                                         doTrilinear, maxAniso, wrap, nearest);
         } else {
             // Create one-valued _MIPMap_
             Tmemory oneVal = scale;
             mipmap = new MIPMap<Tmemory>(Point2i(1, 1), &oneVal);
         }
-        textures[texInfo].reset(mipmap);
         return mipmap;
 
     } else {
@@ -128,20 +212,65 @@ MIPMap<Tmemory> *ImageTexture<Tmemory, Treturn>::GetTexture(
             for (int i = 0; i < resolution.x * resolution.y; ++i)
                 convertIn(texels[i], &convertedTexels[i], scale, gamma);
             mipmap = new MIPMap<Tmemory>(resolution, convertedTexels.get(),
-                                         doTrilinear, maxAniso, wrap);
+                                         doTrilinear, maxAniso, wrap, nearest);
         } else {
             // Create one-valued _MIPMap_
             Tmemory oneVal = scale;
             mipmap = new MIPMap<Tmemory>(Point2i(1, 1), &oneVal);
         }
-        textures[texInfo].reset(mipmap);
         return mipmap;
     }
 }
 
+// 8-bit texels are stored as read from the PNG, sRGB-encoded and without
+// _scale_, which _Evaluate()_ applies after decoding them.
+template <>
+MIPMap<RGBA8> *ImageTexture<RGBA8, Spectrum>::CreateMIPMap(
+    const std::string &filename, bool doTrilinear, Float maxAniso,
+    ImageWrap wrap, Float scale, bool gamma, bool alpha, bool nearest,
+    bool alphaChannel) {
+    CHECK(gamma && !alpha);
+    ProfilePhase _(Prof::TextureLoading);
+    Point2i resolution;
+    std::unique_ptr<RGBA8[]> texels = ReadImageRGBA8(filename, &resolution);
+    if (!texels) {
+        Warning("Creating a constant grey texture to replace \"%s\".",
+                filename.c_str());
+        resolution.x = resolution.y = 1;
+        texels.reset(new RGBA8[1]);
+        texels[0] = RGBA8{128, 128, 128, 255};
+    }
+
+    // Flip image in y; texture coordinate space has (0,0) at the lower
+    // left corner.
+    for (int y = 0; y < resolution.y / 2; ++y)
+        for (int x = 0; x < resolution.x; ++x) {
+            int o1 = y * resolution.x + x;
+            int o2 = (resolution.y - 1 - y) * resolution.x + x;
+            std::swap(texels[o1], texels[o2]);
+        }
+
+    return new MIPMap<RGBA8>(resolution, texels.get(), doTrilinear, maxAniso,
+                             wrap, nearest);
+}
+
 template <typename Tmemory, typename Treturn>
 std::map<TexInfo, std::unique_ptr<MIPMap<Tmemory>>>
     ImageTexture<Tmemory, Treturn>::textures;
+template <typename Tmemory, typename Treturn>
+std::map<TexInfo, std::unique_ptr<CoverageMask>>
+    ImageTexture<Tmemory, Treturn>::coverageMasks;
+template <typename Tmemory, typename Treturn>
+std::mutex ImageTexture<Tmemory, Treturn>::texturesMutex;
+
+const AlphaCoverage *GetAlphaCoverage(const Texture<Float> *alpha) {
+    if (auto image = dynamic_cast<const ImageTexture<Float, Float> *>(alpha))
+        return image->GetAlphaCoverage();
+    if (auto atlas = dynamic_cast<const AtlasTexture<Float, Float> *>(alpha))
+        return atlas->GetAlphaCoverage();
+    return nullptr;
+}
+
 ImageTexture<Float, Float> *CreateImageFloatTexture(const Transform &tex2world,
                                                     const TextureParams &tp) {
     // Initialize 2D texture mapping _map_ from _tp_
@@ -170,6 +299,13 @@ ImageTexture<Float, Float> *CreateImageFloatTexture(const Transform &tex2world,
     // Initialize _ImageTexture_ parameters
     Float maxAniso = tp.FindFloat("maxanisotropy", 8.f);
     bool trilerp = tp.FindBool("trilinear", false);
+    std::string filter = tp.FindString("filter", trilerp ? "trilinear" : "ewa");
+    if (filter != "nearest" && filter != "trilinear" && filter != "ewa") {
+        Error("Texture filter \"%s\" unknown. Using \"ewa\".", filter.c_str());
+        filter = "ewa";
+    }
+    trilerp = filter == "trilinear";
+    bool nearest = filter == "nearest";
     std::string wrap = tp.FindString("wrap", "repeat");
     ImageWrap wrapMode = ImageWrap::Repeat;
     if (wrap == "black")
@@ -179,14 +315,17 @@ ImageTexture<Float, Float> *CreateImageFloatTexture(const Transform &tex2world,
     Float scale = tp.FindFloat("scale", 1.f);
     std::string filename = tp.FindFilename("filename");
     bool gamma = tp.FindBool("gamma", HasExtension(filename, ".tga") ||
-                                          HasExtension(filename, ".png"));
+                                          HasExtension(filename, ".png") ||
+                                          IsPalettedImageFile(filename));
     bool alpha = tp.FindBool("alpha", false);
+    bool alphaChannel = tp.FindBool("alphachannel", false);
     return new ImageTexture<Float, Float>(std::move(map), filename, trilerp,
-                                          maxAniso, wrapMode, scale, gamma, alpha);
+                                          maxAniso, wrapMode, scale, gamma,
+                                          alpha, nearest, alphaChannel);
 }
 
-ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(
-    const Transform &tex2world, const TextureParams &tp) {
+Texture<Spectrum> *CreateImageSpectrumTexture(const Transform &tex2world,
+                                              const TextureParams &tp) {
     // Initialize 2D texture mapping _map_ from _tp_
     std::unique_ptr<TextureMapping2D> map;
     std::string type = tp.FindString("mapping", "uv");
@@ -213,6 +352,13 @@ ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(
     // Initialize _ImageTexture_ parameters
     Float maxAniso = tp.FindFloat("maxanisotropy", 8.f);
     bool trilerp = tp.FindBool("trilinear", false);
+    std::string filter = tp.FindString("filter", trilerp ? "trilinear" : "ewa");
+    if (filter != "nearest" && filter != "trilinear" && filter != "ewa") {
+        Error("Texture filter \"%s\" unknown. Using \"ewa\".", filter.c_str());
+        filter = "ewa";
+    }
+    trilerp = filter == "trilinear";
+    bool nearest = filter == "nearest";
     std::string wrap = tp.FindString("wrap", "repeat");
     ImageWrap wrapMode = ImageWrap::Repeat;
     if (wrap == "black")
@@ -222,13 +368,42 @@ ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(
     Float scale = tp.FindFloat("scale", 1.f);
     std::string filename = tp.FindFilename("filename");
     bool gamma = tp.FindBool("gamma", HasExtension(filename, ".tga") ||
-                                          HasExtension(filename, ".png"));
+                                          HasExtension(filename, ".png") ||
+                                          IsPalettedImageFile(filename));
     bool alpha = tp.FindBool("alpha", false);
-    return new ImageTexture<RGBSpectrum, Spectrum>(
-        std::move(map), filename, trilerp, maxAniso, wrapMode, scale, gamma, alpha);
+    bool alphaChannel = tp.FindBool("alphachannel", false);
+
+    // Keep the texels of sRGB-encoded 8-bit images in 8 bits unless asked
+    // not to. Filtered images whose resolution isn't a power of two are
+    // resampled, which would round the resampled texels to 8 bits, so they
+    // default to floats.
+    bool packable = gamma && !alpha && (HasExtension(filename, ".png") ||
+                                        IsPalettedImageFile(filename));
+    bool resampled = false;
+    if (packable && !nearest) {
+        std::shared_ptr<const DecodedImage> image = GetDecodedImage(filename);
+        resampled = image && (!IsPowerOf2(image->resolution.x) ||
+                              !IsPowerOf2(image->resolution.y));
+    }
+    std::string storage =
+        tp.FindString("storage", packable && !resampled ? "rgba8" : "float");
+    if (storage == "rgba8") {
+        if (packable)
+            return new ImageTexture<RGBA8, Spectrum>(
+                std::move(map), filename, trilerp, maxAniso, wrapMode, scale,
+                gamma, alpha, nearest);
+        Warning("\"rgba8\" storage needs a gamma-encoded 8-bit color image; "
+                "storing \"%s\" as floats.", filename.c_str());
+    } else if (storage != "float")
+        Error("Image texture storage \"%s\" unknown.", storage.c_str());
+    return new ImageTexture<RGBSpectrum, Spectrum>(std::move(map), filename,
+                                                   trilerp, maxAniso, wrapMode,
+                                                   scale, gamma, alpha, nearest,
+                                                   alphaChannel);
 }
 
 template class ImageTexture<Float, Float>;
 template class ImageTexture<RGBSpectrum, Spectrum>;
+template class ImageTexture<RGBA8, Spectrum>;
 
 }  // namespace pbrt
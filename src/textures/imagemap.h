@@ -45,9 +45,62 @@
 #include "paramset.h"
 #include "textures/texinfo.h"
 #include <map>
+#include <mutex>
 
 namespace pbrt {
 
+// CoverageMask Declarations
+
+// One bit per texel of an alpha texture's full-resolution MIPMap level,
+// set where the texel is nonzero.
+struct CoverageMask {
+    CoverageMask(const MIPMap<Float> &mipmap);
+    CoverageMask(int width, int height, ImageWrap wrapMode,
+                 const Float *texels);
+    bool Covered(const Point2f &st) const {
+        int s = std::floor(st[0] * width), t = std::floor(st[1] * height);
+        switch (wrapMode) {
+        case ImageWrap::Repeat:
+            s = Mod(s, width);
+            t = Mod(t, height);
+            break;
+        case ImageWrap::Clamp:
+            s = Clamp(s, 0, width - 1);
+            t = Clamp(t, 0, height - 1);
+            break;
+        case ImageWrap::Black:
+            if (s < 0 || s >= width || t < 0 || t >= height) return false;
+            break;
+        }
+        int offset = t * width + s;
+        return (bits[offset >> 6] & (uint64_t(1) << (offset & 63))) != 0;
+    }
+
+    int width, height;
+    ImageWrap wrapMode;
+    std::vector<uint64_t> bits;
+};
+
+// AlphaCoverage Declarations
+
+// Tests whether an image alpha texture is nonzero at a shape's (u,v)
+// without building a _SurfaceInteraction_. Shapes evaluate alpha during
+// intersection without ray differentials, where the texture lookup
+// reduces to reading the nearest full-resolution texel, so this gives
+// the same answer as _Evaluate()_.
+class AlphaCoverage {
+  public:
+    AlphaCoverage(const CoverageMask *mask, const UVMapping2D *mapping)
+        : mask(mask), mapping(mapping) {}
+    bool Covered(const Point2f &uv) const {
+        return mask->Covered(mapping->Map(uv));
+    }
+
+  private:
+    const CoverageMask *mask;
+    const UVMapping2D *mapping;
+};
+
 // ImageTexture Declarations
 template <typename Tmemory, typename Treturn>
 class ImageTexture : public Texture<Treturn> {
@@ -55,24 +108,70 @@ class ImageTexture : public Texture<Treturn> {
     // ImageTexture Public Methods
     ImageTexture(std::unique_ptr<TextureMapping2D> m,
                  const std::string &filename, bool doTri, Float maxAniso,
-                 ImageWrap wm, Float scale, bool gamma, bool alpha);
+                 ImageWrap wm, Float scale, bool gamma, bool alpha,
+                 bool nearest = false, bool alphaChannel = false);
     static void ClearCache() {
+        std::lock_guard<std::mutex> lock(texturesMutex);
         textures.erase(textures.begin(), textures.end());
+        coverageMasks.erase(coverageMasks.begin(), coverageMasks.end());
+    }
+    const AlphaCoverage *GetAlphaCoverage() const { return coverage.get(); }
+    // Returns the texture's (u,v) mapping, or nullptr if it uses another
+    // kind of mapping
+    const UVMapping2D *GetUVMapping() const {
+        return dynamic_cast<const UVMapping2D *>(mapping.get());
+    }
+    Point2i Resolution() const {
+        return Point2i(mipmap->Width(), mipmap->Height());
+    }
+    bool NeedsDifferentials() const { return !nearest; }
+    bool IsPeriodic() const {
+        const UVMapping2D *uvMapping = GetUVMapping();
+        return mipmap->WrapMode() == ImageWrap::Repeat && uvMapping &&
+               uvMapping->HasIntegerScale();
     }
     Treturn Evaluate(const SurfaceInteraction &si) const {
         Vector2f dstdx, dstdy;
         Point2f st = mapping->Map(si, &dstdx, &dstdy);
-        Tmemory mem = mipmap->Lookup(st, dstdx, dstdy);
+        typename MIPMap<Tmemory>::Value mem = mipmap->Lookup(st, dstdx, dstdy);
+        if (texelScale != 1) mem *= texelScale;
         Treturn ret;
         convertOut(mem, &ret);
         return ret;
     }
+    void EvaluateN(const SurfaceInteraction *si, int n,
+                   Treturn *values) const {
+        Point2f st[TextureBatchSize];
+        Vector2f dstdx[TextureBatchSize], dstdy[TextureBatchSize];
+        for (int start = 0; start < n; start += TextureBatchSize) {
+            int count = std::min(n - start, TextureBatchSize);
+            // Point-sampled textures need no differentials
+            if (nearest)
+                mapping->MapN(si + start, count, st, nullptr, nullptr);
+            else
+                mapping->MapN(si + start, count, st, dstdx, dstdy);
+            for (int i = 0; i < count; ++i) {
+                typename MIPMap<Tmemory>::Value mem =
+                    nearest ? mipmap->Lookup(st[i])
+                            : mipmap->Lookup(st[i], dstdx[i], dstdy[i]);
+                if (texelScale != 1) mem *= texelScale;
+                convertOut(mem, &values[start + i]);
+            }
+        }
+    }
 
   private:
     // ImageTexture Private Methods
     static MIPMap<Tmemory> *GetTexture(const std::string &filename,
                                        bool doTrilinear, Float maxAniso,
-                                       ImageWrap wm, Float scale, bool gamma, bool alpha);
+                                       ImageWrap wm, Float scale, bool gamma,
+                                       bool alpha, bool nearest,
+                                       bool alphaChannel);
+    static MIPMap<Tmemory> *CreateMIPMap(const std::string &filename,
+                                         bool doTrilinear, Float maxAniso,
+                                         ImageWrap wm, Float scale, bool gamma,
+                                         bool alpha, bool nearest,
+                                         bool alphaChannel);
     static void convertIn(const RGBSpectrum &from, RGBSpectrum *to, Float scale,
                           bool gamma) {
         for (int i = 0; i < RGBSpectrum::nSamples; ++i)
@@ -95,22 +194,58 @@ class ImageTexture : public Texture<Treturn> {
         *to = Spectrum::FromRGB(rgb);
     }
     static void convertOut(Float from, Float *to) { *to = from; }
+    // 8-bit texels and the texels of tiled image files are stored without
+    // the texture's scale
+    static bool ScaleAtLookup(const std::string &filename) {
+        return std::is_same<Tmemory, RGBA8>::value ||
+               IsTiledImageFile(filename);
+    }
+    static CoverageMask *MakeCoverageMask(const MIPMap<Float> &mipmap) {
+        return new CoverageMask(mipmap);
+    }
+    static CoverageMask *MakeCoverageMask(const MIPMap<RGBSpectrum> &) {
+        return nullptr;
+    }
+    static CoverageMask *MakeCoverageMask(const MIPMap<RGBA8> &) {
+        return nullptr;
+    }
 
     // ImageTexture Private Data
     std::unique_ptr<TextureMapping2D> mapping;
     MIPMap<Tmemory> *mipmap;
     static std::map<TexInfo, std::unique_ptr<MIPMap<Tmemory>>> textures;
+    // Coverage masks of the textures loaded from PNG alpha channels
+    static std::map<TexInfo, std::unique_ptr<CoverageMask>> coverageMasks;
+    // Guards the two caches, which textures created on worker threads
+    // share
+    static std::mutex texturesMutex;
+    std::unique_ptr<AlphaCoverage> coverage;
+    // Scale applied to looked-up values of texels that are stored without
+    // it (see _ScaleAtLookup()_)
+    Float texelScale;
 
     bool alpha;
+    bool nearest;
 };
 
+template <>
+MIPMap<RGBA8> *ImageTexture<RGBA8, Spectrum>::CreateMIPMap(
+    const std::string &filename, bool doTrilinear, Float maxAniso,
+    ImageWrap wrap, Float scale, bool gamma, bool alpha, bool nearest,
+    bool alphaChannel);
+
 extern template class ImageTexture<Float, Float>;
 extern template class ImageTexture<RGBSpectrum, Spectrum>;
+extern template class ImageTexture<RGBA8, Spectrum>;
+
+// Returns the coverage test for _alpha_ if it's a PNG alpha channel image
+// or atlas texture with a (u,v) mapping, and nullptr otherwise.
+const AlphaCoverage *GetAlphaCoverage(const Texture<Float> *alpha);
 
 ImageTexture<Float, Float> *CreateImageFloatTexture(const Transform &tex2world,
                                                     const TextureParams &tp);
-ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(
-    const Transform &tex2world, const TextureParams &tp);
+Texture<Spectrum> *CreateImageSpectrumTexture(const Transform &tex2world,
+                                              const TextureParams &tp);
 
 }  // namespace pbrt
 
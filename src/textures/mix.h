@@ -59,6 +59,27 @@ class MixTexture : public Texture<T> {
         Float amt = amount->Evaluate(si);
         return (1 - amt) * t1 + amt * t2;
     }
+    void EvaluateN(const SurfaceInteraction *si, int n, T *values) const {
+        tex1->EvaluateN(si, n, values);
+        T t2[TextureBatchSize];
+        Float amt[TextureBatchSize];
+        for (int start = 0; start < n; start += TextureBatchSize) {
+            int count = std::min(n - start, TextureBatchSize);
+            tex2->EvaluateN(si + start, count, t2);
+            amount->EvaluateN(si + start, count, amt);
+            for (int i = 0; i < count; ++i)
+                values[start + i] =
+                    (1 - amt[i]) * values[start + i] + amt[i] * t2[i];
+        }
+    }
+    bool NeedsDifferentials() const {
+        return tex1->NeedsDifferentials() || tex2->NeedsDifferentials() ||
+               amount->NeedsDifferentials();
+    }
+    bool IsPeriodic() const {
+        return tex1->IsPeriodic() && tex2->IsPeriodic() &&
+               amount->IsPeriodic();
+    }
 
   private:
     std::shared_ptr<Texture<T>> tex1, tex2;
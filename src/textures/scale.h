@@ -56,6 +56,22 @@ class ScaleTexture : public Texture<T2> {
     T2 Evaluate(const SurfaceInteraction &si) const {
         return tex1->Evaluate(si) * tex2->Evaluate(si);
     }
+    void EvaluateN(const SurfaceInteraction *si, int n, T2 *values) const {
+        tex2->EvaluateN(si, n, values);
+        T1 scale[TextureBatchSize];
+        for (int start = 0; start < n; start += TextureBatchSize) {
+            int count = std::min(n - start, TextureBatchSize);
+            tex1->EvaluateN(si + start, count, scale);
+            for (int i = 0; i < count; ++i)
+                values[start + i] = scale[i] * values[start + i];
+        }
+    }
+    bool NeedsDifferentials() const {
+        return tex1->NeedsDifferentials() || tex2->NeedsDifferentials();
+    }
+    bool IsPeriodic() const {
+        return tex1->IsPeriodic() && tex2->IsPeriodic();
+    }
 
   private:
     // ScaleTexture Private Data
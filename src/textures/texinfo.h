@@ -17,25 +17,36 @@ namespace pbrt {
 // TexInfo Declarations
 struct TexInfo {
     TexInfo(const std::string &f, bool dt, Float ma, ImageWrap wm, Float sc,
-            bool gamma)
+            bool gamma, bool alpha = false, bool nearest = false,
+            bool alphaChannel = false)
         : filename(f),
           doTrilinear(dt),
           maxAniso(ma),
           wrapMode(wm),
           scale(sc),
-          gamma(gamma) {}
+          gamma(gamma),
+          alpha(alpha),
+          nearest(nearest),
+          alphaChannel(alphaChannel) {}
     std::string filename;
     bool doTrilinear;
     Float maxAniso;
     ImageWrap wrapMode;
     Float scale;
     bool gamma;
+    bool alpha;
+    bool nearest;
+    bool alphaChannel;
     bool operator<(const TexInfo &t2) const {
         if (filename != t2.filename) return filename < t2.filename;
         if (doTrilinear != t2.doTrilinear) return doTrilinear < t2.doTrilinear;
         if (maxAniso != t2.maxAniso) return maxAniso < t2.maxAniso;
         if (scale != t2.scale) return scale < t2.scale;
         if (gamma != t2.gamma) return !gamma;
+        if (alpha != t2.alpha) return alpha < t2.alpha;
+        if (nearest != t2.nearest) return nearest < t2.nearest;
+        if (alphaChannel != t2.alphaChannel)
+            return alphaChannel < t2.alphaChannel;
         return wrapMode < t2.wrapMode;
     }
 };
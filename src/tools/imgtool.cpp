@@ -14,6 +14,8 @@
 #include "pbrt.h"
 #include "spectrum.h"
 #include "parallel.h"
+#include "mipmap.h"
+#include "texcache.h"
 extern "C" {
 #include "ext/ArHosekSkyModel.h"
 }
@@ -31,7 +33,7 @@ static void usage(const char *msg = nullptr, ...) {
     }
     fprintf(stderr, R"(usage: imgtool <command> [options] <filenames...>
 
-commands: assemble, cat, convert, diff, info, makesky
+commands: assemble, cat, convert, diff, info, makepalette, makesky, maketiled
 
 assemble option:
     --outfile          Output image filename.
@@ -70,6 +72,10 @@ diff options:
     --outfile <name>   Filename to use for saving an image that encodes the
                        absolute value of per-pixel differences.
 
+makepalette:
+    Stores a PNG image with at most 256 distinct colors as a ".paletted"
+    image, an 8-bit palette index per pixel.
+
 makesky options:
     --albedo <a>       Albedo of ground-plane (range 0-1). Default: 0.5
     --elevation <e>    Elevation of the sun in degrees (range 0-90). Default: 10
@@ -80,6 +86,15 @@ makesky options:
                        (Horizontal resolution is twice this value.)
                        Default: 2048
 
+maketiled options:
+    --gamma            Treat the input's values as sRGB-encoded and
+                       linearize them. Default: on for PNG and TGA files.
+    --linear           Use the input's values as they are.
+    --tilesize <n>     Width and height of the tiles in texels. Default: 64
+    --wrap <mode>      Wrap mode ("repeat", "clamp" or "black") used when
+                       resampling the image to a power-of-two resolution.
+                       Default: "repeat"
+
 )");
     exit(1);
 }
@@ -187,6 +202,92 @@ int makesky(int argc, char *argv[]) {
     return 0;
 }
 
+// Writes a tiled image file (see core/texcache.h) holding the MIP map of
+// an image, for textures and environment maps to page in through the
+// texture cache.
+int maketiled(int argc, char *argv[]) {
+    int tileSize = 64;
+    // -1 follows the input file's extension
+    int gamma = -1;
+    ImageWrap wrapMode = ImageWrap::Repeat;
+
+    int i;
+    for (i = 0; i < argc; ++i) {
+        if (argv[i][0] != '-') break;
+        if (!strcmp(argv[i], "--gamma") || !strcmp(argv[i], "-gamma"))
+            gamma = 1;
+        else if (!strcmp(argv[i], "--linear") || !strcmp(argv[i], "-linear"))
+            gamma = 0;
+        else if (!strcmp(argv[i], "--tilesize") ||
+                 !strcmp(argv[i], "-tilesize")) {
+            if (i + 1 == argc) usage("missing value after %s flag", argv[i]);
+            tileSize = atoi(argv[++i]);
+            if (tileSize <= 0)
+                usage("--tilesize value must be greater than zero");
+        } else if (!strcmp(argv[i], "--wrap") || !strcmp(argv[i], "-wrap")) {
+            if (i + 1 == argc) usage("missing value after %s flag", argv[i]);
+            std::string wrap = argv[++i];
+            if (wrap == "repeat")
+                wrapMode = ImageWrap::Repeat;
+            else if (wrap == "clamp")
+                wrapMode = ImageWrap::Clamp;
+            else if (wrap == "black")
+                wrapMode = ImageWrap::Black;
+            else
+                usage("unknown wrap mode \"%s\"", wrap.c_str());
+        } else
+            usage("unknown maketiled option \"%s\"", argv[i]);
+    }
+    if (i + 2 != argc)
+        usage("must provide input and output filenames for \"maketiled\"");
+    const char *inFilename = argv[i], *outFilename = argv[i + 1];
+
+    Point2i res;
+    std::unique_ptr<RGBSpectrum[]> image = ReadImage(inFilename, &res);
+    if (!image) {
+        fprintf(stderr, "%s: unable to read image\n", inFilename);
+        return 1;
+    }
+    if (gamma == -1)
+        gamma = HasExtension(inFilename, ".png") ||
+                HasExtension(inFilename, ".tga");
+
+    // Build the MIP map in texture space, with (0,0) at the lower left, as
+    // image textures do, so that they find exactly the same texels
+    std::unique_ptr<RGBSpectrum[]> texels(new RGBSpectrum[res.x * res.y]);
+    for (int y = 0; y < res.y; ++y)
+        for (int x = 0; x < res.x; ++x) {
+            RGBSpectrum v = image[(res.y - 1 - y) * res.x + x];
+            if (gamma)
+                for (int c = 0; c < RGBSpectrum::nSamples; ++c)
+                    v[c] = InverseGammaCorrect(v[c]);
+            texels[y * res.x + x] = v;
+        }
+    ParallelInit();
+    MIPMap<RGBSpectrum> mipmap(res, texels.get(), false, 8.f, wrapMode);
+    ParallelCleanup();
+
+    // Store each level with its top row first
+    std::vector<Point2i> levelResolution;
+    std::vector<std::vector<float>> levels;
+    for (int level = 0; level < mipmap.Levels(); ++level) {
+        Point2i r = mipmap.LevelResolution(level);
+        std::vector<float> values(3 * r.x * r.y);
+        for (int t = 0; t < r.y; ++t)
+            for (int s = 0; s < r.x; ++s) {
+                Float rgb[3];
+                mipmap.Texel(level, s, r.y - 1 - t).ToRGB(rgb);
+                for (int c = 0; c < 3; ++c)
+                    values[3 * (t * r.x + s) + c] = rgb[c];
+            }
+        levelResolution.push_back(r);
+        levels.push_back(std::move(values));
+    }
+    return WriteTiledImage(outFilename, tileSize, 3, levelResolution, levels)
+               ? 0
+               : 1;
+}
+
 int assemble(int argc, char *argv[]) {
     if (argc == 0) usage("no filenames provided to \"assemble\"?");
     const char *outfile = nullptr;
@@ -761,6 +862,20 @@ int convert(int argc, char *argv[]) {
     return 0;
 }
 
+int makepalette(int argc, char *argv[]) {
+    if (argc != 2)
+        usage("must provide input and output filenames for \"makepalette\"");
+    const char *inFilename = argv[0], *outFilename = argv[1];
+
+    Point2i res;
+    std::unique_ptr<RGBA8[]> image = ReadImageRGBA8(inFilename, &res);
+    if (!image) {
+        fprintf(stderr, "%s: unable to read image\n", inFilename);
+        return 1;
+    }
+    return WritePalettedImage(outFilename, image.get(), res) ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
     google::InitGoogleLogging(argv[0]);
     FLAGS_stderrthreshold = 1; // Warning and above.
@@ -777,8 +892,12 @@ int main(int argc, char *argv[]) {
         return diff(argc - 2, argv + 2);
     else if (!strcmp(argv[1], "info"))
         return info(argc - 2, argv + 2);
+    else if (!strcmp(argv[1], "makepalette"))
+        return makepalette(argc - 2, argv + 2);
     else if (!strcmp(argv[1], "makesky"))
         return makesky(argc - 2, argv + 2);
+    else if (!strcmp(argv[1], "maketiled"))
+        return maketiled(argc - 2, argv + 2);
     else
         usage("unknown command \"%s\"", argv[1]);
 
@@ -0,0 +1,257 @@
+// tools/raybench.cpp*
+// Builds a synthetic block world the way the Minecraft exporter does and
+// measures how fast rays can be traced through it.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "pbrt.h"
+#include "api.h"
+#include "paramset.h"
+#include "primitive.h"
+#include "rng.h"
+#include "stats.h"
+#include "sampling.h"
+#include "accelerators/bvh.h"
+#include "accelerators/widebvh.h"
+#include "shapes/quad.h"
+#include "shapes/quadmesh.h"
+#include "shapes/voxelchunk.h"
+#include "textures/imagemap.h"
+
+using namespace pbrt;
+
+static void usage(const char *msg = nullptr, ...) {
+    if (msg) {
+        va_list args;
+        va_start(args, msg);
+        fprintf(stderr, "raybench: ");
+        vfprintf(stderr, msg, args);
+        fprintf(stderr, "\n");
+    }
+    fprintf(stderr, R"(usage: raybench [options]
+options:
+  --size <n>       World is n x n blocks wide. Default: 256
+  --rays <n>       Number of rays to trace. Default: 1000000
+  --shape <name>   How block faces are represented: "quads", "quadmesh",
+                   "voxelchunk" or "strips" (quads, with runs of top faces
+                   along x merged into long quads). Default: "quads"
+  --alpha <file>   Use the alpha channel of the given PNG as an alpha texture
+                   on every face.
+  --accel <name>   Accelerator to trace rays with: "bvh", "qbvh" or "obvh".
+                   Default: "bvh"
+  --compressed     Quantize the bounds in "qbvh" and "obvh" nodes.
+  --splitmethod <name> BVH split method: "sah", "hlbvh", "middle", "equal"
+                   or "sbvh". Default: "sah"
+  --stats          Print statistics, including the accelerator's memory use
+                   and bytes per primitive.
+)");
+    exit(1);
+}
+
+// Terrain height, in blocks, of the column at (x, z)
+static int Height(int x, int z) {
+    return 8 + int(4 * std::sin(x * .11f) * std::cos(z * .07f) +
+                   2 * std::sin((x + z) * .23f));
+}
+
+int main(int argc, char *argv[]) {
+    int size = 256, nRays = 1000000;
+    std::string shapeName = "quads", alphaFile, accelName = "bvh";
+    std::string splitMethod = "sah";
+    bool compressed = false, stats = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--compressed")) {
+            compressed = true;
+            continue;
+        } else if (!strcmp(argv[i], "--stats")) {
+            stats = true;
+            continue;
+        }
+        if (i + 1 == argc) usage("missing value after %s", argv[i]);
+        if (!strcmp(argv[i], "--size"))
+            size = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--rays"))
+            nRays = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--shape"))
+            shapeName = argv[++i];
+        else if (!strcmp(argv[i], "--alpha"))
+            alphaFile = argv[++i];
+        else if (!strcmp(argv[i], "--accel"))
+            accelName = argv[++i];
+        else if (!strcmp(argv[i], "--splitmethod"))
+            splitMethod = argv[++i];
+        else
+            usage("unknown option \"%s\"", argv[i]);
+    }
+
+    Options opt;
+    opt.quiet = true;
+    pbrtInit(opt);
+
+    std::shared_ptr<Texture<Float>> alpha;
+    if (!alphaFile.empty())
+        alpha = std::make_shared<ImageTexture<Float, Float>>(
+            std::unique_ptr<TextureMapping2D>(new UVMapping2D), alphaFile,
+            false, 8.f, ImageWrap::Repeat, 1.f, false, true, false, true);
+
+    // Create the shapes for the visible block faces
+    int maxHeight = 0;
+    for (int z = 0; z < size; ++z)
+        for (int x = 0; x < size; ++x)
+            maxHeight = std::max(maxHeight, Height(x, z));
+    auto solid = [&](int x, int y, int z) {
+        return x >= 0 && z >= 0 && x < size && z < size && y >= 0 &&
+               y < Height(x, z);
+    };
+    std::vector<std::unique_ptr<Transform>> transforms;
+    std::vector<std::shared_ptr<Shape>> shapes;
+    Transform *identity = new Transform;
+    transforms.push_back(std::unique_ptr<Transform>(identity));
+    auto start = std::chrono::steady_clock::now();
+    if (shapeName == "voxelchunk") {
+        const int chunkSize = 16;
+        for (int cz = 0; cz < size; cz += chunkSize)
+            for (int cx = 0; cx < size; cx += chunkSize) {
+                Point3i res(std::min(chunkSize, size - cx), maxHeight,
+                            std::min(chunkSize, size - cz));
+                std::vector<uint16_t> blocks(res.x * res.y * res.z);
+                for (int z = 0; z < res.z; ++z)
+                    for (int y = 0; y < res.y; ++y)
+                        for (int x = 0; x < res.x; ++x)
+                            blocks[(z * res.y + y) * res.x + x] =
+                                solid(cx + x, y, cz + z) ? 1 : 0;
+                Transform *o2w = new Transform(Translate(Vector3f(cx, 0, cz)));
+                Transform *w2o = new Transform(Inverse(*o2w));
+                transforms.push_back(std::unique_ptr<Transform>(o2w));
+                transforms.push_back(std::unique_ptr<Transform>(w2o));
+                shapes.push_back(std::make_shared<VoxelChunk>(
+                    o2w, w2o, false, res, std::move(blocks),
+                    std::vector<Float>(), alpha));
+            }
+    } else {
+        std::vector<Point3f> P;
+        std::vector<int> axis;
+        std::vector<Float> dir, length;
+        bool strips = shapeName == "strips";
+        for (int z = 0; z < size; ++z) {
+            int lastTop = -1;
+            for (int x = 0; x < size; ++x)
+                for (int y = 0; y < Height(x, z); ++y)
+                    for (int face = 0; face < 6; ++face) {
+                        int a = face / 2, step = (face & 1) ? 1 : -1;
+                        Point3i n(x, y, z);
+                        n[a] += step;
+                        if (solid(n.x, n.y, n.z) || n.y < 0) continue;
+                        bool top = a == 1 && step == 1;
+                        if (strips && top && lastTop != -1 &&
+                            Height(x - 1, z) == Height(x, z)) {
+                            // Extend the top face of the column before
+                            P[lastTop].x += .5f;
+                            length[lastTop] += 1;
+                            continue;
+                        }
+                        if (top) lastTop = P.size();
+                        Point3f center(x + .5f, y + .5f, z + .5f);
+                        center[a] += .5f * step;
+                        P.push_back(center);
+                        axis.push_back(a);
+                        dir.push_back(step);
+                        length.push_back(1);
+                    }
+        }
+        if (shapeName == "quadmesh")
+            shapes = CreateQuadMesh(identity, identity, false, P.size(),
+                                    P.data(), axis.data(), dir.data(), nullptr,
+                                    nullptr, nullptr, alpha);
+        else if (shapeName == "quads" || strips) {
+            for (size_t i = 0; i < P.size(); ++i) {
+                Transform *o2w = new Transform(Translate(Vector3f(P[i])));
+                Transform *w2o = new Transform(Inverse(*o2w));
+                transforms.push_back(std::unique_ptr<Transform>(o2w));
+                transforms.push_back(std::unique_ptr<Transform>(w2o));
+                if (axis[i] == 0)
+                    shapes.push_back(std::make_shared<QuadX>(
+                        o2w, w2o, false, 1, 1, dir[i], 0, 0, 1, 1, alpha));
+                else if (axis[i] == 1)
+                    shapes.push_back(std::make_shared<QuadY>(
+                        o2w, w2o, false, length[i], 1, dir[i], 0, 0,
+                        length[i], 1, alpha));
+                else
+                    shapes.push_back(std::make_shared<QuadZ>(
+                        o2w, w2o, false, 1, 1, dir[i], 0, 0, 1, 1, alpha));
+            }
+        } else
+            usage("unknown shape \"%s\"", shapeName.c_str());
+    }
+    std::vector<std::shared_ptr<Primitive>> prims;
+    prims.reserve(shapes.size());
+    for (const auto &s : shapes)
+        prims.push_back(std::make_shared<GeometricPrimitive>(
+            s, nullptr, nullptr, MediumInterface()));
+    ParamSet accelParams;
+    std::unique_ptr<bool[]> compressedParam(new bool[1]);
+    compressedParam[0] = compressed;
+    accelParams.AddBool("compressed", std::move(compressedParam), 1);
+    std::unique_ptr<std::string[]> splitMethodParam(new std::string[1]);
+    splitMethodParam[0] = splitMethod;
+    accelParams.AddString("splitmethod", std::move(splitMethodParam), 1);
+    std::shared_ptr<Primitive> accel;
+    if (accelName == "bvh")
+        accel = CreateBVHAccelerator(std::move(prims), accelParams);
+    else if (accelName == "qbvh")
+        accel = CreateWideBVHAccelerator(
+            4, std::make_shared<const PrimitiveStore>(std::move(prims)),
+            accelParams);
+    else if (accelName == "obvh")
+        accel = CreateWideBVHAccelerator(
+            8, std::make_shared<const PrimitiveStore>(std::move(prims)),
+            accelParams);
+    else
+        usage("unknown accelerator \"%s\"", accelName.c_str());
+    auto built = std::chrono::steady_clock::now();
+    printf("%s, %s: %zu shapes, built in %.3f s\n", shapeName.c_str(),
+           accelName.c_str(), shapes.size(),
+           std::chrono::duration<double>(built - start).count());
+
+    // Generate rays from above the terrain looking down into it
+    RNG rng;
+    std::vector<Ray> rays;
+    rays.reserve(nRays);
+    for (int i = 0; i < nRays; ++i) {
+        Point3f o(size * rng.UniformFloat(), maxHeight + 8,
+                  size * rng.UniformFloat());
+        Vector3f d = UniformSampleHemisphere(
+            Point2f(rng.UniformFloat(), rng.UniformFloat()));
+        rays.push_back(Ray(o, Vector3f(d.x, -d.z, d.y)));
+    }
+
+    // Trace closest-hit and shadow rays
+    int nHits = 0;
+    start = std::chrono::steady_clock::now();
+    for (const Ray &r : rays) {
+        Ray ray = r;
+        SurfaceInteraction isect;
+        if (accel->Intersect(ray, &isect)) ++nHits;
+    }
+    auto traced = std::chrono::steady_clock::now();
+    int nOccluded = 0;
+    for (const Ray &r : rays)
+        if (accel->IntersectP(r)) ++nOccluded;
+    auto tracedP = std::chrono::steady_clock::now();
+
+    double tIntersect = std::chrono::duration<double>(traced - start).count();
+    double tIntersectP = std::chrono::duration<double>(tracedP - traced).count();
+    printf("Intersect:  %.3f Mrays/s (%d hits)\n", nRays / tIntersect / 1e6,
+           nHits);
+    printf("IntersectP: %.3f Mrays/s (%d occluded)\n",
+           nRays / tIntersectP / 1e6, nOccluded);
+    if (stats) {
+        ReportThreadStats();
+        PrintStats(stdout);
+    }
+    pbrtCleanup();
+    return 0;
+}